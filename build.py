@@ -19,6 +19,12 @@ try:
 except ModuleNotFoundError:
     raise SystemExit("Error: pyjson5 not found. Please install it with `python -m pip install json5`")
 
+try:
+    import PIL
+    del PIL
+except ModuleNotFoundError:
+    raise SystemExit("Error: Pillow not found. Please install it with `python -m pip install pillow`")
+
 if sys.version_info < (3, 10):
     raise SystemExit("Error: Python 3.10 or newer is required")
 
@@ -62,6 +68,7 @@ n.newline()
 
 n.variable('merge', os.path.join('.', 'merge.py'))
 n.variable('wuj5', os.path.join('vendor', 'wuj5', 'wuj5.py'))
+n.variable('thumbpack', 'thumbpack.py')
 n.newline()
 
 n.rule(
@@ -92,14 +99,23 @@ n.rule(
 )
 n.newline()
 
+n.rule(
+    'thumbpack',
+    command = f'{sys.executable} $thumbpack $in -o $out',
+    description = 'THUMBPACK $out',
+)
+n.newline()
+
+# The thumbnails are only shipped as a pack of GX textures, the JPEG loader remains for the ones
+# that are not in it.
 thumbnail_in_files = sorted(glob.glob("thumbnails/*.jpg"))
-for in_file in thumbnail_in_files:
-    out_file = os.path.join('$builddir', 'contents.arc.d', in_file)
-    n.build(
-        out_file,
-        'cp',
-        in_file,
-    )
+thumbnail_out_file = os.path.join('thumbnails', 'pack.bin')
+n.build(
+    os.path.join('$builddir', 'contents.arc.d', thumbnail_out_file),
+    'thumbpack',
+    thumbnail_in_files,
+    implicit = '$thumbpack',
+)
 
 LANGUAGES = [
     'E', # English (PAL)
@@ -1497,7 +1513,7 @@ for profile in ['DEBUG', 'TEST', 'RELEASE']:
     in_suffix = 'D' if profile == 'DEBUG' else ''
     out_suffix = profile[0]
     in_paths = [
-        *[os.path.join('$builddir', 'contents.arc.d', target) for target in thumbnail_in_files],
+        os.path.join('$builddir', 'contents.arc.d', thumbnail_out_file),
         *[os.path.join('$builddir', 'contents.arc.d', target) for target in asset_out_files],
         os.path.join('$builddir', 'contents.arc.d', 'bin', f'payloadP{in_suffix}.SMAP.lzma'),
         os.path.join('$builddir', 'contents.arc.d', 'bin', f'payloadE{in_suffix}.SMAP.lzma'),
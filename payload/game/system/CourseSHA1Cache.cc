@@ -0,0 +1,100 @@
+#include "CourseSHA1Cache.hh"
+
+#include <game/util/Registry.hh>
+#include <sp/storage/DecompLoader.hh>
+
+#include <cstdio>
+#include <cwchar>
+
+namespace System {
+
+void CourseSHA1Cache::Update(std::array<SHA1, 32> &sha1s, EGG::Heap *heap) {
+    File file{};
+    auto readSize = SP::Storage::ReadFile(s_path, &file, sizeof(file));
+    if (!readSize || *readSize != sizeof(file) || file.magic != File::MAGIC ||
+            file.version != File::VERSION) {
+        file = {};
+        file.magic = File::MAGIC;
+        file.version = File::VERSION;
+    }
+
+    bool isDirty = false;
+    for (u32 courseId = 0; courseId < 32; courseId++) {
+        auto &entry = file.entries[courseId];
+        bool isLZMA;
+        auto info = StatCourse(courseId, isLZMA);
+        if (!info) {
+            if (entry.isValid) {
+                entry = {};
+                isDirty = true;
+            }
+            continue;
+        }
+
+        if (entry.isValid && entry.isLZMA == isLZMA && entry.size == info->size &&
+                entry.tick == info->tick) {
+            sha1s[courseId] = entry.sha1;
+            continue;
+        }
+
+        entry = {};
+        isDirty = true;
+        if (!HashCourse(courseId, sha1s[courseId], heap)) {
+            continue;
+        }
+
+        entry.isValid = true;
+        entry.isLZMA = isLZMA;
+        entry.size = info->size;
+        entry.tick = info->tick;
+        entry.sha1 = sha1s[courseId];
+    }
+
+    if (isDirty && !SP::Storage::WriteFile(s_path, &file, sizeof(file), true)) {
+        SP_LOG("Failed to save %ls", s_path);
+    }
+}
+
+std::optional<SP::Storage::NodeInfo> CourseSHA1Cache::StatCourse(u32 courseId, bool &isLZMA) {
+    // Same lookup order as DecompLoader: the .arc.lzma variant takes precedence over the .szs.
+    auto *storage = SP::Storage::GetStorage(SP::Storage::StorageType::FAT);
+    const char *filename = Registry::courseFilenames[courseId];
+
+    wchar_t path[128];
+    swprintf(path, std::size(path), L"ro:/Race/Course/%s.arc.lzma", filename);
+    if (auto info = storage->stat(path); info && info->type == SP::Storage::NodeType::File) {
+        isLZMA = true;
+        return info;
+    }
+
+    swprintf(path, std::size(path), L"ro:/Race/Course/%s.szs", filename);
+    if (auto info = storage->stat(path); info && info->type == SP::Storage::NodeType::File) {
+        isLZMA = false;
+        return info;
+    }
+
+    return {};
+}
+
+bool CourseSHA1Cache::HashCourse(u32 courseId, SHA1 &sha1, EGG::Heap *heap) {
+    char path[128];
+    snprintf(path, sizeof(path), "Race/Course/%s.szs", Registry::courseFilenames[courseId]);
+    u8 *buffer;
+    size_t size;
+    if (!SP::Storage::DecompLoader::LoadRO(path, &buffer, &size, heap,
+                SP::Storage::StorageType::FAT)) {
+        return false;
+    }
+
+    SP_LOG("Hashing course %s", path);
+    NETSHA1Context context;
+    NETSHA1Init(&context);
+    NETSHA1Update(&context, buffer, size);
+    NETSHA1GetDigest(&context, sha1.data());
+    delete[] buffer;
+    return true;
+}
+
+const wchar_t *CourseSHA1Cache::s_path = L"/mkw-sp/course-sha1s.bin";
+
+} // namespace System
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <egg/core/eggHeap.hh>
+#include <sp/storage/Storage.hh>
+
+#include <array>
+
+namespace System {
+
+// The SHA-1s of the courses replaced on the SD card, which ghosts are tied to. They are cached in a
+// file keyed by the size and modification time of each course, so that the costly
+// decompress-and-hash pass only happens again when a course actually changes.
+class CourseSHA1Cache {
+public:
+    using SHA1 = std::array<u8, 0x14>;
+
+    // Replaces the SHA-1s of the courses found on the SD card, and leaves the other ones as is.
+    static void Update(std::array<SHA1, 32> &sha1s, EGG::Heap *heap);
+
+private:
+    struct Entry {
+        bool isValid;
+        bool isLZMA;
+        u8 _02[0x08 - 0x02];
+        u64 size;
+        OSTime tick;
+        SHA1 sha1;
+        u8 _2c[0x30 - 0x2c];
+    };
+    static_assert(sizeof(Entry) == 0x30);
+
+    struct File {
+        u32 magic;
+        u32 version;
+        Entry entries[32];
+
+        static constexpr u32 MAGIC = 0x53504353; // SPCS
+        static constexpr u32 VERSION = 1;
+    };
+    static_assert(sizeof(File) == 0x608);
+
+    static std::optional<SP::Storage::NodeInfo> StatCourse(u32 courseId, bool &isLZMA);
+    static bool HashCourse(u32 courseId, SHA1 &sha1, EGG::Heap *heap);
+
+    static const wchar_t *s_path;
+};
+
+} // namespace System
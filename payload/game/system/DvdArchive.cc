@@ -34,18 +34,22 @@ void DvdArchive::load(const char *path, EGG::Heap *archiveHeap, bool isCompresse
     }
 }
 
-void DvdArchive::loadOther(DvdArchive *other, EGG::Heap *) {
+void DvdArchive::loadOther(DvdArchive *other, EGG::Heap *archiveHeap) {
     if (m_state != State::Cleared || other->m_state != State::Mounted) {
         return;
     }
 
-    m_archiveBuffer = other->m_archiveBuffer;
+    // The buffer is copied rather than taken over, so that the heap of the other archive can be
+    // destroyed right away.
+    u8 *archiveBuffer = new (archiveHeap, 0x20) u8[other->m_archiveSize];
+    if (!archiveBuffer) {
+        return;
+    }
+    memcpy(archiveBuffer, other->m_archiveBuffer, other->m_archiveSize);
+    m_archiveBuffer = archiveBuffer;
     m_archiveSize = other->m_archiveSize;
-    m_archiveHeap = other->m_archiveHeap;
-    mount(m_archiveHeap);
-    other->m_archiveBuffer = nullptr;
-    other->m_archiveSize = 0;
-    other->m_archiveHeap = nullptr;
+    m_archiveHeap = archiveHeap;
+    mount(archiveHeap);
     other->clear();
 }
 
@@ -0,0 +1,208 @@
+#include "GhostIndex.hh"
+
+#include <cstring>
+#include <cwchar>
+
+namespace System {
+
+GhostIndex::Entry::Entry() = default;
+
+GhostIndex::Entry::Entry(const SP::Storage::NodeInfo &info)
+    : id(info.id.id), size(info.size), tick(info.tick), nameHash(2166136261), _1c{} {
+    // FNV-1a
+    for (const wchar_t *c = info.name; *c != L'\0'; c++) {
+        nameHash = (nameHash ^ *c) * 16777619;
+    }
+}
+
+GhostIndex::GhostIndex(SP::Storage::NodeId dirId, const wchar_t *dirPath, EGG::Heap *heap) {
+    wchar_t path[255 + 1];
+    if (!GetPath(dirPath, path)) {
+        return;
+    }
+
+    auto file = dirId.storage->open(path, "r");
+    if (!file) {
+        return;
+    }
+
+    u64 size = file->size();
+    if (size < sizeof(Header) || size > FileSize(MAX_GHOST_COUNT)) {
+        return;
+    }
+
+    m_buffer = new (heap, 0x20) u8[size];
+    if (!m_buffer || !file->read(m_buffer, size, 0)) {
+        return;
+    }
+
+    auto *header = reinterpret_cast<const Header *>(m_buffer);
+    if (header->magic != Header::MAGIC || header->version != Header::VERSION) {
+        return;
+    }
+    if (header->count > MAX_GHOST_COUNT || size != FileSize(header->count)) {
+        return;
+    }
+
+    m_count = header->count;
+    u32 offset = sizeof(Header);
+    m_entries = reinterpret_cast<const Entry *>(m_buffer + offset);
+    offset += m_count * sizeof(Entry);
+    m_headers = reinterpret_cast<const RawGhostHeader *>(m_buffer + offset);
+    offset += m_count * sizeof(RawGhostHeader);
+    m_footers = reinterpret_cast<const GhostFooter *>(m_buffer + offset);
+}
+
+GhostIndex::~GhostIndex() {
+    delete[] m_buffer;
+}
+
+u32 GhostIndex::count() const {
+    return m_count;
+}
+
+std::optional<u32> GhostIndex::find(const SP::Storage::NodeInfo &info) {
+    // Directories are usually listed in the same order as when the index was written, so try the
+    // entry following the last match first.
+    Entry entry(info);
+    for (u32 i = 0; i < m_count; i++) {
+        u32 j = (m_cursor + i) % m_count;
+        if (m_entries[j] == entry) {
+            m_cursor = j + 1;
+            return j;
+        }
+    }
+    return {};
+}
+
+const RawGhostHeader &GhostIndex::header(u32 i) const {
+    assert(i < m_count);
+    return m_headers[i];
+}
+
+const GhostFooter &GhostIndex::footer(u32 i) const {
+    assert(i < m_count);
+    return m_footers[i];
+}
+
+bool GhostIndex::Write(SP::Storage::NodeId dirId, const wchar_t *dirPath, u32 count,
+        const Entry *entries, const RawGhostHeader *headers, const GhostFooter *footers) {
+    wchar_t path[255 + 1];
+    if (!GetPath(dirPath, path)) {
+        return false;
+    }
+
+    // The index is only a cache, a partial write is detected through its size on the next boot.
+    auto file = dirId.storage->open(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    Header header{};
+    header.magic = Header::MAGIC;
+    header.version = Header::VERSION;
+    header.count = count;
+    u32 offset = 0;
+    if (!file->write(&header, sizeof(header), offset)) {
+        return false;
+    }
+    offset += sizeof(header);
+    if (!file->write(entries, count * sizeof(Entry), offset)) {
+        return false;
+    }
+    offset += count * sizeof(Entry);
+    if (!file->write(headers, count * sizeof(RawGhostHeader), offset)) {
+        return false;
+    }
+    offset += count * sizeof(RawGhostHeader);
+    return file->write(footers, count * sizeof(GhostFooter), offset);
+}
+
+bool GhostIndex::IsIndexFile(const wchar_t *name) {
+    return !wcscmp(name, s_name);
+}
+
+void GhostIndex::Scan(SP::Storage::NodeId dirId, const wchar_t *dirPath, EGG::Heap *heap,
+        const Ghosts &ghosts) {
+    auto dir = SP::Storage::FastOpenDir(dirId);
+    if (!dir) {
+        return;
+    }
+
+    GhostIndex index(dirId, dirPath, heap);
+    u32 first = ghosts.count;
+    auto *entries = new (heap, 0x4) Entry[MAX_GHOST_COUNT - first];
+    bool isComplete = true;
+    u32 hitCount = 0;
+    while (auto info = dir->read()) {
+        if (info->type != SP::Storage::NodeType::File || IsIndexFile(info->name)) {
+            continue;
+        }
+
+        if (ghosts.count >= MAX_GHOST_COUNT) {
+            isComplete = false;
+            break;
+        }
+
+        if (auto i = index.find(*info)) {
+            ghosts.headers[ghosts.count] = index.header(*i);
+            ghosts.footers[ghosts.count] = index.footer(*i);
+            ghosts.ids[ghosts.count] = info->id;
+            entries[ghosts.count - first] = *info;
+            ghosts.count++;
+            hitCount++;
+        } else {
+            // ReadGhost appends the header and footer, so take the slot before calling it
+            u32 slot = ghosts.count - first;
+            if (ReadGhost(info->id, ghosts)) {
+                entries[slot] = *info;
+            }
+        }
+    }
+
+    u32 count = ghosts.count - first;
+    if (isComplete && (hitCount != count || hitCount != index.count())) {
+        SP_LOG("Updating the ghost index of %ls (%u / %u ghosts cached)", dirPath, hitCount, count);
+        if (!Write(dirId, dirPath, count, entries, ghosts.headers + first,
+                    ghosts.footers + first)) {
+            SP_LOG("Failed to write the ghost index of %ls", dirPath);
+        }
+    }
+
+    delete[] entries;
+}
+
+bool GhostIndex::ReadGhost(SP::Storage::NodeId id, const Ghosts &ghosts) {
+    if (ghosts.count >= MAX_GHOST_COUNT) {
+        return false;
+    }
+
+    auto readSize = SP::Storage::FastReadFile(id, ghosts.rawGhostFile, 0x2800);
+    if (!readSize) {
+        return false;
+    }
+
+    if (!RawGhostFile::IsValid(ghosts.rawGhostFile, *readSize)) {
+        return false;
+    }
+
+    auto *header = reinterpret_cast<const RawGhostHeader *>(ghosts.rawGhostFile);
+    memcpy(&ghosts.headers[ghosts.count], header, sizeof(RawGhostHeader));
+    ghosts.footers[ghosts.count] = GhostFooter(ghosts.rawGhostFile, *readSize);
+    ghosts.ids[ghosts.count] = id;
+    ghosts.count++;
+    return true;
+}
+
+bool GhostIndex::GetPath(const wchar_t *dirPath, wchar_t (&path)[255 + 1]) {
+    u32 length = swprintf(path, std::size(path), L"%ls/%ls", dirPath, s_name);
+    return length < std::size(path);
+}
+
+u32 GhostIndex::FileSize(u32 count) {
+    return sizeof(Header) + count * (sizeof(Entry) + sizeof(RawGhostHeader) + sizeof(GhostFooter));
+}
+
+const wchar_t *GhostIndex::s_name = L"ghost-index.bin";
+
+} // namespace System
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "game/system/GhostFile.hh"
+
+#include <egg/core/eggHeap.hh>
+#include <sp/storage/Storage.hh>
+
+namespace System {
+
+// A cache of the ghosts of a single directory that passed validation, stored in that directory.
+// Files whose id, name, size and modification time are unchanged don't need to be opened again.
+class GhostIndex {
+public:
+    struct Entry {
+        Entry();
+        Entry(const SP::Storage::NodeInfo &info);
+        bool operator==(const Entry &that) const = default;
+
+        u64 id;
+        u64 size;
+        OSTime tick;
+        u32 nameHash;
+        u8 _1c[0x20 - 0x1c];
+    };
+    static_assert(sizeof(Entry) == 0x20);
+
+    // The ghost lists of the save manager, which Scan and ReadGhost append to.
+    struct Ghosts {
+        u32 &count;
+        RawGhostHeader *headers;
+        GhostFooter *footers;
+        SP::Storage::NodeId *ids;
+        u8 *rawGhostFile; // 0x2800 bytes
+    };
+
+    GhostIndex(SP::Storage::NodeId dirId, const wchar_t *dirPath, EGG::Heap *heap);
+    ~GhostIndex();
+    u32 count() const;
+    std::optional<u32> find(const SP::Storage::NodeInfo &info);
+    const RawGhostHeader &header(u32 i) const;
+    const GhostFooter &footer(u32 i) const;
+
+    static bool Write(SP::Storage::NodeId dirId, const wchar_t *dirPath, u32 count,
+            const Entry *entries, const RawGhostHeader *headers, const GhostFooter *footers);
+    static bool IsIndexFile(const wchar_t *name);
+
+    // Appends the valid ghosts of a directory, taking them from its index when they are unchanged,
+    // and rewrites the index when it is out of date. Subdirectories are not visited.
+    static void Scan(SP::Storage::NodeId dirId, const wchar_t *dirPath, EGG::Heap *heap,
+            const Ghosts &ghosts);
+    static bool ReadGhost(SP::Storage::NodeId id, const Ghosts &ghosts);
+
+private:
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 count;
+        u8 _0c[0x10 - 0x0c];
+
+        static constexpr u32 MAGIC = 0x53504749; // SPGI
+        static constexpr u32 VERSION = 1;
+    };
+    static_assert(sizeof(Header) == 0x10);
+
+    GhostIndex(const GhostIndex &) = delete;
+    GhostIndex(GhostIndex &&) = delete;
+
+    static bool GetPath(const wchar_t *dirPath, wchar_t (&path)[255 + 1]);
+    static u32 FileSize(u32 count);
+
+    u8 *m_buffer = nullptr;
+    u32 m_count = 0;
+    u32 m_cursor = 0;
+    const Entry *m_entries = nullptr;
+    const RawGhostHeader *m_headers = nullptr;
+    const GhostFooter *m_footers = nullptr;
+
+    static const wchar_t *s_name;
+};
+
+} // namespace System
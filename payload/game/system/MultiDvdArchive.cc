@@ -5,6 +5,8 @@ extern "C" {
 #include <stdio.h>
 }
 
+#include <sp/storage/DecompLoader.hh>
+
 namespace System {
 
 static const char *getBaseLanguageCode() {
@@ -64,6 +66,35 @@ void MultiDvdArchive::init() {
     m_formats[1] = Format::Double;
 }
 
+void MultiDvdArchive::load(const char *path, EGG::Heap *archiveHeap, EGG::Heap *fileHeap,
+        u32 r7) {
+    OSTime startTime = OSGetTime();
+
+    // Queue all the archives up front, so that each one is read while the previous one is being
+    // decompressed.
+    SP::Storage::DecompLoader::Batch batch;
+    u16 count = 0;
+    for (u16 i = 0; i < m_archiveCount; i++) {
+        if (m_archives[i].state() != DvdArchive::State::Cleared) {
+            continue;
+        }
+
+        char archivePath[128];
+        if (m_formats[i] == Format::Single) {
+            snprintf(archivePath, sizeof(archivePath), "%s", m_names[i]);
+        } else {
+            snprintf(archivePath, sizeof(archivePath), "%s%s", path, m_names[i]);
+        }
+        SP::Storage::DecompLoader::PrefetchRO(archivePath);
+        count++;
+    }
+
+    REPLACED(load)(path, archiveHeap, fileHeap, r7);
+
+    SP_LOG("Loaded %u archives for %s in %llu ms", count, path ? path : "(none)",
+            OSTicksToMilliseconds(OSGetTime() - startTime));
+}
+
 DvdArchive &MultiDvdArchive::archive(u16 i) {
     assert(i < m_archiveCount);
     return m_archives[i];
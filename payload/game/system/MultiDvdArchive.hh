@@ -26,7 +26,8 @@ public:
     void REPLACED(init)();
 
     void clear();
-    void load(const char *path, EGG::Heap *archiveHeap, EGG::Heap *fileHeap, u32);
+    REPLACE void load(const char *path, EGG::Heap *archiveHeap, EGG::Heap *fileHeap, u32 r7);
+    void REPLACED(load)(const char *path, EGG::Heap *archiveHeap, EGG::Heap *fileHeap, u32 r7);
     void loadOther(MultiDvdArchive *other, EGG::Heap *heap);
 
     void setMission(u32 missionId);
@@ -1,7 +1,9 @@
 #include "ResourceManager.hh"
 
 #include "game/system/RootScene.hh"
+#include "game/util/Registry.hh"
 
+#include <sp/ScopeLock.hh>
 #include <sp/storage/DecompLoader.hh>
 #include <sp/storage/Storage.hh>
 
@@ -10,9 +12,26 @@ extern "C" {
 }
 
 #include <cstdio>
+#include <iterator>
 
 namespace System {
 
+// The course cache is filled by a low priority thread, which only ever decodes the latest course
+// that was requested. The mutex is held for as long as the cache is being filled, so that
+// loadCourse waits for a prefetch of the same course rather than loading it twice. A prefetch of
+// any other course is cancelled instead. The heap of the cache only exists from the first request
+// to the end of the race.
+static constexpr u32 NoCourse = 0xffffffff;
+
+static SP::Mutex courseCacheMutex;
+static bool courseCacheIsInitialized = false;
+static u32 requestedCourseId = NoCourse;   // Protected by disabling interrupts
+static u32 prefetchingCourseId = NoCourse; // Protected by disabling interrupts
+static OSMessage prefetchMessages[1];
+static OSMessageQueue prefetchQueue;
+static u8 prefetchStack[0x4000 /* 16 KiB */];
+static OSThread prefetchThread;
+
 void ResourceManager::initGlobeHeap() {
     if (!m_globeHeap) {
         auto *heap = RootScene::Instance()->m_heapCollection.mem2;
@@ -60,10 +79,15 @@ u16 ResourceManager::getMenuArchiveCount() const {
 void ResourceManager::OnCreateScene(RKSceneID sceneId) {
     switch (sceneId) {
     case RKSceneID::Menu:
+        s_instance->deinitGlobeHeap();
+        s_instance->releaseCourseCache(true);
+        break;
     case RKSceneID::Race:
         s_instance->deinitGlobeHeap();
+        s_instance->releaseCourseCache(false);
         break;
     case RKSceneID::Globe:
+        s_instance->releaseCourseCache(true);
         s_instance->initGlobeHeap();
         break;
     default:
@@ -76,6 +100,7 @@ ResourceManager *ResourceManager::CreateInstance() {
     assert(s_instance);
 
     s_instance->m_globe = nullptr;
+    s_instance->m_courseCache.init();
 
     return s_instance;
 }
@@ -126,8 +151,196 @@ void ResourceManager::LoadGlobeTask(void *arg) {
     s_instance->loadGlobe(reinterpret_cast<u8 **>(arg));
 }
 
-void ResourceManager::CourseCache::init() {}
+void ResourceManager::preloadCourseAsync(u32 courseId) {
+    if (courseId >= std::size(Registry::courseFilenames)) {
+        return;
+    }
+
+    if (!m_courseCache.reserve()) {
+        return;
+    }
+
+    {
+        SP::ScopeLock<SP::NoInterrupts> lock;
+        if (requestedCourseId == courseId) {
+            return;
+        }
+        requestedCourseId = courseId;
+        if (prefetchingCourseId != NoCourse && prefetchingCourseId != courseId) {
+            SP::Storage::DecompLoader::Cancel(&prefetchThread);
+        }
+    }
+
+    // If a request is already pending, the thread will pick up the new course anyway.
+    OSSendMessage(&prefetchQueue, nullptr, OS_MESSAGE_NOBLOCK);
+}
+
+MultiDvdArchive *ResourceManager::loadCourse(u32 courseId, EGG::Heap *heap, bool splitScreen) {
+    OSTime startTime = OSGetTime();
+
+    bool wasPrefetched = false;
+    if (courseCacheIsInitialized) {
+        {
+            SP::ScopeLock<SP::NoInterrupts> lock;
+            requestedCourseId = NoCourse;
+            if (prefetchingCourseId != courseId) {
+                SP::Storage::DecompLoader::Cancel(&prefetchThread);
+            }
+        }
+
+        SP::ScopeLock<SP::Mutex> lock(courseCacheMutex);
+        auto *archive = m_archives[static_cast<size_t>(MultiDvdArchive::Type::Course)];
+        if (!splitScreen && m_courseCache.m_state == CourseCache::State::Loaded &&
+                m_courseCache.m_course == courseId) {
+            // The archives copy the buffers into the heap of the race, as if they had been loaded
+            // there, so that they are kept on a restart and the cache can be freed before the race.
+            archive->loadOther(m_courseCache.m_archive, heap);
+            m_courseCache.release();
+            wasPrefetched = true;
+        } else {
+            // Nothing in the cache is of use for this race.
+            releaseCourseCache(true);
+        }
+    }
+
+    // The adopted archives are already mounted and are skipped.
+    MultiDvdArchive *archive = REPLACED(loadCourse)(courseId, heap, splitScreen);
+
+    SP_LOG("Loaded course %u (%s) in %llu ms", courseId, wasPrefetched ? "prefetched" : "cold",
+            OSTicksToMilliseconds(OSGetTime() - startTime));
+    return archive;
+}
+
+void ResourceManager::releaseCourseCache(bool force) {
+    if (!courseCacheIsInitialized || !m_courseCache.m_heap) {
+        return;
+    }
+
+    {
+        SP::ScopeLock<SP::NoInterrupts> lock;
+        if (!force && (requestedCourseId != NoCourse || prefetchingCourseId != NoCourse)) {
+            return;
+        }
+        requestedCourseId = NoCourse;
+        SP::Storage::DecompLoader::Cancel(&prefetchThread);
+    }
+
+    SP::ScopeLock<SP::Mutex> lock(courseCacheMutex);
+    if (!force && m_courseCache.m_state == CourseCache::State::Loaded) {
+        return;
+    }
+
+    m_courseCache.release();
+}
+
+void *ResourceManager::PrefetchCourses(void *arg) {
+    auto *courseCache = reinterpret_cast<CourseCache *>(arg);
+    while (true) {
+        OSMessage message;
+        OSReceiveMessage(&prefetchQueue, &message, OS_MESSAGE_BLOCK);
 
-void ResourceManager::CourseCache::load(u32 /* courseId */) {}
+        u32 courseId;
+        {
+            SP::ScopeLock<SP::NoInterrupts> lock;
+            courseId = requestedCourseId;
+        }
+        if (courseId != NoCourse) {
+            courseCache->load(courseId);
+        }
+    }
+}
+
+void ResourceManager::CourseCache::init() {
+    if (courseCacheIsInitialized) {
+        return;
+    }
+
+    m_buffer = nullptr;
+    m_heap = nullptr;
+    m_course = NoCourse;
+    m_state = State::Cleared;
+    m_archive = MultiDvdArchive::Create(MultiDvdArchive::Type::Course);
+
+    OSInitMessageQueue(&prefetchQueue, prefetchMessages, std::size(prefetchMessages));
+    u8 *stackTop = prefetchStack + sizeof(prefetchStack);
+    OSCreateThread(&prefetchThread, PrefetchCourses, this, stackTop, sizeof(prefetchStack), 28, 0);
+    OSResumeThread(&prefetchThread);
+
+    courseCacheIsInitialized = true;
+}
+
+bool ResourceManager::CourseCache::reserve() {
+    if (!courseCacheIsInitialized) {
+        return false;
+    }
+
+    if (m_heap) {
+        return true;
+    }
+
+    // The region is only held until the course is adopted, see loadCourse.
+    auto *heap = RootScene::Instance()->m_heapCollection.mem2;
+    m_buffer = new (heap, -0x20) u8[HeapSize];
+    if (!m_buffer) {
+        SP_LOG("Failed to reserve the course cache");
+        return false;
+    }
+    m_heap = EGG::ExpHeap::Create(m_buffer, HeapSize, 1);
+    return true;
+}
+
+void ResourceManager::CourseCache::release() {
+    m_archive->clear();
+    m_course = NoCourse;
+    m_state = State::Cleared;
+    // The heap sits at the start of the region, which it frees along with itself.
+    m_heap->destroy();
+    m_heap = nullptr;
+    m_buffer = nullptr;
+}
+
+void ResourceManager::CourseCache::load(u32 courseId) {
+    SP::ScopeLock<SP::Mutex> lock(courseCacheMutex);
+
+    if (m_state == State::Loaded && m_course == courseId) {
+        return;
+    }
+
+    // The archives of a previous prefetch which didn't get used
+    m_archive->clear();
+    m_state = State::Cleared;
+    m_course = NoCourse;
+
+    // A request which is withdrawn before the batch starts is dropped here, and one which is
+    // withdrawn afterwards cancels the batch.
+    SP::Storage::DecompLoader::Batch batch;
+    {
+        SP::ScopeLock<SP::NoInterrupts> requestLock;
+        if (requestedCourseId != courseId || !m_heap) {
+            return;
+        }
+        prefetchingCourseId = courseId;
+    }
+
+    OSTime startTime = OSGetTime();
+    char path[128];
+    snprintf(path, sizeof(path), "Race/Course/%s", Registry::courseFilenames[courseId]);
+    m_archive->load(path, m_heap, m_heap, 0);
+
+    {
+        SP::ScopeLock<SP::NoInterrupts> requestLock;
+        prefetchingCourseId = NoCourse;
+    }
+
+    if (m_archive->archive(0).state() != DvdArchive::State::Mounted) {
+        SP_LOG("Failed to prefetch %s", path);
+        m_archive->clear();
+        return;
+    }
+
+    m_course = courseId;
+    m_state = State::Loaded;
+    SP_LOG("Prefetched %s in %llu ms", path, OSTicksToMilliseconds(OSGetTime() - startTime));
+}
 
 } // namespace System
@@ -21,7 +21,13 @@ public:
         REPLACE void init();
         REPLACE void load(u32 courseId);
 
+        // Enough for the largest course archive along with its _Dif archive
+        static constexpr u32 HeapSize = 0x700000 /* 7 MiB */;
+
     private:
+        bool reserve();
+        void release();
+
         u8 _00[0x10 - 0x00];
         void *m_buffer;
         EGG::ExpHeap *m_heap;
@@ -34,7 +40,7 @@ public:
     ResourceManager();
 
     void createMenuHeaps(u32 count, s32 heapIdx);
-    void preloadCourseAsync(u32 courseId);
+    REPLACE void preloadCourseAsync(u32 courseId);
     void process();
 
     void initGlobeHeap();
@@ -43,6 +49,7 @@ public:
     DvdArchive *getMenuArchive(size_t idx);
     REPLACE u16 getMenuArchiveCount() const;
     REPLACE MultiDvdArchive *loadCourse(u32 courseId, EGG::Heap *heap, bool splitScreen);
+    MultiDvdArchive *REPLACED(loadCourse)(u32 courseId, EGG::Heap *heap, bool splitScreen);
     REPLACE MultiDvdArchive *loadMission(u32 courseId, u32 missionId, EGG::Heap *heap,
             bool splitScreen);
 
@@ -54,8 +61,12 @@ public:
 
 private:
     void loadGlobe(u8 **dst);
+    // Frees the course cache, unless it holds or is decoding a course for the next race. Forced
+    // once back in the menus.
+    void releaseCourseCache(bool force);
 
     REPLACE static void LoadGlobeTask(void *arg);
+    static void *PrefetchCourses(void *arg);
 
     u8 _000[0x004 - 0x000];
     MultiDvdArchive **m_archives;
@@ -1,11 +1,12 @@
 #include "SaveManager.hh"
 
+#include "game/system/CourseSHA1Cache.hh"
+#include "game/system/GhostIndex.hh"
 #include "game/system/RaceConfig.hh"
 #include "game/system/RootScene.hh"
 #include "game/ui/SectionManager.hh"
 
 #include <common/Bytes.hh>
-#include <sp/storage/DecompLoader.hh>
 
 #include <bit>
 #include <cstring>
@@ -89,26 +90,8 @@ void SaveManager::initSPSave() {
 }
 
 void SaveManager::initCourseSHA1s() {
-    for (u32 courseId = 0; courseId < 32; courseId++) {
-        m_courseSHA1s[courseId] = s_courseSHA1s[courseId];
-
-        char path[128];
-        snprintf(path, sizeof(path), "Race/Course/%s.szs", Registry::courseFilenames[courseId]);
-        u8 *buffer;
-        size_t size;
-        auto *heap = RootScene::Instance()->m_heapCollection.mem2;
-        if (!SP::Storage::DecompLoader::LoadRO(path, &buffer, &size, heap,
-                    SP::Storage::StorageType::FAT)) {
-            continue;
-        }
-
-        SP_LOG("Hashing course %s", path);
-        NETSHA1Context context;
-        NETSHA1Init(&context);
-        NETSHA1Update(&context, buffer, size);
-        NETSHA1GetDigest(&context, m_courseSHA1s[courseId].data());
-        delete[] buffer;
-    }
+    m_courseSHA1s = s_courseSHA1s;
+    CourseSHA1Cache::Update(m_courseSHA1s, RootScene::Instance()->m_heapCollection.mem2);
 }
 
 void SaveManager::initGhostsAsync() {
@@ -126,13 +109,16 @@ void *SaveManager::InitGhostsTask(void * /* arg */) {
 
 void SaveManager::initGhosts() {
     SP_LOG("Initializing ghosts...");
+    OSTime startTime = OSGetTime();
 
     initGhosts(L"/mkw-sp/ghosts");
     initGhosts(L"/ctgpr/ghosts");
 
     SP::Storage::CreateDir(L"/mkw-sp/ghosts", true);
 
-    SP_LOG("Ghosts: %u / %u", m_ghostCount, MAX_GHOST_COUNT);
+    OSTime duration = OSGetTime() - startTime;
+    SP_LOG("Ghosts: %u / %u (%llu ms)", m_ghostCount, MAX_GHOST_COUNT,
+            OSTicksToMilliseconds(duration));
 }
 
 void SaveManager::initGhosts(const wchar_t *path) {
@@ -143,47 +129,47 @@ void SaveManager::initGhosts(const wchar_t *path) {
     if (info->type != SP::Storage::NodeType::Dir) {
         return;
     }
-    initGhosts(info->id);
+    initGhosts(info->id, path);
 }
 
-void SaveManager::initGhosts(SP::Storage::NodeId id) {
+void SaveManager::initGhosts(SP::Storage::NodeId id, const wchar_t *path) {
     if (m_ghostCount >= MAX_GHOST_COUNT) {
         return;
     }
 
+    // Files first, so that the ghosts of this directory are contiguous for its index
+    initGhostFiles(id, path);
+
     auto dir = SP::Storage::FastOpenDir(id);
     if (!dir) {
         return;
     }
 
     while (auto info = dir->read()) {
-        if (info->type == SP::Storage::NodeType::Dir) {
-            initGhosts(info->id);
-        } else {
-            initGhost(info->id);
+        if (info->type != SP::Storage::NodeType::Dir) {
+            continue;
         }
-    }
-}
-
-void SaveManager::initGhost(SP::Storage::NodeId id) {
-    if (m_ghostCount >= MAX_GHOST_COUNT) {
-        return;
-    }
 
-    auto readSize = SP::Storage::FastReadFile(id, m_rawGhostFile, 0x2800);
-    if (!readSize) {
-        return;
+        wchar_t childPath[255 + 1];
+        u32 length = swprintf(childPath, std::size(childPath), L"%ls/%ls", path, info->name);
+        if (length >= std::size(childPath)) {
+            continue;
+        }
+        initGhosts(info->id, childPath);
     }
+}
 
-    if (!RawGhostFile::IsValid(m_rawGhostFile, *readSize)) {
-        return;
-    }
+void SaveManager::initGhostFiles(SP::Storage::NodeId id, const wchar_t *path) {
+    auto *heap = RootScene::Instance()->m_heapCollection.mem2;
+    GhostIndex::Ghosts ghosts{m_ghostCount, m_rawGhostHeaders, m_ghostFooters, m_ghostIds,
+            m_rawGhostFile};
+    GhostIndex::Scan(id, path, heap, ghosts);
+}
 
-    auto *header = reinterpret_cast<const RawGhostHeader *>(m_rawGhostFile);
-    memcpy(&m_rawGhostHeaders[m_ghostCount], header, sizeof(RawGhostHeader));
-    m_ghostFooters[m_ghostCount] = GhostFooter(m_rawGhostFile, *readSize);
-    m_ghostIds[m_ghostCount] = id;
-    m_ghostCount++;
+bool SaveManager::initGhost(SP::Storage::NodeId id) {
+    GhostIndex::Ghosts ghosts{m_ghostCount, m_rawGhostHeaders, m_ghostFooters, m_ghostIds,
+            m_rawGhostFile};
+    return GhostIndex::ReadGhost(id, ghosts);
 }
 
 void SaveManager::resetAsync() {
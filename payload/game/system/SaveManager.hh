@@ -126,8 +126,9 @@ private:
     void initGhostsAsync();
     void initGhosts();
     void initGhosts(const wchar_t *path);
-    void initGhosts(SP::Storage::NodeId id);
-    void initGhost(SP::Storage::NodeId id);
+    void initGhosts(SP::Storage::NodeId id, const wchar_t *path);
+    void initGhostFiles(SP::Storage::NodeId id, const wchar_t *path);
+    bool initGhost(SP::Storage::NodeId id);
 
     void saveSPSave();
     void refreshGCPadRumble();
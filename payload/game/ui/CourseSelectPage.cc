@@ -1,11 +1,14 @@
 #include "CourseSelectPage.hh"
 
 #include "game/system/RaceConfig.hh"
+#include "game/system/ResourceManager.hh"
+#include "game/system/RootScene.hh"
 #include "game/ui/RaceConfirmPage.hh"
 #include "game/ui/SectionManager.hh"
 #include "game/ui/VotingBackPage.hh"
 
 #include <sp/ScopeLock.hh>
+#include <sp/ThumbnailCache.hh>
 
 #include <algorithm>
 #include <limits>
@@ -25,6 +28,7 @@ void CourseSelectPage::onInit() {
     m_sheetCount = 1;
     m_sheetIndex = 0;
     m_lastSelected = 0;
+    m_prefetchDelay = 0;
 
     m_inputManager.init(0x1, false);
     setInputManager(&m_inputManager);
@@ -68,11 +72,11 @@ void CourseSelectPage::onInit() {
 
     m_backConfirmed = false;
 
-    for (u32 i = 0; i < m_buffers.size(); i++) {
-        for (u8 c = 0; c < m_buffers[i].size(); c++) {
-            m_buffers[i][c].reset(new (0x20) u8[MaxThumbnailHeight * MaxThumbnailWidth]);
-        }
-    }
+    // The cache can be larger than the heaps of the section, so it is taken from the root heap
+    // until the page is deinitialized, leaving room for the course cache that the page reserves
+    // from the same heap. It is allocated on this thread rather than on the thumbnail one.
+    auto *heap = System::RootScene::Instance()->m_heapCollection.mem2;
+    m_thumbnailCache.emplace(heap, System::ResourceManager::CourseCache::HeapSize);
     m_request = Request::None;
     OSInitThreadQueue(&m_queue);
     u8 *stackTop = m_stack + sizeof(m_stack);
@@ -97,6 +101,7 @@ void CourseSelectPage::onDeinit() {
     OSWakeupThread(&m_queue);
     OSJoinThread(&m_thread, nullptr);
     OSDetachThread(&m_thread);
+    m_thumbnailCache.reset();
 }
 
 void CourseSelectPage::onActivate() {
@@ -104,6 +109,10 @@ void CourseSelectPage::onActivate() {
 }
 
 void CourseSelectPage::afterCalc() {
+    if (m_prefetchDelay > 0 && --m_prefetchDelay == 0) {
+        prefetchCourse();
+    }
+
     SP::ScopeLock<SP::NoInterrupts> lock;
     bool changed = false;
     for (size_t i = 0; i < m_buttons.size(); i++) {
@@ -192,6 +201,8 @@ void CourseSelectPage::onButtonFront(PushButton *button, u32 /* localPlayerId */
     auto &courseDatabase = SP::CourseDatabase::Instance();
     auto &entry = courseDatabase.entry(m_filter, courseIndex);
     courseDatabase.saveSelection(courseIndex);
+    m_prefetchDelay = 0;
+    System::ResourceManager::Instance()->preloadCourseAsync(entry.courseId);
 
     auto *sectionManager = SectionManager::Instance();
     auto *section = sectionManager->currentSection();
@@ -216,6 +227,7 @@ void CourseSelectPage::onButtonFront(PushButton *button, u32 /* localPlayerId */
 
 void CourseSelectPage::onButtonSelect(PushButton *button, u32 /* localPlayerId */) {
     m_lastSelected = button->m_index;
+    m_prefetchDelay = PrefetchDelay;
 }
 
 void CourseSelectPage::onSheetSelectRight(SheetSelectControl * /* control */,
@@ -337,6 +349,18 @@ void CourseSelectPage::refresh() {
                 m_databaseIds[j] = std::numeric_limits<u32>::max();
             }
         }
+        for (s32 i = 0; i < static_cast<s32>(m_prefetchDatabaseIds.size()); i++) {
+            if (count == 0) {
+                m_prefetchDatabaseIds[i] = std::numeric_limits<u32>::max();
+                continue;
+            }
+            // Two sheets back and two sheets ahead
+            s32 size = m_buttons.size();
+            s32 sheetIndex = m_sheetIndex + (i < size ? -2 : 2);
+            s32 index = ((sheetIndex * size + i % size) % count + count) % count;
+            auto &entry = SP::CourseDatabase::Instance().entry(m_filter, index);
+            m_prefetchDatabaseIds[i] = entry.databaseId;
+        }
         for (size_t i = 0; i < m_buttons.size(); i++) {
             if (m_databaseIds[i] != std::numeric_limits<u32>::max() &&
                     m_sheetIndex * m_buttons.size() + i < static_cast<size_t>(count)) {
@@ -370,12 +394,28 @@ void CourseSelectPage::refresh() {
     m_sheetLabel.setMessageAll(2009, &info);
 }
 
+void CourseSelectPage::prefetchCourse() {
+    u32 courseIndex = m_sheetIndex * m_buttons.size() + m_lastSelected;
+    auto &courseDatabase = SP::CourseDatabase::Instance();
+    if (courseIndex >= courseDatabase.count(m_filter)) {
+        return;
+    }
+
+    auto &entry = courseDatabase.entry(m_filter, courseIndex);
+    System::ResourceManager::Instance()->preloadCourseAsync(entry.courseId);
+}
+
 void CourseSelectPage::loadThumbnails() {
-    std::array<u32, 27> databaseIds;
-    std::fill(databaseIds.begin(), databaseIds.end(), std::numeric_limits<u32>::max());
+    auto &thumbnailCache = *m_thumbnailCache;
+
+    if (!m_thumbnailPack.open("/thumbnails/pack.bin")) {
+        SP_LOG("Failed to open the thumbnail pack, falling back to JPEG");
+    }
 
     while (true) {
-        std::array<u32, 27> requestedDatabaseIds{};
+        // The three sheets around the current one are pinned in the cache, and the two sheets
+        // beyond them are only prefetched if the cache has room for them as well.
+        std::array<u32, 27 + 18> requestedDatabaseIds{};
         {
             SP::ScopeLock<SP::NoInterrupts> lock;
             switch (m_request) {
@@ -387,51 +427,104 @@ void CourseSelectPage::loadThumbnails() {
             default:
                 break;
             }
-            requestedDatabaseIds = m_databaseIds;
+            std::copy(m_databaseIds.begin(), m_databaseIds.end(), requestedDatabaseIds.begin());
+            std::copy(m_prefetchDatabaseIds.begin(), m_prefetchDatabaseIds.end(),
+                    requestedDatabaseIds.begin() + m_databaseIds.size());
             m_request = Request::None;
         }
 
-        for (u32 i = 0; i < requestedDatabaseIds.size(); i++) {
-            SP::ScopeLock<SP::NoInterrupts> lock;
-            auto it = std::find(databaseIds.begin(), databaseIds.end(), requestedDatabaseIds[i]);
-            if (it == databaseIds.end()) {
-                if (i < m_buttons.size()) {
-                    m_buttons[i].setPaneVisible("picture_base", false);
-                }
+        std::array<bool, 27> isCached{};
+        for (u32 i = 0; i < m_databaseIds.size(); i++) {
+            std::optional<SP::ThumbnailCache::Thumbnail> thumbnail{};
+            if (requestedDatabaseIds[i] != std::numeric_limits<u32>::max()) {
+                thumbnail = thumbnailCache.get(requestedDatabaseIds[i]);
+            }
+            isCached[i] = thumbnail.has_value();
+            if (i >= m_buttons.size()) {
                 continue;
             }
-            auto j = std::distance(databaseIds.begin(), it);
-            requestedDatabaseIds[i] = std::numeric_limits<u32>::max();
-            std::swap(databaseIds[i], databaseIds[j]);
-            std::swap(m_buffers[i], m_buffers[j]);
-            std::swap(m_texObjs[i], m_texObjs[j]);
-            m_thumbnailChanged[i] = true;
+
+            SP::ScopeLock<SP::NoInterrupts> lock;
+            if (thumbnail) {
+                initTexObjs(i, *thumbnail);
+                m_thumbnailChanged[i] = true;
+            } else {
+                m_buttons[i].setPaneVisible("picture_base", false);
+            }
         }
 
-        for (u32 i = 0; i < requestedDatabaseIds.size(); i++) {
-            if (requestedDatabaseIds[i] == std::numeric_limits<u32>::max()) {
+        // Without a cache, the buttons are left without thumbnails.
+        u32 count = 0;
+        if (thumbnailCache.capacity() >= requestedDatabaseIds.size()) {
+            count = requestedDatabaseIds.size();
+        } else if (thumbnailCache.capacity() >= m_databaseIds.size()) {
+            count = m_databaseIds.size();
+        }
+        std::span<const u32> pinnedDatabaseIds(requestedDatabaseIds.data(), count);
+
+        bool isInterrupted = false;
+        for (u32 i = 0; i < count; i++) {
+            u32 databaseId = requestedDatabaseIds[i];
+            if (databaseId == std::numeric_limits<u32>::max()) {
+                continue;
+            }
+            if (i < isCached.size() && isCached[i]) {
                 continue;
             }
-            JRESULT result = loadThumbnail(i, requestedDatabaseIds[i]);
-            if (result == JDR_OK) {
-                databaseIds[i] = requestedDatabaseIds[i];
+
+            // When there are fewer than five sheets, they wrap around and the same thumbnail can
+            // be requested twice, in which case it was already loaded for the first request.
+            std::optional<SP::ThumbnailCache::Thumbnail> thumbnail{};
+            JRESULT result = JDR_OK;
+            if (thumbnailCache.contains(databaseId)) {
+                if (i >= m_buttons.size()) {
+                    continue;
+                }
+                thumbnail = thumbnailCache.get(databaseId);
             } else {
-                databaseIds[i] = std::numeric_limits<u32>::max();
+                u32 slot = thumbnailCache.evict(pinnedDatabaseIds);
+                u16 width, height;
+                result = loadThumbnail(databaseId, thumbnailCache.buffer(slot), width, height);
+                if (result == JDR_OK) {
+                    thumbnail = thumbnailCache.insert(slot, databaseId, width, height);
+                }
             }
             SP::ScopeLock<SP::NoInterrupts> lock;
             if (m_request != Request::None) {
+                isInterrupted = true;
                 break;
             }
-            if (result == JDR_OK) {
-                m_thumbnailChanged[i] = true;
-            } else {
+            if (!thumbnail) {
                 SP_LOG("Failed to read thumbnail with error %u", result);
+            } else if (i < m_buttons.size()) {
+                initTexObjs(i, *thumbnail);
+                m_thumbnailChanged[i] = true;
             }
         }
+
+        if (!isInterrupted && count != 0) {
+            thumbnailCache.logStats();
+        }
     }
 }
 
-JRESULT CourseSelectPage::loadThumbnail(u32 i, u32 databaseId) {
+JRESULT CourseSelectPage::loadThumbnail(u32 databaseId, u8 *dst, u16 &width, u16 &height) {
+    if (auto *entry = m_thumbnailPack.find(databaseId)) {
+        if (entry->width > SP::ThumbnailCache::MaxWidth ||
+                entry->height > SP::ThumbnailCache::MaxHeight) {
+            return JDR_FMT2;
+        }
+
+        if (!m_thumbnailPack.read(*entry, dst)) {
+            return JDR_INP;
+        }
+
+        width = entry->width;
+        height = entry->height;
+        DCFlushRange(dst, 3 * SP::ThumbnailPack::PlaneSize(width, height));
+        return JDR_OK;
+    }
+
     char path[32];
     snprintf(path, std::size(path), "/thumbnails/%u.jpg", databaseId);
 
@@ -440,7 +533,7 @@ JRESULT CourseSelectPage::loadThumbnail(u32 i, u32 databaseId) {
         return JDR_INP;
     }
 
-    Context context{this, i, std::move(*file), 0};
+    Context context{this, dst, std::move(*file), 0};
 
     u8 buffer[0x3000 /* 12 KiB */];
     JDEC jdec;
@@ -449,7 +542,7 @@ JRESULT CourseSelectPage::loadThumbnail(u32 i, u32 databaseId) {
         return result;
     }
 
-    if (jdec.width > MaxThumbnailWidth || jdec.height > MaxThumbnailHeight) {
+    if (jdec.width > SP::ThumbnailCache::MaxWidth || jdec.height > SP::ThumbnailCache::MaxHeight) {
         return JDR_FMT2;
     }
 
@@ -457,15 +550,20 @@ JRESULT CourseSelectPage::loadThumbnail(u32 i, u32 databaseId) {
         return result;
     }
 
-    for (u8 c = 0; c < m_buffers[i].size(); c++) {
-        DCFlushRange(m_buffers[i][c].get(), MaxThumbnailHeight * MaxThumbnailWidth);
-        GXInitTexObj(&m_texObjs[i][c], m_buffers[i][c].get(), jdec.width, jdec.height, GX_TF_I8,
-                GX_CLAMP, GX_CLAMP, GX_FALSE);
-    }
-
+    width = jdec.width;
+    height = jdec.height;
+    DCFlushRange(dst, 3 * SP::ThumbnailPack::PlaneSize(width, height));
     return JDR_OK;
 }
 
+void CourseSelectPage::initTexObjs(u32 i, const SP::ThumbnailCache::Thumbnail &thumbnail) {
+    u32 planeSize = SP::ThumbnailPack::PlaneSize(thumbnail.width, thumbnail.height);
+    for (u8 c = 0; c < m_texObjs[i].size(); c++) {
+        GXInitTexObj(&m_texObjs[i][c], thumbnail.buffer + c * planeSize, thumbnail.width,
+                thumbnail.height, GX_TF_I8, GX_CLAMP, GX_CLAMP, GX_FALSE);
+    }
+}
+
 void *CourseSelectPage::LoadThumbnails(void *arg) {
     reinterpret_cast<CourseSelectPage *>(arg)->loadThumbnails();
     return nullptr;
@@ -492,7 +590,9 @@ int CourseSelectPage::WriteUncompressedThumbnail(JDEC *jdec, void *bitmap, JRECT
     auto *context = reinterpret_cast<Context *>(jdec->device);
 
     auto *pixels = reinterpret_cast<const u8 *>(bitmap);
-    u16 bwidth = jdec->width / 8;
+    u8 *buffer = context->buffer;
+    u32 planeSize = SP::ThumbnailPack::PlaneSize(jdec->width, jdec->height);
+    u16 bwidth = AlignUp<u16>(jdec->width, 8) / 8;
     for (u16 y = rect->top; y <= rect->bottom; y++) {
         u16 by = y / 4;
         u16 ly = y % 4;
@@ -500,8 +600,8 @@ int CourseSelectPage::WriteUncompressedThumbnail(JDEC *jdec, void *bitmap, JRECT
             u16 bx = x / 8;
             u16 lx = x % 8;
             u32 index = (by * bwidth + bx) * (4 * 8) + ly * 8 + lx;
-            for (u8 c = 0; c < context->page->m_buffers[context->i].size(); c++) {
-                context->page->m_buffers[context->i][c][index] = *pixels++;
+            for (u8 c = 0; c < 3; c++) {
+                buffer[c * planeSize + index] = *pixels++;
             }
         }
     }
@@ -8,11 +8,14 @@
 #include "game/ui/ctrl/CtrlMenuPageTitleText.hh"
 
 #include <sp/CourseDatabase.hh>
+#include <sp/ThumbnailCache.hh>
+#include <sp/ThumbnailPack.hh>
 #include <sp/storage/Storage.hh>
 #include <vendor/tjpgd/tjpgd.h>
 
 #include <atomic>
 #include <memory>
+#include <optional>
 
 namespace UI {
 
@@ -44,7 +47,7 @@ private:
 
     struct Context {
         CourseSelectPage *page;
-        u32 i;
+        u8 *buffer;
         SP::Storage::FileHandle file;
         u32 offset;
     };
@@ -60,8 +63,10 @@ private:
 
     void onBackCommon(f32 delay);
     void refresh();
+    void prefetchCourse();
     void loadThumbnails();
-    JRESULT loadThumbnail(u32 i, u32 courseId);
+    JRESULT loadThumbnail(u32 databaseId, u8 *dst, u16 &width, u16 &height);
+    void initTexObjs(u32 i, const SP::ThumbnailCache::Thumbnail &thumbnail);
 
     static void *LoadThumbnails(void *arg);
     static size_t ReadCompressedThumbnail(JDEC *jdec, uint8_t *buffer, size_t size);
@@ -70,10 +75,8 @@ private:
     template <typename T>
     using H = typename T::template Handler<CourseSelectPage>;
 
-    static constexpr u32 MaxThumbnailWidth = 256;
-    static constexpr u32 MaxThumbnailHeight = 144;
-    static_assert(MaxThumbnailWidth % 8 == 0);
-    static_assert(MaxThumbnailHeight % 4 == 0);
+    // Frames a button needs to stay selected for its course to be prefetched
+    static constexpr u32 PrefetchDelay = 30;
 
     MultiControlInputManager m_inputManager;
     CtrlMenuPageTitleText m_pageTitleText;
@@ -96,11 +99,14 @@ private:
     u32 m_sheetCount;
     u32 m_sheetIndex;
     u32 m_lastSelected;
+    u32 m_prefetchDelay;
     Request m_request;
-    std::array<std::atomic<bool>, 27> m_thumbnailChanged;
+    std::array<std::atomic<bool>, 9> m_thumbnailChanged;
     std::array<u32, 27> m_databaseIds;
-    std::array<std::array<std::unique_ptr<u8[]>, 3>, 27> m_buffers;
-    std::array<std::array<GXTexObj, 3>, 27> m_texObjs;
+    std::array<u32, 18> m_prefetchDatabaseIds;
+    std::array<std::array<GXTexObj, 3>, 9> m_texObjs;
+    std::optional<SP::ThumbnailCache> m_thumbnailCache;
+    SP::ThumbnailPack m_thumbnailPack;
     OSThreadQueue m_queue;
     u8 m_stack[0x5000 /* 20 KiB */];
     OSThread m_thread;
@@ -0,0 +1,14 @@
+#include "gx.h"
+
+#include <string.h>
+
+float gxPerspectiveMtx[4][4];
+bool gxHasPerspectiveMtx = false;
+
+void GXSetProjection(const float mtx[4][4], GXProjectionType type) {
+    if (type == GX_PERSPECTIVE) {
+        memcpy(gxPerspectiveMtx, mtx, sizeof(gxPerspectiveMtx));
+        gxHasPerspectiveMtx = true;
+    }
+    REPLACED(GXSetProjection)(mtx, type);
+}
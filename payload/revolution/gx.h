@@ -1,5 +1,7 @@
 #pragma once
 
+#include <Common.h>
+
 #include "revolution/gx/GXBump.h"
 #include "revolution/gx/GXEnum.h"
 #include "revolution/gx/GXFifo.h"
@@ -18,7 +20,8 @@ void GXSetZTexture(GXZTexOp op, GXTexFmt format, u32 bias);
 void GXSetZMode(GXBool compare, GXCompare comparison, GXBool update);
 void GXSetFog(GXFogType type, float start, float end, float near, float far,
         const GXColor *fogColor);
-void GXSetProjection(const float mtx[4][4], GXProjectionType type);
+void REPLACED(GXSetProjection)(const float mtx[4][4], GXProjectionType type);
+void REPLACE GXSetProjection(const float mtx[4][4], GXProjectionType type);
 void GXSetViewport(float x, float y, float width, float height, float near, float far);
 
 void GXSetScissor(u32 left, u32 top, u32 right, u32 bottom);
@@ -90,3 +93,7 @@ static inline void GXTexCoord2f32(f32 a, f32 b) {
 }
 
 void GXCallDisplayList(const void *buf, u32 len);
+
+// The last perspective projection that was set, the camera frustum of the current pass.
+extern float gxPerspectiveMtx[4][4];
+extern bool gxHasPerspectiveMtx;
@@ -8,194 +8,20 @@ extern "C" {
 
 #include "sp/YAZDecoder.hh"
 #include <algorithm>
+#include <common/Bytes.hh>
 #include <cstring>
 #include <egg/core/eggHeap.hh>
 #include <egg/math/eggMath.hh>
 
 namespace SP {
 
-// Sizes, in bytes
-struct SectionSizes {
-    const u32 pos_data_size = 0;
-    const u32 nrm_data_size = 0;
-    const u32 prism_data_size = 0;
-    const u32 block_data_size = 0;
-};
-
-static SectionSizes GetSectionSizes(const KCollisionV1Header &header, u32 file_size) {
-    /*
-     0 pos_data_offset
-     1 nrm_data_offset
-     2 prism_data_offset
-     3 block_data_offset
-     4 <end_of_file>
-    */
-    struct SectionEntry {
-        u32 offset = 0;
-        size_t index = 0;
-        u32 size = 0;
-    };
-
-    // prism_data_offset is 1-indexed, so the offset is pulled back
-    std::array<SectionEntry, 5> sections{SectionEntry{.offset = header.pos_data_offset, .index = 0},
-            SectionEntry{.offset = header.nrm_data_offset, .index = 1},
-            SectionEntry{.offset = static_cast<u32>(
-                                 header.prism_data_offset + sizeof(KCollisionPrismData)),
-                    .index = 2},
-            SectionEntry{.offset = header.block_data_offset, .index = 3},
-            SectionEntry{.offset = file_size, .index = 4}};
-
-    std::sort(sections.begin(), sections.end(),
-            [](auto &lhs, auto &rhs) { return lhs.offset < rhs.offset; });
-
-    for (size_t i = 0; i < 4; ++i) {
-        sections[i].size = sections[i + 1].offset - sections[i].offset;
-    }
-
-    std::sort(sections.begin(), sections.end(),
-            [](auto &lhs, auto &rhs) { return lhs.index < rhs.index; });
-
-    const u32 pos_data_size = sections[0].size;
-    const u32 nrm_data_size = sections[1].size;
-    const u32 prism_data_size = sections[2].size;
-    const u32 block_data_size = sections[3].size;
-
-    return {pos_data_size, nrm_data_size, prism_data_size, block_data_size};
-}
-
-template <typename T, typename byte_view_t>
-static inline T *reinterpret_buffer(byte_view_t data, unsigned offset = 0) {
-    if (offset + sizeof(T) > data.size_bytes()) {
-        return nullptr;
-    }
-
-    return reinterpret_cast<T *>(data.data() + offset);
-}
-
-template <typename T, typename byte_view_t>
-static inline std::span<T> span_cast(byte_view_t data, unsigned offset = 0) {
-    if (offset + sizeof(T) > data.size_bytes()) {
-        return {};
-    }
-
-    const size_t buffer_len = ROUND_DOWN(data.size_bytes(), sizeof(T));
-    return {reinterpret_cast<T *>(data.data() + offset),
-            reinterpret_cast<T *>(data.data() + buffer_len)};
-}
-
-static FixedString<32> FormatVersion(const WiimmKclVersion &ver) {
-    char buf[32];
-    snprintf(buf, sizeof(buf), "WiimmSZS v%d.%d", ver.major_version, ver.minor_version);
-    return buf;
-}
-static FixedString<32> FormatVersion(const UnknownKclVersion &) {
-    return "<Unknown KCL Encoder>";
-}
-static FixedString<32> FormatVersion(const InvalidKclVersion &) {
-    return "<Invalid KCL File>";
-}
-FixedString<32> FormatVersion(KclVersion metadata) {
-    if (auto *as_wiimm = std::get_if<WiimmKclVersion>(&metadata)) {
-        return FormatVersion(*as_wiimm);
-    } else if (auto *as_unknown = std::get_if<UnknownKclVersion>(&metadata)) {
-        return FormatVersion(*as_unknown);
-    } else if (auto *as_invalid = std::get_if<InvalidKclVersion>(&metadata)) {
-        return FormatVersion(*as_invalid);
-    }
-    return "";
-}
-
-constexpr std::array<char, 8> WiimmSZSIdentifier = {'W', 'i', 'i', 'm', 'm', 'S', 'Z', 'S'};
-
-//! The first position will be this type
-struct WiimmKclMetadata {
-    std::array<char, 8> identifier = WiimmSZSIdentifier;
-    f32 version = 0.0f;
-};
-static_assert(sizeof(WiimmKclMetadata) == sizeof(Vec3));
-
-KclVersion InspectKclFile(std::span<const u8> kcl_file) {
-    auto *header = reinterpret_buffer<const KCollisionV1Header>(kcl_file);
-    if (header == nullptr) {
-        // Data is not large enough
-        return InvalidKclVersion{};
-    }
-
-    const auto sizes = GetSectionSizes(*header, kcl_file.size_bytes());
-
-    if (sizes.pos_data_size < sizeof(Vec3)) {
-        // File is empty
-        return UnknownKclVersion{};
-    }
-
-    static_assert(sizeof(WiimmKclMetadata) == sizeof(Vec3));
-    auto *wiimm_metadata =
-            reinterpret_buffer<const WiimmKclMetadata>(kcl_file, header->pos_data_offset);
-
-    if (wiimm_metadata == nullptr) {
-        // This shouldnt be reached
-        return InvalidKclVersion{};
-    }
-
-    if (wiimm_metadata->identifier != WiimmSZSIdentifier) {
-        // No other heuristics for now
-        return UnknownKclVersion{};
-    }
-
-    SP_LOG("VER %f\n", wiimm_metadata->version);
-
-    const int major_version = static_cast<int>(wiimm_metadata->version);
-    const int minor_version = static_cast<int>(wiimm_metadata->version * 100.0f) % 100;
-
-    return WiimmKclVersion{.major_version = major_version, .minor_version = minor_version};
-}
-
-KclFile::KclFile(std::span<const u8> bytes) {
-    m_version = InspectKclFile(bytes);
-    {
-        auto ver = FormatVersion(m_version);
-        SP_LOG("Parsing KCL file size %u bytes (metadata: %s)", bytes.size(), ver.c_str());
-    }
-    m_header = reinterpret_buffer<const KCollisionV1Header>(bytes);
-    assert(m_header != nullptr);
-    if (m_header == nullptr) {
-        return;
-    }
-    const auto sizes = GetSectionSizes(*m_header, bytes.size());
-    SP_LOG("SIZES: position %u bytes; normal %u bytes; prism %u bytes; block %u bytes",
-            sizes.pos_data_size, sizes.nrm_data_size, sizes.prism_data_size, sizes.block_data_size);
-    if (m_header->pos_data_offset + sizes.pos_data_size < bytes.size()) {
-        pos = span_cast<const Vec3>(bytes.subspan(m_header->pos_data_offset, sizes.pos_data_size));
-    }
-    if (m_header->nrm_data_offset + sizes.nrm_data_size < bytes.size()) {
-        nrm = span_cast<const Vec3>(bytes.subspan(m_header->nrm_data_offset, sizes.nrm_data_size));
-    }
-    if (m_header->prism_data_offset + sizes.prism_data_size < bytes.size()) {
-        prism = span_cast<const KCollisionPrismData>(
-                bytes.subspan(m_header->prism_data_offset, sizes.prism_data_size));
-    }
-    if (m_header->block_data_offset + sizes.block_data_size < bytes.size()) {
-        block = bytes.subspan(m_header->block_data_offset, sizes.block_data_size);
-    }
-}
-
-inline std::array<Vec3, 3> FromPrism(float height, const Vec3 &pos, const Vec3 &fnrm,
-        const Vec3 &enrm1, const Vec3 &enrm2, const Vec3 &enrm3) {
-    auto CrossA = cross(enrm1, fnrm);
-    auto CrossB = cross(enrm2, fnrm);
-    auto Vertex1 = pos;
-    auto Vertex2 = pos + CrossB * (height / dot(CrossB, enrm3));
-    auto Vertex3 = pos + CrossA * (height / dot(CrossA, enrm3));
-
-    return {Vertex1, Vertex2, Vertex3};
-}
-
 KclVis::KclVis(std::span<const u8> file) : m_file(file) {
     prepare();
 }
 KclVis::~KclVis() {
-    SP_LOG("Freeing KclVis (%u bytes)", m_DLSize);
-    m_DL.reset();
+    SP_LOG("Freeing KclVis (%u chunks)", m_chunkCount);
+    m_chunks.reset();
+    m_colors.reset();
 }
 static GXColor TransformHRadians(GXColor in, // color to transform
         float H) {
@@ -260,44 +86,213 @@ alignas(64) static u8 TRUSS_TPL[0x2060];
 alignas(32) GXTexObj TRUSS_OBJ;
 static bool trussBound = false;
 
-void KclVis::prepare() {
-    const size_t count = m_file.prism.size();
-    m_DLSize = ROUND_UP(count * 3 * sizeof(DirectVertex) + 4 /* Header */, 32);
-    SP_LOG("Prism count: %u; Buffer size: %u.", (u32)count, m_DLSize);
-    m_DL = std::unique_ptr<u8[]>(new (32) u8[m_DLSize]);
-    assert(m_DL);
-    memset(m_DL.get(), 0, m_DLSize); // 0 acts as a nop
-    m_DL[0] = 0;                     // For alignment
-    m_DL[1] = static_cast<u8>(GX_TRIANGLES) | static_cast<u8>(GX_VTXFMT0);
-    m_DL[2] = (count * 3) >> 8;
-    m_DL[3] = (count * 3) & 0xff;
-
-    DirectVertex *vertices = reinterpret_cast<DirectVertex *>(m_DL.get() + 4);
-
-    // NOTE: Technically we need to index this data by the octree. Not all prisms need be
-    // referenced.
-    // TODO: Indexed vertex data
-    for (size_t i = 0; i < count; ++i) {
-        const KCollisionPrismData &prism = m_file.prism[i];
-        const auto &fnrm = m_file.nrm[prism.fnrm_i];
-        const auto verts = FromPrism(prism.height, m_file.pos[prism.pos_i], fnrm,
-                m_file.nrm[prism.enrm1_i], m_file.nrm[prism.enrm2_i], m_file.nrm[prism.enrm3_i]);
-        auto gx_clr = GetKCLColor(prism.attribute);
-        u32 clr = (u32 &)gx_clr;
-        clr |= 0xff;
-        // U16 for UVs for alignment (*2 = 4 bytes)
-        vertices[i * 3] = {verts[0], fnrm, clr, 0, 0};
-        vertices[i * 3 + 1] = {verts[1], fnrm, clr, 0, 1};
-        vertices[i * 3 + 2] = {verts[2], fnrm, clr, 1, 1};
+// Triangle counts are u16 in the draw commands, and so are the position indices of a chunk.
+static const u32 MaxChunkTriangleCount = 0xffff / 3;
+
+// Vertex: position index (u16), normal index (u16), color index (u16), UV index (u8)
+static const u32 VertexSize = 7;
+// Array base of the positions (6 bytes) and draw command (3 bytes)
+static const u32 ChunkDLHeaderSize = 9;
+
+alignas(32) static u16 s_uvs[3][2] = {{0, 0}, {0, 1}, {1, 1}};
+
+// Appends the prisms of a node of the octree which aren't part of another chunk yet, by walking
+// the nodes the same way as the game does when looking up a block.
+static void CollectNodePrisms(const u8 *node, u32 offset,
+        std::span<const KCollisionPrismData> prism, u8 *isCollected, u16 *prisms, u32 &count) {
+    if (offset & 0x80000000) {
+        // The list is terminated by 0, and prism indices start at 1.
+        const u16 *list = reinterpret_cast<const u16 *>(node + (offset & 0x7fffffff));
+        while (u16 i = *++list) {
+            if (i >= prism.size() || isCollected[i >> 3] & 1 << (i & 7)) {
+                continue;
+            }
+            isCollected[i >> 3] |= 1 << (i & 7);
+            prisms[count++] = i;
+        }
+        return;
+    }
+
+    node += offset;
+    const u32 *children = reinterpret_cast<const u32 *>(node);
+    for (size_t i = 0; i < 8; i++) {
+        CollectNodePrisms(node, children[i], prism, isCollected, prisms, count);
     }
+}
 
+void KclVis::prepare() {
     if (!trussBound) {
         trussBound = true;
         YAZDecoder::Decode(TRUSS_SZS, sizeof(TRUSS_SZS), TRUSS_TPL, sizeof(TRUSS_TPL));
         TPLBind(TRUSS_TPL);
         TPLGetGXTexObjFromPalette(TRUSS_TPL, &TRUSS_OBJ, 0);
+        DCStoreRange(s_uvs, sizeof(s_uvs));
+    }
+
+    const KCollisionV1Header *header = m_file.m_header;
+    if (header == nullptr || m_file.block.empty() || m_file.prism.empty()) {
+        return;
+    }
+    const u32 prismCount = m_file.prism.size();
+
+    // One color per attribute which is used
+    std::unique_ptr<u16[]> attributes(new (32) u16[prismCount]);
+    for (u32 i = 0; i < prismCount; i++) {
+        attributes[i] = m_file.prism[i].attribute;
+    }
+    std::sort(attributes.get(), attributes.get() + prismCount);
+    m_colorCount = std::unique(attributes.get(), attributes.get() + prismCount) - attributes.get();
+    m_colors = std::unique_ptr<u32[]>(new (32) u32[m_colorCount]);
+    for (u32 i = 0; i < m_colorCount; i++) {
+        auto gx_clr = GetKCLColor(attributes[i]);
+        m_colors[i] = (u32 &)gx_clr | 0xff;
+    }
+    DCStoreRange(m_colors.get(), m_colorCount * sizeof(u32));
+    DCStoreRange(const_cast<Vec3 *>(m_file.nrm.data()), m_file.nrm.size_bytes());
+
+    // Each root cell of the octree becomes a chunk, or several ones if it has too many prisms.
+    // Prisms are in the leaves of every cell they overlap, but are only drawn by the first one.
+    u32 xCount = (~header->area_x_width_mask >> header->block_width_shift) + 1;
+    u32 yCount = (~header->area_y_width_mask >> header->block_width_shift) + 1;
+    u32 zCount = (~header->area_z_width_mask >> header->block_width_shift) + 1;
+    u32 maxChunkCount = xCount * yCount * zCount + prismCount / MaxChunkTriangleCount + 1;
+    std::unique_ptr<u8[]> isCollected(new (32) u8[prismCount / 8 + 1]);
+    memset(isCollected.get(), 0, prismCount / 8 + 1);
+    std::unique_ptr<u16[]> prisms(new (32) u16[prismCount]);
+    std::unique_ptr<u32[]> chunkEnds(new (32) u32[maxChunkCount]);
+    u32 count = 0;
+    const u8 *block = m_file.block.data();
+    for (u32 z = 0; z < zCount; z++) {
+        for (u32 y = 0; y < yCount; y++) {
+            for (u32 x = 0; x < xCount; x++) {
+                u32 index = z << header->area_xy_blocks_shift |
+                        y << header->area_x_blocks_shift | x;
+                u32 offset = reinterpret_cast<const u32 *>(block)[index];
+                u32 start = count;
+                CollectNodePrisms(block, offset, m_file.prism, isCollected.get(), prisms.get(),
+                        count);
+                while (start < count) {
+                    start = std::min(start + MaxChunkTriangleCount, count);
+                    chunkEnds[m_chunkCount++] = start;
+                }
+            }
+        }
+    }
+    m_triangleCount = count;
+
+    u32 maxChunkTriangleCount = 0;
+    for (u32 i = 0; i < m_chunkCount; i++) {
+        u32 start = i == 0 ? 0 : chunkEnds[i - 1];
+        maxChunkTriangleCount = std::max(maxChunkTriangleCount, chunkEnds[i] - start);
     }
+    std::unique_ptr<Vec3[]> vertices(new (32) Vec3[maxChunkTriangleCount * 3]);
+    std::unique_ptr<u16[]> order(new (32) u16[maxChunkTriangleCount * 3]);
+    m_chunks = std::unique_ptr<Chunk[]>(new (32) Chunk[m_chunkCount]);
+    for (u32 i = 0; i < m_chunkCount; i++) {
+        u32 start = i == 0 ? 0 : chunkEnds[i - 1];
+        std::span<const u16> chunkPrisms(prisms.get() + start, prisms.get() + chunkEnds[i]);
+        prepareChunk(m_chunks[i], chunkPrisms, vertices.get(), order.get(), attributes.get());
+    }
+    SP_LOG("Prism count: %u; Drawn prism count: %u; Chunk count: %u.", prismCount, count,
+            m_chunkCount);
+}
+
+void KclVis::prepareChunk(Chunk &chunk, std::span<const u16> prisms, Vec3 *vertices, u16 *order,
+        const u16 *attributes) {
+    const u32 vertexCount = prisms.size() * 3;
+    chunk.triangleCount = prisms.size();
+    chunk.DLSize = ROUND_UP(ChunkDLHeaderSize + vertexCount * VertexSize, 32);
+    chunk.DL = std::unique_ptr<u8[]>(new (32) u8[chunk.DLSize]);
+    u8 *DL = chunk.DL.get();
+    memset(DL, 0, chunk.DLSize); // 0 acts as a nop
+
+    for (size_t i = 0; i < prisms.size(); i++) {
+        const KCollisionPrismData &prism = m_file.prism[prisms[i]];
+        const auto verts = FromPrism(prism.height, m_file.pos[prism.pos_i],
+                m_file.nrm[prism.fnrm_i], m_file.nrm[prism.enrm1_i], m_file.nrm[prism.enrm2_i],
+                m_file.nrm[prism.enrm3_i]);
+        const u16 *attribute = std::lower_bound(attributes, attributes + m_colorCount,
+                prism.attribute);
+        for (size_t j = 0; j < 3; j++) {
+            vertices[i * 3 + j] = verts[j];
+            u8 *vertex = DL + ChunkDLHeaderSize + (i * 3 + j) * VertexSize;
+            Bytes::Write<u16>(vertex, 2, prism.fnrm_i);
+            Bytes::Write<u16>(vertex, 4, attribute - attributes);
+            vertex[6] = j;
+        }
+    }
+
+    // Vertices which share a position share its index
+    auto less = [&](u16 lhs, u16 rhs) {
+        const Vec3 &l = vertices[lhs], &r = vertices[rhs];
+        if (l.x != r.x) {
+            return l.x < r.x;
+        }
+        if (l.y != r.y) {
+            return l.y < r.y;
+        }
+        return l.z < r.z;
+    };
+    for (u32 i = 0; i < vertexCount; i++) {
+        order[i] = i;
+    }
+    std::sort(order, order + vertexCount, less);
+    u32 positionCount = 0;
+    for (u32 i = 0; i < vertexCount; i++) {
+        if (i == 0 || less(order[i - 1], order[i])) {
+            positionCount++;
+        }
+    }
+    chunk.positions = std::unique_ptr<Vec3[]>(new (32) Vec3[positionCount]);
+    chunk.min = vertices[order[0]];
+    chunk.max = vertices[order[0]];
+    u16 positionIndex = 0;
+    for (u32 i = 0; i < vertexCount; i++) {
+        const Vec3 &pos = vertices[order[i]];
+        if (i != 0 && less(order[i - 1], order[i])) {
+            positionIndex++;
+        }
+        chunk.positions[positionIndex] = pos;
+        Bytes::Write<u16>(DL + ChunkDLHeaderSize + order[i] * VertexSize, 0, positionIndex);
+        chunk.min = {std::min(chunk.min.x, pos.x), std::min(chunk.min.y, pos.y),
+                std::min(chunk.min.z, pos.z)};
+        chunk.max = {std::max(chunk.max.x, pos.x), std::max(chunk.max.y, pos.y),
+                std::max(chunk.max.z, pos.z)};
+    }
+    DCStoreRange(chunk.positions.get(), positionCount * sizeof(Vec3));
+
+    // Load the position array base of the chunk into the command processor
+    DL[0] = 0x08;
+    DL[1] = 0xa0;
+    Bytes::Write<u32>(DL, 2, reinterpret_cast<u32>(chunk.positions.get()) & 0x3fffffff);
+    DL[6] = static_cast<u8>(GX_TRIANGLES) | static_cast<u8>(GX_VTXFMT0);
+    Bytes::Write<u16>(DL, 7, vertexCount);
+    DCStoreRange(DL, chunk.DLSize);
 }
+
+// GXSetArray isn't linked, so the array registers of the command processor are written directly.
+static void SetArray(GXAttr attr, const void *base, u8 stride) {
+    WGPIPE._u8 = 0x08;
+    WGPIPE._u8 = 0xa0 + (attr - GX_VA_POS);
+    WGPIPE._u32 = reinterpret_cast<u32>(base) & 0x3fffffff;
+    WGPIPE._u8 = 0x08;
+    WGPIPE._u8 = 0xb0 + (attr - GX_VA_POS);
+    WGPIPE._u32 = stride;
+}
+
+// Whether a box is on the inner side of all the planes of a frustum (a * x + b * y + c * z + d)
+static bool IsVisible(const float (&planes)[6][4], const Vec3 &min, const Vec3 &max) {
+    for (const auto &plane : planes) {
+        float x = plane[0] >= 0.0f ? max.x : min.x;
+        float y = plane[1] >= 0.0f ? max.y : min.y;
+        float z = plane[2] >= 0.0f ? max.z : min.z;
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void KclVis::render(const float mtx[3][4], bool /* overlay */) {
     GXLoadPosMtxImm(mtx, 0);
     float ident[4][4];
@@ -373,20 +368,67 @@ void KclVis::render(const float mtx[3][4], bool /* overlay */) {
 
     // Vertex format
     GXClearVtxDesc();
-    GXSetVtxDesc(GX_VA_POS, GX_DIRECT);
-    GXSetVtxDesc(GX_VA_NRM, GX_DIRECT);
-    GXSetVtxDesc(GX_VA_CLR0, GX_DIRECT);
-    GXSetVtxDesc(GX_VA_TEX0, GX_DIRECT);
+    GXSetVtxDesc(GX_VA_POS, GX_INDEX16);
+    GXSetVtxDesc(GX_VA_NRM, GX_INDEX16);
+    GXSetVtxDesc(GX_VA_CLR0, GX_INDEX16);
+    GXSetVtxDesc(GX_VA_TEX0, GX_INDEX8);
     GXSetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
     GXSetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, GX_F32, 0);
     GXSetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGBA8, 0);
     GXSetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, GX_U16, 0);
 
+    // The base of the position array is set by each chunk
+    SetArray(GX_VA_POS, nullptr, sizeof(Vec3));
+    SetArray(GX_VA_NRM, m_file.nrm.data(), sizeof(Vec3));
+    SetArray(GX_VA_CLR0, m_colors.get(), sizeof(u32));
+    SetArray(GX_VA_TEX0, s_uvs, sizeof(s_uvs[0]));
+
+    // Clip space is -w <= x, y <= w and -w <= z <= 0, each bound is a plane in world space.
+    float planes[6][4];
+    if (gxHasPerspectiveMtx) {
+        float clip[4][4];
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                clip[i][j] = j == 3 ? gxPerspectiveMtx[i][3] : 0.0f;
+                for (size_t k = 0; k < 3; k++) {
+                    clip[i][j] += gxPerspectiveMtx[i][k] * mtx[k][j];
+                }
+            }
+        }
+        for (size_t j = 0; j < 4; j++) {
+            planes[0][j] = clip[3][j] + clip[0][j];
+            planes[1][j] = clip[3][j] - clip[0][j];
+            planes[2][j] = clip[3][j] + clip[1][j];
+            planes[3][j] = clip[3][j] - clip[1][j];
+            planes[4][j] = clip[3][j] + clip[2][j];
+            planes[5][j] = -clip[2][j];
+        }
+    }
+
     GXSetAlphaUpdate(GX_FALSE);
-    assert(m_DL != nullptr);
-    GXCallDisplayList(m_DL.get(), m_DLSize);
+    for (u32 i = 0; i < m_chunkCount; i++) {
+        const Chunk &chunk = m_chunks[i];
+        if (gxHasPerspectiveMtx && !IsVisible(planes, chunk.min, chunk.max)) {
+            continue;
+        }
+        GXCallDisplayList(chunk.DL.get(), chunk.DLSize);
+        s_stats.drawnTriangleCount += chunk.triangleCount;
+        s_stats.drawnChunkCount++;
+    }
+    s_stats.triangleCount += m_triangleCount;
+    s_stats.chunkCount += m_chunkCount;
     // mMaterial.unuse();
     GXSetAlphaUpdate(GX_TRUE);
 }
 
+KclVis::Stats KclVis::GetStats() {
+    return s_stats;
+}
+
+void KclVis::ResetStats() {
+    s_stats = {};
+}
+
+KclVis::Stats KclVis::s_stats{};
+
 } // namespace SP
@@ -1,90 +1,54 @@
 #pragma once
 
-#define _HAS_CXX20
+#include "KclFile.hh"
 
-#include "Common.hh"
-#include <array>
-#include <common/TVec3.hh>
 #include <memory>
-#include <sp/FixedString.hh>
-#include <span>
-#include <variant>
 
 namespace SP {
 
-struct KCollisionV1Header {
-    u32 pos_data_offset;
-    u32 nrm_data_offset;
-    u32 prism_data_offset;
-    u32 block_data_offset;
-    f32 prism_thickness;
-    Vec3 area_min_pos;
-    u32 area_x_width_mask;
-    u32 area_y_width_mask;
-    u32 area_z_width_mask;
-    s32 block_width_shift;
-    s32 area_x_blocks_shift;
-    s32 area_xy_blocks_shift;
-    f32 sphere_radius;
-};
-
-struct KCollisionPrismData {
-    f32 height{0.0f};
-    u16 pos_i{0};
-    u16 fnrm_i{0};
-    u16 enrm1_i{0};
-    u16 enrm2_i{0};
-    u16 enrm3_i{0};
-    u16 attribute{0};
-};
-
-struct WiimmKclVersion {
-    // 2.26
-    int major_version = 2;
-    int minor_version = 26;
-};
-struct UnknownKclVersion {};
-struct InvalidKclVersion {};
-
-using KclVersion = std::variant<WiimmKclVersion, UnknownKclVersion, InvalidKclVersion>;
-
-KclVersion InspectKclFile(std::span<const u8> kcl_file);
-FixedString<32> GetKCLVersion(KclVersion metadata);
-
-struct KclFile {
-    KclFile(std::span<const u8> bytes);
-
-    KclVersion m_version;
-    const KCollisionV1Header *m_header = nullptr;
-    std::span<const Vec3> pos;
-    std::span<const Vec3> nrm;
-    std::span<const KCollisionPrismData> prism;
-    std::span<const u8> block;
-};
-
 class KclVis {
 public:
+    struct Stats {
+        u32 drawnTriangleCount;
+        u32 triangleCount;
+        u32 drawnChunkCount;
+        u32 chunkCount;
+    };
+
     KclVis(std::span<const u8> file);
     ~KclVis();
 
     void render(const float mtx[3][4], bool overlay);
 
+    // Totals for all views since the last reset, shown by the perf overlay.
+    static Stats GetStats();
+    static void ResetStats();
+
 private:
+    // The prisms of a root cell of the octree, drawn with a single indexed display list which also
+    // points the position array to the ones of the chunk.
+    struct Chunk {
+        Vec3 min;
+        Vec3 max;
+        u32 triangleCount;
+        std::unique_ptr<Vec3[]> positions;
+        std::unique_ptr<u8[]> DL;
+        u32 DLSize;
+    };
+
     void prepare();
+    void prepareChunk(Chunk &chunk, std::span<const u16> prisms, Vec3 *vertices, u16 *order,
+            const u16 *attributes);
 
     KclFile m_file;
 
-    // Not indexed (yet)
-    struct DirectVertex {
-        Vec3 pos;
-        Vec3 nrm; // Same for all vertices
-        u32 clr = 0xff00'00ff;
-        u16 uv_u;
-        u16 uv_v;
-    };
+    std::unique_ptr<u32[]> m_colors;
+    u32 m_colorCount = 0;
+    std::unique_ptr<Chunk[]> m_chunks;
+    u32 m_chunkCount = 0;
+    u32 m_triangleCount = 0;
 
-    std::unique_ptr<u8[]> m_DL;
-    u32 m_DLSize;
+    static Stats s_stats;
 };
 
 } // namespace SP
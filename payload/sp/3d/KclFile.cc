@@ -0,0 +1,191 @@
+#include "KclFile.hh"
+
+extern "C" {
+#include <revolution/os.h>
+}
+
+#include <algorithm>
+#include <cstdio>
+
+namespace SP {
+
+// Sizes, in bytes
+struct SectionSizes {
+    const u32 pos_data_size = 0;
+    const u32 nrm_data_size = 0;
+    const u32 prism_data_size = 0;
+    const u32 block_data_size = 0;
+};
+
+static SectionSizes GetSectionSizes(const KCollisionV1Header &header, u32 file_size) {
+    /*
+     0 pos_data_offset
+     1 nrm_data_offset
+     2 prism_data_offset
+     3 block_data_offset
+     4 <end_of_file>
+    */
+    struct SectionEntry {
+        u32 offset = 0;
+        size_t index = 0;
+        u32 size = 0;
+    };
+
+    // prism_data_offset is 1-indexed, so the offset is pulled back
+    std::array<SectionEntry, 5> sections{SectionEntry{.offset = header.pos_data_offset, .index = 0},
+            SectionEntry{.offset = header.nrm_data_offset, .index = 1},
+            SectionEntry{.offset = static_cast<u32>(
+                                 header.prism_data_offset + sizeof(KCollisionPrismData)),
+                    .index = 2},
+            SectionEntry{.offset = header.block_data_offset, .index = 3},
+            SectionEntry{.offset = file_size, .index = 4}};
+
+    std::sort(sections.begin(), sections.end(),
+            [](auto &lhs, auto &rhs) { return lhs.offset < rhs.offset; });
+
+    for (size_t i = 0; i < 4; ++i) {
+        sections[i].size = sections[i + 1].offset - sections[i].offset;
+    }
+
+    std::sort(sections.begin(), sections.end(),
+            [](auto &lhs, auto &rhs) { return lhs.index < rhs.index; });
+
+    const u32 pos_data_size = sections[0].size;
+    const u32 nrm_data_size = sections[1].size;
+    const u32 prism_data_size = sections[2].size;
+    const u32 block_data_size = sections[3].size;
+
+    return {pos_data_size, nrm_data_size, prism_data_size, block_data_size};
+}
+
+template <typename T, typename byte_view_t>
+static inline T *reinterpret_buffer(byte_view_t data, unsigned offset = 0) {
+    if (offset + sizeof(T) > data.size_bytes()) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<T *>(data.data() + offset);
+}
+
+template <typename T, typename byte_view_t>
+static inline std::span<T> span_cast(byte_view_t data, unsigned offset = 0) {
+    if (offset + sizeof(T) > data.size_bytes()) {
+        return {};
+    }
+
+    const size_t buffer_len = ROUND_DOWN(data.size_bytes(), sizeof(T));
+    return {reinterpret_cast<T *>(data.data() + offset),
+            reinterpret_cast<T *>(data.data() + buffer_len)};
+}
+
+static FixedString<32> FormatVersion(const WiimmKclVersion &ver) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "WiimmSZS v%d.%d", ver.major_version, ver.minor_version);
+    return buf;
+}
+static FixedString<32> FormatVersion(const UnknownKclVersion &) {
+    return "<Unknown KCL Encoder>";
+}
+static FixedString<32> FormatVersion(const InvalidKclVersion &) {
+    return "<Invalid KCL File>";
+}
+FixedString<32> FormatVersion(KclVersion metadata) {
+    if (auto *as_wiimm = std::get_if<WiimmKclVersion>(&metadata)) {
+        return FormatVersion(*as_wiimm);
+    } else if (auto *as_unknown = std::get_if<UnknownKclVersion>(&metadata)) {
+        return FormatVersion(*as_unknown);
+    } else if (auto *as_invalid = std::get_if<InvalidKclVersion>(&metadata)) {
+        return FormatVersion(*as_invalid);
+    }
+    return "";
+}
+
+constexpr std::array<char, 8> WiimmSZSIdentifier = {'W', 'i', 'i', 'm', 'm', 'S', 'Z', 'S'};
+
+//! The first position will be this type
+struct WiimmKclMetadata {
+    std::array<char, 8> identifier = WiimmSZSIdentifier;
+    f32 version = 0.0f;
+};
+static_assert(sizeof(WiimmKclMetadata) == sizeof(Vec3));
+
+KclVersion InspectKclFile(std::span<const u8> kcl_file) {
+    auto *header = reinterpret_buffer<const KCollisionV1Header>(kcl_file);
+    if (header == nullptr) {
+        // Data is not large enough
+        return InvalidKclVersion{};
+    }
+
+    const auto sizes = GetSectionSizes(*header, kcl_file.size_bytes());
+
+    if (sizes.pos_data_size < sizeof(Vec3)) {
+        // File is empty
+        return UnknownKclVersion{};
+    }
+
+    static_assert(sizeof(WiimmKclMetadata) == sizeof(Vec3));
+    auto *wiimm_metadata =
+            reinterpret_buffer<const WiimmKclMetadata>(kcl_file, header->pos_data_offset);
+
+    if (wiimm_metadata == nullptr) {
+        // This shouldnt be reached
+        return InvalidKclVersion{};
+    }
+
+    if (wiimm_metadata->identifier != WiimmSZSIdentifier) {
+        // No other heuristics for now
+        return UnknownKclVersion{};
+    }
+
+    SP_LOG("VER %f\n", wiimm_metadata->version);
+
+    const int major_version = static_cast<int>(wiimm_metadata->version);
+    const int minor_version = static_cast<int>(wiimm_metadata->version * 100.0f) % 100;
+
+    return WiimmKclVersion{.major_version = major_version, .minor_version = minor_version};
+}
+
+KclFile::KclFile(std::span<const u8> bytes) {
+    m_version = InspectKclFile(bytes);
+    {
+        auto ver = FormatVersion(m_version);
+        SP_LOG("Parsing KCL file size %u bytes (metadata: %s)", static_cast<u32>(bytes.size()),
+                ver.c_str());
+    }
+    m_header = reinterpret_buffer<const KCollisionV1Header>(bytes);
+    assert(m_header != nullptr);
+    if (m_header == nullptr) {
+        return;
+    }
+    const auto sizes = GetSectionSizes(*m_header, bytes.size());
+    SP_LOG("SIZES: position %u bytes; normal %u bytes; prism %u bytes; block %u bytes",
+            sizes.pos_data_size, sizes.nrm_data_size, sizes.prism_data_size, sizes.block_data_size);
+    if (m_header->pos_data_offset + sizes.pos_data_size <= bytes.size()) {
+        pos = span_cast<const Vec3>(bytes.subspan(m_header->pos_data_offset, sizes.pos_data_size));
+    }
+    if (m_header->nrm_data_offset + sizes.nrm_data_size <= bytes.size()) {
+        nrm = span_cast<const Vec3>(bytes.subspan(m_header->nrm_data_offset, sizes.nrm_data_size));
+    }
+    // The first prism is the unused index 0, before the section whose size was computed
+    u32 prism_size = sizes.prism_data_size + sizeof(KCollisionPrismData);
+    if (m_header->prism_data_offset + prism_size <= bytes.size()) {
+        prism = span_cast<const KCollisionPrismData>(
+                bytes.subspan(m_header->prism_data_offset, prism_size));
+    }
+    if (m_header->block_data_offset + sizes.block_data_size <= bytes.size()) {
+        block = bytes.subspan(m_header->block_data_offset, sizes.block_data_size);
+    }
+}
+
+std::array<Vec3, 3> FromPrism(float height, const Vec3 &pos, const Vec3 &fnrm,
+        const Vec3 &enrm1, const Vec3 &enrm2, const Vec3 &enrm3) {
+    auto CrossA = cross(enrm1, fnrm);
+    auto CrossB = cross(enrm2, fnrm);
+    auto Vertex1 = pos;
+    auto Vertex2 = pos + CrossB * (height / dot(CrossB, enrm3));
+    auto Vertex3 = pos + CrossA * (height / dot(CrossA, enrm3));
+
+    return {Vertex1, Vertex2, Vertex3};
+}
+
+} // namespace SP
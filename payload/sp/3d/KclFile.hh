@@ -0,0 +1,68 @@
+#pragma once
+
+#define _HAS_CXX20
+
+#include "Common.hh"
+#include <array>
+#include <common/TVec3.hh>
+#include <sp/FixedString.hh>
+#include <span>
+#include <variant>
+
+namespace SP {
+
+struct KCollisionV1Header {
+    u32 pos_data_offset;
+    u32 nrm_data_offset;
+    u32 prism_data_offset;
+    u32 block_data_offset;
+    f32 prism_thickness;
+    Vec3 area_min_pos;
+    u32 area_x_width_mask;
+    u32 area_y_width_mask;
+    u32 area_z_width_mask;
+    s32 block_width_shift;
+    s32 area_x_blocks_shift;
+    s32 area_xy_blocks_shift;
+    f32 sphere_radius;
+};
+
+struct KCollisionPrismData {
+    f32 height{0.0f};
+    u16 pos_i{0};
+    u16 fnrm_i{0};
+    u16 enrm1_i{0};
+    u16 enrm2_i{0};
+    u16 enrm3_i{0};
+    u16 attribute{0};
+};
+
+struct WiimmKclVersion {
+    // 2.26
+    int major_version = 2;
+    int minor_version = 26;
+};
+struct UnknownKclVersion {};
+struct InvalidKclVersion {};
+
+using KclVersion = std::variant<WiimmKclVersion, UnknownKclVersion, InvalidKclVersion>;
+
+KclVersion InspectKclFile(std::span<const u8> kcl_file);
+FixedString<32> GetKCLVersion(KclVersion metadata);
+
+struct KclFile {
+    KclFile(std::span<const u8> bytes);
+
+    KclVersion m_version;
+    const KCollisionV1Header *m_header = nullptr;
+    std::span<const Vec3> pos;
+    std::span<const Vec3> nrm;
+    std::span<const KCollisionPrismData> prism;
+    std::span<const u8> block;
+};
+
+// The vertices of the triangle at the top of a prism
+std::array<Vec3, 3> FromPrism(float height, const Vec3 &pos, const Vec3 &fnrm, const Vec3 &enrm1,
+        const Vec3 &enrm2, const Vec3 &enrm3);
+
+} // namespace SP
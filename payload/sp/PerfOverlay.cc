@@ -1,6 +1,7 @@
 #include "PerfOverlay.hh"
 
 #include "sp/ScopeLock.hh"
+#include "sp/storage/DecompLoader.hh"
 
 #include <egg/core/eggSystem.hh>
 #include <game/system/SaveManager.hh>
@@ -98,6 +99,9 @@ void PerfOverlay::measureBeginFrame(OSTime frameDuration) {
 
     m_gpuWidth = 600 * m_gpuDuration / m_frameDuration;
 
+    m_kclStats = KclVis::GetStats();
+    KclVis::ResetStats();
+
     for (size_t i = 0; i < std::size(m_memColors); i++) {
         auto &system = EGG::TSystem::Instance();
         u32 lo = reinterpret_cast<u32>(i == 0 ? system.mem1ArenaLo() : system.mem2ArenaLo());
@@ -171,6 +175,27 @@ void PerfOverlay::draw() {
     GXClearVtxDesc();
     GXSetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XY, GX_S16, 0);
 
+    // Fraction of the collision triangles drawn by the KCL visualiser in the last frame (top) and
+    // the number of chunks it drew, one pixel each (bottom)
+    if (m_kclStats.triangleCount > 0) {
+        s16 trianglesWidth = 600 * m_kclStats.drawnTriangleCount / m_kclStats.triangleCount;
+        s16 chunksWidth = std::min<u32>(m_kclStats.drawnChunkCount, 600);
+        DrawRectangle(4, 416, 600, 6, {0, 0, 0, 102});
+        DrawRectangle(4, 417, trianglesWidth, 2, {255, 255, 255, 255});
+        DrawRectangle(4, 419, chunksWidth, 2, {255, 200, 80, 255});
+    }
+
+    // Fraction of the last DecompLoader load spent waiting for the storage (top) and for the
+    // decoder (bottom)
+    auto loadStats = Storage::DecompLoader::GetStats();
+    if (loadStats.duration > 0) {
+        s16 readStallWidth = 600 * loadStats.readStall / loadStats.duration;
+        s16 decodeStallWidth = 600 * loadStats.decodeStall / loadStats.duration;
+        DrawRectangle(4, 424, 600, 6, {0, 0, 0, 102});
+        DrawRectangle(4, 425, readStallWidth, 2, {255, 160, 80, 255});
+        DrawRectangle(4, 427, decodeStallWidth, 2, {80, 160, 255, 255});
+    }
+
     DrawRectangle(4, 432, 600, 6, {0, 0, 0, 102});
     DrawRectangle(m_cpuDrawX, 433, m_cpuDrawWidth, 2, {80, 255, 80, 255});
     DrawRectangle(m_cpuCalcX, 433, m_cpuCalcWidth, 2, {255, 80, 255, 255});
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "sp/3d/Kcl.hh"
+
 extern "C" {
 #include <revolution.h>
 }
@@ -52,6 +54,7 @@ private:
     s16 m_gpuX = 0;
     s16 m_gpuWidth = 0;
     GXColor m_memColors[2][600];
+    KclVis::Stats m_kclStats{};
 
     static std::optional<PerfOverlay> s_instance;
     static OSSwitchThreadCallback s_switchThreadCallback;
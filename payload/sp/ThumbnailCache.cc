@@ -0,0 +1,123 @@
+#include "ThumbnailCache.hh"
+
+#include "sp/settings/GlobalSettings.hh"
+
+#include <algorithm>
+#include <limits>
+
+namespace SP {
+
+static constexpr u32 NoDatabaseId = std::numeric_limits<u32>::max();
+
+u32 ThumbnailCache::capacity() const {
+    return m_capacity;
+}
+
+bool ThumbnailCache::contains(u32 databaseId) const {
+    return find(databaseId);
+}
+
+std::optional<ThumbnailCache::Thumbnail> ThumbnailCache::get(u32 databaseId) {
+    auto *slot = find(databaseId);
+    if (!slot) {
+        m_missCount++;
+        return {};
+    }
+
+    m_hitCount++;
+    slot->lastUse = ++m_useCount;
+    return Thumbnail{buffer(slot - m_slots), slot->width, slot->height};
+}
+
+u32 ThumbnailCache::evict(std::span<const u32> pinnedDatabaseIds) {
+    Slot *victim = nullptr;
+    for (u32 i = 0; i < m_capacity; i++) {
+        Slot &slot = m_slots[i];
+        if (slot.databaseId != NoDatabaseId &&
+                std::find(pinnedDatabaseIds.begin(), pinnedDatabaseIds.end(), slot.databaseId) !=
+                        pinnedDatabaseIds.end()) {
+            continue;
+        }
+        if (!victim || slot.lastUse < victim->lastUse) {
+            victim = &slot;
+        }
+    }
+    assert(victim);
+
+    victim->databaseId = NoDatabaseId;
+    victim->lastUse = 0;
+    return victim - m_slots;
+}
+
+u8 *ThumbnailCache::buffer(u32 slot) {
+    assert(slot < m_capacity);
+    return m_buffers + slot * BufferSize;
+}
+
+ThumbnailCache::Thumbnail ThumbnailCache::insert(u32 slot, u32 databaseId, u16 width,
+        u16 height) {
+    assert(slot < m_capacity);
+    m_slots[slot] = {databaseId, width, height, ++m_useCount};
+    return Thumbnail{buffer(slot), width, height};
+}
+
+void ThumbnailCache::logStats() const {
+    SP_LOG("Thumbnail cache: %u hits, %u misses", m_hitCount, m_missCount);
+}
+
+ThumbnailCache::ThumbnailCache(EGG::Heap *heap, u32 reservedSize) {
+    u32 capacity = GlobalSettings::Get<GlobalSettings::Setting::ThumbnailCacheSize>();
+    capacity = std::max(capacity, MinCapacity);
+
+    u32 allocatableSize = heap->getAllocatableSize(0x20);
+    u32 availableSize = allocatableSize > reservedSize ? allocatableSize - reservedSize : 0;
+    u32 maxCapacity = availableSize / (BufferSize + sizeof(Slot));
+    if (maxCapacity < MinCapacity) {
+        SP_LOG("Not enough memory for the thumbnail cache (%u bytes available)", availableSize);
+        return;
+    }
+    if (maxCapacity < capacity) {
+        SP_LOG("Reducing the thumbnail cache from %u to %u thumbnails", capacity, maxCapacity);
+        capacity = maxCapacity;
+    }
+
+    m_buffers = new (heap, 0x20) u8[capacity * BufferSize];
+    m_slots = new (heap, 0x4) Slot[capacity];
+    if (!m_buffers || !m_slots) {
+        SP_LOG("Failed to allocate the thumbnail cache");
+        delete[] m_slots;
+        delete[] m_buffers;
+        m_slots = nullptr;
+        m_buffers = nullptr;
+        return;
+    }
+
+    m_capacity = capacity;
+    for (u32 i = 0; i < m_capacity; i++) {
+        m_slots[i] = {NoDatabaseId, 0, 0, 0};
+    }
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    delete[] m_buffers;
+    delete[] m_slots;
+}
+
+ThumbnailCache::Slot *ThumbnailCache::find(u32 databaseId) {
+    if (databaseId == NoDatabaseId) {
+        return nullptr;
+    }
+
+    for (u32 i = 0; i < m_capacity; i++) {
+        if (m_slots[i].databaseId == databaseId) {
+            return &m_slots[i];
+        }
+    }
+    return nullptr;
+}
+
+const ThumbnailCache::Slot *ThumbnailCache::find(u32 databaseId) const {
+    return const_cast<ThumbnailCache *>(this)->find(databaseId);
+}
+
+} // namespace SP
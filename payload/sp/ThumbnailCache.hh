@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Common.hh>
+#include <egg/core/eggHeap.hh>
+
+#include <optional>
+#include <span>
+
+namespace SP {
+
+// Decoded course thumbnails, kept across sheets for as long as CourseSelectPage exists. The number
+// of thumbnails is set by the ThumbnailCacheSize global setting, reduced to what the heap can hold,
+// and the least recently used one is evicted to make room for a new one. Only the thumbnail thread
+// of the page fills and reads it.
+class ThumbnailCache {
+public:
+    struct Thumbnail {
+        u8 *buffer;
+        u16 width;
+        u16 height;
+    };
+
+    static constexpr u32 MaxWidth = 256;
+    static constexpr u32 MaxHeight = 144;
+    // One I8 plane per color channel
+    static constexpr u32 BufferSize = 3 * MaxWidth * MaxHeight;
+    static_assert(MaxWidth % 8 == 0);
+    static_assert(MaxHeight % 4 == 0);
+
+    // Three sheets of buttons need to be cached at the same time. Below that, the cache is left
+    // empty, with a capacity of 0.
+    static constexpr u32 MinCapacity = 27;
+
+    // reservedSize is left free in the heap for the other allocations of the section.
+    ThumbnailCache(EGG::Heap *heap, u32 reservedSize);
+    ~ThumbnailCache();
+    ThumbnailCache(const ThumbnailCache &) = delete;
+    ThumbnailCache(ThumbnailCache &&) = delete;
+
+    u32 capacity() const;
+    bool contains(u32 databaseId) const;
+    std::optional<Thumbnail> get(u32 databaseId);
+    // Empties the least recently used slot whose thumbnail isn't pinned, and returns its index.
+    // As there are at most MinCapacity pinned thumbnails, there is always such a slot.
+    u32 evict(std::span<const u32> pinnedDatabaseIds);
+    u8 *buffer(u32 slot);
+    Thumbnail insert(u32 slot, u32 databaseId, u16 width, u16 height);
+    void logStats() const;
+
+private:
+    struct Slot {
+        u32 databaseId;
+        u16 width;
+        u16 height;
+        u32 lastUse;
+    };
+
+    Slot *find(u32 databaseId);
+    const Slot *find(u32 databaseId) const;
+
+    u32 m_capacity = 0;
+    Slot *m_slots = nullptr;
+    u8 *m_buffers = nullptr;
+    u32 m_useCount = 0;
+    u32 m_hitCount = 0;
+    u32 m_missCount = 0;
+};
+
+} // namespace SP
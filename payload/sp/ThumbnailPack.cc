@@ -0,0 +1,85 @@
+#include "ThumbnailPack.hh"
+
+#include <common/Bytes.hh>
+#include <egg/core/eggHeap.hh>
+
+#include <algorithm>
+
+namespace SP {
+
+ThumbnailPack::ThumbnailPack() = default;
+
+ThumbnailPack::~ThumbnailPack() = default;
+
+bool ThumbnailPack::open(const char *path) {
+    m_file = Storage::OpenRO(path);
+    if (!m_file) {
+        return false;
+    }
+
+    alignas(0x20) u8 header[0x20];
+    if (m_file->size() < sizeof(header) || !m_file->read(header, sizeof(header), 0)) {
+        m_file.reset();
+        return false;
+    }
+
+    if (Bytes::Read<u32>(header, 0x0) != 0x53505450 /* SPTP */) {
+        m_file.reset();
+        return false;
+    }
+
+    u32 count = Bytes::Read<u32>(header, 0x4);
+    u32 indexSize = AlignUp<u32>(0x8 + count * 0xc, 0x20);
+    if (indexSize > m_file->size()) {
+        m_file.reset();
+        return false;
+    }
+
+    std::unique_ptr<u8[]> index(new (0x20) u8[indexSize]);
+    if (!m_file->read(index.get(), indexSize, 0)) {
+        m_file.reset();
+        return false;
+    }
+
+    m_entries.reset(new Entry[count]);
+    for (u32 i = 0; i < count; i++) {
+        const u8 *src = index.get() + 0x8 + i * 0xc;
+        m_entries[i].databaseId = Bytes::Read<u32>(src, 0x0);
+        m_entries[i].width = Bytes::Read<u16>(src, 0x4);
+        m_entries[i].height = Bytes::Read<u16>(src, 0x6);
+        m_entries[i].offset = Bytes::Read<u32>(src, 0x8);
+    }
+    m_count = count;
+    return true;
+}
+
+const ThumbnailPack::Entry *ThumbnailPack::find(u32 databaseId) const {
+    auto *end = m_entries.get() + m_count;
+    auto *entry = std::lower_bound(m_entries.get(), end, databaseId,
+            [](const Entry &entry, u32 databaseId) { return entry.databaseId < databaseId; });
+    if (entry == end || entry->databaseId != databaseId) {
+        return nullptr;
+    }
+
+    return entry;
+}
+
+bool ThumbnailPack::read(const Entry &entry, u8 *dst) {
+    if (!m_file) {
+        return false;
+    }
+
+    u32 size = 3 * PlaneSize(entry.width, entry.height);
+    if (entry.offset + size > m_file->size()) {
+        return false;
+    }
+
+    return m_file->read(dst, size, entry.offset);
+}
+
+u32 ThumbnailPack::PlaneSize(u16 width, u16 height) {
+    // I8 textures are made of 8x4 tiles
+    return AlignUp<u32>(width, 8) * AlignUp<u32>(height, 4);
+}
+
+} // namespace SP
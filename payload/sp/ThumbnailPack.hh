@@ -0,0 +1,38 @@
+#pragma once
+
+#include "sp/storage/Storage.hh"
+
+#include <memory>
+
+namespace SP {
+
+// Thumbnails which are already in the layout of GX textures, written at build time by
+// thumbpack.py. Each thumbnail is made of one I8 plane per color channel, so it can be read into
+// a texture buffer in one go.
+class ThumbnailPack {
+public:
+    struct Entry {
+        u32 databaseId;
+        u16 width;
+        u16 height;
+        u32 offset;
+    };
+
+    ThumbnailPack();
+    ThumbnailPack(const ThumbnailPack &) = delete;
+    ThumbnailPack(ThumbnailPack &&) = delete;
+    ~ThumbnailPack();
+
+    bool open(const char *path);
+    const Entry *find(u32 databaseId) const;
+    bool read(const Entry &entry, u8 *dst);
+
+    static u32 PlaneSize(u16 width, u16 height);
+
+private:
+    std::optional<Storage::FileHandle> m_file{};
+    std::unique_ptr<Entry[]> m_entries{};
+    u32 m_count = 0;
+};
+
+} // namespace SP
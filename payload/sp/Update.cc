@@ -23,6 +23,7 @@ extern "C" {
 namespace SP::Update {
 
 #define TMP_CONTENTS_PATH "/tmp/contents.arc"
+#define CONTENTS_PATH TITLE_DATA_PATH "/contents.arc"
 
 // clang-format off
 static const u8 serverPK[hydro_kx_PUBLICKEYBYTES] = {
@@ -37,6 +38,40 @@ static const u8 signPK[hydro_sign_PUBLICKEYBYTES] = {
 static Status status = Status::Idle;
 static std::optional<Info> info;
 
+// A full download which was interrupted, resumed if the same update is still offered.
+struct Partial {
+    u8 signature[hydro_sign_BYTES];
+    u32 size;
+    hydro_sign_state state;
+};
+
+static std::optional<Partial> partial;
+// Set when patching the current contents failed, in which case they are not used again.
+static bool deltaFailed = false;
+
+// Operations of the deltas generated by the update server, see tools/updateserver/src/delta.rs.
+enum class DeltaOp : u8 {
+    Copy = 0,
+    Add = 1,
+};
+
+static const u32 DELTA_HEADER_SIZE = 0x9;
+
+struct Patch {
+    NANDFileInfo *base;
+    NANDFileInfo *file;
+    hydro_sign_state *state;
+    u8 header[DELTA_HEADER_SIZE];
+    u32 headerSize;
+    u32 addSize; // Remaining literal bytes of the current operation
+    u32 bufferSize;
+    u32 size;
+    u32 maxSize;
+};
+
+alignas(0x20) static u8 patchBuffer[0x1000];
+alignas(0x20) static u8 baseBuffer[0x1000];
+
 Status GetStatus() {
     return status;
 }
@@ -45,6 +80,106 @@ std::optional<Info> GetInfo() {
     return info;
 }
 
+static bool HasBase() {
+    NANDFileInfo fileInfo;
+    if (NANDPrivateOpen(CONTENTS_PATH, &fileInfo, NAND_ACCESS_READ) != NAND_RESULT_OK) {
+        return false;
+    }
+    NANDClose(&fileInfo);
+    return true;
+}
+
+static bool FlushPatch(Patch &patch) {
+    if (patch.bufferSize == 0) {
+        return true;
+    }
+    if (hydro_sign_update(patch.state, patchBuffer, patch.bufferSize) != 0) {
+        return false;
+    }
+    if (NANDWrite(patch.file, patchBuffer, patch.bufferSize) !=
+            static_cast<s32>(patch.bufferSize)) {
+        return false;
+    }
+    patch.bufferSize = 0;
+    return true;
+}
+
+static bool WritePatch(Patch &patch, const u8 *data, u32 size) {
+    if (size > patch.maxSize - patch.size) {
+        return false;
+    }
+    while (size != 0) {
+        u32 chunkSize = std::min(size, static_cast<u32>(sizeof(patchBuffer)) - patch.bufferSize);
+        memcpy(patchBuffer + patch.bufferSize, data, chunkSize);
+        patch.bufferSize += chunkSize;
+        patch.size += chunkSize;
+        data += chunkSize;
+        size -= chunkSize;
+        if (patch.bufferSize == sizeof(patchBuffer) && !FlushPatch(patch)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CopyPatch(Patch &patch, u32 offset, u32 size) {
+    if (NANDSeek(patch.base, offset, NAND_SEEK_SET) != static_cast<s32>(offset)) {
+        return false;
+    }
+    while (size != 0) {
+        u32 chunkSize = std::min(size, static_cast<u32>(sizeof(baseBuffer)));
+        if (NANDRead(patch.base, baseBuffer, chunkSize) != static_cast<s32>(chunkSize)) {
+            return false;
+        }
+        if (!WritePatch(patch, baseBuffer, chunkSize)) {
+            return false;
+        }
+        size -= chunkSize;
+    }
+    return true;
+}
+
+// Operations can span several messages, so the parsing state is kept in the patch.
+static bool ApplyPatch(Patch &patch, const u8 *delta, u32 size) {
+    while (size != 0) {
+        if (patch.addSize != 0) {
+            u32 chunkSize = std::min(size, patch.addSize);
+            if (!WritePatch(patch, delta, chunkSize)) {
+                return false;
+            }
+            patch.addSize -= chunkSize;
+            delta += chunkSize;
+            size -= chunkSize;
+            continue;
+        }
+
+        u32 chunkSize = std::min(size, DELTA_HEADER_SIZE - patch.headerSize);
+        memcpy(patch.header + patch.headerSize, delta, chunkSize);
+        patch.headerSize += chunkSize;
+        delta += chunkSize;
+        size -= chunkSize;
+        if (patch.headerSize != DELTA_HEADER_SIZE) {
+            continue;
+        }
+
+        patch.headerSize = 0;
+        u32 opSize = Bytes::Read<u32>(patch.header, 0x1);
+        switch (static_cast<DeltaOp>(patch.header[0x0])) {
+        case DeltaOp::Copy:
+            if (!CopyPatch(patch, Bytes::Read<u32>(patch.header, 0x5), opSize)) {
+                return false;
+            }
+            break;
+        case DeltaOp::Add:
+            patch.addSize = opSize;
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool Sync(bool update) {
     if (versionInfo.type != BUILD_TYPE_RELEASE) {
         return false;
@@ -68,6 +203,17 @@ static bool Sync(bool update) {
         request.versionPatch = versionInfo.patch;
         NWC24iStrLCpy(request.gameName, OSGetAppGamename(), sizeof(request.gameName));
         NWC24iStrLCpy(request.hostPlatform, Host_GetPlatformString(), sizeof(request.hostPlatform));
+        // The partial download is kept across checks, as a failed update is retried through
+        // Check, and is only dropped once an update with another signature starts.
+        bool resumes = update && partial &&
+                !memcmp(partial->signature, info->signature, hydro_sign_BYTES);
+        if (resumes) {
+            request.has_offset = true;
+            request.offset = partial->size;
+        }
+        // A delta is always sent whole, so it isn't asked for when a download can be resumed.
+        request.has_wantsDelta = true;
+        request.wantsDelta = update && !resumes && !deltaFailed && HasBase();
 
         assert(pb_encode(&stream, UpdateRequest_fields, &request));
 
@@ -76,6 +222,8 @@ static bool Sync(bool update) {
         }
     }
 
+    u32 offset = 0;
+    std::optional<u32> deltaSize;
     status = Status::ReceiveInfo;
     {
         u8 buffer[UpdateResponse_size];
@@ -110,49 +258,126 @@ static bool Sync(bool update) {
             info.reset();
             return false;
         }
+        if (partial && memcmp(partial->signature, info->signature, hydro_sign_BYTES)) {
+            partial.reset();
+        }
+        if (response.has_offset) {
+            offset = response.offset;
+        }
+        if (response.has_deltaSize) {
+            deltaSize = response.deltaSize;
+        }
     }
 
     status = Status::Download;
     {
         OSTime startTime = OSGetTime();
         hydro_sign_state state;
-        if (hydro_sign_init(&state, "update  ") != 0) {
-            return false;
-        }
-        NANDPrivateDelete(TMP_CONTENTS_PATH);
-        u8 perms = NAND_PERM_OWNER_MASK | NAND_PERM_GROUP_MASK | NAND_PERM_OTHER_MASK;
-        if (NANDPrivateCreate(TMP_CONTENTS_PATH, perms, 0) != NAND_RESULT_OK) {
-            return false;
-        }
         NANDFileInfo fileInfo;
-        if (NANDPrivateOpen(TMP_CONTENTS_PATH, &fileInfo, NAND_ACCESS_WRITE) != NAND_RESULT_OK) {
-            return false;
-        }
-        for (info->downloadedSize = 0; info->downloadedSize < info->size;) {
-            alignas(0x20) u8 message[0x1000] = {};
-            u16 chunkSize = std::min(info->size - info->downloadedSize, static_cast<u32>(0x1000));
-            if (!socket.read(message, chunkSize)) {
+        if (offset != 0) {
+            if (!partial || partial->size != offset) {
+                return false;
+            }
+            state = partial->state;
+            if (NANDPrivateOpen(TMP_CONTENTS_PATH, &fileInfo, NAND_ACCESS_WRITE) !=
+                    NAND_RESULT_OK) {
+                return false;
+            }
+            if (NANDSeek(&fileInfo, offset, NAND_SEEK_SET) != static_cast<s32>(offset)) {
                 NANDClose(&fileInfo);
                 return false;
             }
-            if (hydro_sign_update(&state, message, chunkSize) != 0) {
+        } else {
+            if (hydro_sign_init(&state, "update  ") != 0) {
+                return false;
+            }
+            NANDPrivateDelete(TMP_CONTENTS_PATH);
+            u8 perms = NAND_PERM_OWNER_MASK | NAND_PERM_GROUP_MASK | NAND_PERM_OTHER_MASK;
+            if (NANDPrivateCreate(TMP_CONTENTS_PATH, perms, 0) != NAND_RESULT_OK) {
+                return false;
+            }
+            if (NANDPrivateOpen(TMP_CONTENTS_PATH, &fileInfo, NAND_ACCESS_WRITE) !=
+                    NAND_RESULT_OK) {
+                return false;
+            }
+        }
+        partial.reset();
+        if (deltaSize) {
+            NANDFileInfo baseInfo;
+            if (NANDPrivateOpen(CONTENTS_PATH, &baseInfo, NAND_ACCESS_READ) != NAND_RESULT_OK) {
                 NANDClose(&fileInfo);
+                deltaFailed = true;
                 return false;
             }
-            if (NANDWrite(&fileInfo, message, chunkSize) != chunkSize) {
+            Patch patch{};
+            patch.base = &baseInfo;
+            patch.file = &fileInfo;
+            patch.state = &state;
+            patch.maxSize = info->size;
+            for (u32 deltaOffset = 0; deltaOffset < *deltaSize;) {
+                alignas(0x20) u8 message[0x1000] = {};
+                u16 chunkSize = std::min(*deltaSize - deltaOffset, static_cast<u32>(0x1000));
+                if (!socket.read(message, chunkSize)) {
+                    NANDClose(&baseInfo);
+                    NANDClose(&fileInfo);
+                    return false;
+                }
+                if (!ApplyPatch(patch, message, chunkSize)) {
+                    NANDClose(&baseInfo);
+                    NANDClose(&fileInfo);
+                    deltaFailed = true;
+                    return false;
+                }
+                deltaOffset += chunkSize;
+                info->downloadedSize = patch.size;
+                OSTime duration = OSGetTime() - startTime;
+                info->throughput = OSSecondsToTicks(static_cast<u64>(deltaOffset)) / duration;
+            }
+            NANDClose(&baseInfo);
+            if (patch.headerSize != 0 || patch.addSize != 0 || !FlushPatch(patch) ||
+                    patch.size != info->size) {
                 NANDClose(&fileInfo);
+                deltaFailed = true;
                 return false;
             }
-            info->downloadedSize += chunkSize;
-            OSTime duration = OSGetTime() - startTime;
-            info->throughput = OSSecondsToTicks(static_cast<u64>(info->downloadedSize)) / duration;
+        } else {
+            partial.emplace();
+            memcpy(partial->signature, info->signature, sizeof(partial->signature));
+            partial->size = offset;
+            partial->state = state;
+            for (info->downloadedSize = offset; info->downloadedSize < info->size;) {
+                alignas(0x20) u8 message[0x1000] = {};
+                u16 chunkSize =
+                        std::min(info->size - info->downloadedSize, static_cast<u32>(0x1000));
+                if (!socket.read(message, chunkSize)) {
+                    NANDClose(&fileInfo);
+                    return false;
+                }
+                if (hydro_sign_update(&state, message, chunkSize) != 0) {
+                    NANDClose(&fileInfo);
+                    return false;
+                }
+                if (NANDWrite(&fileInfo, message, chunkSize) != chunkSize) {
+                    NANDClose(&fileInfo);
+                    return false;
+                }
+                info->downloadedSize += chunkSize;
+                partial->size = info->downloadedSize;
+                partial->state = state;
+                OSTime duration = OSGetTime() - startTime;
+                u64 downloadedSize = info->downloadedSize - offset;
+                info->throughput = OSSecondsToTicks(downloadedSize) / duration;
+            }
         }
         if (NANDClose(&fileInfo) != NAND_RESULT_OK) {
             return false;
         }
         if (hydro_sign_final_verify(&state, info->signature, signPK) != 0) {
+            deltaFailed = deltaFailed || deltaSize;
+            partial.reset();
             return false;
         }
+        partial.reset();
     }
 
     status = Status::Move;
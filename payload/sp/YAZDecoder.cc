@@ -3,6 +3,8 @@
 #include <common/Bytes.hh>
 
 #include <algorithm>
+#include <bit>
+#include <cstring>
 
 namespace SP {
 
@@ -83,11 +85,52 @@ bool YAZDecoder::process(const u8 *src, size_t &srcOffset) {
     assert(false);
 }
 
+bool YAZDecoder::processGroup(const u8 *src, size_t &srcOffset) {
+    u8 groupHeader = src[srcOffset++];
+    for (u32 i = 0; i < 8;) {
+        u32 copySize = std::min(static_cast<u32>(std::countl_one(groupHeader)), 8 - i);
+        if (copySize != 0) {
+            memcpy(m_dst + m_dstOffset, src + srcOffset, copySize);
+            m_dstOffset += copySize;
+            srcOffset += copySize;
+            groupHeader <<= copySize;
+            i += copySize;
+            continue;
+        }
+
+        u8 val = src[srcOffset++];
+        u16 refOffset = (val << 8 & 0xf00) + src[srcOffset++] + 0x1;
+        u16 refSize = (val >> 4) + 0x2;
+        if (refSize == 0x2) {
+            refSize = src[srcOffset++] + 0x12;
+        }
+        if (refOffset > m_dstOffset) {
+            return false;
+        }
+
+        u8 *dst = m_dst + m_dstOffset;
+        const u8 *ref = dst - refOffset;
+        if (refOffset >= refSize) {
+            memcpy(dst, ref, refSize);
+        } else if (refOffset == 0x1) {
+            memset(dst, *ref, refSize);
+        } else {
+            for (u16 j = 0; j < refSize; j++) {
+                dst[j] = ref[j];
+            }
+        }
+        m_dstOffset += refSize;
+        groupHeader <<= 1;
+        i++;
+    }
+    return true;
+}
+
 bool YAZDecoder::decode(const u8 *src, size_t srcSize) {
     assert(ok() && !done());
 
     size_t srcOffset = 0;
-    do {
+    while (true) {
         if (m_dstOffset == m_dstSize) {
             if (m_state == State::GroupHeader) {
                 return true;
@@ -96,12 +139,27 @@ bool YAZDecoder::decode(const u8 *src, size_t srcSize) {
             return false;
         }
 
+        // Whole groups that are fully buffered, and cannot overrun the destination, bypass the
+        // resumable state machine, which is then only used around chunk and buffer boundaries.
+        if (m_state == State::GroupHeader && m_groupHeaderIndex == 7 &&
+                srcSize - srcOffset >= MAX_GROUP_SRC_SIZE &&
+                m_dstSize - m_dstOffset >= MAX_GROUP_DST_SIZE) {
+            if (!processGroup(src, srcOffset)) {
+                break;
+            }
+            continue;
+        }
+
         if (srcOffset == srcSize &&
                 ((m_state != State::GroupHeader || m_groupHeaderIndex == 7) &&
                         m_state != State::RefCopy)) {
             return true;
         }
-    } while (process(src, srcOffset));
+
+        if (!process(src, srcOffset)) {
+            break;
+        }
+    }
 
     m_ok = false;
     return false;
@@ -38,6 +38,7 @@ private:
     YAZDecoder(u8 *dst, size_t dstSize);
 
     bool process(const u8 *src, size_t &srcOffset);
+    bool processGroup(const u8 *src, size_t &srcOffset);
 
     bool m_owning = true;
     u8 *m_dst = nullptr;
@@ -50,6 +51,10 @@ private:
     u16 m_refOffset;
     bool m_ok = true;
 
+    // Worst case for a whole group: the header followed by 8 three-byte refs of 0x111 bytes each
+    static const size_t MAX_GROUP_SRC_SIZE = 1 + 8 * 3;
+    static const size_t MAX_GROUP_DST_SIZE = 8 * 0x111;
+
     static const u32 YAZ0_MAGIC;
     static const u32 YAZ1_MAGIC;
 };
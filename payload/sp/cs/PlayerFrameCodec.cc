@@ -0,0 +1,132 @@
+#include "PlayerFrameCodec.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SP::PlayerFrameCodec {
+
+static const f32 POS_SCALE = 16.0f;
+static const f32 INTERNAL_SPEED_SCALE = 256.0f;
+static const f32 INTERNAL_SPEED_MIN = -20.0f;
+static const f32 INTERNAL_SPEED_MAX = 120.0f;
+static const u32 ROT_BITS = 10;
+static const u32 ROT_MAX = (1 << ROT_BITS) - 1;
+// The components other than the largest one are at most 1 / sqrt(2) in magnitude.
+static const f32 ROT_RANGE = 0.70710678f;
+
+static u32 PackInputState(const InputState &inputState) {
+    u32 packed = 0;
+    packed |= inputState.accelerate << 0;
+    packed |= inputState.brake << 1;
+    packed |= inputState.item << 2;
+    packed |= inputState.drift << 3;
+    packed |= inputState.brakeDrift << 4;
+    packed |= (inputState.stickX & 0xf) << 5;
+    packed |= (inputState.stickY & 0xf) << 9;
+    packed |= (inputState.trick & 0x7) << 13;
+    return packed;
+}
+
+static InputState UnpackInputState(u32 packed) {
+    InputState inputState;
+    inputState.accelerate = packed >> 0 & 1;
+    inputState.brake = packed >> 1 & 1;
+    inputState.item = packed >> 2 & 1;
+    inputState.drift = packed >> 3 & 1;
+    inputState.brakeDrift = packed >> 4 & 1;
+    inputState.stickX = packed >> 5 & 0xf;
+    inputState.stickY = packed >> 9 & 0xf;
+    inputState.trick = packed >> 13 & 0x7;
+    return inputState;
+}
+
+static u32 PackTime(u32 time) {
+    return std::min<u32>(time, 0xff);
+}
+
+static u32 PackRot(const PlayerFrame_Quat &rot) {
+    std::array<f32, 4> components{rot.x, rot.y, rot.z, rot.w};
+    u32 largest = 0;
+    for (u32 i = 1; i < 4; i++) {
+        if (std::abs(components[i]) > std::abs(components[largest])) {
+            largest = i;
+        }
+    }
+    // q and -q are the same rotation, so the sign of the largest component is not needed.
+    f32 sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+    u32 packed = largest << (3 * ROT_BITS);
+    u32 shift = 2 * ROT_BITS;
+    for (u32 i = 0; i < 4; i++) {
+        if (i == largest) {
+            continue;
+        }
+        f32 component = std::clamp(sign * components[i] / ROT_RANGE, -1.0f, 1.0f);
+        u32 quantized = std::lround((component + 1.0f) / 2.0f * ROT_MAX);
+        packed |= quantized << shift;
+        shift -= ROT_BITS;
+    }
+    return packed;
+}
+
+static PlayerFrame_Quat UnpackRot(u32 packed) {
+    u32 largest = packed >> (3 * ROT_BITS);
+    std::array<f32, 4> components;
+    f32 sum = 0.0f;
+    u32 shift = 2 * ROT_BITS;
+    for (u32 i = 0; i < 4; i++) {
+        if (i == largest) {
+            continue;
+        }
+        u32 quantized = packed >> shift & ROT_MAX;
+        components[i] = (static_cast<f32>(quantized) / ROT_MAX * 2.0f - 1.0f) * ROT_RANGE;
+        sum += components[i] * components[i];
+        shift -= ROT_BITS;
+    }
+    components[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+    return {components[0], components[1], components[2], components[3]};
+}
+
+void Pack(const PlayerFrame &frame, const Pos &basePos, PackedPlayerFrame &packed, Pos &pos) {
+    packed.inputState = PackInputState(frame.inputState);
+    packed.respawnTimes = PackTime(frame.timeBeforeRespawn) | PackTime(frame.timeInRespawn) << 8;
+    packed.boostTimes = 0;
+    for (u32 i = 0; i < frame.timesBeforeBoostEnd_count; i++) {
+        packed.boostTimes |= PackTime(frame.timesBeforeBoostEnd[i]) << (i * 8);
+    }
+    Pos quantizedPos;
+    quantizedPos[0] = std::lround(frame.pos.x * POS_SCALE);
+    quantizedPos[1] = std::lround(frame.pos.y * POS_SCALE);
+    quantizedPos[2] = std::lround(frame.pos.z * POS_SCALE);
+    packed.posX = quantizedPos[0] - basePos[0];
+    packed.posY = quantizedPos[1] - basePos[1];
+    packed.posZ = quantizedPos[2] - basePos[2];
+    pos = quantizedPos;
+    packed.mainRot = PackRot(frame.mainRot);
+    f32 internalSpeed =
+            std::clamp(frame.internalSpeed, INTERNAL_SPEED_MIN, INTERNAL_SPEED_MAX);
+    packed.internalSpeed = std::lround((internalSpeed - INTERNAL_SPEED_MIN) * INTERNAL_SPEED_SCALE);
+}
+
+void Unpack(const PackedPlayerFrame &packed, const Pos &basePos, PlayerFrame &frame, Pos &pos) {
+    frame.inputState = UnpackInputState(packed.inputState);
+    frame.timeBeforeRespawn = packed.respawnTimes >> 0 & 0xff;
+    frame.timeInRespawn = packed.respawnTimes >> 8 & 0xff;
+    frame.timesBeforeBoostEnd_count = 3;
+    for (u32 i = 0; i < 3; i++) {
+        frame.timesBeforeBoostEnd[i] = packed.boostTimes >> (i * 8) & 0xff;
+    }
+    // Wrapping is fine, as the result is validated anyway.
+    Pos quantizedPos;
+    quantizedPos[0] = static_cast<u32>(basePos[0]) + static_cast<u32>(packed.posX);
+    quantizedPos[1] = static_cast<u32>(basePos[1]) + static_cast<u32>(packed.posY);
+    quantizedPos[2] = static_cast<u32>(basePos[2]) + static_cast<u32>(packed.posZ);
+    frame.pos.x = quantizedPos[0] / POS_SCALE;
+    frame.pos.y = quantizedPos[1] / POS_SCALE;
+    frame.pos.z = quantizedPos[2] / POS_SCALE;
+    pos = quantizedPos;
+    frame.mainRot = UnpackRot(packed.mainRot);
+    frame.internalSpeed = packed.internalSpeed / INTERNAL_SPEED_SCALE + INTERNAL_SPEED_MIN;
+}
+
+} // namespace SP::PlayerFrameCodec
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Common.hh>
+#include <protobuf/Room.pb.h>
+
+#include <array>
+
+namespace SP::PlayerFrameCodec {
+
+// A position in fixed point. Positions are sent relative to a base position known to both sides,
+// which must be the quantized one to avoid drift.
+using Pos = std::array<s32, 3>;
+
+// Stores the quantized position of frame to pos, which may alias basePos.
+void Pack(const PlayerFrame &frame, const Pos &basePos, PackedPlayerFrame &packed, Pos &pos);
+// The result still has to be validated, as any packed frame is accepted.
+void Unpack(const PackedPlayerFrame &packed, const Pos &basePos, PlayerFrame &frame, Pos &pos);
+
+} // namespace SP::PlayerFrameCodec
@@ -54,31 +54,40 @@ void RaceClient::calcWrite() {
     RoomRequest request;
     request.which_request = RoomRequest_race_tag;
     request.request.race.time = System::RaceManager::Instance()->time();
+    request.request.race.has_serverTime = m_frame.has_value();
     request.request.race.serverTime = m_frame ? m_frame->time : 0;
     request.request.race.players_count = raceScenario.localPlayerCount;
     for (u8 i = 0; i < raceScenario.localPlayerCount; i++) {
         u8 playerId = raceScenario.screenPlayerIds[i];
         auto *player = System::RaceManager::Instance()->player(playerId);
         auto &inputState = player->padProxy()->currentRaceInputState();
-        request.request.race.players[i].inputState.accelerate = inputState.accelerate;
-        request.request.race.players[i].inputState.brake = inputState.brake;
-        request.request.race.players[i].inputState.item = inputState.item;
-        request.request.race.players[i].inputState.drift = inputState.drift;
-        request.request.race.players[i].inputState.brakeDrift = inputState.brakeDrift;
-        request.request.race.players[i].inputState.stickX = inputState.rawStick.x;
-        request.request.race.players[i].inputState.stickY = inputState.rawStick.y;
-        request.request.race.players[i].inputState.trick = inputState.rawTrick;
+        PlayerFrame frame;
+        frame.inputState.accelerate = inputState.accelerate;
+        frame.inputState.brake = inputState.brake;
+        frame.inputState.item = inputState.item;
+        frame.inputState.drift = inputState.drift;
+        frame.inputState.brakeDrift = inputState.brakeDrift;
+        frame.inputState.stickX = inputState.rawStick.x;
+        frame.inputState.stickY = inputState.rawStick.y;
+        frame.inputState.trick = inputState.rawTrick;
         auto *object = Kart::KartObjectManager::Instance()->object(playerId);
-        request.request.race.players[i].timeBeforeRespawn = object->getTimeBeforeRespawn();
-        request.request.race.players[i].timeInRespawn = object->getTimeInRespawn();
-        request.request.race.players[i].timesBeforeBoostEnd_count = 3;
+        frame.timeBeforeRespawn = object->getTimeBeforeRespawn();
+        frame.timeInRespawn = object->getTimeInRespawn();
+        frame.timesBeforeBoostEnd_count = 3;
         for (u32 j = 0; j < 3; j++) {
-            request.request.race.players[i].timesBeforeBoostEnd[j] =
-                    object->getTimeBeforeBoostEnd(j * 2);
+            frame.timesBeforeBoostEnd[j] = object->getTimeBeforeBoostEnd(j * 2);
         }
-        request.request.race.players[i].pos = *object->getPos();
-        request.request.race.players[i].mainRot = *object->getMainRot();
-        request.request.race.players[i].internalSpeed = object->getInternalSpeed();
+        frame.pos = *object->getPos();
+        frame.mainRot = *object->getMainRot();
+        frame.internalSpeed = object->getInternalSpeed();
+        PlayerFrameCodec::Pack(frame, m_sentPos[i], request.request.race.players[i], m_sentPos[i]);
+    }
+
+    if (m_frame && (!m_ackedFrames.back() || m_ackedFrames.back()->time != m_frame->time)) {
+        if (m_ackedFrames.full()) {
+            m_ackedFrames.pop_front();
+        }
+        m_ackedFrames.push_back({m_frame->time, m_framePos});
     }
 
     u8 buffer[RoomRequest_size];
@@ -97,7 +106,7 @@ void RaceClient::calcRead() {
     ConnectionGroup connectionGroup(*this);
 
     while (true) {
-        u8 buffer[RaceServerFrame_size];
+        u8 buffer[PackedRaceServerFrame_size];
         auto read = m_socket.read(buffer, sizeof(buffer), connectionGroup);
         if (!read) {
             break;
@@ -105,14 +114,21 @@ void RaceClient::calcRead() {
 
         pb_istream_t stream = pb_istream_from_buffer(buffer, read->size);
 
+        PackedRaceServerFrame packedFrame;
+        if (!pb_decode(&stream, PackedRaceServerFrame_fields, &packedFrame)) {
+            continue;
+        }
+
         RaceServerFrame frame;
-        if (!pb_decode(&stream, RaceServerFrame_fields, &frame)) {
+        std::array<PlayerFrameCodec::Pos, 12> pos;
+        if (!unpackFrame(packedFrame, frame, pos)) {
             continue;
         }
 
         if (isFrameValid(frame)) {
             m_frameCount++;
             m_frame = frame;
+            m_framePos = pos;
         }
     }
 
@@ -158,12 +174,39 @@ RaceClient *RaceClient::Instance() {
 RaceClient::RaceClient(RoomClient &roomClient)
     : m_roomClient(roomClient),
       m_socket("race    ", {}), m_connection{roomClient.ip(), roomClient.port(),
-                                        roomClient.keypair()} {}
+                                        roomClient.keypair(), roomClient.connectionTag()} {}
 
 RaceClient::~RaceClient() {
     hydro_memzero(&m_connection, sizeof(m_connection));
 }
 
+bool RaceClient::unpackFrame(const PackedRaceServerFrame &packedFrame, RaceServerFrame &frame,
+        std::array<PlayerFrameCodec::Pos, 12> &pos) {
+    const std::array<PlayerFrameCodec::Pos, 12> *basePos = nullptr;
+    if (packedFrame.has_baseTime) {
+        // The server always uses the latest acknowledgement it has received.
+        while (m_ackedFrames.front() && m_ackedFrames.front()->time < packedFrame.baseTime) {
+            m_ackedFrames.pop_front();
+        }
+        if (!m_ackedFrames.front() || m_ackedFrames.front()->time != packedFrame.baseTime) {
+            return false;
+        }
+        basePos = &m_ackedFrames.front()->pos;
+    }
+
+    frame.time = packedFrame.time;
+    frame.playerTimes_count = packedFrame.playerTimes_count;
+    for (u32 i = 0; i < packedFrame.playerTimes_count; i++) {
+        frame.playerTimes[i] = packedFrame.playerTimes[i];
+    }
+    frame.players_count = packedFrame.players_count;
+    for (u32 i = 0; i < packedFrame.players_count; i++) {
+        PlayerFrameCodec::Pos playerBasePos = basePos ? (*basePos)[i] : PlayerFrameCodec::Pos{};
+        PlayerFrameCodec::Unpack(packedFrame.players[i], playerBasePos, frame.players[i], pos[i]);
+    }
+    return true;
+}
+
 bool RaceClient::isFrameValid(const RaceServerFrame &frame) {
     if (m_frame && frame.time <= m_frame->time) {
         return false;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "sp/CircularBuffer.hh"
+#include "sp/cs/PlayerFrameCodec.hh"
 #include "sp/cs/RaceManager.hh"
 #include "sp/cs/RoomClient.hh"
 
@@ -34,9 +35,18 @@ private:
         RaceClient &m_client;
     };
 
+    // The positions of a server frame that has been acknowledged, which the server may use as a
+    // base for later frames.
+    struct AckedFrame {
+        u32 time;
+        std::array<PlayerFrameCodec::Pos, 12> pos;
+    };
+
     RaceClient(RoomClient &roomClient);
     ~RaceClient();
 
+    bool unpackFrame(const PackedRaceServerFrame &packedFrame, RaceServerFrame &frame,
+            std::array<PlayerFrameCodec::Pos, 12> &pos);
     bool isFrameValid(const RaceServerFrame &frame);
 
     static bool IsVec3Valid(const PlayerFrame_Vec3 &v);
@@ -48,6 +58,9 @@ private:
     Net::UnreliableSocket::Connection m_connection;
     u32 m_frameCount = 0;
     std::optional<RaceServerFrame> m_frame{};
+    std::array<PlayerFrameCodec::Pos, 12> m_framePos{};
+    CircularBuffer<AckedFrame, 32> m_ackedFrames;
+    std::array<PlayerFrameCodec::Pos, 2> m_sentPos{};
     /*CircularBuffer<s32, 60> m_drifts;
     s32 m_drift = 0;*/
 
@@ -3,6 +3,7 @@
 #include "sp/settings/RegionLineColor.hh"
 
 #include <egg/core/eggHeap.hh>
+#include <game/system/ResourceManager.hh>
 #include <game/system/RootScene.hh>
 #include <game/system/SaveManager.hh>
 #include <game/ui/GlobalContext.hh>
@@ -84,6 +85,10 @@ hydro_kx_session_keypair RoomClient::keypair() const {
     return m_socket.keypair();
 }
 
+u32 RoomClient::connectionTag() const {
+    return m_connectionTag;
+}
+
 Net::AsyncSocket &RoomClient::socket() {
     return m_socket;
 }
@@ -241,6 +246,9 @@ std::optional<RoomClient::State> RoomClient::calcSetup(Handler &handler) {
             }
         }
         return State::Setup;
+    case RoomEvent_connection_tag:
+        m_connectionTag = event->event.connection.tag;
+        return State::Setup;
     case RoomEvent_settings_tag:
         if (m_playerCount == 0) {
             auto *saveManager = System::SaveManager::Instance();
@@ -523,6 +531,13 @@ bool RoomClient::onReceiveInfo(Handler &handler, RoomEvent event) {
         handler.onReceiveInfo(i, properties.course, event.event.selectInfo.selectedPlayer,
                 properties.character, properties.vehicle);
     }
+
+    // Start decoding the course right away, the roulette only reveals it a few seconds later.
+    u32 selectedPlayer = event.event.selectInfo.selectedPlayer;
+    if (selectedPlayer < event.event.selectInfo.playerProperties_count) {
+        u32 course = event.event.selectInfo.playerProperties[selectedPlayer].course;
+        System::ResourceManager::Instance()->preloadCourseAsync(course);
+    }
     return true;
 }
 
@@ -27,6 +27,7 @@ public:
     u32 ip() const;
     u16 port() const;
     hydro_kx_session_keypair keypair() const;
+    u32 connectionTag() const;
     Net::AsyncSocket &socket();
 
     // Request writing interface - new requests should go here!
@@ -91,6 +92,7 @@ private:
     Net::AsyncSocket m_socket;
     u32 m_ip;
     u16 m_port;
+    u32 m_connectionTag = 0;
     std::optional<LoginInfo> m_loginInfo;
     std::optional<u32> m_errorCode;
     bool m_reportedError;
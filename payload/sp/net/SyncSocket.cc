@@ -83,7 +83,8 @@ SyncSocket::SyncSocket(const char *hostname, u16 port, const u8 serverPK[hydro_k
 }
 
 SyncSocket::SyncSocket(SyncSocket &&that)
-    : m_handle(that.m_handle), m_keypair(that.m_keypair), m_messageID(that.m_messageID) {
+    : m_handle(that.m_handle), m_keypair(that.m_keypair), m_messageID(that.m_messageID),
+      m_readMessageID(that.m_readMessageID) {
     memcpy(m_context, that.m_context, sizeof(m_context));
     hydro_memzero(&that.m_keypair, sizeof(that.m_keypair));
     that.m_handle = -1;
@@ -93,6 +94,7 @@ SyncSocket &SyncSocket::operator=(SyncSocket &&that) {
     m_handle = that.m_handle;
     m_keypair = that.m_keypair;
     m_messageID = that.m_messageID;
+    m_readMessageID = that.m_readMessageID;
     memcpy(m_context, that.m_context, sizeof(m_context));
     hydro_memzero(&that.m_keypair, sizeof(that.m_keypair));
     that.m_handle = -1;
@@ -111,6 +113,7 @@ bool SyncSocket::ok() const {
 }
 
 std::optional<u16> SyncSocket::read(u8 *message, u16 maxSize) {
+    u64 &messageID = m_readMessageID ? *m_readMessageID : m_messageID;
     auto tmp = Alloc<u8>(sizeof(u16) + hydro_secretbox_HEADERBYTES + maxSize);
     for (u16 offset = 0; offset < sizeof(u16);) {
         s32 result = SORecv(m_handle, tmp.get() + offset, sizeof(u16) - offset, 0);
@@ -124,7 +127,7 @@ std::optional<u16> SyncSocket::read(u8 *message, u16 maxSize) {
     u16 size = Bytes::Read<u16>(tmp.get(), 0);
     if (size > GetSize(tmp) - sizeof(u16)) {
         SP_LOG("Message %llu is larger than the allotted buffer size (0x%04X > 0x%04X)",
-                m_messageID, size, GetSize(tmp) - sizeof(u16));
+                messageID, size, GetSize(tmp) - sizeof(u16));
         return {};
     }
 
@@ -138,7 +141,7 @@ std::optional<u16> SyncSocket::read(u8 *message, u16 maxSize) {
     }
 
     const u8 *key = m_keypair.rx;
-    if (hydro_secretbox_decrypt(message, tmp.get() + sizeof(u16), size, m_messageID++, m_context,
+    if (hydro_secretbox_decrypt(message, tmp.get() + sizeof(u16), size, messageID++, m_context,
                 key) != 0) {
         SP_LOG("Failed to decrypt message");
         return {};
@@ -164,4 +167,15 @@ bool SyncSocket::write(const u8 *message, u16 size) {
     return true;
 }
 
+void SyncSocket::separateMessageIDs() {
+    m_readMessageID = m_messageID;
+}
+
+void SyncSocket::joinMessageIDs() {
+    if (m_readMessageID) {
+        m_messageID = *m_readMessageID;
+        m_readMessageID.reset();
+    }
+}
+
 } // namespace SP::Net
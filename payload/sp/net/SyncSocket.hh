@@ -24,11 +24,19 @@ public:
     std::optional<u16> read(u8 *message, u16 maxSize);
     bool write(const u8 *message, u16 size);
 
+    // Numbers the messages read from now on separately from the written ones, starting from the
+    // next number of the shared sequence, for protocols where both directions can have messages in
+    // flight at once.
+    void separateMessageIDs();
+    // Goes back to a single sequence, continuing from the number of the next message to be read
+    void joinMessageIDs();
+
 private:
     s32 m_handle = -1;
     hydro_kx_session_keypair m_keypair;
     char m_context[hydro_secretbox_CONTEXTBYTES];
     u64 m_messageID = 0;
+    std::optional<u64> m_readMessageID{};
 };
 
 } // namespace SP::Net
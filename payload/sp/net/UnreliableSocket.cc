@@ -67,18 +67,33 @@ std::optional<UnreliableSocket::Read> UnreliableSocket::read(u8 *message, u16 ma
             return {};
         }
 
-        if (hydro_secretbox_HEADERBYTES + maxSize < result) {
+        size_t size = result;
+        if (size < TAG_SIZE + hydro_secretbox_HEADERBYTES ||
+                size > TAG_SIZE + hydro_secretbox_HEADERBYTES + maxSize) {
             SP_LOG("Failed to decrypt message");
             continue;
         }
 
+        // Only the connection with the tag of the datagram can decrypt it, other connections are
+        // only tried if there is none, as is the case with connections that have no tag yet.
+        u32 tag = Bytes::Read<u32>(buffer, 0);
+        std::optional<u32> index = findConnection(tag, connectionGroup);
+        if (index) {
+            if (decrypt(message, buffer, size, connectionGroup[*index])) {
+                connectionGroup[*index].ip = address.addr.addr;
+                connectionGroup[*index].port = address.port;
+                return Read{static_cast<u16>(size - TAG_SIZE - hydro_secretbox_HEADERBYTES),
+                        *index};
+            }
+            continue;
+        }
+
         for (u8 i = 0; i < connectionGroup.count(); i++) {
-            if (hydro_secretbox_decrypt(message, buffer, result, 0, m_context,
-                        connectionGroup[i].keypair.rx) == 0) {
+            if (decrypt(message, buffer, size, connectionGroup[i])) {
                 // TODO: this sucks
                 connectionGroup[i].ip = address.addr.addr;
                 connectionGroup[i].port = address.port;
-                return Read{static_cast<u16>(result - hydro_secretbox_HEADERBYTES), i};
+                return Read{static_cast<u16>(size - TAG_SIZE - hydro_secretbox_HEADERBYTES), i};
             }
         }
     }
@@ -90,13 +105,15 @@ bool UnreliableSocket::write(const u8 *message, u16 size, const Connection &conn
     assert(m_handle >= 0);
 
     u8 buffer[1024];
-    assert(size + hydro_secretbox_HEADERBYTES > size);
-    assert(static_cast<u32>(size + hydro_secretbox_HEADERBYTES) <= sizeof(buffer));
-    if (hydro_secretbox_encrypt(buffer, message, size, 0, m_context, connection.keypair.tx) != 0) {
+    assert(size + TAG_SIZE + hydro_secretbox_HEADERBYTES > size);
+    assert(static_cast<u32>(size + TAG_SIZE + hydro_secretbox_HEADERBYTES) <= sizeof(buffer));
+    Bytes::Write<u32>(buffer, 0, connection.tag);
+    if (hydro_secretbox_encrypt(buffer + TAG_SIZE, message, size, 0, m_context,
+                connection.keypair.tx) != 0) {
         SP_LOG("Failed to encrypt message");
         return false;
     }
-    size += hydro_secretbox_HEADERBYTES;
+    size += TAG_SIZE + hydro_secretbox_HEADERBYTES;
 
     SOSockAddrIn address{};
     address.len = sizeof(address);
@@ -113,6 +130,21 @@ bool UnreliableSocket::write(const u8 *message, u16 size, const Connection &conn
     return true;
 }
 
+std::optional<u32> UnreliableSocket::findConnection(u32 tag, ConnectionGroup &connectionGroup) {
+    for (u32 i = 0; i < connectionGroup.count(); i++) {
+        if (connectionGroup[i].tag == tag) {
+            return i;
+        }
+    }
+    return {};
+}
+
+bool UnreliableSocket::decrypt(u8 *message, const u8 *buffer, size_t size,
+        const Connection &connection) {
+    return hydro_secretbox_decrypt(message, buffer + TAG_SIZE, size - TAG_SIZE, 0, m_context,
+                   connection.keypair.rx) == 0;
+}
+
 bool UnreliableSocket::makeNonBlocking() {
     s32 result = SOFcntl(m_handle, SO_F_GETFL, 0);
     if (result < 0) {
@@ -18,6 +18,7 @@ public:
         u32 ip;
         u16 port;
         hydro_kx_session_keypair keypair;
+        u32 tag; // Prefixed to each datagram, in the clear
     };
 
     class ConnectionGroup {
@@ -40,8 +41,13 @@ public:
     bool write(const u8 *message, u16 size, const Connection &connection);
 
 private:
+    bool decrypt(u8 *message, const u8 *buffer, size_t size, const Connection &connection);
     bool makeNonBlocking();
 
+    static std::optional<u32> findConnection(u32 tag, ConnectionGroup &connectionGroup);
+
+    static const size_t TAG_SIZE = sizeof(u32);
+
     char m_context[hydro_secretbox_CONTEXTBYTES];
     s32 m_handle = -1;
     std::optional<u16> m_port{};
@@ -32,6 +32,17 @@ const Entry entries[] = {
         .valueMessageIds = nullptr,
         .valueExplanationMessageIds = nullptr,
     },
+    [static_cast<u32>(Setting::ThumbnailCacheSize)] = {
+        .category = Category::UI,
+        .name = magic_enum::enum_name(Setting::ThumbnailCacheSize),
+        .messageId = 0,
+        .defaultValue = 45,
+        .valueCount = 102,
+        .valueOffset = 27,
+        .valueNames = nullptr,
+        .valueMessageIds = nullptr,
+        .valueExplanationMessageIds = nullptr,
+    },
     [static_cast<u32>(Setting::LogFileRetention)] = {
         .category = Category::Miscellaneous,
         .name = magic_enum::enum_name(Setting::LogFileRetention),
@@ -42,6 +53,28 @@ const Entry entries[] = {
         .valueMessageIds = nullptr,
         .valueExplanationMessageIds = nullptr,
     },
+    [static_cast<u32>(Setting::DecompLoaderSlotCount)] = {
+        .category = Category::Miscellaneous,
+        .name = magic_enum::enum_name(Setting::DecompLoaderSlotCount),
+        .messageId = 0,
+        .defaultValue = 4,
+        .valueCount = 15,
+        .valueOffset = 2,
+        .valueNames = nullptr,
+        .valueMessageIds = nullptr,
+        .valueExplanationMessageIds = nullptr,
+    },
+    [static_cast<u32>(Setting::DecompLoaderJobCount)] = {
+        .category = Category::Miscellaneous,
+        .name = magic_enum::enum_name(Setting::DecompLoaderJobCount),
+        .messageId = 0,
+        .defaultValue = 8,
+        .valueCount = 31,
+        .valueOffset = 2,
+        .valueNames = nullptr,
+        .valueMessageIds = nullptr,
+        .valueExplanationMessageIds = nullptr,
+    },
 };
 // clang-format on
 
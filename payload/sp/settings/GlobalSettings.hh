@@ -7,7 +7,10 @@ namespace SP::GlobalSettings {
 enum class Setting {
     FileReplacement,
     BootSection,
+    ThumbnailCacheSize,
     LogFileRetention,
+    DecompLoaderSlotCount,
+    DecompLoaderJobCount,
 };
 
 enum class Category {
@@ -58,9 +61,24 @@ struct Helper<GlobalSettings::Setting, GlobalSettings::Setting::BootSection> {
     using type = u32;
 };
 
+template <>
+struct Helper<GlobalSettings::Setting, GlobalSettings::Setting::ThumbnailCacheSize> {
+    using type = u32;
+};
+
 template <>
 struct Helper<GlobalSettings::Setting, GlobalSettings::Setting::LogFileRetention> {
     using type = u32;
 };
 
+template <>
+struct Helper<GlobalSettings::Setting, GlobalSettings::Setting::DecompLoaderSlotCount> {
+    using type = u32;
+};
+
+template <>
+struct Helper<GlobalSettings::Setting, GlobalSettings::Setting::DecompLoaderJobCount> {
+    using type = u32;
+};
+
 } // namespace SP::Settings
@@ -1,10 +1,11 @@
 #include "DecompLoader.hh"
 
-#include "sp/Exchange.hh"
 #include "sp/LZ77Decoder.hh"
 #include "sp/LZMADecoder.hh"
+#include "sp/ScopeLock.hh"
 #include "sp/ThumbnailManager.hh"
 #include "sp/YAZDecoder.hh"
+#include "sp/settings/GlobalSettings.hh"
 
 #include <game/util/Registry.hh>
 
@@ -15,18 +16,57 @@
 
 namespace SP::Storage::DecompLoader {
 
-struct StartInfo {
-    const char *path;
+struct Job {
+    char path[128];
     size_t maxSize;
     u64 offset;
     std::optional<StorageType> storageType;
+    volatile bool isCancelled;
+    volatile bool isSpeculative; // Queued by Prefetch and not yet claimed by a load
+    OSTime decodeStall;          // Time the reader waited for a free slot
 };
 
-static Exchange<StartInfo, Empty> startExchange;
-static Exchange<bool, s32> updateExchange;
+// The reader thread works through the jobs in order, and fills the slots in order, up to
+// slotCount chunks ahead of the decoder. A job can be queued by Prefetch before it is loaded, so
+// that the next file is already being read while the previous one is being decoded. Until its load
+// claims it, such a job only fills a single slot, so that a wrong guess costs at most one slot of
+// reading.
+//
+// Each message on freeQueue hands one slot back to the reader, and each message on readQueue
+// holds the size of the next filled slot, or 0 at the end of a job, or -1 on error. The slots are
+// shared by all jobs: the reader and the decoder both keep their position in the ring across jobs.
+//
+// The numbers of slots and jobs come from the global settings, and their buffers are allocated by
+// Init.
+static constexpr u32 SLOT_SIZE = 0x10000 /* 64 KiB */;
+
+static u32 slotCount;
+static u32 jobCount;
+
+static Mutex mutex;
+static u32 batchDepth = 0;                     // Protected by the mutex
+static OSThread *batchThread = nullptr;        // Protected by disabling interrupts
+static volatile bool batchIsCancelled = false; // Protected by disabling interrupts
+static Job *jobs;
+static u32 jobHead = 0; // Next job to be decoded, only written by the decoder
+static u32 jobTail = 0; // Next job to be queued
+static OSMessage *startMessages;
+static OSMessageQueue startQueue;
+static OSMessage *freeMessages;
+static OSMessageQueue freeQueue;
+static OSMessage *readMessages; // slotCount + jobCount
+static OSMessageQueue readQueue;
+static OSThreadQueue claimQueue; // Woken when a speculative job is claimed or cancelled
+static u32 readSlot = 0;
+static u32 decodeSlot = 0;
+static Stats stats{};
 static u8 stack[0x2000 /* 8 KiB */];
 static OSThread thread;
-alignas(0x20) static u8 srcs[2][0x20000 /* 128 KiB */];
+static u8 *srcs;
+
+static u8 *Src(u32 slot) {
+    return srcs + slot * SLOT_SIZE;
+}
 
 static std::optional<FileHandle> Open(const char *path, std::optional<StorageType> storageType) {
     if (ThumbnailManager::IsActive()) {
@@ -57,55 +97,207 @@ static std::optional<FileHandle> Open(const char *path, std::optional<StorageTyp
                          Storage::Open(szsPath, "r");
 }
 
-static void Read(StartInfo info) {
-    auto file = Open(info.path, info.storageType);
-    if (!file || info.offset > file->size()) {
-        updateExchange.right(-1);
+static void SendSize(OSMessageQueue *queue, s32 size) {
+    auto message = reinterpret_cast<OSMessage>(static_cast<intptr_t>(size));
+    OSSendMessage(queue, message, OS_MESSAGE_BLOCK);
+}
+
+static s32 ReceiveSize(OSMessageQueue *queue) {
+    OSMessage message;
+    OSReceiveMessage(queue, &message, OS_MESSAGE_BLOCK);
+    return reinterpret_cast<intptr_t>(message);
+}
+
+static void WaitForClaim(Job &job) {
+    ScopeLock<NoInterrupts> lock;
+    while (job.isSpeculative && !job.isCancelled) {
+        OSSleepThread(&claimQueue);
+    }
+}
+
+static void CancelJob(Job &job) {
+    ScopeLock<NoInterrupts> lock;
+    job.isCancelled = true;
+    OSWakeupThread(&claimQueue);
+}
+
+static void Read(Job &job) {
+    job.decodeStall = 0;
+
+    if (job.isCancelled) {
+        SendSize(&readQueue, -1);
+        return;
+    }
+
+    auto file = Open(job.path, job.storageType);
+    if (!file || job.offset > file->size()) {
+        SendSize(&readQueue, -1);
         return;
     }
 
-    u64 size = std::min(file->size(), info.offset + info.maxSize);
-    for (u32 offset = info.offset, i = 0; offset < size; offset += sizeof(*srcs), i = (i + 1) % 2) {
-        s32 srcSize = MIN(size - offset, sizeof(*srcs));
-        if (!file->read(srcs[i], srcSize, offset)) {
-            updateExchange.right(-1);
+    u64 size = std::min(file->size(), job.offset + job.maxSize);
+    for (u32 offset = job.offset; offset < size; offset += SLOT_SIZE) {
+        if (offset != job.offset) {
+            WaitForClaim(job);
+        }
+
+        OSTime startTime = OSGetTime();
+        ReceiveSize(&freeQueue);
+        job.decodeStall += OSGetTime() - startTime;
+        if (job.isCancelled) {
+            SendSize(&freeQueue, 0);
+            SendSize(&readQueue, -1);
             return;
         }
 
-        if (!updateExchange.right(srcSize)) {
+        s32 srcSize = MIN(size - offset, SLOT_SIZE);
+        if (!file->read(Src(readSlot), srcSize, offset)) {
+            SendSize(&freeQueue, 0);
+            SendSize(&readQueue, -1);
             return;
         }
+
+        SendSize(&readQueue, srcSize);
+        readSlot = (readSlot + 1) % slotCount;
     }
 
-    updateExchange.right(0);
+    SendSize(&readQueue, 0);
 }
 
 static void *Handle(void * /* arg */) {
     while (true) {
-        auto info = startExchange.right({});
-        Read(info);
+        OSMessage message;
+        OSReceiveMessage(&startQueue, &message, OS_MESSAGE_BLOCK);
+        Read(*reinterpret_cast<Job *>(message));
     }
 }
 
 void Init() {
+    slotCount = GlobalSettings::Get<GlobalSettings::Setting::DecompLoaderSlotCount>();
+    jobCount = GlobalSettings::Get<GlobalSettings::Setting::DecompLoaderJobCount>();
+
+    srcs = reinterpret_cast<u8 *>(OSAllocFromMEM2ArenaLo(slotCount * SLOT_SIZE, 0x20));
+    jobs = reinterpret_cast<Job *>(OSAllocFromMEM2ArenaLo(jobCount * sizeof(Job), alignof(Job)));
+    for (u32 i = 0; i < jobCount; i++) {
+        new (&jobs[i]) Job{};
+    }
+    startMessages = reinterpret_cast<OSMessage *>(
+            OSAllocFromMEM2ArenaLo(jobCount * sizeof(OSMessage), alignof(OSMessage)));
+    freeMessages = reinterpret_cast<OSMessage *>(
+            OSAllocFromMEM2ArenaLo(slotCount * sizeof(OSMessage), alignof(OSMessage)));
+    readMessages = reinterpret_cast<OSMessage *>(OSAllocFromMEM2ArenaLo(
+            (slotCount + jobCount) * sizeof(OSMessage), alignof(OSMessage)));
+
+    OSInitMessageQueue(&startQueue, startMessages, jobCount);
+    OSInitMessageQueue(&freeQueue, freeMessages, slotCount);
+    OSInitMessageQueue(&readQueue, readMessages, slotCount + jobCount);
+    OSInitThreadQueue(&claimQueue);
+    for (u32 i = 0; i < slotCount; i++) {
+        SendSize(&freeQueue, 0);
+    }
+
     OSCreateThread(&thread, Handle, nullptr, stack + sizeof(stack), sizeof(stack), 24, 0);
     OSResumeThread(&thread);
 }
 
-bool Load(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *dstSize,
-        EGG::Heap *heap, std::optional<StorageType> storageType) {
-    startExchange.left({path, srcMaxSize, srcOffset, storageType});
+static bool Start(const char *path, size_t maxSize, u64 offset,
+        std::optional<StorageType> storageType, bool isSpeculative) {
+    if (strlen(path) >= std::size(jobs[0].path)) {
+        return false;
+    }
 
-    u32 i = 0;
-    const u8 *src = srcs[i];
-    s32 srcSize = updateExchange.left(true);
-    if (srcSize <= 0) {
+    // The job must be complete and sent to the reader before any other thread can see it. The
+    // start queue cannot be full, as it never holds more messages than there are queued jobs.
+    ScopeLock<NoInterrupts> lock;
+    if (jobTail - jobHead == jobCount) {
         return false;
-    } else if (static_cast<size_t>(srcSize) < sizeof(u32)) {
-        updateExchange.left(false);
+    }
+    Job &job = jobs[jobTail++ % jobCount];
+    snprintf(job.path, std::size(job.path), "%s", path);
+    job.maxSize = maxSize;
+    job.offset = offset;
+    job.storageType = storageType;
+    job.isCancelled = batchIsCancelled && batchThread == OSGetCurrentThread();
+    job.isSpeculative = isSpeculative;
+    OSSendMessage(&startQueue, &job, OS_MESSAGE_NOBLOCK);
+    return true;
+}
+
+static Job *Head() {
+    ScopeLock<NoInterrupts> lock;
+    return jobHead != jobTail ? &jobs[jobHead % jobCount] : nullptr;
+}
+
+class Session {
+public:
+    Session(Job &job) : m_job(job), m_startTime(OSGetTime()) {}
+
+    ~Session() {
+        if (m_hasSlot) {
+            SendSize(&freeQueue, 0);
+            decodeSlot = (decodeSlot + 1) % slotCount;
+        }
+        if (!m_isFinished) {
+            // Make the reader give up, and hand back the slots it has already filled.
+            CancelJob(m_job);
+            while (ReceiveSize(&readQueue) > 0) {
+                SendSize(&freeQueue, 0);
+                decodeSlot = (decodeSlot + 1) % slotCount;
+            }
+        }
+        {
+            ScopeLock<NoInterrupts> lock;
+            jobHead++;
+        }
+
+        ScopeLock<NoInterrupts> lock;
+        stats.size = m_size;
+        stats.duration = OSGetTime() - m_startTime;
+        stats.readStall = m_readStall;
+        stats.decodeStall = m_job.decodeStall;
+    }
+
+    s32 read() {
+        if (m_isFinished) {
+            return -1;
+        }
+
+        if (m_hasSlot) {
+            SendSize(&freeQueue, 0);
+            decodeSlot = (decodeSlot + 1) % slotCount;
+        }
+
+        OSTime startTime = OSGetTime();
+        s32 srcSize = ReceiveSize(&readQueue);
+        m_readStall += OSGetTime() - startTime;
+        m_hasSlot = srcSize > 0;
+        m_isFinished = srcSize <= 0;
+        if (srcSize > 0) {
+            m_size += srcSize;
+        }
+        return srcSize;
+    }
+
+    const u8 *src() const {
+        return Src(decodeSlot);
+    }
+
+private:
+    Job &m_job;
+    OSTime m_startTime;
+    OSTime m_readStall = 0;
+    u64 m_size = 0;
+    bool m_hasSlot = false;
+    bool m_isFinished = false;
+};
+
+static bool Load(Session &session, u8 **dst, size_t *dstSize, EGG::Heap *heap) {
+    s32 srcSize = session.read();
+    if (srcSize <= 0 || static_cast<size_t>(srcSize) < sizeof(u32)) {
         return false;
     }
 
+    const u8 *src = session.src();
     std::unique_ptr<Decoder> decoder;
     if (YAZDecoder::CheckMagic(Bytes::Read<u32>(src, 0x0))) {
         decoder.reset(new (heap, 0x4) YAZDecoder(src, srcSize, heap));
@@ -119,7 +311,7 @@ bool Load(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *
     srcSize -= decoder->headerSize();
 
     while (decoder->ok() && !decoder->done() && decoder->decode(src, srcSize)) {
-        srcSize = updateExchange.left(true);
+        srcSize = session.read();
         if (srcSize < 0 || (srcSize == 0 && !decoder->done())) {
             return false;
         } else if (srcSize == 0 && decoder->done()) {
@@ -127,22 +319,66 @@ bool Load(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *
             return true;
         }
 
-        i = (i + 1) % 2;
-        src = srcs[i];
+        src = session.src();
     }
 
-    updateExchange.left(false);
     return false;
 }
 
-bool LoadRO(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *dstSize,
+bool Load(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *dstSize,
         EGG::Heap *heap, std::optional<StorageType> storageType) {
-    char roPath[128];
+    if (strlen(path) >= std::size(jobs[0].path)) {
+        return false;
+    }
+
+    ScopeLock<Mutex> lock(mutex);
+
+    // Skip the prefetched jobs that do not match this load.
+    Job *job;
+    while (true) {
+        job = Head();
+        if (!job) {
+            Start(path, srcMaxSize, srcOffset, storageType, false);
+            continue;
+        }
+        if (!strcmp(job->path, path) && job->maxSize == srcMaxSize && job->offset == srcOffset &&
+                job->storageType == storageType) {
+            break;
+        }
+        Session session(*job);
+    }
+
+    {
+        ScopeLock<NoInterrupts> lock;
+        job->isSpeculative = false;
+        OSWakeupThread(&claimQueue);
+    }
+
+    bool result;
+    {
+        Session session(*job);
+        result = Load(session, dst, dstSize, heap);
+    }
+
+    SP_LOG("%s %s: %llu bytes in %llu ms (read stall: %llu ms, decode stall: %llu ms)",
+            result ? "Loaded" : "Failed to load", path, stats.size,
+            OSTicksToMilliseconds(stats.duration), OSTicksToMilliseconds(stats.readStall),
+            OSTicksToMilliseconds(stats.decodeStall));
+    return result;
+}
+
+static void ToROPath(const char *path, char (&roPath)[128]) {
     if (path[0] == '/') {
         snprintf(roPath, sizeof(roPath), "ro:%s", path);
     } else {
         snprintf(roPath, sizeof(roPath), "ro:/%s", path);
     }
+}
+
+bool LoadRO(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *dstSize,
+        EGG::Heap *heap, std::optional<StorageType> storageType) {
+    char roPath[128];
+    ToROPath(path, roPath);
     return Load(roPath, srcMaxSize, srcOffset, dst, dstSize, heap, storageType);
 }
 
@@ -156,6 +392,54 @@ bool LoadRO(const char *path, u8 **dst, size_t *dstSize, EGG::Heap *heap,
     return LoadRO(path, SIZE_MAX, 0, dst, dstSize, heap, storageType);
 }
 
+void Prefetch(const char *path, std::optional<StorageType> storageType) {
+    ScopeLock<Mutex> lock(mutex);
+    Start(path, SIZE_MAX, 0, storageType, true);
+}
+
+void PrefetchRO(const char *path, std::optional<StorageType> storageType) {
+    char roPath[128];
+    ToROPath(path, roPath);
+    Prefetch(roPath, storageType);
+}
+
+Batch::Batch() {
+    mutex.lock();
+    if (batchDepth++ == 0) {
+        ScopeLock<NoInterrupts> lock;
+        batchThread = OSGetCurrentThread();
+        batchIsCancelled = false;
+    }
+}
+
+Batch::~Batch() {
+    if (--batchDepth == 0) {
+        ScopeLock<NoInterrupts> lock;
+        batchThread = nullptr;
+        batchIsCancelled = false;
+    }
+    mutex.unlock();
+}
+
+void Cancel(OSThread *thread) {
+    ScopeLock<NoInterrupts> lock;
+    if (batchThread != thread) {
+        return;
+    }
+
+    // All the queued jobs belong to the batch, as the other threads wait for it to end.
+    batchIsCancelled = true;
+    for (u32 i = jobHead; i != jobTail; i++) {
+        jobs[i % jobCount].isCancelled = true;
+    }
+    OSWakeupThread(&claimQueue);
+}
+
+Stats GetStats() {
+    ScopeLock<NoInterrupts> lock;
+    return stats;
+}
+
 } // namespace SP::Storage::DecompLoader
 
 extern "C" bool DecompLoader_Load(const char *path, u8 **dst, size_t *dstSize, EGG_Heap *heap) {
@@ -10,6 +10,13 @@ extern "C" {
 
 namespace SP::Storage::DecompLoader {
 
+struct Stats {
+    u64 size;
+    OSTime duration;
+    OSTime readStall;   // Time the decoder waited for the storage
+    OSTime decodeStall; // Time the reader waited for a free slot
+};
+
 void Init();
 bool Load(const char *path, size_t srcMaxSize, u64 srcOffset, u8 **dst, size_t *dstSize,
         EGG::Heap *heap, std::optional<StorageType> storageType = {});
@@ -20,4 +27,23 @@ bool Load(const char *path, u8 **dst, size_t *dstSize, EGG::Heap *heap,
 bool LoadRO(const char *path, u8 **dst, size_t *dstSize, EGG::Heap *heap,
         std::optional<StorageType> = {});
 
+// Queues a load, so that reading the file can overlap with decoding the files loaded before it.
+// The data is only used if the next load has the same arguments, and only its first slot is read
+// until then.
+void Prefetch(const char *path, std::optional<StorageType> = {});
+void PrefetchRO(const char *path, std::optional<StorageType> = {});
+
+// Keeps the other threads from loading between the first prefetch and the last load of a batch,
+// as a load cancels the queued jobs which do not match it. Batches can be nested.
+class Batch {
+public:
+    Batch();
+    ~Batch();
+};
+
+// Makes the loads of the batch that a thread holds fail, as soon as the reader notices it.
+void Cancel(OSThread *thread);
+
+Stats GetStats();
+
 } // namespace SP::Storage::DecompLoader
@@ -16,6 +16,7 @@ NetStorage::NetStorage() {
     for (u32 i = 0; i < std::size(m_dirs); i++) {
         m_dirs[i].m_storage = this;
     }
+    OSInitThreadQueue(&m_queue);
 
     u8 *stackTop = m_stack + sizeof(m_stack);
     OSCreateThread(&m_thread, Connect, this, stackTop, sizeof(m_stack), 24, 0);
@@ -32,8 +33,7 @@ std::optional<FileHandle> NetStorage::fastOpen(u64 id) {
         return {};
     }
 
-    auto *file = FindNode(m_files);
-    if (file == std::end(m_files)) {
+    if (FindNode(m_files) == std::end(m_files)) {
         return {};
     }
 
@@ -41,7 +41,7 @@ std::optional<FileHandle> NetStorage::fastOpen(u64 id) {
         return {};
     }
 
-    return readOpen(file);
+    return readOpen();
 }
 
 std::optional<FileHandle> NetStorage::open(const wchar_t *path, const char *mode) {
@@ -51,8 +51,7 @@ std::optional<FileHandle> NetStorage::open(const wchar_t *path, const char *mode
         return {};
     }
 
-    auto *file = FindNode(m_files);
-    if (file == std::end(m_files)) {
+    if (FindNode(m_files) == std::end(m_files)) {
         return {};
     }
 
@@ -60,7 +59,7 @@ std::optional<FileHandle> NetStorage::open(const wchar_t *path, const char *mode
         return {};
     }
 
-    return readOpen(file);
+    return readOpen();
 }
 
 bool NetStorage::createDir(const wchar_t * /* path */, bool /* allowNop */) {
@@ -74,8 +73,7 @@ std::optional<DirHandle> NetStorage::fastOpenDir(u64 id) {
         return {};
     }
 
-    auto *dir = FindNode(m_dirs);
-    if (dir == std::end(m_dirs)) {
+    if (FindNode(m_dirs) == std::end(m_dirs)) {
         return {};
     }
 
@@ -83,7 +81,7 @@ std::optional<DirHandle> NetStorage::fastOpenDir(u64 id) {
         return {};
     }
 
-    return readOpenDir(dir);
+    return readOpenDir();
 }
 
 std::optional<DirHandle> NetStorage::openDir(const wchar_t *path) {
@@ -93,8 +91,7 @@ std::optional<DirHandle> NetStorage::openDir(const wchar_t *path) {
         return {};
     }
 
-    auto *dir = FindNode(m_dirs);
-    if (dir == std::end(m_dirs)) {
+    if (FindNode(m_dirs) == std::end(m_dirs)) {
         return {};
     }
 
@@ -102,7 +99,7 @@ std::optional<DirHandle> NetStorage::openDir(const wchar_t *path) {
         return {};
     }
 
-    return readOpenDir(dir);
+    return readOpenDir();
 }
 
 std::optional<NodeInfo> NetStorage::stat(const wchar_t *path) {
@@ -134,8 +131,7 @@ std::optional<FileHandle> NetStorage::startBenchmark() {
         return {};
     }
 
-    auto *file = FindNode(m_files);
-    if (file == std::end(m_files)) {
+    if (FindNode(m_files) == std::end(m_files)) {
         return {};
     }
 
@@ -143,7 +139,7 @@ std::optional<FileHandle> NetStorage::startBenchmark() {
         return {};
     }
 
-    return readOpen(file);
+    return readOpen();
 }
 
 void NetStorage::endBenchmark() {}
@@ -159,8 +155,7 @@ std::optional<FileHandle> NetStorage::File::clone() {
         return {};
     }
 
-    auto *file = FindNode(m_storage->m_files);
-    if (file == std::end(m_storage->m_files)) {
+    if (FindNode(m_storage->m_files) == std::end(m_storage->m_files)) {
         return {};
     }
 
@@ -168,7 +163,7 @@ std::optional<FileHandle> NetStorage::File::clone() {
         return {};
     }
 
-    return m_storage->readOpen(file);
+    return m_storage->readOpen();
 }
 
 bool NetStorage::File::close() {
@@ -178,6 +173,8 @@ bool NetStorage::File::close() {
         return {};
     }
 
+    m_storage->discardReadAheads(this);
+
     if (!m_storage->writeClose(*m_handle)) {
         return false;
     }
@@ -197,26 +194,7 @@ bool NetStorage::File::read(void *dst, u32 size, u32 offset) {
         return false;
     }
 
-    if (!m_storage->writeRead(*m_handle, size, offset)) {
-        return false;
-    }
-
-    if (!m_storage->readOk()) {
-        return false;
-    }
-
-    auto *ptr = reinterpret_cast<u8 *>(dst);
-    size += offset;
-    while (offset < size) {
-        u16 chunkSize = std::min(size - offset, static_cast<u32>(0x1000));
-        if (!m_storage->m_socket->read(ptr, chunkSize)) {
-            return false;
-        }
-        ptr += chunkSize;
-        offset += chunkSize;
-    }
-
-    return true;
+    return m_storage->readFile(this, reinterpret_cast<u8 *>(dst), size, offset);
 }
 
 bool NetStorage::File::write(const void *src, u32 size, u32 offset) {
@@ -226,6 +204,9 @@ bool NetStorage::File::write(const void *src, u32 size, u32 offset) {
         return false;
     }
 
+    // Blocks read ahead before the write would be stale
+    m_storage->discardReadAheads(this);
+
     if (!m_storage->writeWrite(*m_handle, size, offset)) {
         return false;
     }
@@ -259,8 +240,7 @@ std::optional<DirHandle> NetStorage::Dir::clone() {
         return {};
     }
 
-    auto *dir = FindNode(m_storage->m_dirs);
-    if (dir == std::end(m_storage->m_dirs)) {
+    if (FindNode(m_storage->m_dirs) == std::end(m_storage->m_dirs)) {
         return {};
     }
 
@@ -268,7 +248,7 @@ std::optional<DirHandle> NetStorage::Dir::clone() {
         return {};
     }
 
-    return m_storage->readOpenDir(dir);
+    return m_storage->readOpenDir();
 }
 
 bool NetStorage::Dir::close() {
@@ -304,6 +284,253 @@ std::optional<NodeInfo> NetStorage::Dir::read() {
     return m_storage->readNodeInfo();
 }
 
+bool NetStorage::readFile(File *file, u8 *dst, u32 size, u64 offset) {
+    bool isSequential = offset == file->m_readEnd;
+    file->m_readEnd = offset + size;
+
+    if (!readFromReadAheads(file, dst, size, offset)) {
+        return false;
+    }
+
+    // Split the rest into blocks that are requested without waiting for the previous ones, so that
+    // the server can process them concurrently. Servers which don't echo the ids only have one
+    // request in flight, so the rest is requested at once.
+    u32 reads[MAX_READ_COUNT];
+    u32 maxReadCount = m_echoesIds ? MAX_READ_COUNT : 1;
+    u32 maxBlockSize = m_echoesIds ? READ_BLOCK_SIZE : size;
+    u32 readCount = 0;
+    bool ok = true;
+    while (size > 0) {
+        // Only wait for the other threads to free a slot while holding none, so that they never
+        // wait for each other
+        if (readCount == maxReadCount || (readCount > 0 && !hasFreeRequest())) {
+            ok = waitForRequest(reads[0]) && isOk(reads[0]) && ok;
+            endRequest(reads[0]);
+            memmove(reads, reads + 1, --readCount * sizeof(*reads));
+        }
+
+        u32 blockSize = std::min(size, maxBlockSize);
+        auto i = startRead(file, dst, blockSize, offset);
+        if (!i) {
+            ok = false;
+            break;
+        }
+        reads[readCount++] = *i;
+        dst += blockSize;
+        size -= blockSize;
+        offset += blockSize;
+    }
+
+    if (ok && isSequential && m_echoesIds) {
+        startReadAheads(file, offset);
+    }
+
+    for (u32 i = 0; i < readCount; i++) {
+        ok = waitForRequest(reads[i]) && isOk(reads[i]) && ok;
+        endRequest(reads[i]);
+    }
+
+    return ok;
+}
+
+bool NetStorage::readFromReadAheads(File *file, u8 *&dst, u32 &size, u64 &offset) {
+    while (size > 0) {
+        auto *readAhead = std::find_if(std::begin(m_readAheads), std::end(m_readAheads),
+                [&](const auto &readAhead) {
+                    return readAhead.file == file && readAhead.offset <= offset &&
+                            offset < readAhead.offset + readAhead.size;
+                });
+        if (readAhead == std::end(m_readAheads)) {
+            return true;
+        }
+
+        u32 i = *readAhead->read;
+        if (!waitForRequest(i)) {
+            return false;
+        }
+        // Another thread can have reused the block while the lock was released
+        if (readAhead->file != file || readAhead->read != i) {
+            continue;
+        }
+        if (!isOk(i)) {
+            endRequest(i);
+            readAhead->read.reset();
+            readAhead->file = nullptr;
+            return true;
+        }
+
+        u32 blockOffset = offset - readAhead->offset;
+        u32 blockSize = std::min(size, readAhead->size - blockOffset);
+        memcpy(dst, readAhead->buffer + blockOffset, blockSize);
+        dst += blockSize;
+        size -= blockSize;
+        offset += blockSize;
+
+        if (blockOffset + blockSize == readAhead->size) {
+            endRequest(i);
+            readAhead->read.reset();
+            readAhead->file = nullptr;
+        }
+    }
+
+    return true;
+}
+
+void NetStorage::startReadAheads(File *file, u64 offset) {
+    for (u32 j = 0; j < READ_AHEAD_COUNT; j++) {
+        u64 blockOffset = offset + j * READ_BLOCK_SIZE;
+        if (blockOffset >= file->m_size) {
+            return;
+        }
+
+        bool isPresent = std::any_of(std::begin(m_readAheads), std::end(m_readAheads),
+                [&](const auto &readAhead) {
+                    return readAhead.file == file && readAhead.offset == blockOffset;
+                });
+        if (isPresent) {
+            continue;
+        }
+
+        // Reuse the blocks of other files or from behind the reader, once they have arrived
+        auto *readAhead = std::find_if(std::begin(m_readAheads), std::end(m_readAheads),
+                [&](const auto &readAhead) {
+                    if (readAhead.file == file && readAhead.offset >= offset) {
+                        return false;
+                    }
+                    return !readAhead.read || m_requests[*readAhead.read].isDone;
+                });
+        if (readAhead == std::end(m_readAheads)) {
+            return;
+        }
+        if (readAhead->read) {
+            endRequest(*readAhead->read);
+            readAhead->read.reset();
+        }
+        readAhead->file = nullptr;
+
+        // Read-aheads are speculative, they never wait for a slot
+        if (!hasFreeRequest()) {
+            return;
+        }
+
+        u32 blockSize = std::min(file->m_size - blockOffset, static_cast<u64>(READ_BLOCK_SIZE));
+        readAhead->read = startRead(file, readAhead->buffer, blockSize, blockOffset);
+        if (!readAhead->read) {
+            return;
+        }
+        readAhead->file = file;
+        readAhead->offset = blockOffset;
+        readAhead->size = blockSize;
+    }
+}
+
+void NetStorage::discardReadAheads(File *file) {
+    // Blocks that are still in flight keep their buffer until their response has been received.
+    for (auto &readAhead : m_readAheads) {
+        if (readAhead.file == file) {
+            readAhead.file = nullptr;
+        }
+    }
+}
+
+std::optional<u32> NetStorage::startRead(File *file, u8 *dst, u32 size, u64 offset) {
+    if (!writeRead(*file->m_handle, size, offset)) {
+        return {};
+    }
+
+    // The response can't be handled before the lock is released
+    m_requests[m_request].dst = dst;
+    m_requests[m_request].size = size;
+    return m_request;
+}
+
+bool NetStorage::isOk(u32 i) const {
+    return m_requests[i].response.which_response == NetStorageResponse_ok_tag;
+}
+
+bool NetStorage::hasFreeRequest() const {
+    return std::any_of(std::begin(m_requests), std::end(m_requests),
+            [](const auto &request) { return !request.id; });
+}
+
+void NetStorage::waitForFreeRequest() {
+    while (!hasFreeRequest()) {
+        sleepUntil([&] { return hasFreeRequest(); });
+    }
+}
+
+bool NetStorage::waitForRequest(u32 i) {
+    while (!m_requests[i].isDone) {
+        if (m_isReading) {
+            sleepUntil([&] { return m_requests[i].isDone || !m_isReading; });
+        } else if (!readResponse()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void NetStorage::endRequest(u32 i) {
+    m_requests[i].id.reset();
+    OSWakeupThread(&m_queue);
+}
+
+bool NetStorage::readResponse() {
+    m_isReading = true;
+    bool ok = handleResponse();
+    m_isReading = false;
+    OSWakeupThread(&m_queue);
+    return ok;
+}
+
+bool NetStorage::handleResponse() {
+    if (m_echoesIds) {
+        m_mutex.unlock();
+    }
+    auto response = readAny();
+    if (m_echoesIds) {
+        m_mutex.lock();
+    }
+    if (!response) {
+        return false;
+    }
+
+    // Servers which don't echo the ids only have the last request in flight
+    u32 id = response->has_id ? response->id : m_requestId;
+    auto *request = std::find_if(std::begin(m_requests), std::end(m_requests),
+            [&](const auto &request) { return request.id == id; });
+    if (request == std::end(m_requests) || request->isDone) {
+        return false;
+    }
+
+    if (request->dst && response->which_response == NetStorageResponse_ok_tag) {
+        // The owner waits for the request to be done, so the destination stays valid
+        u8 *ptr = request->dst;
+        u32 size = request->size;
+        if (m_echoesIds) {
+            m_mutex.unlock();
+        }
+        bool ok = true;
+        for (u32 offset = 0; ok && offset < size;) {
+            u16 chunkSize = std::min(size - offset, static_cast<u32>(0x1000));
+            ok = m_socket->read(ptr, chunkSize).has_value();
+            ptr += chunkSize;
+            offset += chunkSize;
+        }
+        if (m_echoesIds) {
+            m_mutex.lock();
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    request->response = *response;
+    request->isDone = true;
+    return true;
+}
+
 bool NetStorage::writeFastOpen(u64 id) {
     NetStorageRequest request;
     request.which_request = NetStorageRequest_fastOpen_tag;
@@ -400,15 +627,33 @@ bool NetStorage::writeStartBenchmark() {
 }
 
 bool NetStorage::write(NetStorageRequest request) {
+    // The response can arrive as soon as the request is sent, so it needs a slot beforehand
+    waitForFreeRequest();
+    auto *slot = std::find_if(std::begin(m_requests), std::end(m_requests),
+            [](const auto &request) { return !request.id; });
+
+    request.has_id = true;
+    request.id = m_nextRequestId++;
+    m_requestId = request.id;
+
     u8 buffer[NetStorageRequest_size];
     pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
 
     assert(pb_encode(&stream, NetStorageRequest_fields, &request));
 
-    return m_socket->write(buffer, stream.bytes_written);
+    if (!m_socket->write(buffer, stream.bytes_written)) {
+        return false;
+    }
+
+    slot->id = request.id;
+    slot->dst = nullptr;
+    slot->size = 0;
+    slot->isDone = false;
+    m_request = slot - m_requests;
+    return true;
 }
 
-std::optional<FileHandle> NetStorage::readOpen(File *file) {
+std::optional<FileHandle> NetStorage::readOpen() {
     auto response = read();
     if (!response) {
         return {};
@@ -418,12 +663,22 @@ std::optional<FileHandle> NetStorage::readOpen(File *file) {
         return {};
     }
 
+    // Other threads can have taken the free nodes while the lock was released
+    auto *file = FindNode(m_files);
+    if (file == std::end(m_files)) {
+        if (writeClose(response->response.open.handle)) {
+            readOk();
+        }
+        return {};
+    }
+
     file->m_handle = response->response.open.handle;
     file->m_size = response->response.open.size;
+    file->m_readEnd = 0;
     return file;
 }
 
-std::optional<DirHandle> NetStorage::readOpenDir(Dir *dir) {
+std::optional<DirHandle> NetStorage::readOpenDir() {
     auto response = read();
     if (!response) {
         return {};
@@ -433,6 +688,14 @@ std::optional<DirHandle> NetStorage::readOpenDir(Dir *dir) {
         return {};
     }
 
+    auto *dir = FindNode(m_dirs);
+    if (dir == std::end(m_dirs)) {
+        if (writeCloseDir(response->response.openDir.handle)) {
+            readOk();
+        }
+        return {};
+    }
+
     dir->m_handle = response->response.openDir.handle;
     return dir;
 }
@@ -470,6 +733,18 @@ bool NetStorage::readOk() {
 }
 
 std::optional<NetStorageResponse> NetStorage::read() {
+    // The lock has been held since the request was written, so this is still its slot
+    u32 i = m_request;
+    bool ok = waitForRequest(i);
+    std::optional<NetStorageResponse> response;
+    if (ok) {
+        response = m_requests[i].response;
+    }
+    endRequest(i);
+    return response;
+}
+
+std::optional<NetStorageResponse> NetStorage::readAny() {
     u8 buffer[NetStorageResponse_size];
     std::optional<u16> size = m_socket->read(buffer, sizeof(buffer));
     if (!size) {
@@ -491,14 +766,39 @@ void NetStorage::connect() {
     while (true) {
         Net::SyncSocket socket(NET_STORAGE_HOSTNAME, NET_STORAGE_PORT, serverPK, "storage ");
         if (socket.ok()) {
+            ScopeLock<Mutex> lock(m_mutex);
             m_socket = std::move(socket);
-            return;
+            if (negotiate()) {
+                return;
+            }
+            m_socket.reset();
         }
         OSSleepMilliseconds(1000);
     }
 #endif
 }
 
+// The first request tells whether the server echoes the ids. If so, the messages of each direction
+// are numbered separately from its response on, as both can then be in flight at once.
+bool NetStorage::negotiate() {
+    if (!writeStat(L"ro:/")) {
+        return false;
+    }
+
+    m_socket->separateMessageIDs();
+    auto response = readAny();
+    endRequest(m_request);
+    if (!response) {
+        return false;
+    }
+
+    m_echoesIds = response->has_id;
+    if (!m_echoesIds) {
+        m_socket->joinMessageIDs();
+    }
+    return true;
+}
+
 void *NetStorage::Connect(void *arg) {
     reinterpret_cast<NetStorage *>(arg)->connect();
     return nullptr;
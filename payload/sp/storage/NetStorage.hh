@@ -44,6 +44,7 @@ private:
         NetStorage *m_storage = nullptr;
         std::optional<u32> m_handle{};
         u64 m_size;
+        u64 m_readEnd = 0;
 
         friend class NetStorage;
     };
@@ -61,6 +62,43 @@ private:
         friend class NetStorage;
     };
 
+    static constexpr u32 READ_BLOCK_SIZE = 0x4000 /* 16 KiB */;
+    static constexpr u32 READ_AHEAD_COUNT = 4;
+    static constexpr u32 MAX_READ_COUNT = 8;
+    // Enough for the read-aheads and two threads reading at once, more wait for a free slot
+    static constexpr u32 MAX_REQUEST_COUNT = READ_AHEAD_COUNT + 2 * MAX_READ_COUNT;
+
+    // An outstanding request, completed when its response is received
+    struct Request {
+        std::optional<u32> id{};
+        u8 *dst; // Where the data of a read goes
+        u32 size;
+        bool isDone;
+        NetStorageResponse response;
+    };
+
+    // A block requested ahead of a sequential reader
+    struct ReadAhead {
+        File *file = nullptr;
+        u64 offset;
+        u32 size;
+        std::optional<u32> read{};
+        alignas(0x20) u8 buffer[READ_BLOCK_SIZE];
+    };
+
+    bool readFile(File *file, u8 *dst, u32 size, u64 offset);
+    bool readFromReadAheads(File *file, u8 *&dst, u32 &size, u64 &offset);
+    void startReadAheads(File *file, u64 offset);
+    void discardReadAheads(File *file);
+    std::optional<u32> startRead(File *file, u8 *dst, u32 size, u64 offset);
+    bool isOk(u32 i) const;
+    bool hasFreeRequest() const;
+    void waitForFreeRequest();
+    bool waitForRequest(u32 i);
+    void endRequest(u32 i);
+    bool readResponse();
+    bool handleResponse();
+
     bool writeFastOpen(u64 id);
     bool writeOpen(const wchar_t *path, const char *mode);
     bool writeClone(u32 handle);
@@ -76,13 +114,29 @@ private:
     bool writeStartBenchmark();
     bool write(NetStorageRequest request);
 
-    std::optional<FileHandle> readOpen(File *file);
-    std::optional<DirHandle> readOpenDir(Dir *dir);
+    std::optional<FileHandle> readOpen();
+    std::optional<DirHandle> readOpenDir();
     std::optional<NodeInfo> readNodeInfo();
     bool readOk();
     std::optional<NetStorageResponse> read();
+    std::optional<NetStorageResponse> readAny();
 
     void connect();
+    bool negotiate();
+
+    // Waits with m_mutex released until the condition holds, which is checked with interrupts
+    // disabled so that no wakeup is missed.
+    template <typename C>
+    void sleepUntil(C condition) {
+        m_mutex.unlock();
+        {
+            ScopeLock<NoInterrupts> lock;
+            while (!condition()) {
+                OSSleepThread(&m_queue);
+            }
+        }
+        m_mutex.lock();
+    }
 
     static void *Connect(void *arg);
 
@@ -98,6 +152,17 @@ private:
     std::optional<Net::SyncSocket> m_socket;
     File m_files[32];
     Dir m_dirs[32];
+    // Servers which echo the request ids can have several requests in flight, and the lock is
+    // released while waiting for them. Older ones get one request at a time, under the lock.
+    bool m_echoesIds = false;
+    u32 m_nextRequestId = 0;
+    u32 m_requestId = 0;
+    u32 m_request = 0; // The slot of the last request
+    Request m_requests[MAX_REQUEST_COUNT];
+    ReadAhead m_readAheads[READ_AHEAD_COUNT];
+    // A single thread reads the socket at a time, and completes the requests of the others
+    bool m_isReading = false;
+    OSThreadQueue m_queue;
 
     static const u8 serverPK[hydro_kx_PUBLICKEYBYTES];
 };
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+
+from argparse import ArgumentParser
+import os
+import struct
+
+from PIL import Image
+
+
+# Thumbnails already in the layout of GX textures, so that the game can read each of them straight
+# into its texture buffer. All fields are big-endian.
+#
+# 0x00 magic 'SPTP'
+# 0x04 entry count
+# 0x08 entries, sorted by database id:
+#      0x0 database id
+#      0x4 width
+#      0x6 height
+#      0x8 data offset
+# .... data of each thumbnail, aligned to 0x20: one I8 plane per color channel (red, green, blue)
+MAGIC = b'SPTP'
+ALIGNMENT = 0x20
+TILE_WIDTH, TILE_HEIGHT = 8, 4
+
+
+def align_up(val, alignment):
+    return (val + alignment - 1) // alignment * alignment
+
+def tile_plane(pixels, width, height):
+    tiled_width = align_up(width, TILE_WIDTH)
+    tiled_height = align_up(height, TILE_HEIGHT)
+    plane = bytearray(tiled_width * tiled_height)
+    i = 0
+    for by in range(0, tiled_height, TILE_HEIGHT):
+        for bx in range(0, tiled_width, TILE_WIDTH):
+            for y in range(by, by + TILE_HEIGHT):
+                for x in range(bx, bx + TILE_WIDTH):
+                    if x < width and y < height:
+                        plane[i] = pixels[y * width + x]
+                    i += 1
+    return plane
+
+def pack_thumbnail(in_path):
+    with Image.open(in_path) as image:
+        image = image.convert('RGB')
+        width, height = image.size
+        planes = [tile_plane(band.tobytes(), width, height) for band in image.split()]
+    return width, height, b''.join(planes)
+
+
+parser = ArgumentParser()
+parser.add_argument('in_paths', nargs='+')
+parser.add_argument('-o', '--out-path', required=True)
+args = parser.parse_args()
+
+thumbnails = []
+for in_path in args.in_paths:
+    database_id = int(os.path.splitext(os.path.basename(in_path))[0])
+    thumbnails += [(database_id, *pack_thumbnail(in_path))]
+thumbnails.sort()
+
+offset = align_up(0x8 + len(thumbnails) * 0xc, ALIGNMENT)
+header = struct.pack('>4sI', MAGIC, len(thumbnails))
+data = b''
+for database_id, width, height, pixels in thumbnails:
+    header += struct.pack('>IHHI', database_id, width, height, offset + len(data))
+    data += pixels + b'\0' * (align_up(len(pixels), ALIGNMENT) - len(pixels))
+header += b'\0' * (offset - len(header))
+
+with open(args.out_path, 'wb') as out_file:
+    out_file.write(header + data)
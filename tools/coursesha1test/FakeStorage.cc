@@ -0,0 +1,143 @@
+#include "FakeStorage.hh"
+
+#include <cstring>
+#include <cwchar>
+#include <utility>
+
+class FakeStorage::File : public SP::Storage::IFile {
+public:
+    File(FakeStorage &storage, std::wstring path) : m_storage(storage), m_path(std::move(path)) {}
+
+    std::optional<SP::Storage::FileHandle> clone() override {
+        return SP::Storage::FileHandle(new File(m_storage, m_path));
+    }
+
+    bool close() override {
+        delete this;
+        return true;
+    }
+
+    bool read(void *dst, u32 size, u32 offset) override {
+        auto &contents = m_storage.m_nodes.at(m_path).contents;
+        if (offset > contents.size() || size > contents.size() - offset) {
+            return false;
+        }
+        memcpy(dst, contents.data() + offset, size);
+        return true;
+    }
+
+    bool write(const void *src, u32 size, u32 offset) override {
+        auto &node = m_storage.m_nodes.at(m_path);
+        if (node.contents.size() < offset + size) {
+            node.contents.resize(offset + size);
+        }
+        memcpy(node.contents.data() + offset, src, size);
+        node.tick = ++m_storage.m_tick;
+        m_storage.m_writeCount++;
+        return true;
+    }
+
+    bool sync() override {
+        return true;
+    }
+
+    u64 size() override {
+        return m_storage.m_nodes.at(m_path).contents.size();
+    }
+
+private:
+    FakeStorage &m_storage;
+    std::wstring m_path;
+};
+
+void FakeStorage::setFile(const std::wstring &path, std::vector<u8> contents) {
+    m_nodes[path] = {std::move(contents), ++m_tick};
+}
+
+void FakeStorage::setTick(const std::wstring &path, OSTime tick) {
+    m_nodes.at(path).tick = tick;
+}
+
+void FakeStorage::removeFile(const std::wstring &path) {
+    m_nodes.erase(path);
+}
+
+const std::vector<u8> *FakeStorage::file(const std::wstring &path) const {
+    auto it = m_nodes.find(path);
+    return it != m_nodes.end() ? &it->second.contents : nullptr;
+}
+
+OSTime FakeStorage::tick(const std::wstring &path) const {
+    return m_nodes.at(path).tick;
+}
+
+u32 FakeStorage::takeWriteCount() {
+    return std::exchange(m_writeCount, 0);
+}
+
+std::optional<SP::Storage::FileHandle> FakeStorage::fastOpen(u64 /* id */) {
+    return {};
+}
+
+std::optional<SP::Storage::FileHandle> FakeStorage::open(const wchar_t *path, const char *mode) {
+    if (!strcmp(mode, "w")) {
+        m_nodes[path] = {{}, ++m_tick};
+    } else if (!strcmp(mode, "wx")) {
+        if (!m_nodes.try_emplace(path, Node{{}, ++m_tick}).second) {
+            return {};
+        }
+    } else if (!m_nodes.contains(path)) {
+        return {};
+    }
+    return SP::Storage::FileHandle(new File(*this, path));
+}
+
+bool FakeStorage::createDir(const wchar_t * /* path */, bool /* allowNop */) {
+    return true;
+}
+
+std::optional<SP::Storage::DirHandle> FakeStorage::fastOpenDir(u64 /* id */) {
+    return {};
+}
+
+std::optional<SP::Storage::DirHandle> FakeStorage::openDir(const wchar_t * /* path */) {
+    return {};
+}
+
+std::optional<SP::Storage::NodeInfo> FakeStorage::stat(const wchar_t *path) {
+    auto it = m_nodes.find(path);
+    if (it == m_nodes.end()) {
+        return {};
+    }
+    SP::Storage::NodeInfo info{};
+    info.id = {this, 0};
+    info.type = SP::Storage::NodeType::File;
+    info.size = it->second.contents.size();
+    info.tick = it->second.tick;
+    const wchar_t *name = wcsrchr(path, L'/');
+    wcsncpy(info.name, name ? name + 1 : path, std::size(info.name) - 1);
+    return info;
+}
+
+bool FakeStorage::rename(const wchar_t *srcPath, const wchar_t *dstPath) {
+    auto node = m_nodes.extract(srcPath);
+    if (node.empty()) {
+        return false;
+    }
+    m_nodes.insert_or_assign(dstPath, std::move(node.mapped()));
+    return true;
+}
+
+bool FakeStorage::remove(const wchar_t *path, bool allowNop) {
+    return m_nodes.erase(path) != 0 || allowNop;
+}
+
+std::optional<SP::Storage::FileHandle> FakeStorage::startBenchmark() {
+    return {};
+}
+
+void FakeStorage::endBenchmark() {}
+
+u32 FakeStorage::getMessageId() {
+    return 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sp/storage/Storage.hh>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// A FAT storage reduced to a map of paths to files, with the sizes and modification times that the
+// cache is keyed by. Directories are implicit.
+class FakeStorage : public SP::Storage::IStorage {
+public:
+    void setFile(const std::wstring &path, std::vector<u8> contents);
+    void setTick(const std::wstring &path, OSTime tick);
+    void removeFile(const std::wstring &path);
+    const std::vector<u8> *file(const std::wstring &path) const;
+    OSTime tick(const std::wstring &path) const;
+    // The number of files written since the last call
+    u32 takeWriteCount();
+
+    std::optional<SP::Storage::FileHandle> fastOpen(u64 id) override;
+    std::optional<SP::Storage::FileHandle> open(const wchar_t *path, const char *mode) override;
+
+    bool createDir(const wchar_t *path, bool allowNop) override;
+    std::optional<SP::Storage::DirHandle> fastOpenDir(u64 id) override;
+    std::optional<SP::Storage::DirHandle> openDir(const wchar_t *path) override;
+
+    std::optional<SP::Storage::NodeInfo> stat(const wchar_t *path) override;
+    bool rename(const wchar_t *srcPath, const wchar_t *dstPath) override;
+    bool remove(const wchar_t *path, bool allowNop) override;
+
+    std::optional<SP::Storage::FileHandle> startBenchmark() override;
+    void endBenchmark() override;
+    u32 getMessageId() override;
+
+private:
+    struct Node {
+        std::vector<u8> contents;
+        OSTime tick;
+    };
+
+    class File;
+
+    std::map<std::wstring, Node> m_nodes;
+    OSTime m_tick = 0;
+    u32 m_writeCount = 0;
+};
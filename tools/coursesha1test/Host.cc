@@ -0,0 +1,220 @@
+// What the game, the SDK and the storage layer of the payload provide to the course SHA-1 cache.
+
+#include "Host.hh"
+
+#include <game/util/Registry.hh>
+#include <sp/storage/DecompLoader.hh>
+#include <vendor/sha1/sha1.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+FakeStorage fatStorage;
+u32 courseLoadCount = 0;
+
+extern "C" void OSReport(const char *msg, ...) {
+    va_list args;
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+static_assert(sizeof(SHA1_CTX) <= sizeof(NETSHA1Context));
+
+extern "C" void NETSHA1Init(NETSHA1Context *context) {
+    SHA1Init(reinterpret_cast<SHA1_CTX *>(context));
+}
+
+extern "C" void NETSHA1Update(NETSHA1Context *context, const void *input, u32 length) {
+    SHA1Update(reinterpret_cast<SHA1_CTX *>(context), reinterpret_cast<const u8 *>(input), length);
+}
+
+extern "C" void NETSHA1GetDigest(NETSHA1Context *context, void *digest) {
+    SHA1Final(reinterpret_cast<u8 *>(digest), reinterpret_cast<SHA1_CTX *>(context));
+}
+
+namespace Registry {
+
+// Stand-ins: only the first 0x20 are looked up, and they only have to be distinct.
+const char *courseFilenames[0x28] = {
+    "course00",
+    "course01",
+    "course02",
+    "course03",
+    "course04",
+    "course05",
+    "course06",
+    "course07",
+    "course08",
+    "course09",
+    "course0a",
+    "course0b",
+    "course0c",
+    "course0d",
+    "course0e",
+    "course0f",
+    "course10",
+    "course11",
+    "course12",
+    "course13",
+    "course14",
+    "course15",
+    "course16",
+    "course17",
+    "course18",
+    "course19",
+    "course1a",
+    "course1b",
+    "course1c",
+    "course1d",
+    "course1e",
+    "course1f",
+};
+
+} // namespace Registry
+
+namespace SP::Storage {
+
+FileHandle::FileHandle(IFile *file) : m_file(file) {}
+
+FileHandle::FileHandle(FileHandle &&that) : m_file(that.m_file) {
+    that.m_file = nullptr;
+}
+
+FileHandle &FileHandle::operator=(FileHandle &&that) {
+    m_file = that.m_file;
+    that.m_file = nullptr;
+    return *this;
+}
+
+FileHandle::~FileHandle() {
+    if (m_file) {
+        m_file->close();
+    }
+}
+
+bool FileHandle::read(void *dst, u32 size, u32 offset) {
+    assert(dst);
+
+    return m_file->read(dst, size, offset);
+}
+
+bool FileHandle::write(const void *src, u32 size, u32 offset) {
+    assert(src);
+
+    return m_file->write(src, size, offset);
+}
+
+u64 FileHandle::size() {
+    return m_file->size();
+}
+
+IStorage *GetStorage(StorageType type) {
+    return type == StorageType::FAT ? &fatStorage : nullptr;
+}
+
+std::optional<FileHandle> Open(const wchar_t *path, const char *mode) {
+    return fatStorage.open(path, mode);
+}
+
+bool Rename(const wchar_t *srcPath, const wchar_t *dstPath) {
+    return fatStorage.rename(srcPath, dstPath);
+}
+
+bool Remove(const wchar_t *path, bool allowNop) {
+    return fatStorage.remove(path, allowNop);
+}
+
+// The two below are those of Storage.cc.
+
+std::optional<u32> ReadFile(const wchar_t *path, void *dst, u32 size) {
+    auto file = Open(path, "r");
+    if (!file) {
+        return {};
+    }
+
+    size = std::min(static_cast<u64>(size), file->size());
+    if (!file->read(dst, size, 0)) {
+        return {};
+    }
+    return size;
+}
+
+bool WriteFile(const wchar_t *path, const void *src, u32 size, bool overwrite) {
+    if (overwrite) {
+        wchar_t newPath[256];
+        swprintf(newPath, std::size(newPath), L"%ls.new", path);
+        wchar_t oldPath[256];
+        swprintf(oldPath, std::size(oldPath), L"%ls.old", path);
+
+        {
+            auto file = Open(newPath, "w");
+            if (!file) {
+                return false;
+            }
+            if (!file->write(src, size, 0)) {
+                SP_LOG("Failed to write to %ls", newPath);
+                return false;
+            }
+        }
+
+        if (!Remove(oldPath, true)) {
+            SP_LOG("Failed to remove %ls", oldPath);
+            return false;
+        }
+
+        if (!Rename(path, oldPath)) {
+            SP_LOG("Failed to rename %ls to %ls", path, oldPath);
+            // Ignore
+        }
+
+        if (!Rename(newPath, path)) {
+            SP_LOG("Failed to rename %ls to %ls", newPath, path);
+            return false;
+        }
+
+        Remove(oldPath, true); // Not a big deal if this fails
+        return true;
+    } else {
+        auto file = Open(path, "wx");
+        if (!file) {
+            return false;
+        }
+        return file->write(src, size, 0);
+    }
+}
+
+} // namespace SP::Storage
+
+namespace SP::Storage::DecompLoader {
+
+// The archives of the fake storage are stored decompressed, whatever their extension. As in the
+// payload, the .arc.lzma variant takes precedence over the .szs.
+bool LoadRO(const char *path, u8 **dst, size_t *dstSize, EGG::Heap * /* heap */,
+        std::optional<StorageType> storageType) {
+    assert(storageType == StorageType::FAT);
+
+    std::string stem(path);
+    if (stem.ends_with(".szs")) {
+        stem.resize(stem.size() - strlen(".szs"));
+    }
+    for (const char *extension : {".arc.lzma", ".szs"}) {
+        std::string fullPath = "ro:/" + stem + extension;
+        auto *contents = fatStorage.file(std::wstring(fullPath.begin(), fullPath.end()));
+        if (!contents) {
+            continue;
+        }
+        *dst = new u8[contents->size()];
+        std::copy(contents->begin(), contents->end(), *dst);
+        *dstSize = contents->size();
+        courseLoadCount++;
+        return true;
+    }
+    return false;
+}
+
+} // namespace SP::Storage::DecompLoader
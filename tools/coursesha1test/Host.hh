@@ -0,0 +1,7 @@
+#pragma once
+
+#include "FakeStorage.hh"
+
+// The SD card behind the FAT storage, and the number of courses that the loader read from it.
+extern FakeStorage fatStorage;
+extern u32 courseLoadCount;
@@ -0,0 +1,11 @@
+#pragma once
+
+// Shadows the header of the payload: on the host, every heap allocates from the C library.
+
+#include <Common.hh>
+
+namespace EGG {
+
+class Heap {};
+
+} // namespace EGG
@@ -0,0 +1,5 @@
+#pragma once
+
+// Shadows the header of newlib, which vendor/sha1 includes for the byte order.
+
+#include <endian.h>
@@ -0,0 +1,22 @@
+#pragma once
+
+// Shadows the header of the payload, whose structures have the layout of the console.
+
+#include <Common.h>
+
+#ifdef RVL_OS_NEEDS_IMPORT
+#undef RVL_OS_NEEDS_IMPORT
+#define RVL_OS_NEEDS_IMPORT
+#endif
+
+typedef s64 OSTime;
+
+__attribute__((format(printf, 1, 2))) void OSReport(const char *msg, ...);
+
+typedef struct {
+    u32 _00[0x60 / sizeof(u32)];
+} NETSHA1Context;
+
+void NETSHA1Init(NETSHA1Context *context);
+void NETSHA1Update(NETSHA1Context *context, const void *input, u32 length);
+void NETSHA1GetDigest(NETSHA1Context *context, void *digest);
@@ -0,0 +1,14 @@
+#pragma once
+
+// Shadows the header of the payload: the host loader reads the courses from the fake storage as
+// is, and counts the loads so that the tests can tell whether a course was hashed again.
+
+#include <egg/core/eggHeap.hh>
+#include <sp/storage/Storage.hh>
+
+namespace SP::Storage::DecompLoader {
+
+bool LoadRO(const char *path, u8 **dst, size_t *dstSize, EGG::Heap *heap,
+        std::optional<StorageType> = {});
+
+} // namespace SP::Storage::DecompLoader
@@ -0,0 +1,242 @@
+// Runs the course SHA-1 cache of the save manager over a fake SD card, and checks when it hashes
+// the courses again. See README.md.
+
+#include "Host.hh"
+
+#include <game/system/CourseSHA1Cache.hh>
+#include <vendor/sha1/sha1.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <random>
+
+namespace {
+
+using SHA1s = std::array<System::CourseSHA1Cache::SHA1, 32>;
+
+const wchar_t *CACHE_PATH = L"/mkw-sp/course-sha1s.bin";
+
+std::wstring CoursePath(u32 courseId, const wchar_t *extension) {
+    wchar_t path[128];
+    swprintf(path, std::size(path), L"ro:/Race/Course/course%02x%ls", courseId, extension);
+    return path;
+}
+
+std::vector<u8> GenerateCourse(std::mt19937 &random, size_t size) {
+    std::vector<u8> contents(size);
+    for (auto &byte : contents) {
+        byte = random();
+    }
+    return contents;
+}
+
+System::CourseSHA1Cache::SHA1 Hash(const std::vector<u8> &contents) {
+    SHA1_CTX context;
+    SHA1Init(&context);
+    SHA1Update(&context, contents.data(), contents.size());
+    System::CourseSHA1Cache::SHA1 sha1;
+    SHA1Final(sha1.data(), &context);
+    return sha1;
+}
+
+// The SHA-1s of the vanilla courses, which the cache must leave as is for the courses that aren't
+// replaced.
+SHA1s VanillaSHA1s() {
+    SHA1s sha1s;
+    for (u32 i = 0; i < sha1s.size(); i++) {
+        sha1s[i].fill(0xa0 + i);
+    }
+    return sha1s;
+}
+
+class Test {
+public:
+    Test(const char *name) : m_name(name) {}
+
+    // Boots with the current state of the SD card.
+    void boot() {
+        m_sha1s = VanillaSHA1s();
+        courseLoadCount = 0;
+        fatStorage.takeWriteCount();
+        EGG::Heap heap;
+        System::CourseSHA1Cache::Update(m_sha1s, &heap);
+    }
+
+    void expectLoads(u32 count) {
+        if (courseLoadCount != count) {
+            fail("%u courses hashed, %u expected", courseLoadCount, count);
+        }
+    }
+
+    // The cache is written through a .new file, which is renamed into place.
+    void expectWrite(bool isWritten) {
+        u32 writeCount = fatStorage.takeWriteCount();
+        if ((writeCount != 0) != isWritten) {
+            fail("the cache was %swritten", writeCount != 0 ? "" : "not ");
+        }
+        auto *cache = fatStorage.file(CACHE_PATH);
+        if (isWritten && (!cache || cache->size() != 0x608)) {
+            fail("the cache is missing or truncated");
+        }
+    }
+
+    // A course hashed from the given contents, or the vanilla SHA-1 if there are none.
+    void expectSHA1(u32 courseId, const std::vector<u8> *contents) {
+        auto expected = contents ? Hash(*contents) : VanillaSHA1s()[courseId];
+        if (m_sha1s[courseId] != expected) {
+            fail("wrong SHA-1 for course %u", courseId);
+        }
+    }
+
+    bool ok() const {
+        printf("%-24s %s\n", m_name, m_ok ? "ok" : "FAILED");
+        return m_ok;
+    }
+
+private:
+    __attribute__((format(printf, 2, 3))) void fail(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        fprintf(stderr, "%s: ", m_name);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+        va_end(args);
+        m_ok = false;
+    }
+
+    const char *m_name;
+    SHA1s m_sha1s;
+    bool m_ok = true;
+};
+
+} // namespace
+
+int main() {
+    std::mt19937 random(0);
+    std::vector<u8> course3 = GenerateCourse(random, 0x4000);
+    std::vector<u8> course7 = GenerateCourse(random, 0x3000);
+    fatStorage.setFile(CoursePath(3, L".szs"), course3);
+    fatStorage.setFile(CoursePath(7, L".szs"), course7);
+    bool ok = true;
+
+    {
+        Test test("cold");
+        test.boot();
+        test.expectLoads(2);
+        test.expectWrite(true);
+        for (u32 i = 0; i < 32; i++) {
+            test.expectSHA1(i, i == 3 ? &course3 : i == 7 ? &course7 : nullptr);
+        }
+        ok &= test.ok();
+    }
+
+    {
+        Test test("hit");
+        test.boot();
+        test.expectLoads(0);
+        test.expectWrite(false);
+        test.expectSHA1(3, &course3);
+        test.expectSHA1(7, &course7);
+        ok &= test.ok();
+    }
+
+    {
+        // Same modification time, as FAT only keeps it to the 2 seconds
+        Test test("size change");
+        OSTime tick = fatStorage.tick(CoursePath(3, L".szs"));
+        course3 = GenerateCourse(random, 0x4100);
+        fatStorage.setFile(CoursePath(3, L".szs"), course3);
+        fatStorage.setTick(CoursePath(3, L".szs"), tick);
+        test.boot();
+        test.expectLoads(1);
+        test.expectWrite(true);
+        test.expectSHA1(3, &course3);
+        test.expectSHA1(7, &course7);
+        ok &= test.ok();
+    }
+
+    {
+        // Same size
+        Test test("tick change");
+        course7 = GenerateCourse(random, course7.size());
+        OSTime tick = fatStorage.tick(CoursePath(7, L".szs"));
+        fatStorage.setFile(CoursePath(7, L".szs"), course7);
+        fatStorage.setTick(CoursePath(7, L".szs"), tick + 1);
+        test.boot();
+        test.expectLoads(1);
+        test.expectWrite(true);
+        test.expectSHA1(3, &course3);
+        test.expectSHA1(7, &course7);
+        ok &= test.ok();
+    }
+
+    {
+        Test test("miss");
+        fatStorage.removeFile(CoursePath(7, L".szs"));
+        test.boot();
+        test.expectLoads(0);
+        test.expectWrite(true);
+        test.expectSHA1(3, &course3);
+        test.expectSHA1(7, nullptr);
+        test.boot();
+        test.expectWrite(false);
+        ok &= test.ok();
+    }
+
+    {
+        // The entry of a removed course is invalidated, so the same file put back is hashed again.
+        Test test("course put back");
+        fatStorage.setFile(CoursePath(7, L".szs"), course7);
+        test.boot();
+        test.expectLoads(1);
+        test.expectWrite(true);
+        test.expectSHA1(7, &course7);
+        ok &= test.ok();
+    }
+
+    {
+        // Same size and modification time, but another file
+        Test test("variant change");
+        OSTime tick = fatStorage.tick(CoursePath(3, L".szs"));
+        std::vector<u8> variant = GenerateCourse(random, course3.size());
+        fatStorage.setFile(CoursePath(3, L".arc.lzma"), variant);
+        fatStorage.setTick(CoursePath(3, L".arc.lzma"), tick);
+        test.boot();
+        test.expectLoads(1);
+        test.expectWrite(true);
+        test.expectSHA1(3, &variant);
+        fatStorage.removeFile(CoursePath(3, L".arc.lzma"));
+        test.boot();
+        test.expectLoads(1);
+        test.expectSHA1(3, &course3);
+        ok &= test.ok();
+    }
+
+    {
+        Test test("corrupted cache");
+        auto cache = *fatStorage.file(CACHE_PATH);
+        cache[0] ^= 0xff;
+        fatStorage.setFile(CACHE_PATH, cache);
+        test.boot();
+        test.expectLoads(2);
+        test.expectWrite(true);
+        test.expectSHA1(3, &course3);
+        test.expectSHA1(7, &course7);
+        ok &= test.ok();
+    }
+
+    {
+        Test test("truncated cache");
+        auto cache = *fatStorage.file(CACHE_PATH);
+        cache.resize(cache.size() - 1);
+        fatStorage.setFile(CACHE_PATH, cache);
+        test.boot();
+        test.expectLoads(2);
+        test.expectWrite(true);
+        ok &= test.ok();
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,199 @@
+// Runs synthetic races through the player frame codec of the payload, to measure the size of the
+// packed frames and their round-trip error on a PC. See README.md.
+
+#include <sp/cs/PlayerFrameCodec.hh>
+
+extern "C" {
+#include <vendor/nanopb/pb_encode.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The error of a frame that went through Pack and Unpack, relative to the original one.
+struct Errors {
+    f32 pos = 0.0f;           // Per component, in units
+    f32 rot = 0.0f;           // In degrees
+    f32 internalSpeed = 0.0f; // In units per frame
+    u32 inputStateMismatches = 0;
+    u32 timeMismatches = 0;
+};
+
+PlayerFrame_Quat AxisAngle(f32 x, f32 y, f32 z, f32 angle) {
+    f32 s = std::sin(angle / 2.0f);
+    return {x * s, y * s, z * s, std::cos(angle / 2.0f)};
+}
+
+PlayerFrame_Quat Multiply(const PlayerFrame_Quat &q0, const PlayerFrame_Quat &q1) {
+    return {
+            q0.w * q1.x + q0.x * q1.w + q0.y * q1.z - q0.z * q1.y,
+            q0.w * q1.y - q0.x * q1.z + q0.y * q1.w + q0.z * q1.x,
+            q0.w * q1.z + q0.x * q1.y - q0.y * q1.x + q0.z * q1.w,
+            q0.w * q1.w - q0.x * q1.x - q0.y * q1.y - q0.z * q1.z,
+    };
+}
+
+// A kart driving laps of an uneven oval at a varying speed, with the occasional respawn.
+class Driver {
+public:
+    Driver(u32 seed) : m_random(seed) {
+        std::uniform_real_distribution<f32> phase(0.0f, 2.0f * std::numbers::pi_v<f32>);
+        m_angle = phase(m_random);
+        m_radius = 6000.0f + 500.0f * (seed % 12);
+    }
+
+    PlayerFrame next() {
+        std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+        std::uniform_int_distribution<u32> byte(0, 0xff);
+        m_internalSpeed = std::clamp(m_internalSpeed + (unit(m_random) - 0.45f) * 4.0f, -10.0f,
+                110.0f);
+        m_angle += m_internalSpeed / m_radius;
+        if (unit(m_random) < 0.001f) {
+            // Respawns move the kart back by a good part of the lap
+            m_angle -= 1.0f;
+        }
+
+        PlayerFrame frame = PlayerFrame_init_zero;
+        frame.inputState.accelerate = byte(m_random) & 1;
+        frame.inputState.brake = byte(m_random) & 1;
+        frame.inputState.item = byte(m_random) & 1;
+        frame.inputState.drift = byte(m_random) & 1;
+        frame.inputState.brakeDrift = byte(m_random) & 1;
+        frame.inputState.stickX = byte(m_random) % 15;
+        frame.inputState.stickY = byte(m_random) % 15;
+        frame.inputState.trick = byte(m_random) % 5;
+        frame.timeBeforeRespawn = byte(m_random);
+        frame.timeInRespawn = byte(m_random);
+        frame.timesBeforeBoostEnd_count = 3;
+        for (u32 i = 0; i < 3; i++) {
+            frame.timesBeforeBoostEnd[i] = byte(m_random);
+        }
+        frame.pos.x = m_radius * 1.5f * std::cos(m_angle);
+        frame.pos.y = 1200.0f * std::sin(3.0f * m_angle) + 20.0f * unit(m_random);
+        frame.pos.z = m_radius * std::sin(m_angle);
+        f32 pitch = 0.2f * std::cos(3.0f * m_angle);
+        f32 roll = 0.1f * (unit(m_random) - 0.5f);
+        frame.mainRot = Multiply(AxisAngle(0.0f, 1.0f, 0.0f, -m_angle),
+                Multiply(AxisAngle(1.0f, 0.0f, 0.0f, pitch), AxisAngle(0.0f, 0.0f, 1.0f, roll)));
+        frame.internalSpeed = m_internalSpeed;
+        return frame;
+    }
+
+private:
+    std::mt19937 m_random;
+    f32 m_angle;
+    f32 m_radius;
+    f32 m_internalSpeed = 0.0f;
+};
+
+size_t EncodedSize(const pb_msgdesc_t *fields, const void *message) {
+    size_t size;
+    if (!pb_get_encoded_size(&size, fields, message)) {
+        abort();
+    }
+    return size;
+}
+
+void Compare(const PlayerFrame &frame, const PlayerFrame &result, Errors &errors) {
+    errors.pos = std::max({errors.pos, std::abs(result.pos.x - frame.pos.x),
+            std::abs(result.pos.y - frame.pos.y), std::abs(result.pos.z - frame.pos.z)});
+    const PlayerFrame_Quat &q0 = frame.mainRot, &q1 = result.mainRot;
+    f32 dot = std::abs(q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w);
+    f32 angle = 2.0f * std::acos(std::min(dot, 1.0f)) * 180.0f / std::numbers::pi_v<f32>;
+    errors.rot = std::max(errors.rot, angle);
+    errors.internalSpeed =
+            std::max(errors.internalSpeed, std::abs(result.internalSpeed - frame.internalSpeed));
+    const InputState &i0 = frame.inputState, &i1 = result.inputState;
+    errors.inputStateMismatches += i0.accelerate != i1.accelerate || i0.brake != i1.brake ||
+            i0.item != i1.item || i0.drift != i1.drift || i0.brakeDrift != i1.brakeDrift ||
+            i0.stickX != i1.stickX || i0.stickY != i1.stickY || i0.trick != i1.trick;
+    errors.timeMismatches += frame.timeBeforeRespawn != result.timeBeforeRespawn ||
+            frame.timeInRespawn != result.timeInRespawn ||
+            !std::equal(frame.timesBeforeBoostEnd, frame.timesBeforeBoostEnd + 3,
+                    result.timesBeforeBoostEnd);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    u32 frameCount = 60 * 60 * 3;
+    u32 playerCount = 12;
+    u32 seed = 0;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (!strcmp(argv[i], "-n")) {
+            frameCount = strtoul(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "-p")) {
+            playerCount = std::clamp<u32>(strtoul(argv[i + 1], nullptr, 0), 1, 12);
+        } else if (!strcmp(argv[i], "-s")) {
+            seed = strtoul(argv[i + 1], nullptr, 0);
+        } else {
+            break;
+        }
+    }
+    if (i != argc) {
+        fprintf(stderr, "Usage: %s [-n frames] [-p players] [-s seed]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Driver> drivers;
+    for (u32 i = 0; i < playerCount; i++) {
+        drivers.emplace_back(seed * 12 + i);
+    }
+    // As in RaceClient, each side keeps the last quantized position of every player as the base
+    // of the next one, so any drift between them would build up over the race.
+    std::vector<SP::PlayerFrameCodec::Pos> senderPos(playerCount), receiverPos(playerCount);
+
+    Errors errors;
+    u64 frameSize = 0, packedFrameSize = 0;
+    f64 packNs = 0.0, unpackNs = 0.0;
+    for (u32 t = 0; t < frameCount; t++) {
+        for (u32 i = 0; i < playerCount; i++) {
+            PlayerFrame frame = drivers[i].next();
+            PackedPlayerFrame packed = PackedPlayerFrame_init_zero;
+            auto start = std::chrono::steady_clock::now();
+            SP::PlayerFrameCodec::Pack(frame, senderPos[i], packed, senderPos[i]);
+            auto mid = std::chrono::steady_clock::now();
+            PlayerFrame result = PlayerFrame_init_zero;
+            SP::PlayerFrameCodec::Unpack(packed, receiverPos[i], result, receiverPos[i]);
+            auto end = std::chrono::steady_clock::now();
+            packNs += std::chrono::duration<f64, std::nano>(mid - start).count();
+            unpackNs += std::chrono::duration<f64, std::nano>(end - mid).count();
+
+            frameSize += EncodedSize(PlayerFrame_fields, &frame);
+            packedFrameSize += EncodedSize(PackedPlayerFrame_fields, &packed);
+            Compare(frame, result, errors);
+        }
+    }
+
+    u64 count = static_cast<u64>(frameCount) * playerCount;
+    if (count == 0) {
+        return EXIT_SUCCESS;
+    }
+    printf("%u frames of %u players\n", frameCount, playerCount);
+    printf("  PlayerFrame       %6.2f bytes/frame\n", static_cast<f64>(frameSize) / count);
+    printf("  PackedPlayerFrame %6.2f bytes/frame\n", static_cast<f64>(packedFrameSize) / count);
+    printf("  Pack %.1f ns/frame, Unpack %.1f ns/frame\n", packNs / count, unpackNs / count);
+    printf("  Max error: pos %.4f, mainRot %.3f deg, internalSpeed %.4f\n", errors.pos,
+            errors.rot, errors.internalSpeed);
+    printf("  Mismatches: inputState %u, times %u\n", errors.inputStateMismatches,
+            errors.timeMismatches);
+
+    // Half a quantization step, plus the precision of floats at the scale of a course
+    bool ok = errors.pos <= 1.0f / 32.0f + 0.004f && errors.rot <= 0.25f &&
+            errors.internalSpeed <= 1.0f / 512.0f + 0.0001f && errors.inputStateMismatches == 0 &&
+            errors.timeMismatches == 0;
+    if (!ok) {
+        fprintf(stderr, "The round-trip error is out of bounds\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
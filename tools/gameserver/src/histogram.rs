@@ -0,0 +1,133 @@
+use std::fmt;
+use std::time::Duration;
+
+/// A histogram of durations with power-of-two microsecond buckets, cheap enough to be updated on
+/// every race tick.
+#[derive(Debug, Default)]
+pub struct Histogram {
+    counts: [u32; Self::BUCKET_COUNT],
+    count: u32,
+    sum: Duration,
+    max: Duration,
+}
+
+impl Histogram {
+    /// The first bucket holds durations below 64us, the last one those above 32ms.
+    const BUCKET_COUNT: usize = 11;
+    const FIRST_BUCKET_SHIFT: u32 = 6;
+
+    pub fn record(&mut self, duration: Duration) {
+        let micros = duration.as_micros().min(u32::MAX as u128) as u32;
+        let bucket = (u32::BITS - (micros >> Self::FIRST_BUCKET_SHIFT).leading_zeros()) as usize;
+        self.counts[bucket.min(Self::BUCKET_COUNT - 1)] += 1;
+        self.count += 1;
+        self.sum += duration;
+        self.max = self.max.max(duration);
+    }
+
+    pub fn count(&self) -> u32 {
+        self.count
+    }
+
+    /// Returns the upper bound of the bucket containing the given quantile.
+    pub fn quantile(&self, quantile: f64) -> Duration {
+        let target = (self.count as f64 * quantile).ceil() as u32;
+        let mut count = 0;
+        for (bucket, bucket_count) in self.counts.iter().enumerate() {
+            count += bucket_count;
+            if count >= target.max(1) {
+                return Self::bucket_limit(bucket).min(self.max);
+            }
+        }
+        self.max
+    }
+
+    pub fn reset(&mut self) {
+        *self = Histogram::default();
+    }
+
+    fn bucket_limit(bucket: usize) -> Duration {
+        if bucket == Self::BUCKET_COUNT - 1 {
+            return Duration::MAX;
+        }
+        Duration::from_micros(1 << (bucket as u32 + Self::FIRST_BUCKET_SHIFT))
+    }
+}
+
+impl fmt::Display for Histogram {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        if self.count == 0 {
+            return write!(f, "empty");
+        }
+        write!(
+            f,
+            "mean {:?}, p50 <= {:?}, p99 <= {:?}, max {:?}, buckets {:?}",
+            self.sum / self.count,
+            self.quantile(0.5),
+            self.quantile(0.99),
+            self.max,
+            self.counts,
+        )
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn micros(micros: u64) -> Duration {
+        Duration::from_micros(micros)
+    }
+
+    #[test]
+    fn records_in_power_of_two_buckets() {
+        let mut histogram = Histogram::default();
+        for duration in [0, 63, 64, 127, 128, 32_767, 32_768, 10_000_000] {
+            histogram.record(micros(duration));
+        }
+        assert_eq!(histogram.counts, [2, 2, 1, 0, 0, 0, 0, 0, 0, 1, 2]);
+        assert_eq!(histogram.count(), 8);
+        assert_eq!(histogram.max, micros(10_000_000));
+    }
+
+    #[test]
+    fn quantiles_are_bucket_limits() {
+        let mut histogram = Histogram::default();
+        for _ in 0..90 {
+            histogram.record(micros(10));
+        }
+        for _ in 0..9 {
+            histogram.record(micros(100));
+        }
+        histogram.record(micros(5_000));
+        assert_eq!(histogram.quantile(0.0), micros(64));
+        assert_eq!(histogram.quantile(0.5), micros(64));
+        assert_eq!(histogram.quantile(0.9), micros(64));
+        assert_eq!(histogram.quantile(0.91), micros(128));
+        assert_eq!(histogram.quantile(0.99), micros(128));
+        // The limit of the bucket is above the largest duration
+        assert_eq!(histogram.quantile(1.0), micros(5_000));
+    }
+
+    #[test]
+    fn last_bucket_quantile_is_max() {
+        let mut histogram = Histogram::default();
+        histogram.record(micros(10));
+        histogram.record(micros(100_000));
+        assert_eq!(histogram.quantile(0.5), micros(64));
+        assert_eq!(histogram.quantile(1.0), micros(100_000));
+    }
+
+    #[test]
+    fn empty_and_reset() {
+        let mut histogram = Histogram::default();
+        assert_eq!(histogram.quantile(0.5), Duration::ZERO);
+        assert_eq!(histogram.to_string(), "empty");
+        histogram.record(micros(1_000));
+        assert_ne!(histogram.to_string(), "empty");
+        histogram.reset();
+        assert_eq!(histogram.count(), 0);
+        assert_eq!(histogram.counts, [0; Histogram::BUCKET_COUNT]);
+        assert_eq!(histogram.to_string(), "empty");
+    }
+}
@@ -1,5 +1,9 @@
+mod histogram;
 mod matchmaking;
+mod player_frame;
+mod race_socket;
 mod room;
+mod spectators;
 mod unreliable_socket;
 
 use std::sync::Arc;
@@ -15,21 +19,22 @@ use tokio::net::{TcpListener, TcpStream};
 use tokio::sync::mpsc;
 use tokio_tungstenite::{MaybeTlsStream, WebSocketStream};
 
-use crate::room::Room;
+use crate::race_socket::RaceSocket;
+use crate::room::{Connect, Room};
 use matchmaking::Message;
 use netprotocol::{
     async_stream::AsyncStream,
     matchmaking::{gts_message, stg_message, GTSMessage, GTSMessageOpt, STGMessage, STGMessageOpt},
     room_protocol,
-    room_protocol::{room_request, RoomEventOpt, RoomRequest, RoomRequestOpt},
+    room_protocol::{RoomEventOpt, RoomRequest, RoomRequestOpt},
 };
 
 type RoomAsyncStream = AsyncStream<RoomRequestOpt, RoomEventOpt>;
 
 #[derive(Clone, Debug)]
 pub enum ServerConnection {
-    Client(mpsc::Sender<(RoomAsyncStream, room_request::Join)>),
-    Matchmaking(Arc<DashMap<u16, mpsc::Sender<(RoomAsyncStream, room_request::Join)>>>),
+    Client(mpsc::Sender<(RoomAsyncStream, Connect)>),
+    Matchmaking(Arc<DashMap<u16, mpsc::Sender<(RoomAsyncStream, Connect)>>>),
 }
 
 #[derive(clap::Parser, Debug)]
@@ -54,11 +59,14 @@ async fn main() -> Result<()> {
     libhydrogen::init()?;
     tracing_subscriber::fmt::init();
 
+    // Shared by the races of all rooms
+    let race_socket = RaceSocket::bind("0.0.0.0:21330").await?;
+
     let arg_count = std::env::args().skip(1).len();
     let server_conn;
     if arg_count == 0 {
         tracing::info!("No arguments passed, starting as standalone server.");
-        server_conn = ServerConnection::Client(spawn_room(None));
+        server_conn = ServerConnection::Client(spawn_room(None, race_socket));
     } else {
         tracing::info!("Arguments passed, starting as part of matchmaking pool.");
 
@@ -70,6 +78,7 @@ async fn main() -> Result<()> {
         tokio::spawn(central_listener(
             ws,
             rooms,
+            race_socket,
             args.gameserver_ip,
             args.gameserver_id,
             args.max_rooms,
@@ -116,7 +125,8 @@ async fn client_listener(server_keypair: kx::KeyPair, server_conn: ServerConnect
 
 async fn central_listener(
     mut ws: WebSocketStream<MaybeTlsStream<TcpStream>>,
-    rooms: Arc<DashMap<u16, mpsc::Sender<(RoomAsyncStream, room_request::Join)>>>,
+    rooms: Arc<DashMap<u16, mpsc::Sender<(RoomAsyncStream, Connect)>>>,
+    race_socket: RaceSocket,
     room_ip: std::net::Ipv4Addr,
     gameserver_id: u16,
     max_rooms: u16,
@@ -183,10 +193,13 @@ async fn central_listener(
                         match rooms.entry(room_id) {
                             Entry::Occupied(_) => continue,
                             Entry::Vacant(entry) => {
-                                entry.insert(spawn_room(Some(matchmaking::State {
-                                    room_id,
-                                    ws_conn: ws_send.clone(),
-                                })));
+                                entry.insert(spawn_room(
+                                    Some(matchmaking::State {
+                                        room_id,
+                                        ws_conn: ws_send.clone(),
+                                    }),
+                                    race_socket.clone(),
+                                ));
 
                                 break (room_id, waiting_client.take());
                             }
@@ -223,11 +236,12 @@ async fn central_listener(
 
 fn spawn_room(
     match_state: Option<matchmaking::State>,
-) -> mpsc::Sender<(RoomAsyncStream, room_request::Join)> {
+    race_socket: RaceSocket,
+) -> mpsc::Sender<(RoomAsyncStream, Connect)> {
     let (connect_tx, connect_rx) = mpsc::channel(32);
 
     tokio::spawn(async move {
-        let mut room = Room::new(connect_rx, match_state);
+        let mut room = Room::new(connect_rx, match_state, race_socket);
         room.handle().await
     });
 
@@ -244,12 +258,18 @@ async fn handle_client(
 
     let request: RoomRequestOpt =
         stream.read().await?.context("Connection closed unexpectedly!")?;
-    let join = match request.request {
-        Some(RoomRequest::Join(join)) => join,
+    let connect = match request.request {
+        Some(RoomRequest::Join(join)) => Connect::Join(join),
+        // Spectators have no token, so only private rooms can be spectated.
+        Some(RoomRequest::Spectate(_)) => Connect::Spectate,
         _ => anyhow::bail!("Unexpected request type!"),
     };
+    let login_info = match &connect {
+        Connect::Join(join) => join.login_info.as_ref(),
+        Connect::Spectate => None,
+    };
 
-    let connect_tx = match &join.login_info {
+    let connect_tx = match login_info {
         Some(login_info) => {
             let ServerConnection::Matchmaking(rooms) = server_conn else {
                 anyhow::bail!("Provided connection token to private room!");
@@ -266,6 +286,10 @@ async fn handle_client(
         },
     };
 
+    let Connect::Join(join) = &connect else {
+        connect_tx.send((stream, connect)).await?;
+        return Ok(());
+    };
     if join.miis.len() != 1 {
         anyhow::bail!("Invalid Mii count!");
     }
@@ -280,6 +304,6 @@ async fn handle_client(
         anyhow::bail!("Invalid setting count!");
     }
 
-    connect_tx.send((stream, join)).await?;
+    connect_tx.send((stream, connect)).await?;
     Ok(())
 }
@@ -0,0 +1,28 @@
+//! Helpers for the packed player frames of the race protocol. Positions are in fixed point and
+//! relative to a base frame, the server only converts them between bases and never dequantizes
+//! them.
+
+use crate::room_protocol::PackedPlayerFrame;
+
+pub type Pos = [i32; 3];
+
+pub fn pos(frame: &PackedPlayerFrame) -> Pos {
+    [frame.pos_x, frame.pos_y, frame.pos_z]
+}
+
+/// Turns a position relative to `base` into an absolute one.
+pub fn to_absolute(frame: &mut PackedPlayerFrame, base: Pos) {
+    frame.pos_x = base[0].wrapping_add(frame.pos_x);
+    frame.pos_y = base[1].wrapping_add(frame.pos_y);
+    frame.pos_z = base[2].wrapping_add(frame.pos_z);
+}
+
+/// Turns an absolute position into one relative to `base`.
+pub fn to_relative(frame: &PackedPlayerFrame, base: Pos) -> PackedPlayerFrame {
+    PackedPlayerFrame {
+        pos_x: frame.pos_x.wrapping_sub(base[0]),
+        pos_y: frame.pos_y.wrapping_sub(base[1]),
+        pos_z: frame.pos_z.wrapping_sub(base[2]),
+        ..frame.clone()
+    }
+}
@@ -0,0 +1,253 @@
+use std::net::SocketAddr;
+use std::sync::Arc;
+
+use anyhow::Result;
+use dashmap::mapref::entry::Entry;
+use dashmap::DashMap;
+use tokio::net::UdpSocket;
+use tokio::sync::mpsc;
+
+/// The UDP endpoint shared by the races of all rooms. Each datagram starts with the tag of the
+/// connection it belongs to, which is used to route it to the room of that connection.
+#[derive(Clone, Debug)]
+pub struct RaceSocket {
+    inner: Arc<Inner>,
+}
+
+#[derive(Debug)]
+struct Inner {
+    socket: UdpSocket,
+    routes: DashMap<u32, Option<mpsc::Sender<Datagram>>>,
+}
+
+#[derive(Debug)]
+pub struct Datagram {
+    pub tag: u32,
+    pub addr: SocketAddr,
+    pub data: Vec<u8>,
+}
+
+/// A tag reserved for a connection, which is released when dropped.
+#[derive(Debug)]
+pub struct Tag {
+    value: u32,
+    inner: Arc<Inner>,
+}
+
+impl RaceSocket {
+    pub const TAG_SIZE: usize = 4;
+    /// Datagrams are dropped rather than queued when a room falls this far behind.
+    const QUEUE_SIZE: usize = 256;
+
+    pub async fn bind(addr: &str) -> Result<RaceSocket> {
+        let inner = Arc::new(Inner {
+            socket: UdpSocket::bind(addr).await?,
+            routes: DashMap::new(),
+        });
+        tokio::spawn(Self::route(inner.clone()));
+        Ok(RaceSocket {
+            inner,
+        })
+    }
+
+    #[cfg(test)]
+    pub fn local_addr(&self) -> Result<SocketAddr> {
+        Ok(self.inner.socket.local_addr()?)
+    }
+
+    pub fn reserve_tag(&self) -> Tag {
+        loop {
+            let value = rand::random::<u32>();
+            if let Entry::Vacant(entry) = self.inner.routes.entry(value) {
+                entry.insert(None);
+                return Tag {
+                    value,
+                    inner: self.inner.clone(),
+                };
+            }
+        }
+    }
+
+    /// Routes the datagrams of the given connections to the returned receiver, until it is
+    /// dropped or the tags are released.
+    pub fn subscribe(&self, tags: impl Iterator<Item = u32>) -> mpsc::Receiver<Datagram> {
+        let (tx, rx) = mpsc::channel(Self::QUEUE_SIZE);
+        for tag in tags {
+            if let Some(mut route) = self.inner.routes.get_mut(&tag) {
+                *route = Some(tx.clone());
+            }
+        }
+        rx
+    }
+
+    /// Routes the datagrams of a connection to the receiver of an earlier one, returns false if
+    /// that one has been released.
+    pub fn share_route(&self, tag: u32, existing_tag: u32) -> bool {
+        let Some(tx) = self.inner.routes.get(&existing_tag).and_then(|route| route.clone()) else {
+            return false;
+        };
+        match self.inner.routes.get_mut(&tag) {
+            Some(mut route) => {
+                *route = Some(tx);
+                true
+            }
+            None => false,
+        }
+    }
+
+    pub async fn send_to(&self, tag: u32, message: &[u8], addr: SocketAddr) -> Result<()> {
+        let mut datagram = Vec::with_capacity(Self::TAG_SIZE + message.len());
+        datagram.extend_from_slice(&tag.to_be_bytes());
+        datagram.extend_from_slice(message);
+        self.inner.socket.send_to(&datagram, addr).await?;
+        Ok(())
+    }
+
+    async fn route(inner: Arc<Inner>) {
+        let mut buffer = [0u8; 1024];
+        loop {
+            let (size, addr) = match inner.socket.recv_from(&mut buffer).await {
+                Ok(result) => result,
+                Err(e) => {
+                    tracing::error!("Failed to receive race datagram: {e}");
+                    continue;
+                }
+            };
+            if size < Self::TAG_SIZE {
+                continue;
+            }
+            let tag = u32::from_be_bytes(buffer[0..Self::TAG_SIZE].try_into().unwrap());
+            let Some(route) = inner.routes.get(&tag).and_then(|route| route.clone()) else {
+                continue;
+            };
+            let datagram = Datagram {
+                tag,
+                addr,
+                data: buffer[Self::TAG_SIZE..size].to_vec(),
+            };
+            let _ = route.try_send(datagram);
+        }
+    }
+}
+
+impl Tag {
+    pub fn value(&self) -> u32 {
+        self.value
+    }
+}
+
+impl Drop for Tag {
+    fn drop(&mut self) {
+        self.inner.routes.remove(&self.value);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::{Duration, Instant};
+
+    use anyhow::anyhow;
+    use tokio::time;
+
+    use super::*;
+    use crate::histogram::Histogram;
+
+    const ROOM_COUNT: usize = 16;
+    const CLIENT_COUNT: usize = 12;
+    const TICK_COUNT: u32 = 120;
+    const TICK_DURATION: Duration = Duration::from_millis(16);
+
+    /// Sends an input on the schedule of each tick, and waits for the frame of the room before
+    /// the next one. The input is sent again if either of them got lost.
+    async fn run_client(race_addr: SocketAddr, tag: u32, start: Instant) -> Result<()> {
+        let socket = UdpSocket::bind("127.0.0.1:0").await?;
+        let mut buffer = [0u8; 1024];
+        for tick in 0..TICK_COUNT {
+            time::sleep_until((start + TICK_DURATION * tick).into()).await;
+            let mut datagram = tag.to_be_bytes().to_vec();
+            datagram.extend_from_slice(&tick.to_be_bytes());
+            loop {
+                socket.send_to(&datagram, race_addr).await?;
+                let size = tokio::select! {
+                    r = socket.recv(&mut buffer) => r?,
+                    _ = time::sleep(TICK_DURATION) => continue,
+                };
+                if buffer[RaceSocket::TAG_SIZE..size] == tick.to_be_bytes() {
+                    break;
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Waits for the inputs of every client for each tick, then sends them the frame. Returns the
+    /// latencies of the ticks, from their scheduled start to the last input.
+    async fn run_room(
+        socket: RaceSocket,
+        tags: Vec<Tag>,
+        mut datagrams: mpsc::Receiver<Datagram>,
+        start: Instant,
+    ) -> Result<Histogram> {
+        let mut histogram = Histogram::default();
+        let mut addrs = vec![None; tags.len()];
+        let mut has_input = vec![false; tags.len()];
+        for tick in 0..TICK_COUNT {
+            has_input.fill(false);
+            let mut input_count = 0;
+            while input_count < tags.len() {
+                let datagram = datagrams.recv().await.ok_or(anyhow!("Race socket closed!"))?;
+                let index = tags.iter().position(|tag| tag.value() == datagram.tag).unwrap();
+                let input_tick = u32::from_be_bytes(datagram.data[..].try_into()?);
+                if input_tick + 1 == tick {
+                    // The frame of the previous tick got lost
+                    socket.send_to(datagram.tag, &input_tick.to_be_bytes(), datagram.addr).await?;
+                }
+                if input_tick != tick || has_input[index] {
+                    continue;
+                }
+                has_input[index] = true;
+                addrs[index] = Some(datagram.addr);
+                input_count += 1;
+            }
+            histogram.record(start.elapsed().saturating_sub(TICK_DURATION * tick));
+            for (tag, addr) in tags.iter().zip(&addrs) {
+                socket.send_to(tag.value(), &tick.to_be_bytes(), addr.unwrap()).await?;
+            }
+        }
+        Ok(histogram)
+    }
+
+    /// Rooms of 12 clients race at the same time on the shared socket, each of them must get the
+    /// inputs of every tick in time.
+    #[tokio::test(flavor = "multi_thread")]
+    async fn rooms_get_every_tick() -> Result<()> {
+        let race_socket = RaceSocket::bind("127.0.0.1:0").await?;
+        let race_addr = race_socket.local_addr()?;
+        // Leaves time for every task to be spawned
+        let start = Instant::now() + TICK_DURATION * 4;
+
+        let mut room_tasks = vec![];
+        let mut client_tasks = vec![];
+        for _ in 0..ROOM_COUNT {
+            let tags: Vec<Tag> = (0..CLIENT_COUNT).map(|_| race_socket.reserve_tag()).collect();
+            let datagrams = race_socket.subscribe(tags.iter().map(Tag::value));
+            for tag in &tags {
+                client_tasks.push(tokio::spawn(run_client(race_addr, tag.value(), start)));
+            }
+            let room_task = run_room(race_socket.clone(), tags, datagrams, start);
+            room_tasks.push(tokio::spawn(room_task));
+        }
+
+        for task in client_tasks {
+            task.await??;
+        }
+        for (i, task) in room_tasks.into_iter().enumerate() {
+            let histogram = task.await??;
+            println!("Room {i}: {histogram}");
+            assert_eq!(histogram.count(), TICK_COUNT);
+            // Lenient, as the test shares the machine with the other ones
+            assert!(histogram.quantile(0.99) <= TICK_DURATION * 8);
+        }
+        Ok(())
+    }
+}
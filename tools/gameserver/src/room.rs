@@ -1,42 +1,70 @@
+use std::collections::{HashMap, VecDeque};
+use std::time::{Duration, Instant};
+
 use anyhow::{Context, Result};
 use libhydrogen::secretbox;
 use rand::Rng;
 use slab::Slab;
-use tokio::net::UdpSocket;
 use tokio::sync::{broadcast, mpsc};
 use tokio::task::JoinHandle;
+use tokio::time::{self, MissedTickBehavior};
 
+use crate::histogram::Histogram;
 use crate::matchmaking;
+use crate::player_frame;
+use crate::race_socket::{self, RaceSocket};
 use crate::room_protocol::room_event::Properties;
 use crate::room_protocol::*;
+use crate::spectators::Spectators;
 use crate::unreliable_socket::{Connection, UnreliableSocket};
 use crate::RoomAsyncStream;
 
+/// How a connection enters a room.
+#[derive(Debug)]
+pub enum Connect {
+    Join(room_request::Join),
+    Spectate,
+}
+
 #[derive(Debug)]
 pub struct Room {
-    connect_rx: mpsc::Receiver<(RoomAsyncStream, room_request::Join)>,
+    connect_rx: mpsc::Receiver<(RoomAsyncStream, Connect)>,
     disconnect_tx: mpsc::Sender<usize>,
     disconnect_rx: mpsc::Receiver<usize>,
     read_tx: mpsc::Sender<(usize, RoomRequestOpt)>,
     read_rx: mpsc::Receiver<(usize, RoomRequestOpt)>,
     write_tx: broadcast::Sender<RoomEventOpt>,
+    /// The number of events sent by the room, which tells the spectator relay where the state
+    /// written to a new spectator ends.
+    event_count: u64,
     clients: Slab<Client>,
     players: Vec<Player>,
     settings: Option<Vec<u32>>,
     matchmaking_state: Option<matchmaking::State>,
+    race_socket: RaceSocket,
+    spectators: Spectators,
 }
 
 impl Room {
     const MAX_CLIENT_COUNT: usize = 32;
     const MAX_PLAYER_COUNT: usize = 12;
+    /// The number of sent race frames that clients can acknowledge and get positions relative to.
+    const FRAME_HISTORY_SIZE: usize = 64;
+    /// Race frames are broadcast at the game's frame rate, whether or not every client has sent
+    /// a new frame since the previous tick.
+    const TICK_DURATION: Duration = Duration::from_nanos(1_000_000_000 / 60);
+    /// The number of ticks over which timing histograms are accumulated before being logged.
+    const TICK_REPORT_INTERVAL: u32 = 60 * 60;
 
     pub fn new(
-        connect_rx: mpsc::Receiver<(RoomAsyncStream, room_request::Join)>,
+        connect_rx: mpsc::Receiver<(RoomAsyncStream, Connect)>,
         matchmaking_state: Option<matchmaking::State>,
+        race_socket: RaceSocket,
     ) -> Room {
         let (disconnect_tx, disconnect_rx) = mpsc::channel(32);
         let (read_tx, read_rx) = mpsc::channel(32);
         let (write_tx, _) = broadcast::channel(32);
+        let spectators = Spectators::new(write_tx.clone(), race_socket.clone());
 
         Room {
             connect_rx,
@@ -45,10 +73,13 @@ impl Room {
             read_tx,
             read_rx,
             write_tx,
+            event_count: 0,
             clients: Slab::new(),
             players: vec![],
             settings: None,
             matchmaking_state,
+            race_socket,
+            spectators,
         }
     }
 
@@ -74,6 +105,11 @@ impl Room {
         self.client_players(client_key).skip(client_player_id).next()
     }
 
+    fn send_event(&mut self, event: RoomEventOpt) {
+        self.event_count += 1;
+        let _ = self.write_tx.send(event);
+    }
+
     fn start_lobby(&mut self, gamemode: u32) {
         let event = room_event::Start {
             gamemode,
@@ -83,7 +119,7 @@ impl Room {
             event: Some(event),
         };
 
-        let _ = self.write_tx.send(event);
+        self.send_event(event);
     }
 
     pub async fn handle(&mut self) -> Result<()> {
@@ -99,7 +135,14 @@ impl Room {
     async fn handle_lobby(&mut self) -> Result<Option<u32>> {
         loop {
             tokio::select! {
-                Some((stream, join)) = self.connect_rx.recv() => {
+                Some((stream, connect)) = self.connect_rx.recv() => {
+                    let join = match connect {
+                        Connect::Join(join) => join,
+                        Connect::Spectate => {
+                            self.handle_spectate_connect(stream).await;
+                            continue;
+                        }
+                    };
                     match self.handle_lobby_connect(stream, join) {
                         Ok(Some(gamemode)) => return Ok(Some(gamemode)),
                         Err(e) => tracing::error!("Failed to join: {e}"),
@@ -130,6 +173,9 @@ impl Room {
     async fn handle_select(&mut self, gamemode: u32) -> Result<Option<u32>> {
         loop {
             tokio::select! {
+                Some((stream, connect)) = self.connect_rx.recv() => {
+                    self.handle_late_connect(stream, connect).await;
+                },
                 Some((client_key, request)) = self.read_rx.recv() => {
                     if self.clients.get(client_key).is_none() {
                         continue;
@@ -147,78 +193,192 @@ impl Room {
     }
 
     async fn handle_race(&mut self) -> Result<()> {
-        let socket = UdpSocket::bind("0.0.0.0:21330").await?;
         let context = secretbox::Context::from(*b"race    ");
+        // Client keys are slab keys, which can have holes, while the connections of the socket
+        // are indexed from 0.
+        let connection_indices: HashMap<usize, usize> =
+            self.clients.iter().enumerate().map(|(index, (key, _))| (key, index)).collect();
         let connections = self
             .clients
             .iter()
-            .map(|(_, client)| Connection::new(client.read_key.clone(), client.write_key.clone()))
+            .map(|(_, client)| {
+                Connection::new(
+                    client.tag.value(),
+                    client.read_key.clone(),
+                    client.write_key.clone(),
+                )
+            })
             .collect();
-        let mut unreliable_socket = UnreliableSocket::new(socket, context, connections);
+        let mut unreliable_socket =
+            UnreliableSocket::new(self.race_socket.clone(), context, connections);
+        self.spectators.start_race().await;
 
-        let mut pending_clients = (0..self.clients.len()).collect::<Vec<_>>();
+        let mut pending_clients = (0..connection_indices.len()).collect::<Vec<_>>();
         while !pending_clients.is_empty() {
             let (index, _) = unreliable_socket.read::<RaceClientPing>().await?;
             pending_clients.retain(|i| *i != index);
         }
 
+        // Only the latest frame of each player is kept, and the race only starts once every
+        // player has sent one.
         let mut player_frames = vec![None; self.players.len()];
-        let mut player_frames = loop {
+        let mut acked_times = vec![None; connection_indices.len()];
+        while player_frames.iter().any(Option::is_none) {
             let Some((client_key, request)) = self.read_rx.recv().await else {return Ok(())};
-            let Some(request) = request.request else { continue }; // TODO handle
-            let race = match request {
-                RoomRequest::Race(race) => race,
-                _ => continue, // TODO handle
-            };
-            if race.players.len() != self.clients[client_key].player_count {
-                continue; // TODO handle
-            }
-            tracing::debug!("{:?} {:?}", client_key, race);
-            for ((player_id, _), player_frame) in
-                self.client_players(client_key).zip(race.players.into_iter())
-            {
-                player_frames[player_id] = Some((race.time, player_frame));
-            }
+            let acked_time = connection_indices.get(&client_key).map(|i| &mut acked_times[*i]);
+            self.handle_race_request(client_key, request, &mut player_frames, acked_time);
+        }
 
-            let player_frames: Option<Vec<_>> = player_frames.iter().cloned().collect();
-            if let Some(player_frames) = player_frames {
-                break player_frames;
-            }
+        let mut history = VecDeque::with_capacity(Self::FRAME_HISTORY_SIZE);
+        let mut server_frame = PackedRaceServerFrame {
+            time: 0,
+            player_times: Vec::with_capacity(self.players.len()),
+            players: Vec::with_capacity(self.players.len()),
+            base_time: None,
         };
-
+        // Clients which acknowledged the same frame get the same bytes, so each distinct base is
+        // only encoded once per tick.
+        let mut encoded_frames: Vec<(Option<u32>, Vec<u8>)> = Vec::new();
+        let mut tick_durations = Histogram::default();
+        let mut tick_delays = Histogram::default();
+        let mut interval = time::interval(Self::TICK_DURATION);
+        interval.set_missed_tick_behavior(MissedTickBehavior::Skip);
         for time in 0.. {
-            let Some((client_key, request)) = self.read_rx.recv().await else {return Ok(())};
-            let Some(request) = request.request else { continue }; // TODO handle
-            let race = match request {
-                RoomRequest::Race(race) => race,
-                _ => continue, // TODO handle
+            let deadline = loop {
+                tokio::select! {
+                    deadline = interval.tick() => break deadline,
+                    Some((stream, connect)) = self.connect_rx.recv() => {
+                        self.handle_late_connect(stream, connect).await;
+                    }
+                    request = self.read_rx.recv() => {
+                        let Some((client_key, request)) = request else { return Ok(()) };
+                        let acked_time =
+                            connection_indices.get(&client_key).map(|i| &mut acked_times[*i]);
+                        self.handle_race_request(
+                            client_key,
+                            request,
+                            &mut player_frames,
+                            acked_time,
+                        );
+                    }
+                }
             };
-            if race.players.len() != self.clients[client_key].player_count {
-                continue; // TODO handle
+            let start = Instant::now();
+
+            server_frame.time = time;
+            server_frame.player_times.clear();
+            server_frame.player_times.extend(player_frames.iter().flatten().map(|(time, _)| *time));
+            if history.len() == Self::FRAME_HISTORY_SIZE {
+                history.pop_front();
             }
-            tracing::debug!("{:?} {:?}", client_key, race);
-            for ((player_id, _), player_frame) in
-                self.client_players(client_key).zip(race.players.into_iter())
-            {
-                player_frames[player_id] = (race.time, player_frame);
+            let positions: Vec<_> = player_frames
+                .iter()
+                .flatten()
+                .map(|(_, player_frame)| player_frame::pos(player_frame))
+                .collect();
+            history.push_back((time, positions));
+
+            // Spectators get the absolute frame of every few ticks, after the clients.
+            let spectator_tick = time % Spectators::FRAME_INTERVAL == 0;
+            let indices = (0..acked_times.len()).map(Some).chain(spectator_tick.then_some(None));
+            let mut encoded_frame_count = 0;
+            for index in indices {
+                // Send the positions relative to the last frame the client has acknowledged, if
+                // it is recent enough.
+                let base = index
+                    .and_then(|index| acked_times[index])
+                    .and_then(|acked_time| history.iter().find(|(time, _)| *time == acked_time));
+                let base_time = base.map(|(time, _)| *time);
+                let encoded = encoded_frames[..encoded_frame_count]
+                    .iter()
+                    .position(|(time, _)| *time == base_time);
+                let encoded = match encoded {
+                    Some(encoded) => encoded,
+                    None => {
+                        server_frame.players.clear();
+                        match base {
+                            Some((_, base)) => server_frame.players.extend(
+                                player_frames.iter().flatten().zip(base).map(
+                                    |((_, player_frame), base)| {
+                                        player_frame::to_relative(player_frame, *base)
+                                    },
+                                ),
+                            ),
+                            None => server_frame.players.extend(
+                                player_frames
+                                    .iter()
+                                    .flatten()
+                                    .map(|(_, player_frame)| player_frame.clone()),
+                            ),
+                        }
+                        server_frame.base_time = base_time;
+                        tracing::debug!("{:?}", server_frame);
+                        if encoded_frames.len() == encoded_frame_count {
+                            encoded_frames.push((None, Vec::new()));
+                        }
+                        let (time, message) = &mut encoded_frames[encoded_frame_count];
+                        *time = base_time;
+                        message.clear();
+                        server_frame.encode(message)?;
+                        encoded_frame_count += 1;
+                        encoded_frame_count - 1
+                    }
+                };
+                match index {
+                    Some(index) => {
+                        unreliable_socket.write(index, &encoded_frames[encoded].1).await?
+                    }
+                    None => self.spectators.send_frame(&encoded_frames[encoded].1),
+                }
             }
-            let player_times = player_frames.iter().map(|(time, _)| *time).collect();
-            let players =
-                player_frames.iter().map(|(_, player_frame)| player_frame.clone()).collect();
-            let server_frame = RaceServerFrame {
-                time,
-                player_times,
-                players,
-            };
-            tracing::debug!("{:?}", server_frame);
-            for index in 0..self.clients.len() {
-                unreliable_socket.write(index, &server_frame).await?;
+
+            tick_durations.record(start.elapsed());
+            tick_delays.record(start.saturating_duration_since(deadline.into_std()));
+            if tick_durations.count() == Self::TICK_REPORT_INTERVAL {
+                tracing::info!("Race tick durations: {tick_durations}");
+                tracing::info!("Race tick delays: {tick_delays}");
+                tick_durations.reset();
+                tick_delays.reset();
             }
         }
 
         Ok(())
     }
 
+    /// Stores the frames of a race request as the latest frames of the players of the client, and
+    /// the server time it acknowledges if the client has a race connection.
+    fn handle_race_request(
+        &self,
+        client_key: usize,
+        request: RoomRequestOpt,
+        player_frames: &mut [Option<(u32, PackedPlayerFrame)>],
+        acked_time: Option<&mut Option<u32>>,
+    ) {
+        let Some(request) = request.request else { return }; // TODO handle
+        let race = match request {
+            RoomRequest::Race(race) => race,
+            _ => return, // TODO handle
+        };
+        let Some(client) = self.clients.get(client_key) else { return };
+        if race.players.len() != client.player_count {
+            return; // TODO handle
+        }
+        tracing::debug!("{:?} {:?}", client_key, race);
+        if let Some(acked_time) = acked_time {
+            *acked_time = race.server_time;
+        }
+        for ((player_id, _), mut player_frame) in
+            self.client_players(client_key).zip(race.players.into_iter())
+        {
+            let base = match &player_frames[player_id] {
+                Some((_, player_frame)) => player_frame::pos(player_frame),
+                None => player_frame::Pos::default(),
+            };
+            player_frame::to_absolute(&mut player_frame, base);
+            player_frames[player_id] = Some((race.time, player_frame));
+        }
+    }
+
     fn handle_lobby_connect(
         &mut self,
         mut stream: RoomAsyncStream,
@@ -233,7 +393,15 @@ impl Room {
             "Max player count reached!",
         );
 
-        let mut to_write = vec![];
+        let tag = self.race_socket.reserve_tag();
+        let event = room_event::Connection {
+            tag: tag.value(),
+        };
+        let event = RoomEvent::Connection(event);
+        let event = RoomEventOpt {
+            event: Some(event),
+        };
+        let mut to_write = vec![event];
         let is_host = self.settings.is_none();
 
         let client_id = match &mut self.matchmaking_state {
@@ -292,7 +460,7 @@ impl Room {
             let event = RoomEventOpt {
                 event: Some(event),
             };
-            let _ = self.write_tx.send(event);
+            self.send_event(event);
         }
 
         let read_key = stream.read_key().clone();
@@ -340,6 +508,7 @@ impl Room {
         });
         let client = Client {
             is_host,
+            tag,
             read_key,
             write_key,
             player_count: join.miis.len(),
@@ -373,6 +542,54 @@ impl Room {
         }
     }
 
+    /// Hands a new spectator to the spectator relay, along with the current state of the room.
+    async fn handle_spectate_connect(&mut self, stream: RoomAsyncStream) {
+        let tag = self.race_socket.reserve_tag();
+        let event = room_event::Connection {
+            tag: tag.value(),
+        };
+        let event = RoomEvent::Connection(event);
+        let event = RoomEventOpt {
+            event: Some(event),
+        };
+        let mut to_write = vec![event];
+
+        for player in &self.players {
+            let event = room_event::Join {
+                mii: player.mii.clone(),
+                location: player.location,
+                latitude: player.latitude,
+                longitude: player.longitude,
+                region_line_color: player.region_line_color,
+            };
+            let event = RoomEvent::Join(event);
+            let event = RoomEventOpt {
+                event: Some(event),
+            };
+            to_write.push(event);
+        }
+        if let Some(settings) = self.settings.clone() {
+            let event = room_event::Settings {
+                settings,
+            };
+            let event = RoomEvent::Settings(event);
+            let event = RoomEventOpt {
+                event: Some(event),
+            };
+            to_write.push(event);
+        }
+
+        self.spectators.add(stream, tag, to_write, self.event_count).await;
+    }
+
+    /// Players can only join in the lobby, but spectators can join at any point.
+    async fn handle_late_connect(&mut self, stream: RoomAsyncStream, connect: Connect) {
+        match connect {
+            Connect::Join(_) => tracing::error!("Failed to join: The room has already started!"),
+            Connect::Spectate => self.handle_spectate_connect(stream).await,
+        }
+    }
+
     fn handle_lobby_disconnect(&mut self, client_key: usize) {
         for i in (0..self.players.len()).rev() {
             if self.players[i].client_key != client_key {
@@ -387,7 +604,7 @@ impl Room {
             let event = RoomEventOpt {
                 event: Some(event),
             };
-            let _ = self.write_tx.send(event);
+            self.send_event(event);
         }
 
         let client = self.clients.remove(client_key);
@@ -425,7 +642,7 @@ impl Room {
                 let event = RoomEventOpt {
                     event: Some(event),
                 };
-                let _ = self.write_tx.send(event);
+                self.send_event(event);
 
                 Ok(None)
             }
@@ -487,7 +704,9 @@ impl Room {
                     player.properties = Some(properties.clone());
                 }
 
-                for (player_id, _) in self.client_players(client_key) {
+                let player_ids: Vec<_> =
+                    self.client_players(client_key).map(|(player_id, _)| player_id).collect();
+                for player_id in player_ids {
                     let event = room_event::SelectPulse {
                         player_id: player_id as u32,
                     };
@@ -495,7 +714,7 @@ impl Room {
                     let event = RoomEventOpt {
                         event: Some(event),
                     };
-                    let _ = self.write_tx.send(event);
+                    self.send_event(event);
                 }
 
                 let Some(player_properties): Option<Vec<_>> = self.players.iter().map(|player| player.properties.clone()).collect() else { return Ok(None) };
@@ -511,7 +730,7 @@ impl Room {
                 let event = RoomEventOpt {
                     event: Some(event),
                 };
-                let _ = self.write_tx.send(event);
+                self.send_event(event);
 
                 Ok(Some(course))
             }
@@ -524,6 +743,7 @@ impl Room {
 #[derive(Debug)]
 struct Client {
     task: JoinHandle<()>,
+    tag: race_socket::Tag,
     read_key: secretbox::Key,
     write_key: secretbox::Key,
     player_count: usize,
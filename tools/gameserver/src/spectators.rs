@@ -0,0 +1,542 @@
+use std::collections::VecDeque;
+use std::sync::Arc;
+use std::time::Duration;
+
+use anyhow::Result;
+use libhydrogen::secretbox;
+use prost::Message;
+use slab::Slab;
+use tokio::sync::{broadcast, mpsc, watch};
+use tokio::task::JoinHandle;
+use tokio::time::{self, MissedTickBehavior};
+
+use crate::race_socket::{self, RaceSocket};
+use crate::room_protocol::*;
+use crate::unreliable_socket::{Connection, UnreliableSocket};
+use crate::RoomAsyncStream;
+
+/// The spectator tier of a room. Spectators are served by a separate relay task rather than by
+/// the room itself: the relay encodes each room event once for all of them, and sends them race
+/// frames at a lower rate, so that the number of spectators doesn't affect the tick of the race.
+#[derive(Debug)]
+pub struct Spectators {
+    command_tx: mpsc::Sender<Command>,
+    frame_tx: watch::Sender<Vec<u8>>,
+}
+
+#[derive(Debug)]
+enum Command {
+    Add {
+        stream: RoomAsyncStream,
+        tag: race_socket::Tag,
+        to_write: Vec<RoomEventOpt>,
+        event_count: u64,
+    },
+    StartRace,
+}
+
+impl Spectators {
+    const MAX_SPECTATOR_COUNT: usize = 512;
+    /// Race frames are only sent to spectators every this many ticks.
+    pub const FRAME_INTERVAL: u32 = 3;
+    /// The relay yields to other tasks after sending a race frame to this many spectators.
+    const BATCH_SIZE: usize = 32;
+    /// Spectators can come and go in bursts, so the room is told their count at most this often.
+    const COUNT_INTERVAL: Duration = Duration::from_secs(1);
+    const EVENT_QUEUE_SIZE: usize = 256;
+
+    pub fn new(write_tx: broadcast::Sender<RoomEventOpt>, race_socket: RaceSocket) -> Spectators {
+        let (command_tx, command_rx) = mpsc::channel(32);
+        let (frame_tx, frame_rx) = watch::channel(vec![]);
+        let (disconnect_tx, disconnect_rx) = mpsc::channel(32);
+        // Encoded events are queued per spectator, as the events of the room are for each client.
+        let (encoded_tx, _) = broadcast::channel(Self::EVENT_QUEUE_SIZE);
+        let relay = Relay {
+            command_rx,
+            frame_rx,
+            disconnect_tx,
+            disconnect_rx,
+            event_rx: write_tx.subscribe(),
+            write_tx,
+            event_count: 0,
+            recent_events: VecDeque::new(),
+            encoded_tx,
+            race_socket,
+            spectators: Slab::new(),
+            count_changed: false,
+            is_racing: false,
+            race: None,
+        };
+        tokio::spawn(relay.run());
+
+        Spectators {
+            command_tx,
+            frame_tx,
+        }
+    }
+
+    /// Hands the stream of a new spectator to the relay, which first writes the given events to
+    /// it, and then the room events which follow the first `event_count` ones.
+    pub async fn add(
+        &self,
+        stream: RoomAsyncStream,
+        tag: race_socket::Tag,
+        to_write: Vec<RoomEventOpt>,
+        event_count: u64,
+    ) {
+        let command = Command::Add {
+            stream,
+            tag,
+            to_write,
+            event_count,
+        };
+        let _ = self.command_tx.send(command).await;
+    }
+
+    /// Race frames are sent to the spectators from this point on, including the ones which connect
+    /// during the race.
+    pub async fn start_race(&self) {
+        let _ = self.command_tx.send(Command::StartRace).await;
+    }
+
+    /// Replaces the race frame to be sent next, a frame which is not sent before the next one is
+    /// simply skipped.
+    pub fn send_frame(&self, frame: &[u8]) {
+        self.frame_tx.send_modify(|latest| {
+            latest.clear();
+            latest.extend_from_slice(frame);
+        });
+    }
+}
+
+struct Relay {
+    command_rx: mpsc::Receiver<Command>,
+    frame_rx: watch::Receiver<Vec<u8>>,
+    disconnect_tx: mpsc::Sender<usize>,
+    disconnect_rx: mpsc::Receiver<usize>,
+    event_rx: broadcast::Receiver<RoomEventOpt>,
+    write_tx: broadcast::Sender<RoomEventOpt>,
+    /// The number of room events received, the spectator counts sent by the relay itself aside.
+    event_count: u64,
+    /// The last relayed events, with the number of room events received before each of them.
+    recent_events: VecDeque<(u64, Arc<Vec<u8>>)>,
+    encoded_tx: broadcast::Sender<Arc<Vec<u8>>>,
+    race_socket: RaceSocket,
+    spectators: Slab<Spectator>,
+    count_changed: bool,
+    is_racing: bool,
+    /// The unreliable socket of the spectators of the race, with the key of each connection, which
+    /// is cleared when the spectator disconnects as keys are reused.
+    race: Option<(UnreliableSocket, Vec<Option<usize>>)>,
+}
+
+impl Relay {
+    async fn run(mut self) {
+        let mut frame = vec![];
+        let mut count_interval = time::interval(Spectators::COUNT_INTERVAL);
+        count_interval.set_missed_tick_behavior(MissedTickBehavior::Delay);
+        loop {
+            tokio::select! {
+                command = self.command_rx.recv() => match command {
+                    Some(Command::Add { stream, tag, to_write, event_count }) => {
+                        self.add(stream, tag, to_write, event_count);
+                    }
+                    Some(Command::StartRace) => self.start_race(),
+                    // The room is gone
+                    None => break,
+                },
+                Some(spectator_key) = self.disconnect_rx.recv() => self.remove(spectator_key),
+                _ = count_interval.tick(), if self.count_changed => {
+                    self.count_changed = false;
+                    self.send_count();
+                },
+                event = self.event_rx.recv() => match event {
+                    Ok(event) => self.relay_event(event),
+                    Err(broadcast::error::RecvError::Lagged(count)) => self.skip_events(count),
+                    Err(broadcast::error::RecvError::Closed) => break,
+                },
+                changed = self.frame_rx.changed(), if self.race.is_some() => {
+                    if changed.is_err() {
+                        break;
+                    }
+                    frame.clear();
+                    frame.extend_from_slice(&self.frame_rx.borrow());
+                    self.write_frame(&frame).await;
+                },
+                // Only the address of the spectators is needed from their pings. The socket is
+                // closed once every spectator of the race is gone, and reopened for the next one.
+                r = read_ping(&mut self.race) => {
+                    if r.is_err() {
+                        self.race = None;
+                    }
+                },
+            }
+        }
+    }
+
+    fn add(
+        &mut self,
+        mut stream: RoomAsyncStream,
+        tag: race_socket::Tag,
+        to_write: Vec<RoomEventOpt>,
+        event_count: u64,
+    ) {
+        if self.spectators.len() >= Spectators::MAX_SPECTATOR_COUNT {
+            tracing::error!("Failed to spectate: Max spectator count reached!");
+            return;
+        }
+
+        // The events which the room sent before writing the ones to write first are relayed
+        // before the spectator subscribes, and the ones which it sent after and which were
+        // relayed already are written to the spectator first.
+        while self.event_count < event_count {
+            match self.event_rx.try_recv() {
+                Ok(event) => self.relay_event(event),
+                Err(broadcast::error::TryRecvError::Lagged(count)) => self.skip_events(count),
+                Err(_) => break,
+            }
+        }
+        let missed_events: Vec<_> = self
+            .recent_events
+            .iter()
+            .filter(|(before_count, _)| *before_count >= event_count)
+            .map(|(_, message)| message.clone())
+            .collect();
+
+        let read_key = stream.read_key().clone();
+        let write_key = stream.write_key().clone();
+        let spectator_entry = self.spectators.vacant_entry();
+        let spectator_key = spectator_entry.key();
+        let disconnect_tx = self.disconnect_tx.clone();
+        let mut encoded_rx = self.encoded_tx.subscribe();
+        let task = tokio::spawn(async move {
+            let handle_spectator = async move {
+                for message in to_write {
+                    stream.write(&message).await?;
+                }
+                for message in missed_events {
+                    stream.write_encoded(&message).await?;
+                }
+                loop {
+                    tokio::select! {
+                        r = encoded_rx.recv() => {
+                            let message = match r {
+                                Ok(message) => message,
+                                Err(_) => break,
+                            };
+                            stream.write_encoded(&message).await?;
+                        }
+                        // Spectators have no requests to make
+                        r = stream.read() => {
+                            if r?.is_none() {
+                                break;
+                            }
+                        }
+                    }
+                }
+                Ok(())
+            };
+
+            let r: Result<()> = handle_spectator.await;
+            match r {
+                Ok(()) => tracing::info!("Spectator disconnected"),
+                Err(e) => tracing::error!("Spectator disconnected: {e}"),
+            }
+
+            let _ = disconnect_tx.send(spectator_key).await;
+        });
+        spectator_entry.insert(Spectator {
+            task,
+            tag,
+            read_key,
+            write_key,
+        });
+        self.count_changed = true;
+
+        if self.is_racing {
+            self.add_race_connection(spectator_key);
+        }
+    }
+
+    fn remove(&mut self, spectator_key: usize) {
+        self.spectators.try_remove(spectator_key);
+        self.count_changed = true;
+        if let Some((_, spectator_keys)) = &mut self.race {
+            for key in spectator_keys.iter_mut().filter(|key| **key == Some(spectator_key)) {
+                *key = None;
+            }
+        }
+    }
+
+    fn relay_event(&mut self, event: RoomEventOpt) {
+        let message = Arc::new(event.encode_to_vec());
+        if self.recent_events.len() == Spectators::EVENT_QUEUE_SIZE {
+            self.recent_events.pop_front();
+        }
+        self.recent_events.push_back((self.event_count, message.clone()));
+        if !matches!(event.event, Some(RoomEvent::Spectate(_))) {
+            self.event_count += 1;
+        }
+        let _ = self.encoded_tx.send(message);
+    }
+
+    /// The skipped events are all counted as room events, which can only misplace the start of the
+    /// events of a new spectator once some are lost anyway.
+    fn skip_events(&mut self, count: u64) {
+        tracing::warn!("Spectator relay skipped {count} events");
+        self.event_count += count;
+    }
+
+    fn start_race(&mut self) {
+        self.is_racing = true;
+        self.connect_race();
+    }
+
+    fn connect_race(&mut self) {
+        let context = secretbox::Context::from(*b"race    ");
+        let spectator_keys = self.spectators.iter().map(|(key, _)| Some(key)).collect();
+        let connections =
+            self.spectators.iter().map(|(_, spectator)| spectator.race_connection()).collect();
+        let unreliable_socket =
+            UnreliableSocket::new(self.race_socket.clone(), context, connections);
+        self.race = Some((unreliable_socket, spectator_keys));
+    }
+
+    /// Spectators which connect during the race are added to its socket, which keeps the
+    /// addresses of the others.
+    fn add_race_connection(&mut self, spectator_key: usize) {
+        if let Some((unreliable_socket, spectator_keys)) = &mut self.race {
+            let connection = self.spectators[spectator_key].race_connection();
+            if unreliable_socket.add_connection(connection).is_some() {
+                spectator_keys.push(Some(spectator_key));
+                return;
+            }
+        }
+        // Every other spectator of the race is gone
+        self.connect_race();
+    }
+
+    async fn write_frame(&mut self, frame: &[u8]) {
+        let Some((unreliable_socket, spectator_keys)) = &mut self.race else {
+            return;
+        };
+        let mut write_count = 0;
+        for (index, spectator_key) in spectator_keys.iter().enumerate() {
+            // Spectators which haven't pinged yet or have disconnected
+            if unreliable_socket.connection_addr(index).is_none() || spectator_key.is_none() {
+                continue;
+            }
+            if let Err(e) = unreliable_socket.write(index, frame).await {
+                tracing::error!("Failed to send race frame to spectator: {e}");
+            }
+            write_count += 1;
+            if write_count % Spectators::BATCH_SIZE == 0 {
+                tokio::task::yield_now().await;
+            }
+        }
+    }
+
+    fn send_count(&self) {
+        let event = room_event::Spectate {
+            count: self.spectators.len() as u32,
+        };
+        let event = RoomEvent::Spectate(event);
+        let event = RoomEventOpt {
+            event: Some(event),
+        };
+        let _ = self.write_tx.send(event);
+    }
+}
+
+async fn read_ping(race: &mut Option<(UnreliableSocket, Vec<Option<usize>>)>) -> Result<()> {
+    match race {
+        Some((unreliable_socket, _)) => {
+            unreliable_socket.read::<RaceClientPing>().await?;
+        }
+        None => std::future::pending().await,
+    }
+    Ok(())
+}
+
+#[derive(Debug)]
+struct Spectator {
+    task: JoinHandle<()>,
+    tag: race_socket::Tag,
+    read_key: secretbox::Key,
+    write_key: secretbox::Key,
+}
+
+impl Spectator {
+    fn race_connection(&self) -> Connection {
+        Connection::new(self.tag.value(), self.read_key.clone(), self.write_key.clone())
+    }
+}
+
+impl Drop for Spectator {
+    fn drop(&mut self) {
+        self.task.abort();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::net::SocketAddr;
+    use std::time::Instant;
+
+    use libhydrogen::kx;
+    use tokio::io::{AsyncReadExt, AsyncWriteExt};
+    use tokio::net::{TcpListener, TcpStream, UdpSocket};
+
+    use super::*;
+
+    const SPECTATOR_COUNT: usize = 500;
+    const COMMENT_COUNT: u32 = 200;
+    const FRAME_DURATION: Duration = Duration::from_millis(50);
+
+    fn comment(message_id: u32) -> RoomEventOpt {
+        let event = room_event::Comment {
+            player_id: 0,
+            message_id,
+        };
+        RoomEventOpt {
+            event: Some(RoomEvent::Comment(event)),
+        }
+    }
+
+    async fn connect(addr: SocketAddr) -> Result<(TcpStream, kx::SessionKeyPair)> {
+        let mut stream = TcpStream::connect(addr).await?;
+        let mut state = kx::State::new();
+        let mut xx1 = kx::XXPacket1::new();
+        kx::xx_1(&mut state, &mut xx1, None)?;
+        stream.write_all(xx1.as_ref()).await?;
+        let mut xx2 = [0u8; kx::XX_PACKET2BYTES];
+        stream.read_exact(&mut xx2).await?;
+        let xx2 = kx::XXPacket2::from(xx2);
+        let mut xx3 = kx::XXPacket3::new();
+        let keypair = kx::xx_3(&mut state, &mut xx3, None, &xx2, None, &kx::KeyPair::gen())?;
+        stream.write_all(xx3.as_ref()).await?;
+        Ok((stream, keypair))
+    }
+
+    /// Reads the room events of a spectator until it has every comment, and returns the ids of
+    /// the comments in the order they were received, along with the stream to keep it connected.
+    async fn read_comments(
+        mut stream: TcpStream,
+        read_key: secretbox::Key,
+    ) -> Result<(Vec<u32>, TcpStream)> {
+        let context = secretbox::Context::from(*b"room    ");
+        let mut message_ids = vec![];
+        let mut message_id = 0;
+        while message_ids.last() != Some(&(COMMENT_COUNT - 1)) {
+            let size = stream.read_u16().await? as usize;
+            let mut message = vec![0; size];
+            stream.read_exact(&mut message).await?;
+            let message = secretbox::decrypt(&message, message_id, &context, &read_key)?;
+            message_id += 1;
+            if let Some(RoomEvent::Comment(comment)) = RoomEventOpt::decode(&*message)?.event {
+                message_ids.push(comment.message_id);
+            }
+        }
+        Ok((message_ids, stream))
+    }
+
+    /// Pings the race socket until a race frame arrives.
+    async fn read_frame(
+        socket: UdpSocket,
+        race_addr: SocketAddr,
+        tag: u32,
+        read_key: secretbox::Key,
+        write_key: secretbox::Key,
+    ) -> Result<()> {
+        let context = secretbox::Context::from(*b"race    ");
+        let ping = RaceClientPing::default().encode_to_vec();
+        let ping = secretbox::encrypt(&ping, 0, &context, &write_key);
+        let mut datagram = tag.to_be_bytes().to_vec();
+        datagram.extend_from_slice(&ping);
+        let mut buffer = [0u8; 1024];
+        loop {
+            socket.send_to(&datagram, race_addr).await?;
+            let size = tokio::select! {
+                r = socket.recv(&mut buffer) => r?,
+                _ = time::sleep(FRAME_DURATION) => continue,
+            };
+            let frame = &buffer[RaceSocket::TAG_SIZE..size];
+            secretbox::decrypt(frame, 0, &context, &read_key)?;
+            return Ok(());
+        }
+    }
+
+    /// Spectators join while the room sends comments and starts the race, each of them must get
+    /// every comment exactly once, either in the events written first or relayed, and race
+    /// frames.
+    #[tokio::test(flavor = "multi_thread")]
+    async fn spectators_get_every_event_and_frame() -> Result<()> {
+        libhydrogen::init()?;
+        let race_socket = RaceSocket::bind("127.0.0.1:0").await?;
+        let race_addr = race_socket.local_addr()?;
+        let (write_tx, _) = broadcast::channel(32);
+        let spectators = Spectators::new(write_tx.clone(), race_socket.clone());
+        let listener = TcpListener::bind("127.0.0.1:0").await?;
+        let addr = listener.local_addr()?;
+        let server_keypair = kx::KeyPair::gen();
+
+        let start = Instant::now();
+        let mut event_count = 0;
+        let mut comment_tasks = vec![];
+        let mut frame_tasks = vec![];
+        for i in 0..SPECTATOR_COUNT {
+            let (client, server) = tokio::join!(connect(addr), async {
+                let (stream, _) = listener.accept().await?;
+                let context = secretbox::Context::from(*b"room    ");
+                RoomAsyncStream::new(stream, server_keypair.clone(), context).await
+            });
+            let (client, keypair) = client?;
+            let read_key: [u8; 32] = keypair.rx.into();
+            let read_key = secretbox::Key::from(read_key);
+            let write_key: [u8; 32] = keypair.tx.into();
+            let write_key = secretbox::Key::from(write_key);
+            comment_tasks.push(tokio::spawn(read_comments(client, read_key.clone())));
+            let tag = race_socket.reserve_tag();
+            let socket = UdpSocket::bind("127.0.0.1:0").await?;
+            let frame_task = read_frame(socket, race_addr, tag.value(), read_key, write_key);
+            frame_tasks.push(tokio::spawn(frame_task));
+
+            let to_write = (0..event_count as u32).map(comment).collect();
+            spectators.add(server?, tag, to_write, event_count).await;
+            if i % 4 == 0 {
+                let _ = write_tx.send(comment(event_count as u32));
+                event_count += 1;
+            }
+            if i == SPECTATOR_COUNT / 2 {
+                spectators.start_race().await;
+            }
+        }
+        while event_count < COMMENT_COUNT as u64 {
+            let _ = write_tx.send(comment(event_count as u32));
+            event_count += 1;
+            time::sleep(Duration::from_millis(1)).await;
+        }
+        let mut streams = vec![];
+        for task in comment_tasks {
+            let (message_ids, stream) = time::timeout(Duration::from_secs(10), task).await???;
+            assert_eq!(message_ids, (0..COMMENT_COUNT).collect::<Vec<_>>());
+            streams.push(stream);
+        }
+        let mut frame_count = 0u32;
+        let deadline = Instant::now() + Duration::from_secs(10);
+        for task in frame_tasks {
+            while !task.is_finished() {
+                assert!(Instant::now() < deadline, "Spectator got no race frame");
+                spectators.send_frame(&frame_count.to_be_bytes());
+                frame_count += 1;
+                time::sleep(FRAME_DURATION).await;
+            }
+            task.await??;
+        }
+        println!(
+            "{SPECTATOR_COUNT} spectators served in {:?}, {frame_count} frames",
+            start.elapsed()
+        );
+        Ok(())
+    }
+}
@@ -1,28 +1,57 @@
+use std::collections::HashMap;
 use std::net::SocketAddr;
 
 use anyhow::{anyhow, Result};
 use libhydrogen::secretbox;
 use prost::Message;
-use tokio::net::UdpSocket;
+use tokio::sync::mpsc;
+
+use crate::race_socket::{Datagram, RaceSocket};
 
 #[derive(Debug)]
 pub struct UnreliableSocket {
-    socket: UdpSocket,
+    socket: RaceSocket,
+    datagrams: mpsc::Receiver<Datagram>,
     context: secretbox::Context,
     connections: Vec<Connection>,
+    indices: HashMap<u32, usize>,
 }
 
 impl UnreliableSocket {
     pub fn new(
-        socket: UdpSocket,
+        socket: RaceSocket,
         context: secretbox::Context,
         connections: Vec<Connection>,
     ) -> UnreliableSocket {
+        let datagrams = socket.subscribe(connections.iter().map(|connection| connection.tag));
+        let indices = connections
+            .iter()
+            .enumerate()
+            .map(|(index, connection)| (connection.tag, index))
+            .collect();
         UnreliableSocket {
             socket,
+            datagrams,
             context,
             connections,
+            indices,
+        }
+    }
+
+    /// Adds a connection to a socket which is already in use, returns its index or None if
+    /// every other connection is gone.
+    pub fn add_connection(&mut self, connection: Connection) -> Option<usize> {
+        let is_routed = self
+            .connections
+            .iter()
+            .any(|existing| self.socket.share_route(connection.tag, existing.tag));
+        if !is_routed {
+            return None;
         }
+        let index = self.connections.len();
+        self.indices.insert(connection.tag, index);
+        self.connections.push(connection);
+        Some(index)
     }
 
     pub fn connection_addr(&self, index: usize) -> Option<SocketAddr> {
@@ -33,46 +62,140 @@ impl UnreliableSocket {
     where
         M: Message + Default,
     {
-        let mut message = [0u8; 1024]; // TODO make that configurable
         loop {
-            let (size, addr) = self.socket.recv_from(&mut message).await?;
-            for (index, connection) in self.connections.iter_mut().enumerate() {
-                let message =
-                    secretbox::decrypt(&message[0..size], 0, &self.context, &connection.read_key);
-                let Ok(message) = message else {continue};
-                connection.addr = Some(addr);
-                let Ok(message) = M::decode(&*message) else {break};
-                return Ok((index, message));
-            }
+            let datagram = self.datagrams.recv().await.ok_or(anyhow!("Race socket closed!"))?;
+            // The tag identifies the connection, so only its key has to be tried.
+            let Some(&index) = self.indices.get(&datagram.tag) else {
+                continue;
+            };
+            let connection = &mut self.connections[index];
+            let message =
+                secretbox::decrypt(&datagram.data, 0, &self.context, &connection.read_key);
+            let Ok(message) = message else {
+                continue;
+            };
+            connection.addr = Some(datagram.addr);
+            let Ok(message) = M::decode(&*message) else {
+                continue;
+            };
+            return Ok((index, message));
         }
     }
 
-    pub async fn write<M: Message>(&mut self, index: usize, message: &M) -> Result<()>
-    where
-        M: Message,
-    {
+    /// Writes an already encoded message, so that the same bytes can be sent to several
+    /// connections.
+    pub async fn write(&mut self, index: usize, message: &[u8]) -> Result<()> {
         let connection = &self.connections[index];
         let addr = connection.addr.ok_or(anyhow!("Unknown connection address!"))?;
-        let message = message.encode_to_vec();
         let message = secretbox::encrypt(&message, 0, &self.context, &connection.write_key);
-        self.socket.send_to(&message, addr).await?;
+        self.socket.send_to(connection.tag, &message, addr).await?;
         Ok(())
     }
 }
 
 #[derive(Debug)]
 pub struct Connection {
+    tag: u32,
     read_key: secretbox::Key,
     write_key: secretbox::Key,
     addr: Option<SocketAddr>,
 }
 
 impl Connection {
-    pub fn new(read_key: secretbox::Key, write_key: secretbox::Key) -> Connection {
+    pub fn new(tag: u32, read_key: secretbox::Key, write_key: secretbox::Key) -> Connection {
         Connection {
+            tag,
             read_key,
             write_key,
             addr: None,
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::sync::atomic::{AtomicBool, Ordering};
+    use std::sync::Arc;
+    use std::time::Instant;
+
+    use tokio::net::UdpSocket;
+
+    use super::*;
+    use crate::room_protocol::RaceClientPing;
+
+    const PACKET_COUNT: u32 = 200_000;
+
+    /// Sends pings to the race socket from every peer in turn, as fast as possible, until
+    /// stopped.
+    async fn flood(
+        race_addr: SocketAddr,
+        peers: Vec<(u32, secretbox::Key)>,
+        stop: Arc<AtomicBool>,
+    ) -> Result<()> {
+        let context = secretbox::Context::from(*b"race    ");
+        let ping = RaceClientPing::default().encode_to_vec();
+        let mut sockets = vec![];
+        for (tag, write_key) in peers {
+            let ping = secretbox::encrypt(&ping, 0, &context, &write_key);
+            let mut datagram = tag.to_be_bytes().to_vec();
+            datagram.extend_from_slice(&ping);
+            sockets.push((UdpSocket::bind("127.0.0.1:0").await?, datagram));
+        }
+        for (socket, datagram) in sockets.iter().cycle() {
+            if stop.load(Ordering::Relaxed) {
+                break;
+            }
+            socket.send_to(datagram, race_addr).await?;
+        }
+        Ok(())
+    }
+
+    /// Returns the number of packets per second that a socket with the given number of peers
+    /// reads and decodes.
+    async fn measure_read(peer_count: usize) -> Result<f64> {
+        let race_socket = RaceSocket::bind("127.0.0.1:0").await?;
+        let race_addr = race_socket.local_addr()?;
+        let stop = Arc::new(AtomicBool::new(false));
+        let mut tags = vec![];
+        let mut connections = vec![];
+        let mut peers = vec![];
+        for i in 0..peer_count {
+            let tag = race_socket.reserve_tag();
+            let read_key = secretbox::Key::from([i as u8; 32]);
+            let write_key = secretbox::Key::from([!(i as u8); 32]);
+            connections.push(Connection::new(tag.value(), read_key.clone(), write_key));
+            peers.push((tag.value(), read_key));
+            tags.push(tag);
+        }
+        let flood_task = tokio::spawn(flood(race_addr, peers, stop.clone()));
+
+        let context = secretbox::Context::from(*b"race    ");
+        let mut socket = UnreliableSocket::new(race_socket, context, connections);
+        let mut counts = vec![0u32; peer_count];
+        let start = Instant::now();
+        for _ in 0..PACKET_COUNT {
+            let (index, _) = socket.read::<RaceClientPing>().await?;
+            counts[index] += 1;
+        }
+        let duration = start.elapsed();
+
+        stop.store(true, Ordering::Relaxed);
+        flood_task.await??;
+        assert!(counts.iter().all(|count| *count > 0));
+        Ok(PACKET_COUNT as f64 / duration.as_secs_f64())
+    }
+
+    /// Measures how many packets per second a room can take, with every peer sending as fast as
+    /// possible. A single task sends for every peer in turn, so that they get the same share of the
+    /// socket. Run it with `cargo test --release read_throughput -- --ignored --nocapture`.
+    #[tokio::test(flavor = "multi_thread")]
+    #[ignore]
+    async fn read_throughput() -> Result<()> {
+        libhydrogen::init()?;
+        for peer_count in [12, 32] {
+            let packets_per_second = measure_read(peer_count).await?;
+            println!("{peer_count} peers: {packets_per_second:.0} packets/s");
+        }
+        Ok(())
+    }
+}
@@ -0,0 +1,13 @@
+// The ghost validation of the payload. Its C header is pulled in first, for the same reason as in
+// include/game/system/GhostFile.hh.
+
+#include <game/system/GhostFile.hh>
+
+#pragma push_macro("static_assert")
+#define static_assert(...)
+extern "C" {
+#include <game/system/GhostFile.h>
+}
+#pragma pop_macro("static_assert")
+
+#include <game/system/GhostFile.cc>
@@ -0,0 +1,164 @@
+// What the game, the SDK and the storage layer of the payload provide to the ghost scan.
+
+#include <egg/core/eggHeap.hh>
+#include <game/system/GhostFile.hh>
+extern "C" {
+#include <sp/Yaz.h>
+}
+#include <sp/storage/Storage.hh>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" void OSReport(const char *msg, ...) {
+    va_list args;
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+extern "C" u32 NETCalcCRC32(const void *data, u32 size) {
+    auto *bytes = reinterpret_cast<const u8 *>(data);
+    u32 crc = 0xffffffff;
+    for (u32 i = 0; i < size; i++) {
+        crc ^= bytes[i];
+        for (u32 j = 0; j < 8; j++) {
+            crc = crc >> 1 ^ (crc & 1 ? 0xedb88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+extern "C" u16 RFLiCalculateCRC(const void *data, u32 size) {
+    auto *bytes = reinterpret_cast<const u8 *>(data);
+    u16 crc = 0;
+    for (u32 i = 0; i < size; i++) {
+        crc ^= bytes[i] << 8;
+        for (u32 j = 0; j < 8; j++) {
+            crc = crc << 1 ^ (crc & 0x8000 ? 0x1021 : 0);
+        }
+    }
+    return crc;
+}
+
+// Only used when saving ghosts, which the benchmark doesn't do
+void System::GhostFile::writeHeader(RawGhostHeader * /* header */) {
+    abort();
+}
+
+extern "C" u32 Yaz_encode(const u8 *restrict /* src */, u8 *restrict /* dst */, u32 /* srcSize */,
+        u32 /* dstSize */) {
+    abort();
+}
+
+void *operator new(size_t size, EGG::Heap * /* heap */, int align) {
+    return std::aligned_alloc(align, AlignUp(size, align));
+}
+
+void *operator new[](size_t size, int align) {
+    return std::aligned_alloc(align, AlignUp(size, align));
+}
+
+void *operator new[](size_t size, EGG::Heap * /* heap */, int align) {
+    return std::aligned_alloc(align, AlignUp(size, align));
+}
+
+namespace SP::Storage {
+
+FileHandle::FileHandle(IFile *file) : m_file(file) {}
+
+FileHandle::FileHandle(FileHandle &&that) : m_file(that.m_file) {
+    that.m_file = nullptr;
+}
+
+FileHandle &FileHandle::operator=(FileHandle &&that) {
+    m_file = that.m_file;
+    that.m_file = nullptr;
+    return *this;
+}
+
+FileHandle::~FileHandle() {
+    if (m_file) {
+        m_file->close();
+    }
+}
+
+std::optional<FileHandle> FileHandle::clone() {
+    return m_file->clone();
+}
+
+bool FileHandle::read(void *dst, u32 size, u32 offset) {
+    assert(dst);
+
+    return m_file->read(dst, size, offset);
+}
+
+bool FileHandle::write(const void *src, u32 size, u32 offset) {
+    assert(src);
+
+    return m_file->write(src, size, offset);
+}
+
+bool FileHandle::sync() {
+    return m_file->sync();
+}
+
+u64 FileHandle::size() {
+    return m_file->size();
+}
+
+DirHandle::DirHandle(IDir *dir) : m_dir(dir) {}
+
+DirHandle::DirHandle(DirHandle &&that) : m_dir(that.m_dir) {
+    that.m_dir = nullptr;
+}
+
+DirHandle &DirHandle::operator=(DirHandle &&that) {
+    m_dir = that.m_dir;
+    that.m_dir = nullptr;
+    return *this;
+}
+
+DirHandle::~DirHandle() {
+    if (m_dir) {
+        m_dir->close();
+    }
+}
+
+std::optional<DirHandle> DirHandle::clone() {
+    return m_dir->clone();
+}
+
+std::optional<NodeInfo> DirHandle::read() {
+    return m_dir->read();
+}
+
+std::optional<FileHandle> FastOpen(NodeId id) {
+    assert(id.storage);
+
+    return id.storage->fastOpen(id.id);
+}
+
+std::optional<u32> FastReadFile(NodeId id, void *dst, u32 size) {
+    auto file = FastOpen(id);
+    if (!file) {
+        return {};
+    }
+
+    size = std::min(static_cast<u64>(size), file->size());
+    if (!file->read(dst, size, 0)) {
+        return {};
+    }
+    return size;
+}
+
+std::optional<DirHandle> FastOpenDir(NodeId id) {
+    assert(id.storage);
+
+    return id.storage->fastOpenDir(id.id);
+}
+
+} // namespace SP::Storage
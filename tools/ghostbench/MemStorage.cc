@@ -0,0 +1,220 @@
+#include "MemStorage.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+
+class MemStorage::File : public SP::Storage::IFile {
+public:
+    File(MemStorage &storage, u64 id) : m_storage(storage), m_id(id) {}
+
+    std::optional<SP::Storage::FileHandle> clone() override {
+        return SP::Storage::FileHandle(new File(m_storage, m_id));
+    }
+
+    bool close() override {
+        delete this;
+        return true;
+    }
+
+    bool read(void *dst, u32 size, u32 offset) override {
+        auto &contents = m_storage.m_nodes[m_id].contents;
+        if (offset > contents.size() || size > contents.size() - offset) {
+            return false;
+        }
+        memcpy(dst, contents.data() + offset, size);
+        m_storage.m_stats.reads++;
+        m_storage.m_stats.readSize += size;
+        return true;
+    }
+
+    bool write(const void *src, u32 size, u32 offset) override {
+        auto &node = m_storage.m_nodes[m_id];
+        if (node.contents.size() < offset + size) {
+            node.contents.resize(offset + size);
+        }
+        memcpy(node.contents.data() + offset, src, size);
+        node.tick = ++m_storage.m_tick;
+        m_storage.m_stats.writes++;
+        m_storage.m_stats.writeSize += size;
+        return true;
+    }
+
+    bool sync() override {
+        return true;
+    }
+
+    u64 size() override {
+        return m_storage.m_nodes[m_id].contents.size();
+    }
+
+private:
+    MemStorage &m_storage;
+    u64 m_id;
+};
+
+class MemStorage::Dir : public SP::Storage::IDir {
+public:
+    Dir(MemStorage &storage, u64 id) : m_storage(storage), m_id(id) {}
+
+    std::optional<SP::Storage::DirHandle> clone() override {
+        return SP::Storage::DirHandle(new Dir(m_storage, m_id));
+    }
+
+    bool close() override {
+        delete this;
+        return true;
+    }
+
+    std::optional<SP::Storage::NodeInfo> read() override {
+        auto &children = m_storage.m_nodes[m_id].children;
+        if (m_index >= children.size()) {
+            return {};
+        }
+        return m_storage.info(children[m_index++]);
+    }
+
+private:
+    MemStorage &m_storage;
+    u64 m_id;
+    size_t m_index = 0;
+};
+
+MemStorage::MemStorage() {
+    m_nodes.push_back({L"", L"", SP::Storage::NodeType::Dir, {}, 0, {}});
+}
+
+u64 MemStorage::root() const {
+    return 0;
+}
+
+u64 MemStorage::createDir(u64 parent, const wchar_t *name) {
+    return createNode(parent, name, SP::Storage::NodeType::Dir);
+}
+
+u64 MemStorage::createFile(u64 parent, const wchar_t *name, std::vector<u8> contents,
+        OSTime tick) {
+    u64 id = createNode(parent, name, SP::Storage::NodeType::File);
+    m_nodes[id].contents = std::move(contents);
+    m_nodes[id].tick = tick;
+    m_tick = std::max(m_tick, tick);
+    return id;
+}
+
+void MemStorage::touch(u64 id, OSTime tick) {
+    m_nodes[id].tick = tick;
+    m_tick = std::max(m_tick, tick);
+}
+
+const MemStorage::Stats &MemStorage::stats() const {
+    return m_stats;
+}
+
+void MemStorage::resetStats() {
+    m_stats = {};
+}
+
+std::optional<SP::Storage::FileHandle> MemStorage::fastOpen(u64 id) {
+    if (id >= m_nodes.size() || m_nodes[id].type != SP::Storage::NodeType::File) {
+        return {};
+    }
+    m_stats.opens++;
+    return SP::Storage::FileHandle(new File(*this, id));
+}
+
+std::optional<SP::Storage::FileHandle> MemStorage::open(const wchar_t *path, const char *mode) {
+    auto id = find(path);
+    if (!strcmp(mode, "w")) {
+        if (!id) {
+            const wchar_t *name = wcsrchr(path, L'/');
+            if (!name) {
+                return {};
+            }
+            auto parent = find(std::wstring(path, name).c_str());
+            if (!parent || m_nodes[*parent].type != SP::Storage::NodeType::Dir) {
+                return {};
+            }
+            id = createNode(*parent, name + 1, SP::Storage::NodeType::File);
+        }
+        m_nodes[*id].contents.clear();
+        m_nodes[*id].tick = ++m_tick;
+    }
+    if (!id) {
+        return {};
+    }
+    return fastOpen(*id);
+}
+
+bool MemStorage::createDir(const wchar_t * /* path */, bool /* allowNop */) {
+    return false;
+}
+
+std::optional<SP::Storage::DirHandle> MemStorage::fastOpenDir(u64 id) {
+    if (id >= m_nodes.size() || m_nodes[id].type != SP::Storage::NodeType::Dir) {
+        return {};
+    }
+    m_stats.dirOpens++;
+    return SP::Storage::DirHandle(new Dir(*this, id));
+}
+
+std::optional<SP::Storage::DirHandle> MemStorage::openDir(const wchar_t *path) {
+    auto id = find(path);
+    if (!id) {
+        return {};
+    }
+    return fastOpenDir(*id);
+}
+
+std::optional<SP::Storage::NodeInfo> MemStorage::stat(const wchar_t *path) {
+    auto id = find(path);
+    if (!id) {
+        return {};
+    }
+    return info(*id);
+}
+
+bool MemStorage::rename(const wchar_t * /* srcPath */, const wchar_t * /* dstPath */) {
+    return false;
+}
+
+bool MemStorage::remove(const wchar_t * /* path */, bool /* allowNop */) {
+    return false;
+}
+
+std::optional<SP::Storage::FileHandle> MemStorage::startBenchmark() {
+    return {};
+}
+
+void MemStorage::endBenchmark() {}
+
+u32 MemStorage::getMessageId() {
+    return 0;
+}
+
+u64 MemStorage::createNode(u64 parent, const wchar_t *name, SP::Storage::NodeType type) {
+    u64 id = m_nodes.size();
+    std::wstring path = m_nodes[parent].path + L"/" + name;
+    m_nodes.push_back({path, name, type, {}, 0, {}});
+    m_nodes[parent].children.push_back(id);
+    return id;
+}
+
+std::optional<u64> MemStorage::find(const wchar_t *path) const {
+    for (u64 id = 0; id < m_nodes.size(); id++) {
+        if (m_nodes[id].path == path) {
+            return id;
+        }
+    }
+    return {};
+}
+
+SP::Storage::NodeInfo MemStorage::info(u64 id) const {
+    auto &node = m_nodes[id];
+    SP::Storage::NodeInfo info{};
+    info.id = {const_cast<MemStorage *>(this), id};
+    info.type = node.type;
+    info.size = node.contents.size();
+    info.tick = node.tick;
+    wcsncpy(info.name, node.name.c_str(), std::size(info.name) - 1);
+    return info;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sp/storage/Storage.hh>
+
+#include <string>
+#include <vector>
+
+// A storage which keeps its whole tree in memory. It counts the operations issued by the scan, so
+// that their cost on the SD card or over the network can be estimated.
+class MemStorage : public SP::Storage::IStorage {
+public:
+    struct Stats {
+        u32 opens;
+        u32 dirOpens;
+        u32 reads;
+        u64 readSize;
+        u32 writes;
+        u64 writeSize;
+    };
+
+    MemStorage();
+    u64 root() const;
+    u64 createDir(u64 parent, const wchar_t *name);
+    u64 createFile(u64 parent, const wchar_t *name, std::vector<u8> contents, OSTime tick);
+    void touch(u64 id, OSTime tick);
+    const Stats &stats() const;
+    void resetStats();
+
+    std::optional<SP::Storage::FileHandle> fastOpen(u64 id) override;
+    std::optional<SP::Storage::FileHandle> open(const wchar_t *path, const char *mode) override;
+
+    bool createDir(const wchar_t *path, bool allowNop) override;
+    std::optional<SP::Storage::DirHandle> fastOpenDir(u64 id) override;
+    std::optional<SP::Storage::DirHandle> openDir(const wchar_t *path) override;
+
+    std::optional<SP::Storage::NodeInfo> stat(const wchar_t *path) override;
+    bool rename(const wchar_t *srcPath, const wchar_t *dstPath) override;
+    bool remove(const wchar_t *path, bool allowNop) override;
+
+    std::optional<SP::Storage::FileHandle> startBenchmark() override;
+    void endBenchmark() override;
+    u32 getMessageId() override;
+
+private:
+    struct Node {
+        std::wstring path;
+        std::wstring name;
+        SP::Storage::NodeType type;
+        std::vector<u8> contents;
+        OSTime tick;
+        std::vector<u64> children;
+    };
+
+    class File;
+    class Dir;
+
+    u64 createNode(u64 parent, const wchar_t *name, SP::Storage::NodeType type);
+    std::optional<u64> find(const wchar_t *path) const;
+    SP::Storage::NodeInfo info(u64 id) const;
+
+    std::vector<Node> m_nodes;
+    OSTime m_tick = 0;
+    Stats m_stats{};
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+// Shadows the header of the payload: on the host, every heap allocates from the C library.
+
+#include <Common.hh>
+
+namespace EGG {
+
+class Heap {};
+
+} // namespace EGG
+
+void *operator new(size_t size, EGG::Heap *heap, int align);
+
+void *operator new[](size_t size, int align);
+void *operator new[](size_t size, EGG::Heap *heap, int align);
@@ -0,0 +1,12 @@
+#pragma once
+
+// wchar_t and pointers are wider on the host, so the layout checks of the payload header don't
+// hold. The ghosts of the benchmark are generated on the host too, with the same layout.
+
+#include <array>
+#include <optional>
+
+#pragma push_macro("static_assert")
+#define static_assert(...)
+#include_next <game/system/GhostFile.hh>
+#pragma pop_macro("static_assert")
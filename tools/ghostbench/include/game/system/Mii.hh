@@ -0,0 +1,8 @@
+#pragma once
+
+// wchar_t is wider on the host, so the layout checks of the payload header don't hold.
+
+#pragma push_macro("static_assert")
+#define static_assert(...)
+#include_next <game/system/Mii.hh>
+#pragma pop_macro("static_assert")
@@ -0,0 +1,16 @@
+#pragma once
+
+// Shadows the header of the payload, whose structures have the layout of the console.
+
+#include <Common.h>
+
+#ifdef RVL_OS_NEEDS_IMPORT
+#undef RVL_OS_NEEDS_IMPORT
+#define RVL_OS_NEEDS_IMPORT
+#endif
+
+typedef s64 OSTime;
+
+__attribute__((format(printf, 1, 2))) void OSReport(const char *msg, ...);
+
+u32 NETCalcCRC32(const void *data, u32 size);
@@ -0,0 +1,248 @@
+// Generates a tree of ghosts in memory and runs the ghost scan of the payload over it, without and
+// with the per-directory indices. See README.md.
+
+#include "MemStorage.hh"
+
+#include <common/Bytes.hh>
+#include <game/system/GhostIndex.hh>
+extern "C" {
+#include <rfl.h>
+}
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+
+namespace {
+
+struct Ghost {
+    System::RawGhostHeader header;
+    std::array<u8, 0x14> courseSHA1;
+    bool isValid;
+};
+
+// Literal groups only: the scan decodes the inputs header, it doesn't care about the ratio.
+std::vector<u8> EncodeYaz0(const std::vector<u8> &src) {
+    std::vector<u8> dst(0x10);
+    memcpy(dst.data(), "Yaz0", 4);
+    Bytes::Write<u32>(dst.data(), 0x4, src.size());
+    for (size_t i = 0; i < src.size(); i += 8) {
+        dst.push_back(0xff);
+        dst.insert(dst.end(), src.begin() + i, src.begin() + std::min(i + 8, src.size()));
+    }
+    return dst;
+}
+
+// A compressed ghost with an SP footer, as saved by the payload, with distinct fields so that a
+// header or a footer returned for the wrong file is noticed.
+std::vector<u8> GenerateGhost(u32 i, Ghost &ghost) {
+    System::RawGhostHeader header{};
+    header.magic = 0x524b4744; // RKGD
+    header.raceTime.minutes = 1 + i % 3;
+    header.raceTime.seconds = i % 60;
+    header.raceTime.milliseconds = i % 1000;
+    header.courseId = i % 0x20;
+    header.vehicleId = i % 0x24;
+    header.characterId = i % 0x18;
+    header.year = 22;
+    header.month = 1 + i % 12;
+    header.day = 1 + i % 28;
+    header.controllerId = i % 0x4;
+    header.isCompressed = true;
+    header.type = 0x1;
+    header.lapCount = 3;
+    for (u32 j = 0; j < 3; j++) {
+        header.lapTimes[j].seconds = 20 + j;
+        header.lapTimes[j].milliseconds = (i + j) % 1000;
+    }
+    swprintf(header.mii.name, std::size(header.mii.name), L"Ghost %u", i);
+    header.mii.crc16 = RFLiCalculateCRC(&header.mii, 0x4c);
+
+    std::vector<u8> inputs(0x8 + 0x180);
+    u16 counts[3] = {0x40, 0x40, 0x40};
+    memcpy(inputs.data(), counts, sizeof(counts));
+    for (size_t j = 0x8; j < inputs.size(); j++) {
+        inputs[j] = i + j;
+    }
+    std::vector<u8> src = EncodeYaz0(inputs);
+
+    std::vector<u8> raw(sizeof(header) + sizeof(u32));
+    memcpy(raw.data(), &header, sizeof(header));
+    Bytes::Write<u32>(raw.data(), sizeof(header), src.size());
+    raw.insert(raw.end(), src.begin(), src.end());
+    raw.resize(raw.size() + sizeof(u32));
+    Bytes::Write<u32>(raw.data(), raw.size() - sizeof(u32),
+            NETCalcCRC32(raw.data(), raw.size() - sizeof(u32)));
+
+    System::SPFooter footer{};
+    footer.version = System::SPFooter::VERSION;
+    for (u32 j = 0; j < std::size(footer.courseSHA1); j++) {
+        footer.courseSHA1[j] = i >> (j % 4 * 8);
+    }
+    System::FooterFooter footerFooter{sizeof(footer), System::SPFooter::MAGIC};
+    size_t offset = raw.size();
+    raw.resize(offset + sizeof(footer) + sizeof(footerFooter) + sizeof(u32));
+    memcpy(raw.data() + offset, &footer, sizeof(footer));
+    memcpy(raw.data() + offset + sizeof(footer), &footerFooter, sizeof(footerFooter));
+    Bytes::Write<u32>(raw.data(), raw.size() - sizeof(u32),
+            NETCalcCRC32(raw.data(), raw.size() - sizeof(u32)));
+
+    ghost.header = header;
+    ghost.courseSHA1 = std::to_array(footer.courseSHA1);
+    ghost.isValid = true;
+    return raw;
+}
+
+struct Tree {
+    MemStorage storage;
+    std::vector<std::pair<u64, std::wstring>> dirs;
+    std::map<u64, Ghost> ghosts;
+    u32 validCount = 0;
+};
+
+void GenerateTree(Tree &tree, u32 ghostCount, u32 dirCount, u32 invalidInterval) {
+    u64 root = tree.storage.createDir(tree.storage.root(), L"ghosts");
+    for (u32 i = 0; i < dirCount; i++) {
+        wchar_t name[32];
+        swprintf(name, std::size(name), L"%02u", i);
+        tree.dirs.emplace_back(tree.storage.createDir(root, name),
+                L"/ghosts/" + std::wstring(name));
+    }
+
+    for (u32 i = 0; i < ghostCount; i++) {
+        Ghost ghost;
+        std::vector<u8> raw = GenerateGhost(i, ghost);
+        if (invalidInterval != 0 && i % invalidInterval == invalidInterval - 1) {
+            raw[raw.size() - 1] ^= 0xff;
+            ghost.isValid = false;
+        }
+        wchar_t name[32];
+        swprintf(name, std::size(name), L"%05u.rkg", i);
+        u64 dir = tree.dirs[i % dirCount].first;
+        u64 id = tree.storage.createFile(dir, name, std::move(raw), 1 + i);
+        tree.ghosts[id] = ghost;
+        tree.validCount += ghost.isValid;
+    }
+}
+
+struct Ghosts {
+    Ghosts()
+        : headers(new System::RawGhostHeader[System::MAX_GHOST_COUNT]),
+          footers(new System::GhostFooter[System::MAX_GHOST_COUNT]),
+          ids(new SP::Storage::NodeId[System::MAX_GHOST_COUNT]), rawGhostFile(new u8[0x2800]) {}
+
+    u32 count = 0;
+    std::unique_ptr<System::RawGhostHeader[]> headers;
+    std::unique_ptr<System::GhostFooter[]> footers;
+    std::unique_ptr<SP::Storage::NodeId[]> ids;
+    std::unique_ptr<u8[]> rawGhostFile;
+};
+
+// Every valid ghost must be listed once, with its own header and footer.
+bool Check(const Tree &tree, const Ghosts &ghosts) {
+    if (ghosts.count != tree.validCount) {
+        fprintf(stderr, "  %u ghosts found, %u expected\n", ghosts.count, tree.validCount);
+        return false;
+    }
+    std::set<u64> ids;
+    for (u32 i = 0; i < ghosts.count; i++) {
+        auto it = tree.ghosts.find(ghosts.ids[i].id);
+        if (it == tree.ghosts.end() || !it->second.isValid || !ids.insert(it->first).second) {
+            fprintf(stderr, "  Ghost %u: unexpected file %llu\n", i,
+                    static_cast<unsigned long long>(ghosts.ids[i].id));
+            return false;
+        }
+        const Ghost &ghost = it->second;
+        if (memcmp(&ghosts.headers[i], &ghost.header, sizeof(ghost.header)) ||
+                ghosts.footers[i].courseSHA1() != ghost.courseSHA1) {
+            fprintf(stderr, "  Ghost %u: the header or the footer of another file\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Costs {
+    f64 openLatency; // us
+    f64 throughput;  // MiB/s
+};
+
+bool Scan(const char *name, Tree &tree, const Costs &costs) {
+    Ghosts ghosts;
+    System::GhostIndex::Ghosts view{ghosts.count, ghosts.headers.get(), ghosts.footers.get(),
+            ghosts.ids.get(), ghosts.rawGhostFile.get()};
+    EGG::Heap heap;
+    tree.storage.resetStats();
+    auto start = std::chrono::steady_clock::now();
+    for (auto &[id, path] : tree.dirs) {
+        System::GhostIndex::Scan({&tree.storage, id}, path.c_str(), &heap, view);
+    }
+    auto end = std::chrono::steady_clock::now();
+    f64 ms = std::chrono::duration<f64, std::milli>(end - start).count();
+
+    const MemStorage::Stats &stats = tree.storage.stats();
+    u32 openCount = stats.opens + stats.dirOpens;
+    u64 size = stats.readSize + stats.writeSize;
+    f64 ioMs = openCount * costs.openLatency / 1000.0 +
+            size / (costs.throughput * 1024.0 * 1024.0) * 1000.0;
+    printf("%-8s %5u ghosts, %8.2f ms on the host, %5u opens, %5u reads (%7.1f KiB), "
+           "%3u writes (%6.1f KiB), ~%7.0f ms of I/O\n",
+            name, ghosts.count, ms, openCount, stats.reads, stats.readSize / 1024.0, stats.writes,
+            stats.writeSize / 1024.0, ioMs);
+    return Check(tree, ghosts);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    u32 ghostCount = System::MAX_GHOST_COUNT;
+    u32 dirCount = 16;
+    u32 invalidInterval = 64;
+    u32 touchInterval = 15;
+    Costs costs{1000.0, 4.0};
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (!strcmp(argv[i], "-n")) {
+            ghostCount = std::min<u32>(strtoul(argv[i + 1], nullptr, 0), System::MAX_GHOST_COUNT);
+        } else if (!strcmp(argv[i], "-d")) {
+            dirCount = std::max<u32>(strtoul(argv[i + 1], nullptr, 0), 1);
+        } else if (!strcmp(argv[i], "-i")) {
+            invalidInterval = strtoul(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "-t")) {
+            touchInterval = std::max<u32>(strtoul(argv[i + 1], nullptr, 0), 1);
+        } else if (!strcmp(argv[i], "-l")) {
+            costs.openLatency = strtod(argv[i + 1], nullptr);
+        } else if (!strcmp(argv[i], "-b")) {
+            costs.throughput = strtod(argv[i + 1], nullptr);
+        } else {
+            break;
+        }
+    }
+    if (i != argc || costs.throughput <= 0.0) {
+        fprintf(stderr, "Usage: %s [-n ghosts] [-d dirs] [-i invalid interval] [-t touch interval] "
+                        "[-l open latency (us)] [-b throughput (MiB/s)]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Tree tree;
+    GenerateTree(tree, ghostCount, dirCount, invalidInterval);
+    printf("%u ghosts (%u valid) in %u directories\n", ghostCount, tree.validCount, dirCount);
+
+    bool ok = true;
+    ok &= Scan("cold", tree, costs);
+    ok &= Scan("indexed", tree, costs);
+    u32 touchCount = 0;
+    for (auto &[id, ghost] : tree.ghosts) {
+        if (touchCount++ % touchInterval == 0) {
+            tree.storage.touch(id, 1 + ghostCount + touchCount);
+        }
+    }
+    ok &= Scan("touched", tree, costs);
+    ok &= Scan("indexed", tree, costs);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,29 @@
+// What the game and the PowerPC assembly of the payload provide to the KCL code.
+
+#include <common/TVec3.hh>
+
+#include <cstdarg>
+#include <cstdio>
+
+extern "C" void OSReport(const char *msg, ...) {
+    va_list args;
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+Vec3::Vec3() = default;
+
+Vec3::Vec3(f32 x, f32 y, f32 z) : TVec3Base{x, y, z} {}
+
+Vec3 operator+(const Vec3 &v0, const Vec3 &v1) {
+    return {v0.x + v1.x, v0.y + v1.y, v0.z + v1.z};
+}
+
+Vec3 operator-(const Vec3 &v0, const Vec3 &v1) {
+    return {v0.x - v1.x, v0.y - v1.y, v0.z - v1.z};
+}
+
+Vec3 operator*(const f32 &s, const Vec3 &v0) {
+    return {s * v0.x, s * v0.y, s * v0.z};
+}
@@ -0,0 +1,222 @@
+#include "KclQuery.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SP {
+
+// Real-Time Collision Detection, 5.1.5
+static Vec3 ClosestPointOnTriangle(const Vec3 &p, const std::array<Vec3, 3> &triangle) {
+    const auto &[a, b, c] = triangle;
+    Vec3 ab = b - a;
+    Vec3 ac = c - a;
+    Vec3 ap = p - a;
+    f32 d1 = dot(ab, ap);
+    f32 d2 = dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        return a;
+    }
+
+    Vec3 bp = p - b;
+    f32 d3 = dot(ab, bp);
+    f32 d4 = dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        return b;
+    }
+
+    f32 vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    Vec3 cp = p - c;
+    f32 d5 = dot(ab, cp);
+    f32 d6 = dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        return c;
+    }
+
+    f32 vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    f32 va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    f32 denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+KclQuery::KclQuery(const KclFile &file) : m_file(file) {}
+
+const u16 *KclQuery::searchBlock(const Vec3 &pos) const {
+    const KCollisionV1Header *header = m_file.m_header;
+    if (header == nullptr || m_file.block.empty()) {
+        return nullptr;
+    }
+
+    u32 x = static_cast<s32>(pos.x - header->area_min_pos.x);
+    if (x & header->area_x_width_mask) {
+        return nullptr;
+    }
+    u32 y = static_cast<s32>(pos.y - header->area_min_pos.y);
+    if (y & header->area_y_width_mask) {
+        return nullptr;
+    }
+    u32 z = static_cast<s32>(pos.z - header->area_min_pos.z);
+    if (z & header->area_z_width_mask) {
+        return nullptr;
+    }
+
+    s32 shift = header->block_width_shift;
+    const u8 *node = m_file.block.data();
+    u32 index = (z >> shift) << header->area_xy_blocks_shift |
+            (y >> shift) << header->area_x_blocks_shift | x >> shift;
+    u32 offset = reinterpret_cast<const u32 *>(node)[index];
+    while (!(offset & 0x80000000)) {
+        node += offset;
+        shift--;
+        index = (x >> shift & 1) | (y >> shift & 1) << 1 | (z >> shift & 1) << 2;
+        offset = reinterpret_cast<const u32 *>(node)[index];
+    }
+    return reinterpret_cast<const u16 *>(node + (offset & 0x7fffffff));
+}
+
+std::optional<KclQuery::Hit> KclQuery::checkSphere(const Vec3 &pos, f32 radius) const {
+    std::optional<Hit> hit;
+    forEachPrism(searchBlock(pos), [&](u16 i) {
+        const KCollisionPrismData &prism = m_file.prism[i];
+        const Vec3 &fnrm = m_file.nrm[prism.fnrm_i];
+        Vec3 relativePos = pos - m_file.pos[prism.pos_i];
+        f32 planeDist = dot(relativePos, fnrm);
+        if (planeDist >= radius || planeDist <= -m_file.m_header->prism_thickness) {
+            return;
+        }
+
+        // Edge normals point outwards, the third edge is at the height of the prism.
+        f32 edgeDists[3] = {
+                dot(relativePos, m_file.nrm[prism.enrm1_i]),
+                dot(relativePos, m_file.nrm[prism.enrm2_i]),
+                dot(relativePos, m_file.nrm[prism.enrm3_i]) - prism.height,
+        };
+        if (*std::max_element(std::begin(edgeDists), std::end(edgeDists)) >= radius) {
+            return;
+        }
+
+        Hit candidate{.prism = i, .attribute = prism.attribute};
+        auto isInside = [](f32 edgeDist) { return edgeDist <= 0.0f; };
+        if (std::all_of(std::begin(edgeDists), std::end(edgeDists), isInside)) {
+            candidate.distance = radius - planeDist;
+            candidate.pos = pos - fnrm * planeDist;
+            candidate.nrm = fnrm;
+        } else {
+            // Edges and corners can only be hit from above the plane.
+            if (planeDist <= 0.0f) {
+                return;
+            }
+            Vec3 point = ClosestPointOnTriangle(pos, vertices(prism));
+            Vec3 delta = pos - point;
+            f32 distance = std::sqrt(dot(delta, delta));
+            if (distance >= radius) {
+                return;
+            }
+            candidate.distance = radius - distance;
+            candidate.pos = point;
+            candidate.nrm = delta * (1.0f / distance);
+        }
+
+        if (!hit || candidate.distance > hit->distance) {
+            hit = candidate;
+        }
+    });
+    return hit;
+}
+
+std::optional<KclQuery::Hit> KclQuery::castRay(const Vec3 &origin, const Vec3 &dir,
+        f32 maxDistance) const {
+    if (m_file.m_header == nullptr) {
+        return {};
+    }
+
+    // A prism which the ray crosses between two samples is within sphere_radius of the first one,
+    // and thus in its leaf. Once the leaves up to a sample have been checked, a hit before it is
+    // final.
+    std::optional<Hit> hit;
+    f32 step = std::max(m_file.m_header->sphere_radius, 1.0f);
+    const u16 *lastList = nullptr;
+    for (f32 t = 0.0f; !hit || hit->distance > t; t += step) {
+        const u16 *list = searchBlock(origin + dir * std::min(t, maxDistance));
+        if (list != lastList) {
+            forEachPrism(list, [&](u16 i) {
+                const KCollisionPrismData &prism = m_file.prism[i];
+                const Vec3 &fnrm = m_file.nrm[prism.fnrm_i];
+                f32 denom = dot(dir, fnrm);
+                if (denom >= 0.0f) {
+                    return;
+                }
+                f32 distance = -dot(origin - m_file.pos[prism.pos_i], fnrm) / denom;
+                if (distance < 0.0f || distance > maxDistance ||
+                        (hit && distance >= hit->distance)) {
+                    return;
+                }
+
+                Vec3 pos = origin + dir * distance;
+                Vec3 relativePos = pos - m_file.pos[prism.pos_i];
+                if (dot(relativePos, m_file.nrm[prism.enrm1_i]) > 0.0f ||
+                        dot(relativePos, m_file.nrm[prism.enrm2_i]) > 0.0f ||
+                        dot(relativePos, m_file.nrm[prism.enrm3_i]) > prism.height) {
+                    return;
+                }
+
+                hit = Hit{.prism = i, .attribute = prism.attribute, .distance = distance,
+                        .pos = pos, .nrm = fnrm};
+            });
+            lastList = list;
+        }
+        if (t >= maxDistance) {
+            break;
+        }
+    }
+    return hit;
+}
+
+std::optional<KclQuery::Hit> KclQuery::closestPoint(const Vec3 &pos, f32 maxDistance) const {
+    std::optional<Hit> hit;
+    forEachPrism(searchBlock(pos), [&](u16 i) {
+        const KCollisionPrismData &prism = m_file.prism[i];
+        Vec3 point = ClosestPointOnTriangle(pos, vertices(prism));
+        Vec3 delta = pos - point;
+        f32 distance = std::sqrt(dot(delta, delta));
+        if (distance > maxDistance || (hit && distance >= hit->distance)) {
+            return;
+        }
+
+        hit = Hit{.prism = i, .attribute = prism.attribute, .distance = distance, .pos = point,
+                .nrm = m_file.nrm[prism.fnrm_i]};
+    });
+    return hit;
+}
+
+// Calls f with the index of each prism of a leaf, skipping the ones which aren't in the file.
+template <typename F>
+void KclQuery::forEachPrism(const u16 *list, F f) const {
+    if (list == nullptr) {
+        return;
+    }
+
+    while (u16 i = *++list) {
+        if (i < m_file.prism.size()) {
+            f(i);
+        }
+    }
+}
+
+std::array<Vec3, 3> KclQuery::vertices(const KCollisionPrismData &prism) const {
+    return FromPrism(prism.height, m_file.pos[prism.pos_i], m_file.nrm[prism.fnrm_i],
+            m_file.nrm[prism.enrm1_i], m_file.nrm[prism.enrm2_i], m_file.nrm[prism.enrm3_i]);
+}
+
+} // namespace SP
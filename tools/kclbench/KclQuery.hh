@@ -0,0 +1,46 @@
+#pragma once
+
+#include <sp/3d/KclFile.hh>
+
+#include <optional>
+
+namespace SP {
+
+// Collision queries against a KCL file. Prisms are only looked up in the leaf of the octree which
+// contains a point, exactly as the game does, so that tracks can be checked outside of a race. The
+// encoder adds every prism within sphere_radius of a leaf to it, which bounds the sizes for which
+// the queries are exact.
+class KclQuery {
+public:
+    struct Hit {
+        u16 prism = 0; // Starts at 1, as in the octree
+        u16 attribute = 0;
+        // Penetration depth for spheres, distance from the origin otherwise
+        f32 distance = 0.0f;
+        Vec3 pos{};
+        Vec3 nrm{};
+    };
+
+    KclQuery(const KclFile &file);
+
+    // The prism list of the leaf which contains pos, or nullptr if it is outside of the area. As in
+    // the game, the list is terminated by 0 and the first index is after the returned pointer.
+    const u16 *searchBlock(const Vec3 &pos) const;
+    // The deepest prism that a sphere overlaps from the front, among the ones of the leaf of its
+    // center.
+    std::optional<Hit> checkSphere(const Vec3 &pos, f32 radius) const;
+    // The nearest prism that a ray hits from the front, dir must be normalized. The ray is sampled
+    // every sphere_radius, so that each prism it crosses is in the leaf of a sample.
+    std::optional<Hit> castRay(const Vec3 &origin, const Vec3 &dir, f32 maxDistance) const;
+    // The nearest point on the top of a prism of the leaf of pos.
+    std::optional<Hit> closestPoint(const Vec3 &pos, f32 maxDistance) const;
+
+private:
+    template <typename F>
+    void forEachPrism(const u16 *list, F f) const;
+    std::array<Vec3, 3> vertices(const KCollisionPrismData &prism) const;
+
+    const KclFile &m_file;
+};
+
+} // namespace SP
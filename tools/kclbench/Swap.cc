@@ -0,0 +1,132 @@
+#include "Swap.hh"
+
+#include <common/Bytes.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace SP {
+
+namespace {
+
+// The header only has 32-bit fields
+constexpr u32 HeaderSize = 0x3c;
+constexpr u32 PrismSize = 0x10;
+
+void Swap32(std::span<u8> bytes, u32 offset) {
+    u32 val = Bytes::Read<u32>(bytes.data(), offset);
+    Bytes::Write<u32, std::endian::native>(bytes.data(), offset, val);
+}
+
+void Swap16(std::span<u8> bytes, u32 offset) {
+    u16 val = Bytes::Read<u16>(bytes.data(), offset);
+    Bytes::Write<u16, std::endian::native>(bytes.data(), offset, val);
+}
+
+u32 Native32(std::span<const u8> bytes, u32 offset) {
+    u32 val;
+    memcpy(&val, bytes.data() + offset, sizeof(val));
+    return val;
+}
+
+// Octree nodes and prism lists can be shared between leaves, so each half-word is only swapped
+// once.
+class BlockSwapper {
+public:
+    BlockSwapper(std::span<u8> block) : m_block(block), m_swapped(block.size() / 2) {}
+
+    bool swapGroup(u32 node, u32 count, s32 shift) {
+        if (node % 4 != 0 || node + u64{count} * 4 > m_block.size()) {
+            return false;
+        }
+        for (u32 i = 0; i < count; i++) {
+            u32 entry = node + i * 4;
+            if (m_swapped[entry / 2]) {
+                continue;
+            }
+            m_swapped[entry / 2] = m_swapped[entry / 2 + 1] = true;
+            Swap32(m_block, entry);
+
+            u32 offset = Native32(m_block, entry);
+            bool valid = offset & 0x80000000 ? swapList(node + (offset & 0x7fffffff)) :
+                                               shift > 0 && swapGroup(node + offset, 8, shift - 1);
+            if (!valid) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // The game skips the first half-word of a list
+    bool swapList(u32 list) {
+        if (list % 2 != 0) {
+            return false;
+        }
+        for (u32 offset = list + 2;; offset += 2) {
+            if (offset + 2 > m_block.size()) {
+                return false;
+            }
+            if (!m_swapped[offset / 2]) {
+                m_swapped[offset / 2] = true;
+                Swap16(m_block, offset);
+            }
+            if (m_block[offset] == 0 && m_block[offset + 1] == 0) {
+                return true;
+            }
+        }
+    }
+
+    std::span<u8> m_block;
+    std::vector<bool> m_swapped;
+};
+
+} // namespace
+
+bool SwapKclFile(std::span<u8> bytes) {
+    if (bytes.size() < HeaderSize) {
+        return false;
+    }
+    for (u32 offset = 0; offset < HeaderSize; offset += 4) {
+        Swap32(bytes, offset);
+    }
+    KCollisionV1Header header;
+    memcpy(&header, bytes.data(), sizeof(header));
+
+    // Prism indices start at 1
+    u32 prismOffset = header.prism_data_offset + PrismSize;
+    std::array<u32, 5> ends{header.pos_data_offset, header.nrm_data_offset, prismOffset,
+            header.block_data_offset, static_cast<u32>(bytes.size())};
+    std::sort(ends.begin(), ends.end());
+    if (ends[0] < HeaderSize || ends[4] > bytes.size()) {
+        return false;
+    }
+    auto end = [&](u32 offset) { return *std::upper_bound(ends.begin(), ends.end() - 1, offset); };
+
+    for (u32 section : {header.pos_data_offset, header.nrm_data_offset}) {
+        for (u32 offset = section; offset + 4 <= end(section); offset += 4) {
+            Swap32(bytes, offset);
+        }
+    }
+    for (u32 offset = prismOffset; offset + PrismSize <= end(prismOffset); offset += PrismSize) {
+        Swap32(bytes, offset);
+        for (u32 i = 4; i < PrismSize; i += 2) {
+            Swap16(bytes, offset + i);
+        }
+    }
+
+    s32 shift = header.block_width_shift;
+    if (shift < 0 || shift >= 32) {
+        return false;
+    }
+    u32 xCount = (~header.area_x_width_mask >> shift) + 1;
+    u32 yCount = (~header.area_y_width_mask >> shift) + 1;
+    u32 zCount = (~header.area_z_width_mask >> shift) + 1;
+    u32 block = header.block_data_offset;
+    BlockSwapper swapper(bytes.subspan(block, end(block) - block));
+    return swapper.swapGroup(0, xCount * yCount * zCount, shift);
+}
+
+} // namespace SP
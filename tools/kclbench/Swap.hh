@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Common.hh>
+
+#include <sp/3d/KclFile.hh>
+
+#include <span>
+
+namespace SP {
+
+// Converts a big-endian KCL file to the byte order of the host, in place, as KclFile reads it
+// as is. Returns false if the sections or the octree are out of the bounds of the file.
+bool SwapKclFile(std::span<u8> bytes);
+
+} // namespace SP
@@ -0,0 +1,12 @@
+#pragma once
+
+// Shadows the header of the payload, whose structures have the layout of the console.
+
+#include <Common.h>
+
+#ifdef RVL_OS_NEEDS_IMPORT
+#undef RVL_OS_NEEDS_IMPORT
+#define RVL_OS_NEEDS_IMPORT
+#endif
+
+__attribute__((format(printf, 1, 2))) void OSReport(const char *msg, ...);
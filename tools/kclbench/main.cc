@@ -0,0 +1,177 @@
+// Replays positions against the KCL queries of the payload, to measure them on a PC. See README.md.
+
+#include "Swap.hh"
+
+#include "KclQuery.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <vector>
+
+namespace {
+
+struct LeafStats {
+    u32 leafCount = 0;
+    u32 totalPrismCount = 0;
+    u32 maxPrismCount = 0;
+};
+
+// Leaves are counted once per distinct list, as encoders share them.
+void CollectLeaves(const SP::KclFile &file, u32 node, u32 count, std::set<u32> &lists) {
+    for (u32 i = 0; i < count; i++) {
+        u32 offset;
+        memcpy(&offset, file.block.data() + node + i * 4, sizeof(offset));
+        if (offset & 0x80000000) {
+            lists.insert(node + (offset & 0x7fffffff));
+        } else {
+            CollectLeaves(file, node + offset, 8, lists);
+        }
+    }
+}
+
+LeafStats GetLeafStats(const SP::KclFile &file) {
+    const SP::KCollisionV1Header &header = *file.m_header;
+    s32 shift = header.block_width_shift;
+    u32 count = ((~header.area_x_width_mask >> shift) + 1) *
+            ((~header.area_y_width_mask >> shift) + 1) * ((~header.area_z_width_mask >> shift) + 1);
+    std::set<u32> lists;
+    CollectLeaves(file, 0, count, lists);
+
+    LeafStats stats;
+    for (u32 list : lists) {
+        const u16 *indices = reinterpret_cast<const u16 *>(file.block.data() + list);
+        u32 prismCount = 0;
+        while (*++indices) {
+            prismCount++;
+        }
+        stats.leafCount++;
+        stats.totalPrismCount += prismCount;
+        stats.maxPrismCount = std::max(stats.maxPrismCount, prismCount);
+    }
+    return stats;
+}
+
+// Points slightly above the prisms, as karts would be
+std::vector<Vec3> SynthesizePositions(const SP::KclFile &file, f32 radius) {
+    std::vector<Vec3> positions;
+    size_t stride = std::max<size_t>(file.prism.size() / 100000, 1);
+    for (size_t i = 1; i < file.prism.size(); i += stride) {
+        const SP::KCollisionPrismData &prism = file.prism[i];
+        if (prism.pos_i >= file.pos.size() ||
+                std::max({prism.fnrm_i, prism.enrm1_i, prism.enrm2_i, prism.enrm3_i}) >=
+                        file.nrm.size()) {
+            continue;
+        }
+        const Vec3 &fnrm = file.nrm[prism.fnrm_i];
+        auto vertices = SP::FromPrism(prism.height, file.pos[prism.pos_i], fnrm,
+                file.nrm[prism.enrm1_i], file.nrm[prism.enrm2_i], file.nrm[prism.enrm3_i]);
+        Vec3 centroid = (vertices[0] + vertices[1] + vertices[2]) * (1.0f / 3.0f);
+        positions.push_back(centroid + fnrm * (radius * 0.5f));
+    }
+    return positions;
+}
+
+bool ReadPositions(const char *path, std::vector<Vec3> &positions) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    f32 x, y, z;
+    while (fscanf(file, "%f %f %f", &x, &y, &z) == 3) {
+        positions.emplace_back(x, y, z);
+    }
+    fclose(file);
+    return true;
+}
+
+template <typename F>
+void Measure(const char *name, const std::vector<Vec3> &positions, F query) {
+    u32 hitCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Vec3 &pos : positions) {
+        hitCount += query(pos).has_value();
+    }
+    auto end = std::chrono::steady_clock::now();
+    f64 ns = std::chrono::duration<f64, std::nano>(end - start).count();
+    printf("  %-13s %7u/%zu hits, %8.1f ns/query\n", name, hitCount, positions.size(),
+            positions.empty() ? 0.0 : ns / positions.size());
+}
+
+bool Bench(const char *path, const std::vector<Vec3> &replayedPositions, f32 radius) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        fprintf(stderr, "%s: cannot be opened\n", path);
+        return false;
+    }
+    std::vector<u8> bytes(std::istreambuf_iterator<char>(stream), {});
+    if (!SP::SwapKclFile(bytes)) {
+        fprintf(stderr, "%s: not a valid KCL file\n", path);
+        return false;
+    }
+
+    SP::KclFile file(bytes);
+    if (file.block.empty() || file.prism.empty()) {
+        fprintf(stderr, "%s: not a valid KCL file\n", path);
+        return false;
+    }
+    SP::KclQuery query(file);
+
+    LeafStats stats = GetLeafStats(file);
+    printf("%s: %zu prisms, block_width_shift %d, sphere_radius %.1f\n", path,
+            file.prism.size() - 1, file.m_header->block_width_shift,
+            file.m_header->sphere_radius);
+    printf("  %u leaves, %.1f prisms per leaf on average, %u at most\n", stats.leafCount,
+            stats.leafCount ? static_cast<f64>(stats.totalPrismCount) / stats.leafCount : 0.0,
+            stats.maxPrismCount);
+
+    std::vector<Vec3> positions = replayedPositions;
+    if (positions.empty()) {
+        positions = SynthesizePositions(file, radius);
+    }
+    Measure("checkSphere", positions, [&](const Vec3 &pos) {
+        return query.checkSphere(pos, radius);
+    });
+    Measure("castRay", positions, [&](const Vec3 &pos) {
+        return query.castRay(pos, Vec3(0.0f, -1.0f, 0.0f), 10000.0f);
+    });
+    Measure("closestPoint", positions, [&](const Vec3 &pos) {
+        return query.closestPoint(pos, file.m_header->sphere_radius);
+    });
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::vector<Vec3> positions;
+    f32 radius = 50.0f;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (!strcmp(argv[i], "-p")) {
+            if (!ReadPositions(argv[i + 1], positions)) {
+                fprintf(stderr, "%s: cannot be opened\n", argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "-r")) {
+            radius = strtof(argv[i + 1], nullptr);
+        } else {
+            break;
+        }
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: %s [-p positions.txt] [-r radius] course.kcl...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    for (; i < argc; i++) {
+        ok &= Bench(argv[i], positions, radius);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
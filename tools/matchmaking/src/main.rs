@@ -1,10 +1,13 @@
 mod ids;
+mod room_index;
 mod tcp_forward;
+mod user_store;
 mod ws_forward;
 
 use std::{
-    collections::{HashMap, HashSet},
-    sync::Arc,
+    collections::HashMap,
+    sync::{Arc, Mutex},
+    time::{Duration, Instant},
 };
 
 use anyhow::Result;
@@ -19,6 +22,7 @@ use netprotocol::{
     },
 };
 use prost::Message;
+use room_index::RoomIndex;
 use tokio::net::TcpStream;
 use tokio_tungstenite::{tungstenite::Message as WebSocketMessage, WebSocketStream};
 
@@ -30,10 +34,56 @@ type GameserverMessageReceiver = tokio::sync::mpsc::UnboundedReceiver<STGMessage
 #[allow(non_upper_case_globals)]
 const Success: Fallible = Ok(());
 
+#[derive(Clone, Copy, Debug)]
+pub struct Ratings {
+    vs: i32,
+    bt: i32,
+}
+
+impl Ratings {
+    /// The default of the users table, also used for guests.
+    const DEFAULT: Ratings = Ratings {
+        vs: 5000,
+        bt: 5000,
+    };
+
+    pub fn new(vs: i32, bt: i32) -> Self {
+        Self {
+            vs,
+            bt,
+        }
+    }
+
+    fn get(&self, is_battle: bool) -> i32 {
+        if is_battle {
+            self.bt
+        } else {
+            self.vs
+        }
+    }
+}
+
 #[derive(Debug, Default)]
 struct Room {
-    clients: HashSet<ClientId>,
+    /// The rating of each member for the gamemode of the room
+    clients: HashMap<ClientId, i32>,
     is_battle: bool,
+    rating_sum: i64,
+}
+
+impl Room {
+    const MAX_CLIENT_COUNT: usize = 12;
+
+    fn rating(&self) -> i32 {
+        match self.clients.len() {
+            0 => Ratings::DEFAULT.get(self.is_battle),
+            len => (self.rating_sum / len as i64) as i32,
+        }
+    }
+
+    fn is_open(&self) -> bool {
+        !self.clients.is_empty() && self.clients.len() < Self::MAX_CLIENT_COUNT
+    }
 }
 
 #[derive(Debug)]
@@ -55,57 +105,71 @@ impl Gameserver {
 pub struct Server {
     waiting_clients: Arc<DashMap<ClientId, OneshotSender>>,
     gameservers: Arc<DashMap<GameserverID, Gameserver>>,
+    /// Open rooms, kept in sync with the rooms of the gameservers
+    room_index: Arc<Mutex<RoomIndex>>,
+    /// The gamemode and rating of clients which were sent to a room, until they join it
+    placements: Arc<DashMap<ClientId, (bool, i32)>>,
 }
 
 impl Server {
+    /// Rooms are first looked for within this distance of the client's rating, and the window
+    /// then widens for each second spent waiting.
+    const BASE_RATING_WINDOW: i32 = 500;
+    const RATING_WINDOW_GROWTH: i32 = 250;
+    const MAX_RATING_WINDOW: i32 = 2500;
+    const SEARCH_INTERVAL: Duration = Duration::from_secs(1);
+
     pub fn new() -> Self {
         Self::default()
     }
 
+    /// Finds the fullest open room with a close enough rating, widening the window over time.
+    /// Returns None when a new room should be opened instead, either because there is no open
+    /// room for the gamemode or because the window can no longer grow.
+    async fn find_room(&self, is_battle: bool, rating: i32) -> Option<(GameserverID, RoomId)> {
+        let start = Instant::now();
+        loop {
+            let window = Self::BASE_RATING_WINDOW
+                + Self::RATING_WINDOW_GROWTH * start.elapsed().as_secs() as i32;
+            let window = window.min(Self::MAX_RATING_WINDOW);
+            let (room, has_rooms) = {
+                let room_index = self.room_index.lock().unwrap();
+                (room_index.find(is_battle, rating, window), room_index.has_rooms(is_battle))
+            };
+            if room.is_some() || !has_rooms || window == Self::MAX_RATING_WINDOW {
+                tracing::debug!("Searched rooms for {:?} (window {window})", start.elapsed());
+                return room;
+            }
+            tokio::time::sleep(Self::SEARCH_INTERVAL).await;
+        }
+    }
+
     /// Requests for a room to be opened on either:
-    /// - The room with the most members
+    /// - The fullest room with a close enough rating
     /// - The gameserver with the least rooms
     #[async_recursion::async_recursion]
     async fn request_room(
         &self,
         client_id: ClientId,
         gamemode: u32,
+        ratings: Ratings,
     ) -> Result<gts_message::TokenResponse> {
         let is_battle = gamemode == 1;
-        let mut least_room = None;
-        let mut highest_member_count = None;
-
-        for gameserver in self.gameservers.iter() {
-            let (gameserver_id, gameserver) = gameserver.pair();
-
-            for (room_id, room) in &gameserver.rooms {
-                if room.is_battle == is_battle && room.clients.len() < 12 {
-                    if let Some((highest_member_count, _, _)) = highest_member_count {
-                        if highest_member_count > room.clients.len() as u8 {
-                            continue;
-                        }
-                    }
-
-                    highest_member_count =
-                        Some((room.clients.len() as u8, *gameserver_id, *room_id));
+        let rating = ratings.get(is_battle);
+
+        let (gameserver_id, room_id) = match self.find_room(is_battle, rating).await {
+            Some((gameserver_id, room_id)) => (gameserver_id, Some(room_id)),
+            None => {
+                let least_room = self
+                    .gameservers
+                    .iter()
+                    .min_by_key(|gameserver| gameserver.rooms.len())
+                    .map(|gameserver| *gameserver.key());
+                match least_room {
+                    Some(gameserver_id) => (gameserver_id, None),
+                    None => anyhow::bail!("No gameservers found!"),
                 }
             }
-
-            if highest_member_count.is_none() {
-                if let Some((least_room_count, _)) = least_room {
-                    if least_room_count > gameserver.rooms.len() as u8 {
-                        continue;
-                    }
-                }
-
-                least_room = Some((gameserver.rooms.len() as u8, *gameserver_id));
-            }
-        }
-
-        let (gameserver_id, room_id) = match (highest_member_count, least_room) {
-            (Some((_, gameserver_id, room_id)), _) => (gameserver_id, Some(room_id)),
-            (None, Some((_, gameserver_id))) => (gameserver_id, None),
-            (None, None) => anyhow::bail!("No gameservers found!"),
         };
 
         let message = STGMessage::TokenRequest(stg_message::RequestToken {
@@ -118,6 +182,7 @@ impl Server {
         if let Some(gameserver) = self.gameservers.get(&gameserver_id) {
             let (resp_tx, resp_rx) = tokio::sync::oneshot::channel();
             self.waiting_clients.insert(client_id, resp_tx);
+            self.placements.insert(client_id, (is_battle, rating));
             gameserver.sender.send(message)?;
 
             resp_rx.await.map_err(Into::into)
@@ -125,7 +190,23 @@ impl Server {
             tracing::warn!(
                 "Gameserver {gameserver_id} deleted before token request could be sent, retrying"
             );
-            self.request_room(client_id, gamemode).await
+            self.request_room(client_id, gamemode, ratings).await
+        }
+    }
+
+    pub fn remove_gameserver(&self, gameserver_id: GameserverID) {
+        let Some((_, gameserver)) = self.gameservers.remove(&gameserver_id) else { return };
+        let mut room_index = self.room_index.lock().unwrap();
+        for (room_id, room) in &gameserver.rooms {
+            if room.is_open() {
+                room_index.remove(
+                    room.is_battle,
+                    room.rating(),
+                    room.clients.len(),
+                    gameserver_id,
+                    *room_id,
+                );
+            }
         }
     }
 
@@ -133,6 +214,7 @@ impl Server {
         &self,
         mut tcp: AsyncStream<CTSMessageOpt, STCMessageOpt>,
         client_id: ClientId,
+        ratings: Ratings,
     ) -> Fallible {
         while let Some(msg) = tcp.read().await? {
             let Some(msg) = msg.message else {todo!("Handle client disconnect")};
@@ -142,7 +224,7 @@ impl Server {
                     gamemode,
                     trackpack,
                 }) => {
-                    let server_resp = self.request_room(client_id, gamemode).await?;
+                    let server_resp = self.request_room(client_id, gamemode, ratings).await?;
                     let client_resp = stc_message::FoundMatch {
                         login_info: server_resp.login_info,
                         room_ip: server_resp.room_ip,
@@ -195,20 +277,54 @@ impl Server {
                     is_host,
                 }) => {
                     let room_id = RoomId(room_id as u16);
+                    let client_id = client_id.into();
 
                     let mut gameserver = self.gameservers.get_mut(&gameserver_id).unwrap();
+                    let room = gameserver.rooms.entry(room_id).or_default();
+                    let mut room_index = self.room_index.lock().unwrap();
+                    if room.is_open() {
+                        room_index.remove(
+                            room.is_battle,
+                            room.rating(),
+                            room.clients.len(),
+                            gameserver_id,
+                            room_id,
+                        );
+                    }
+
                     // "Host" left, remove room
                     if is_host && !is_join {
                         gameserver.rooms.remove(&room_id);
                         continue;
                     }
 
-                    let room = gameserver.rooms.entry(room_id).or_default();
-
                     if is_join {
-                        room.clients.insert(client_id.into());
-                    } else {
-                        room.clients.remove(&client_id.into());
+                        let placement = self.placements.remove(&client_id).map(|(_, p)| p);
+                        if let Some((is_battle, _)) = placement {
+                            if room.clients.is_empty() {
+                                room.is_battle = is_battle;
+                            }
+                        }
+                        let rating = match placement {
+                            Some((is_battle, rating)) if is_battle == room.is_battle => rating,
+                            _ => Ratings::DEFAULT.get(room.is_battle),
+                        };
+                        if let Some(rating) = room.clients.insert(client_id, rating) {
+                            room.rating_sum -= rating as i64;
+                        }
+                        room.rating_sum += rating as i64;
+                    } else if let Some(rating) = room.clients.remove(&client_id) {
+                        room.rating_sum -= rating as i64;
+                    }
+
+                    if room.is_open() {
+                        room_index.insert(
+                            room.is_battle,
+                            room.rating(),
+                            room.clients.len(),
+                            gameserver_id,
+                            room_id,
+                        );
                     }
                 }
                 _ => todo!(),
@@ -0,0 +1,171 @@
+use std::{
+    cmp::Reverse,
+    collections::{BTreeSet, HashMap},
+};
+
+use crate::{GameserverID, RoomId};
+
+/// Fullest rooms first, so that joining players fill existing rooms before new ones are opened.
+type Entry = (Reverse<usize>, GameserverID, RoomId);
+
+/// Open rooms bucketed by gamemode and rating band, so that a room close to a player's rating can
+/// be found without scanning every room of every gameserver.
+#[derive(Debug, Default)]
+pub struct RoomIndex {
+    bands: HashMap<(bool, i32), BTreeSet<Entry>>,
+    room_counts: [usize; 2],
+}
+
+impl RoomIndex {
+    pub const BAND_WIDTH: i32 = 250;
+
+    pub fn insert(
+        &mut self,
+        is_battle: bool,
+        rating: i32,
+        member_count: usize,
+        gameserver_id: GameserverID,
+        room_id: RoomId,
+    ) {
+        let band = self.bands.entry((is_battle, Self::band(rating))).or_default();
+        if band.insert((Reverse(member_count), gameserver_id, room_id)) {
+            self.room_counts[is_battle as usize] += 1;
+        }
+    }
+
+    /// Takes the same key the room was inserted with.
+    pub fn remove(
+        &mut self,
+        is_battle: bool,
+        rating: i32,
+        member_count: usize,
+        gameserver_id: GameserverID,
+        room_id: RoomId,
+    ) {
+        let key = (is_battle, Self::band(rating));
+        let Some(band) = self.bands.get_mut(&key) else { return };
+        if band.remove(&(Reverse(member_count), gameserver_id, room_id)) {
+            self.room_counts[is_battle as usize] -= 1;
+        }
+        if band.is_empty() {
+            self.bands.remove(&key);
+        }
+    }
+
+    pub fn has_rooms(&self, is_battle: bool) -> bool {
+        self.room_counts[is_battle as usize] != 0
+    }
+
+    /// Returns the fullest room of the closest band whose rating is within the window, looking at
+    /// one band on each side per step.
+    pub fn find(
+        &self,
+        is_battle: bool,
+        rating: i32,
+        window: i32,
+    ) -> Option<(GameserverID, RoomId)> {
+        let band = Self::band(rating);
+        for distance in 0..=window / Self::BAND_WIDTH {
+            let bands = if distance == 0 {
+                [band, band]
+            } else {
+                [band - distance, band + distance]
+            };
+            let closest =
+                bands.iter().filter_map(|band| self.bands.get(&(is_battle, *band))?.first()).min();
+            if let Some((_, gameserver_id, room_id)) = closest {
+                return Some((*gameserver_id, *room_id));
+            }
+        }
+        None
+    }
+
+    fn band(rating: i32) -> i32 {
+        rating.div_euclid(Self::BAND_WIDTH)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn room(gameserver_id: u16, room_id: u16) -> Option<(GameserverID, RoomId)> {
+        Some((GameserverID(gameserver_id), RoomId(room_id)))
+    }
+
+    #[test]
+    fn window_widens_one_band_per_step() {
+        let mut index = RoomIndex::default();
+        index.insert(false, 1000, 4, GameserverID(0), RoomId(0));
+        assert_eq!(index.find(false, 1600, 0), None);
+        assert_eq!(index.find(false, 1600, 250), None);
+        assert_eq!(index.find(false, 1600, 500), room(0, 0));
+        assert_eq!(index.find(false, 1100, 0), room(0, 0));
+
+        // The closest band wins over a fuller room further away
+        index.insert(false, 1750, 1, GameserverID(0), RoomId(1));
+        assert_eq!(index.find(false, 1600, 500), room(0, 1));
+
+        // Negative ratings get their own bands
+        index.insert(false, -1, 1, GameserverID(0), RoomId(2));
+        assert_eq!(index.find(false, 0, 0), None);
+        assert_eq!(index.find(false, 0, 250), room(0, 2));
+    }
+
+    #[test]
+    fn fullest_room_first() {
+        let mut index = RoomIndex::default();
+        index.insert(false, 1000, 3, GameserverID(0), RoomId(0));
+        index.insert(false, 1000, 10, GameserverID(1), RoomId(1));
+        index.insert(false, 1000, 5, GameserverID(2), RoomId(2));
+        assert_eq!(index.find(false, 1000, 0), room(1, 1));
+
+        // Across the two bands at the same distance as well
+        index.insert(false, 1600, 11, GameserverID(3), RoomId(3));
+        assert_eq!(index.find(false, 1300, 250), room(3, 3));
+
+        // Then the lowest ids
+        index.insert(false, 1000, 10, GameserverID(0), RoomId(4));
+        assert_eq!(index.find(false, 1000, 0), room(0, 4));
+    }
+
+    #[test]
+    fn gamemodes_are_separate() {
+        let mut index = RoomIndex::default();
+        index.insert(true, 1000, 2, GameserverID(0), RoomId(0));
+        assert!(index.has_rooms(true));
+        assert!(!index.has_rooms(false));
+        assert_eq!(index.find(false, 1000, 1000), None);
+        assert_eq!(index.find(true, 1000, 0), room(0, 0));
+    }
+
+    #[test]
+    fn insert_and_remove_are_symmetric() {
+        let mut index = RoomIndex::default();
+        index.insert(false, 1000, 2, GameserverID(0), RoomId(0));
+        index.insert(false, 1000, 2, GameserverID(0), RoomId(0));
+        index.insert(false, 3000, 1, GameserverID(0), RoomId(1));
+        assert_eq!(index.room_counts, [2, 0]);
+
+        // Only the key the room was inserted with removes it
+        index.remove(false, 1000, 3, GameserverID(0), RoomId(0));
+        index.remove(true, 1000, 2, GameserverID(0), RoomId(0));
+        index.remove(false, 2000, 2, GameserverID(0), RoomId(0));
+        assert_eq!(index.room_counts, [2, 0]);
+        assert_eq!(index.find(false, 1000, 0), room(0, 0));
+
+        // A member joining moves the room in its band
+        index.remove(false, 1000, 2, GameserverID(0), RoomId(0));
+        index.insert(false, 1000, 3, GameserverID(0), RoomId(0));
+        index.insert(false, 1000, 2, GameserverID(1), RoomId(2));
+        assert_eq!(index.find(false, 1000, 0), room(0, 0));
+
+        index.remove(false, 1000, 3, GameserverID(0), RoomId(0));
+        index.remove(false, 1000, 2, GameserverID(1), RoomId(2));
+        index.remove(false, 1000, 2, GameserverID(1), RoomId(2));
+        index.remove(false, 3000, 1, GameserverID(0), RoomId(1));
+        assert_eq!(index.room_counts, [0, 0]);
+        assert!(!index.has_rooms(false));
+        assert!(index.bands.is_empty());
+    }
+}
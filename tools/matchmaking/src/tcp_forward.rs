@@ -10,12 +10,15 @@ use netprotocol::{
 use tokio::net::ToSocketAddrs;
 
 use crate::{
-    cts_message, stc_message, ClientId, Fallible, Result, STCMessage, STCMessageOpt, Server,
+    cts_message, stc_message,
+    user_store::{User, UserStore},
+    ClientId, Fallible, Ratings, Result, STCMessage, STCMessageOpt, Server,
 };
 
 pub struct ClientForwarder {
     listener: tokio::net::TcpListener,
     db_pool: sqlx::PgPool,
+    user_store: UserStore,
     server: Server,
 }
 
@@ -27,6 +30,7 @@ impl ClientForwarder {
     ) -> Result<Self> {
         Ok(Self {
             listener: tokio::net::TcpListener::bind(bind).await?,
+            user_store: UserStore::new(db_pool.clone()),
             db_pool,
             server,
         })
@@ -42,6 +46,7 @@ impl ClientForwarder {
 
             let server = self.server.clone();
             let db_pool = self.db_pool.clone();
+            let user_store = self.user_store.clone();
             let server_keypair = server_keypair.clone();
             let logged_in_clients = logged_in_clients.clone();
 
@@ -53,7 +58,8 @@ impl ClientForwarder {
                 };
 
                 if let Err(err) =
-                    Self::handle_connection(stream, logged_in_clients, db_pool, server).await
+                    Self::handle_connection(stream, logged_in_clients, db_pool, user_store, server)
+                        .await
                 {
                     tracing::error!("Error in tcp connection handler: {err}")
                 };
@@ -65,11 +71,13 @@ impl ClientForwarder {
         mut stream: AsyncStream<CTSMessageOpt, STCMessageOpt>,
         logged_in_clients: Arc<DashSet<ClientId>>,
         db_pool: sqlx::PgPool,
+        user_store: UserStore,
         server: Server,
     ) -> Fallible {
-        let client_id = Self::handle_login_flow(&mut stream, &db_pool).await?;
+        let (client_id, ratings) =
+            Self::handle_login_flow(&mut stream, &db_pool, &user_store).await?;
         if logged_in_clients.insert(client_id) {
-            let res = server.client_listener(stream, client_id).await;
+            let res = server.client_listener(stream, client_id, ratings).await;
             logged_in_clients.remove(&client_id);
             res
         } else {
@@ -77,11 +85,12 @@ impl ClientForwarder {
         }
     }
 
-    /// Returns Ok(true) if the login was successful, Ok(false) if logging in as guest, Err if login failed
+    /// Returns the id and ratings of the client, guests getting the default ratings. Err if login failed
     async fn handle_login_flow(
         stream: &mut AsyncStream<CTSMessageOpt, STCMessageOpt>,
         db_pool: &sqlx::PgPool,
-    ) -> Result<ClientId> {
+        user_store: &UserStore,
+    ) -> Result<(ClientId, Ratings)> {
         let Some(initial_message) = stream.read().await? else {bail!("No initial message")};
         let Some(CTSMessage::Login(initial_message)) = initial_message.message else {bail!("Invalid initial message")};
 
@@ -96,7 +105,7 @@ impl ClientForwarder {
                     message: Some(STCMessage::GuestResponse(stc_message::LoginGuest {})),
                 })
                 .await?;
-            return Ok(ClientId::new(None));
+            return Ok((ClientId::new(None), Ratings::DEFAULT));
         }
 
         let client_id = initial_message.client_id.unwrap();
@@ -127,42 +136,30 @@ impl ClientForwarder {
             bail!("Challenge response verification failed");
         }
 
-        let mut db_connection = db_pool.acquire().await?;
-        let rr_record = sqlx::query!(
-            "
-            INSERT INTO
-                users(device_id, licence_id, mii, friend_suffix, location, latitude, longitude)
-            VALUES
-                ($1, $2, $3, $4, $5, $6, $7)
-            ON CONFLICT (device_id, licence_id) DO UPDATE SET
-                mii = $3,
-                location = $5,
-                latitude = $6,
-                longitude = $7
-            RETURNING vs_rating, bt_rating
-        ",
-            device_id,
-            licence_id,
-            mii,
-            rand::random::<i8>() as i16,
-            location,
-            latitude,
-            longitude
-        )
-        .fetch_one(&mut db_connection)
-        .await?;
+        let ratings = user_store
+            .login(User {
+                device_id,
+                licence_id,
+                mii,
+                location,
+                latitude,
+                longitude,
+            })
+            .await?;
 
+        let mut db_connection = db_pool.acquire().await?;
         let friends = fetch_friend_data(&mut db_connection, device_id, licence_id).await?;
         let message = STCMessageOpt {
             message: Some(STCMessage::Response(stc_message::LoginResponse {
-                vs_rating: rr_record.vs_rating,
-                bt_rating: rr_record.bt_rating,
+                vs_rating: ratings.vs,
+                bt_rating: ratings.bt,
                 friends,
             })),
         };
 
         stream.write(&message).await?;
-        Ok(ClientId::new(Some((device_id as u32, licence_id as u16))))
+        let client_id = ClientId::new(Some((device_id as u32, licence_id as u16)));
+        Ok((client_id, ratings))
     }
 }
 
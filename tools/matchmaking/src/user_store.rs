@@ -0,0 +1,191 @@
+use std::{
+    collections::{hash_map::Entry, HashMap},
+    mem,
+    sync::Arc,
+};
+
+use anyhow::Context;
+use tokio::sync::{oneshot, Mutex, Notify};
+
+use crate::{Ratings, Result};
+
+type UserKey = (i32, i16);
+
+#[derive(Debug)]
+pub struct User {
+    pub device_id: i32,
+    pub licence_id: i16,
+    pub mii: Vec<u8>,
+    pub location: i32,
+    pub latitude: i32,
+    pub longitude: i32,
+}
+
+/// Writes the rows of logging in users in batches, so that a login storm costs a few bulk upserts
+/// rather than a round trip per client. A login waits for the batch which writes its row, which
+/// also returns its ratings.
+#[derive(Clone)]
+pub struct UserStore {
+    inner: Arc<Inner>,
+}
+
+struct Inner {
+    db_pool: sqlx::PgPool,
+    /// Only the latest login of each user is written, with the logins waiting for the row.
+    pending: Mutex<HashMap<UserKey, (User, Vec<oneshot::Sender<Ratings>>)>>,
+    flush: Notify,
+}
+
+impl UserStore {
+    const MAX_BATCH_SIZE: usize = 1000;
+
+    pub fn new(db_pool: sqlx::PgPool) -> Self {
+        let inner = Arc::new(Inner {
+            db_pool,
+            pending: Mutex::new(HashMap::new()),
+            flush: Notify::new(),
+        });
+        tokio::spawn(Self::flush_loop(inner.clone()));
+        Self {
+            inner,
+        }
+    }
+
+    /// Creates or updates the user and returns their ratings, once the row is written.
+    pub async fn login(&self, user: User) -> Result<Ratings> {
+        let key = (user.device_id, user.licence_id);
+        let (ratings_tx, ratings_rx) = oneshot::channel();
+        match self.inner.pending.lock().await.entry(key) {
+            Entry::Occupied(mut entry) => {
+                let (pending_user, ratings_txs) = entry.get_mut();
+                *pending_user = user;
+                ratings_txs.push(ratings_tx);
+            }
+            Entry::Vacant(entry) => {
+                entry.insert((user, vec![ratings_tx]));
+            }
+        }
+        self.inner.flush.notify_one();
+
+        ratings_rx.await.context("Failed to write the user")
+    }
+
+    /// A batch is written as soon as the previous one is done, so a single login isn't delayed,
+    /// while the logins which arrive during a write are grouped into the next one.
+    async fn flush_loop(inner: Arc<Inner>) {
+        loop {
+            inner.flush.notified().await;
+            loop {
+                let batch = {
+                    let mut pending = inner.pending.lock().await;
+                    if pending.len() <= Self::MAX_BATCH_SIZE {
+                        mem::take(&mut *pending)
+                    } else {
+                        let keys = pending.keys().take(Self::MAX_BATCH_SIZE).copied();
+                        let keys = keys.collect::<Vec<_>>();
+                        keys.iter().filter_map(|key| pending.remove_entry(key)).collect()
+                    }
+                };
+                if batch.is_empty() {
+                    break;
+                }
+
+                let (users, ratings_txs): (Vec<_>, Vec<_>) = batch.into_values().unzip();
+                // The logins whose row wasn't written get an error as their sender is dropped.
+                let ratings = Self::write_or_split(&inner.db_pool, &users).await;
+                for (user, ratings_txs) in users.iter().zip(ratings_txs) {
+                    let Some(ratings) = ratings.get(&(user.device_id, user.licence_id)) else {
+                        continue;
+                    };
+                    for ratings_tx in ratings_txs {
+                        let _ = ratings_tx.send(*ratings);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Writes the users, halving the batch whenever the database rejects it, so that a bad row
+    /// only fails its own logins. Other errors fail the whole batch, as retrying it in parts
+    /// wouldn't help. Returns the ratings of the rows which were written.
+    async fn write_or_split(db_pool: &sqlx::PgPool, users: &[User]) -> HashMap<UserKey, Ratings> {
+        let mut ratings = HashMap::with_capacity(users.len());
+        let mut batches = vec![users];
+        while let Some(batch) = batches.pop() {
+            let err = match Self::write(db_pool, batch).await {
+                Ok(batch_ratings) => {
+                    ratings.extend(batch_ratings);
+                    continue;
+                }
+                Err(err) => err,
+            };
+            let is_rejected = matches!(err.downcast_ref(), Some(sqlx::Error::Database(_)));
+            if batch.len() == 1 || !is_rejected {
+                tracing::error!("Failed to write {} users: {err}", batch.len());
+                continue;
+            }
+            let (left, right) = batch.split_at(batch.len() / 2);
+            batches.push(right);
+            batches.push(left);
+        }
+        ratings
+    }
+
+    async fn write(db_pool: &sqlx::PgPool, users: &[User]) -> Result<HashMap<UserKey, Ratings>> {
+        let mut device_ids = Vec::with_capacity(users.len());
+        let mut licence_ids = Vec::with_capacity(users.len());
+        let mut miis = Vec::with_capacity(users.len());
+        let mut friend_suffixes = Vec::with_capacity(users.len());
+        let mut locations = Vec::with_capacity(users.len());
+        let mut latitudes = Vec::with_capacity(users.len());
+        let mut longitudes = Vec::with_capacity(users.len());
+        for user in users {
+            device_ids.push(user.device_id);
+            licence_ids.push(user.licence_id);
+            miis.push(user.mii.clone());
+            friend_suffixes.push(rand::random::<i8>() as i16);
+            locations.push(user.location);
+            latitudes.push(user.latitude);
+            longitudes.push(user.longitude);
+        }
+
+        let records = sqlx::query!(
+            "
+            INSERT INTO
+                users(device_id, licence_id, mii, friend_suffix, location, latitude, longitude)
+            SELECT * FROM UNNEST(
+                $1::integer[],
+                $2::smallint[],
+                $3::bytea[],
+                $4::smallint[],
+                $5::integer[],
+                $6::integer[],
+                $7::integer[]
+            )
+            ON CONFLICT (device_id, licence_id) DO UPDATE SET
+                mii = EXCLUDED.mii,
+                location = EXCLUDED.location,
+                latitude = EXCLUDED.latitude,
+                longitude = EXCLUDED.longitude
+            RETURNING device_id, licence_id, vs_rating, bt_rating
+        ",
+            &device_ids,
+            &licence_ids,
+            &miis,
+            &friend_suffixes,
+            &locations,
+            &latitudes,
+            &longitudes
+        )
+        .fetch_all(db_pool)
+        .await?;
+        let ratings = records
+            .into_iter()
+            .map(|record| {
+                let key = (record.device_id, record.licence_id);
+                (key, Ratings::new(record.vs_rating, record.bt_rating))
+            })
+            .collect();
+        Ok(ratings)
+    }
+}
@@ -47,7 +47,7 @@ impl WebsocketListener {
         tracing::info!("New gameserver connected: {id}");
         server.gameservers.insert(id, Gameserver::new(sender, initial_message.max_rooms as usize));
         let res = server.gameserver_listener(ws, receiver, id).await;
-        server.gameservers.remove(&id);
+        server.remove_gameserver(id);
         res
     }
 }
@@ -3,11 +3,15 @@ use std::slice::SliceIndex;
 
 use anyhow::Result;
 use libhydrogen::{kx, secretbox};
+use prost::bytes::Buf;
 use prost::Message;
 use tokio::io::{AsyncReadExt, AsyncWriteExt};
 use tokio::net::TcpStream;
 
+/// The limit on the size of a read message, including its length prefix. Written messages are only
+/// limited by the prefix, the peer being responsible for its own limit.
 const MAX_MESSAGE_SIZE: usize = 1024;
+const SIZE_SIZE: usize = 2;
 
 #[derive(Debug)]
 pub struct AsyncStream<R: Message + Default, W: Message> {
@@ -20,6 +24,9 @@ pub struct AsyncStream<R: Message + Default, W: Message> {
     read_offset: usize,
     write_key: secretbox::Key,
     write_message_id: u64,
+    /// Reused for every message, so that encoding does not allocate once it has grown. Encrypting
+    /// and decrypting still allocate the output of secretbox for each message.
+    write_buffer: Vec<u8>,
     _marker: PhantomData<(R, W)>,
 }
 
@@ -60,6 +67,7 @@ impl<R: Message + Default, W: Message> AsyncStream<R, W> {
             read_offset: 0,
             write_key,
             write_message_id: 0,
+            write_buffer: Vec::with_capacity(MAX_MESSAGE_SIZE),
             _marker: PhantomData,
         })
     }
@@ -91,22 +99,22 @@ impl<R: Message + Default, W: Message> AsyncStream<R, W> {
     }
 
     pub async fn read(&mut self) -> Result<Option<R>> {
-        while self.read_offset < 2 {
-            if !self.read_internal(self.read_offset..2).await? {
+        while self.read_offset < SIZE_SIZE {
+            if !self.read_internal(self.read_offset..SIZE_SIZE).await? {
                 anyhow::ensure!(self.read_offset == 0, "Unexpected eof!");
                 return Ok(None);
             }
         }
         let size = u16::from_be_bytes(<[u8; 2]>::try_from(&self.read_buffer[..2]).unwrap());
-        let size = size as usize + 2;
+        let size = size as usize + SIZE_SIZE;
         anyhow::ensure!(size <= MAX_MESSAGE_SIZE, "Invalid message size!");
         while self.read_offset < size {
-            if !self.read_internal(2..size).await? {
-                anyhow::ensure!(self.read_offset == 0, "Unexpected eof!");
+            if !self.read_internal(self.read_offset..size).await? {
+                anyhow::bail!("Unexpected eof!");
             }
         }
         let message = secretbox::decrypt(
-            &self.read_buffer[2..size],
+            &self.read_buffer[SIZE_SIZE..size],
             self.read_message_id,
             &self.context,
             &self.read_key,
@@ -118,15 +126,34 @@ impl<R: Message + Default, W: Message> AsyncStream<R, W> {
     }
 
     pub async fn write(&mut self, message: &W) -> Result<()> {
-        let message = message.encode_to_vec();
+        self.write_buffer.clear();
+        message.encode(&mut self.write_buffer)?;
+        let message = secretbox::encrypt(
+            &self.write_buffer,
+            self.write_message_id,
+            &self.context,
+            &self.write_key,
+        );
+        self.write_encrypted(message).await
+    }
+
+    /// Writes an already encoded message, so that a message sent to many streams is only encoded
+    /// once.
+    pub async fn write_encoded(&mut self, message: &[u8]) -> Result<()> {
         let message =
-            secretbox::encrypt(&message, self.write_message_id, &self.context, &self.write_key);
-        self.write_message_id += 1;
+            secretbox::encrypt(message, self.write_message_id, &self.context, &self.write_key);
+        self.write_encrypted(message).await
+    }
+
+    async fn write_encrypted(&mut self, message: Vec<u8>) -> Result<()> {
         let size = message.len();
-        assert!(size <= u16::MAX as usize);
+        anyhow::ensure!(size <= u16::MAX as usize, "Message too large!");
+        self.write_message_id += 1;
         let size = (size as u16).to_be_bytes();
-        self.stream.write_all(&size).await?;
-        self.stream.write_all(&message).await?;
+        // The prefix and the ciphertext go out together, with a vectored write when the stream
+        // supports it.
+        let mut frame = Buf::chain(&size[..], &message[..]);
+        self.stream.write_all_buf(&mut frame).await?;
         Ok(())
     }
 }
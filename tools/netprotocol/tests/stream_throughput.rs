@@ -0,0 +1,159 @@
+//! Measures the messages per second and the allocations per message of AsyncStream, over a local
+//! TCP connection. Run it with `cargo test --release --test stream_throughput -- --ignored
+//! --nocapture`.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::Instant;
+
+use anyhow::Result;
+use libhydrogen::{kx, secretbox};
+use netprotocol::async_stream::AsyncStream;
+use netprotocol::room_protocol::{room_event, RoomEvent, RoomEventOpt, RoomRequestOpt};
+use prost::Message;
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream};
+
+const MESSAGE_COUNT: u32 = 200_000;
+
+/// Counts the allocations of the whole test binary.
+struct CountingAllocator;
+
+static ALLOCATION_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATION_COUNT.fetch_add(1, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATION_COUNT.fetch_add(1, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+type RoomAsyncStream = AsyncStream<RoomRequestOpt, RoomEventOpt>;
+
+fn context() -> secretbox::Context {
+    secretbox::Context::from(*b"room    ")
+}
+
+fn comment(message_id: u32) -> RoomEventOpt {
+    let event = room_event::Comment {
+        player_id: 0,
+        message_id,
+    };
+    RoomEventOpt {
+        event: Some(RoomEvent::Comment(event)),
+    }
+}
+
+/// Returns the client side of a connection, with its read and write keys, and the server side.
+async fn connect() -> Result<(TcpStream, secretbox::Key, secretbox::Key, RoomAsyncStream)> {
+    let listener = TcpListener::bind("127.0.0.1:0").await?;
+    let addr = listener.local_addr()?;
+    let server_keypair = kx::KeyPair::gen();
+    let (client, server) = tokio::join!(
+        async {
+            let mut stream = TcpStream::connect(addr).await?;
+            let mut state = kx::State::new();
+            let mut xx1 = kx::XXPacket1::new();
+            kx::xx_1(&mut state, &mut xx1, None)?;
+            stream.write_all(xx1.as_ref()).await?;
+            let mut xx2 = [0u8; kx::XX_PACKET2BYTES];
+            stream.read_exact(&mut xx2).await?;
+            let xx2 = kx::XXPacket2::from(xx2);
+            let mut xx3 = kx::XXPacket3::new();
+            let keypair = kx::xx_3(&mut state, &mut xx3, None, &xx2, None, &kx::KeyPair::gen())?;
+            stream.write_all(xx3.as_ref()).await?;
+            anyhow::Ok((stream, keypair))
+        },
+        async {
+            let (stream, _) = listener.accept().await?;
+            RoomAsyncStream::new(stream, server_keypair, context()).await
+        }
+    );
+    let (client, keypair) = client?;
+    let read_key: [u8; 32] = keypair.rx.into();
+    let write_key: [u8; 32] = keypair.tx.into();
+    Ok((client, secretbox::Key::from(read_key), secretbox::Key::from(write_key), server?))
+}
+
+fn report(name: &str, start: Instant, allocation_count: usize) {
+    let duration = start.elapsed();
+    println!(
+        "{name}: {:.0} messages/s, {:.2} allocations/message",
+        MESSAGE_COUNT as f64 / duration.as_secs_f64(),
+        allocation_count as f64 / MESSAGE_COUNT as f64,
+    );
+}
+
+#[tokio::test]
+#[ignore]
+async fn write_throughput() -> Result<()> {
+    libhydrogen::init()?;
+    let (mut client, _, _, mut server) = connect().await?;
+    // The peer only drains the socket, without allocating.
+    let drain = tokio::spawn(async move {
+        let mut buffer = [0u8; 64 * 1024];
+        while client.read(&mut buffer).await? != 0 {}
+        anyhow::Ok(())
+    });
+
+    let event = comment(0);
+    let encoded = event.encode_to_vec();
+    let start = Instant::now();
+    let allocation_count = ALLOCATION_COUNT.load(Ordering::Relaxed);
+    for _ in 0..MESSAGE_COUNT {
+        server.write(&event).await?;
+    }
+    report("write", start, ALLOCATION_COUNT.load(Ordering::Relaxed) - allocation_count);
+
+    let start = Instant::now();
+    let allocation_count = ALLOCATION_COUNT.load(Ordering::Relaxed);
+    for _ in 0..MESSAGE_COUNT {
+        server.write_encoded(&encoded).await?;
+    }
+    report("write_encoded", start, ALLOCATION_COUNT.load(Ordering::Relaxed) - allocation_count);
+
+    drop(server);
+    drain.await??;
+    Ok(())
+}
+
+#[tokio::test]
+#[ignore]
+async fn read_throughput() -> Result<()> {
+    libhydrogen::init()?;
+    let (mut client, _, write_key, mut server) = connect().await?;
+    // The messages are encrypted up front, so that the peer only writes.
+    let mut frames = vec![];
+    for message_id in 0..MESSAGE_COUNT {
+        let message = comment(message_id).encode_to_vec();
+        let message = secretbox::encrypt(&message, message_id as u64, &context(), &write_key);
+        frames.extend_from_slice(&(message.len() as u16).to_be_bytes());
+        frames.extend_from_slice(&message);
+    }
+    let write = tokio::spawn(async move {
+        client.write_all(&frames).await?;
+        anyhow::Ok(client)
+    });
+
+    let start = Instant::now();
+    let allocation_count = ALLOCATION_COUNT.load(Ordering::Relaxed);
+    for _ in 0..MESSAGE_COUNT {
+        server.read().await?.unwrap();
+    }
+    report("read", start, ALLOCATION_COUNT.load(Ordering::Relaxed) - allocation_count);
+
+    write.await??;
+    Ok(())
+}
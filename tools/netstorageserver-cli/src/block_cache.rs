@@ -0,0 +1,95 @@
+use std::collections::{BTreeMap, HashMap};
+use std::path::PathBuf;
+use std::sync::{Arc, Mutex};
+use std::time::SystemTime;
+
+pub const BLOCK_SIZE: u64 = 0x10000;
+
+/// Identifies one version of a file on disk, so that blocks of a file which has changed since
+/// they were read are never served.
+#[derive(Debug, Eq, Hash, PartialEq)]
+pub struct FileKey {
+    pub path: PathBuf,
+    pub size: u64,
+    pub modified: Option<SystemTime>,
+}
+
+/// A size-bounded LRU cache of file blocks, shared by all connections.
+pub struct BlockCache {
+    capacity: usize,
+    inner: Mutex<Inner>,
+}
+
+struct Inner {
+    blocks: HashMap<(Arc<FileKey>, u64), Block>,
+    lru: BTreeMap<u64, (Arc<FileKey>, u64)>,
+    next_stamp: u64,
+    size: usize,
+}
+
+struct Block {
+    data: Arc<Vec<u8>>,
+    stamp: u64,
+}
+
+impl BlockCache {
+    pub fn new(capacity: usize) -> BlockCache {
+        BlockCache {
+            capacity,
+            inner: Mutex::new(Inner {
+                blocks: HashMap::new(),
+                lru: BTreeMap::new(),
+                next_stamp: 0,
+                size: 0,
+            }),
+        }
+    }
+
+    pub fn get(&self, key: &Arc<FileKey>, index: u64) -> Option<Arc<Vec<u8>>> {
+        let mut inner = self.inner.lock().unwrap();
+        let inner = &mut *inner;
+        let stamp = inner.next_stamp;
+        let block = inner.blocks.get_mut(&(key.clone(), index))?;
+        let entry = inner.lru.remove(&block.stamp)?;
+        block.stamp = stamp;
+        inner.lru.insert(stamp, entry);
+        inner.next_stamp += 1;
+        Some(block.data.clone())
+    }
+
+    pub fn insert(&self, key: Arc<FileKey>, index: u64, data: Arc<Vec<u8>>) {
+        if data.len() > self.capacity {
+            return;
+        }
+        let mut inner = self.inner.lock().unwrap();
+        let inner = &mut *inner;
+        // Another connection may have read the same block in the meantime.
+        if inner.blocks.contains_key(&(key.clone(), index)) {
+            return;
+        }
+        while inner.size + data.len() > self.capacity {
+            let (_, entry) = match inner.lru.pop_first() {
+                Some(entry) => entry,
+                None => break,
+            };
+            if let Some(block) = inner.blocks.remove(&entry) {
+                inner.size -= block.data.len();
+            }
+        }
+        let stamp = inner.next_stamp;
+        inner.next_stamp += 1;
+        inner.size += data.len();
+        inner.lru.insert(stamp, (key.clone(), index));
+        inner.blocks.insert(
+            (key, index),
+            Block {
+                data,
+                stamp,
+            },
+        );
+    }
+
+    pub fn size(&self) -> usize {
+        self.inner.lock().unwrap().size
+    }
+}
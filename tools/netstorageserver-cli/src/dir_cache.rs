@@ -0,0 +1,173 @@
+use std::collections::HashMap;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant, SystemTime};
+
+use crate::net_storage_response::{node_info, NodeInfo};
+use crate::path_ids::PathIds;
+
+/// The entries of a directory, None for those which can't be sent to clients.
+pub type Listing = Arc<Vec<Option<NodeInfo>>>;
+
+/// Directory listings shared by all connections, so that ghost scans by several clients read
+/// each directory and stat its entries once. A listing is reused as long as the modification time
+/// of the directory is unchanged, which covers entries being added, removed or renamed. Files
+/// which are rewritten in place don't change it, so a listing is also only reused for a short
+/// while, after which the sizes of its entries are read again.
+pub struct DirCache {
+    max_age: Duration,
+    listings: Mutex<HashMap<PathBuf, (SystemTime, Instant, Listing)>>,
+}
+
+impl DirCache {
+    /// The cache is simply cleared when it gets this large.
+    const MAX_LISTINGS: usize = 4096;
+    /// Long enough to cover a ghost scan by several clients at once.
+    const MAX_AGE: Duration = Duration::from_secs(1);
+
+    pub fn new() -> DirCache {
+        DirCache::with_max_age(Self::MAX_AGE)
+    }
+
+    fn with_max_age(max_age: Duration) -> DirCache {
+        DirCache {
+            max_age,
+            listings: Mutex::new(HashMap::new()),
+        }
+    }
+
+    /// Blocks on the file system.
+    pub fn get(&self, path: &Path, ids: &PathIds) -> std::io::Result<Listing> {
+        let modified = fs::metadata(path)?.modified()?;
+        if let Some((cached_modified, read_at, listing)) = self.listings.lock().unwrap().get(path) {
+            if *cached_modified == modified && read_at.elapsed() < self.max_age {
+                return Ok(listing.clone());
+            }
+        }
+
+        let read_at = Instant::now();
+        let listing: Listing =
+            Arc::new(fs::read_dir(path)?.map(|entry| node_info(&entry.ok()?, ids)).collect());
+        let mut listings = self.listings.lock().unwrap();
+        if listings.len() >= Self::MAX_LISTINGS {
+            listings.clear();
+        }
+        listings.insert(path.to_path_buf(), (modified, read_at, listing.clone()));
+        Ok(listing)
+    }
+}
+
+fn node_info(entry: &fs::DirEntry, ids: &PathIds) -> Option<NodeInfo> {
+    let metadata = entry.metadata().ok()?;
+    let name = entry.file_name().into_string().ok()?;
+    let r#type = if metadata.file_type().is_file() {
+        node_info::Type::File
+    } else if metadata.file_type().is_dir() {
+        node_info::Type::Dir
+    } else {
+        return None;
+    } as i32;
+    Some(NodeInfo {
+        id: ids.path_to_id(&entry.path()),
+        r#type,
+        size: metadata.len(),
+        name,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const DIR_COUNT: usize = 16;
+    const FILES_PER_DIR: usize = 625;
+
+    fn file_size(listing: &Listing, name: &str) -> Option<u64> {
+        listing
+            .iter()
+            .flatten()
+            .find(|node_info| node_info.name == name)
+            .map(|node_info| node_info.size)
+    }
+
+    #[test]
+    fn rewritten_file_is_listed_with_its_new_size() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("ghost.rkg");
+        fs::write(&path, [0; 16]).unwrap();
+        let dir_cache = DirCache::with_max_age(Duration::from_millis(100));
+        let ids = PathIds::new();
+        assert_eq!(file_size(&dir_cache.get(dir.path(), &ids).unwrap(), "ghost.rkg"), Some(16));
+
+        // Writing to an existing file leaves the modification time of the directory as is.
+        let modified = fs::metadata(dir.path()).unwrap().modified().unwrap();
+        fs::OpenOptions::new().append(true).open(&path).unwrap().set_len(32).unwrap();
+        assert_eq!(fs::metadata(dir.path()).unwrap().modified().unwrap(), modified);
+
+        std::thread::sleep(Duration::from_millis(150));
+        assert_eq!(file_size(&dir_cache.get(dir.path(), &ids).unwrap(), "ghost.rkg"), Some(32));
+    }
+
+    /// Scans every directory the way the ghost scan of a client does: lists it, then converts the
+    /// id of each entry back to the path that FastOpen would open. Returns the entry count.
+    fn scan(dirs: &[PathBuf], dir_cache: Option<&DirCache>, ids: &PathIds) -> usize {
+        let mut entry_count = 0;
+        for dir in dirs {
+            let listing = match dir_cache {
+                Some(dir_cache) => dir_cache.get(dir, ids).unwrap(),
+                None => Arc::new(
+                    fs::read_dir(dir).unwrap().map(|entry| node_info(&entry.ok()?, ids)).collect(),
+                ),
+            };
+            for node_info in listing.iter().flatten() {
+                let path = ids.id_to_path(node_info.id).unwrap();
+                assert_eq!(path, dir.join(&node_info.name));
+                entry_count += 1;
+            }
+        }
+        entry_count
+    }
+
+    /// Runs clients in parallel over a tree of 10k files, with and without the listing cache, and
+    /// prints the entries per second. Run it with
+    /// `cargo test --release scan_load -- --ignored --nocapture`.
+    #[test]
+    #[ignore]
+    fn scan_load() {
+        let root = tempfile::tempdir().unwrap();
+        let dirs: Vec<_> = (0..DIR_COUNT)
+            .map(|dir_index| {
+                let dir = root.path().join(format!("{dir_index:02}"));
+                fs::create_dir(&dir).unwrap();
+                for file_index in 0..FILES_PER_DIR {
+                    fs::write(dir.join(format!("{file_index:04}.rkg")), [0; 16]).unwrap();
+                }
+                dir
+            })
+            .collect();
+
+        for (name, is_cached) in [("uncached", false), ("cached", true)] {
+            for client_count in [1, 4, 12, 32] {
+                let dir_cache = DirCache::new();
+                let dir_cache = is_cached.then_some(&dir_cache);
+                let ids = PathIds::new();
+                let start = Instant::now();
+                std::thread::scope(|scope| {
+                    for _ in 0..client_count {
+                        scope.spawn(|| {
+                            assert_eq!(scan(&dirs, dir_cache, &ids), DIR_COUNT * FILES_PER_DIR)
+                        });
+                    }
+                });
+                let duration = start.elapsed().as_secs_f64();
+                let entry_count = DIR_COUNT * FILES_PER_DIR * client_count;
+                println!(
+                    "{name:8} {client_count:2} clients: {:6.1} ms, {:9.0} entries/s",
+                    duration * 1000.0,
+                    entry_count as f64 / duration,
+                );
+            }
+        }
+    }
+}
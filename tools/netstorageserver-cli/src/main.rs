@@ -1,18 +1,30 @@
-use std::collections::hash_map::Entry;
-use std::collections::HashMap;
 use std::env;
-use std::io::{ErrorKind, Read, SeekFrom, Write};
+use std::io::{ErrorKind, Read, Write};
+use std::ops::Range;
 use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
 
 use libhydrogen::errors::anyhow;
 use libhydrogen::{kx, secretbox};
 use prost::Message;
-use tokio::io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt};
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::tcp::{OwnedReadHalf, OwnedWriteHalf};
 use tokio::net::{TcpListener, TcpStream};
 use tokio::runtime::Runtime;
-use tokio::sync::{mpsc, oneshot};
+use tokio::sync::mpsc;
 use zeroize::Zeroizing;
 
+mod block_cache;
+mod dir_cache;
+mod path_ids;
+
+use block_cache::{BlockCache, FileKey, BLOCK_SIZE};
+use dir_cache::{DirCache, Listing};
+use path_ids::PathIds;
+
+const CACHE_CAPACITY: usize = 256 * 1024 * 1024;
+
 include!(concat!(env!("OUT_DIR"), "/_.rs"));
 use net_storage_response::Response;
 
@@ -53,45 +65,19 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
 
     let runtime = Runtime::new()?;
     runtime.block_on(async {
-        let (tx, mut rx) = mpsc::channel::<ConversionRequest>(16);
-        tokio::spawn(async move {
-            let mut ids = HashMap::new();
-            let mut paths = vec![];
-            while let Some(request) = rx.recv().await {
-                match request {
-                    ConversionRequest::PathToId {
-                        path,
-                        tx,
-                    } => {
-                        let id = match ids.entry(path.clone()) {
-                            Entry::Occupied(occupied) => *occupied.get(),
-                            Entry::Vacant(vacant) => {
-                                let id = paths.len();
-                                paths.push(path);
-                                *vacant.insert(id)
-                            }
-                        };
-                        let _ = tx.send(id as u32);
-                    }
-                    ConversionRequest::IdToPath {
-                        id,
-                        tx,
-                    } => {
-                        let path = paths.get(id as usize).map(|path| path.clone());
-                        let _ = tx.send(path);
-                    }
-                }
-            }
-        });
-
+        let ids = Arc::new(PathIds::new());
+        let dir_cache = Arc::new(DirCache::new());
+        let cache = Arc::new(BlockCache::new(CACHE_CAPACITY));
         let listener = TcpListener::bind("0.0.0.0:21329").await?;
         loop {
             if let Ok((stream, _)) = listener.accept().await {
                 let server_keypair = server_keypair.clone();
-                let tx = tx.clone();
+                let ids = ids.clone();
+                let dir_cache = dir_cache.clone();
                 let root = root.clone();
+                let cache = cache.clone();
                 tokio::spawn(async move {
-                    let _ = handle(stream, server_keypair, tx, root).await;
+                    let _ = handle(stream, server_keypair, ids, dir_cache, root, cache).await;
                 });
             }
         }
@@ -101,20 +87,83 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
 async fn handle(
     stream: TcpStream,
     server_keypair: kx::KeyPair,
-    tx: mpsc::Sender<ConversionRequest>,
+    ids: Arc<PathIds>,
+    dir_cache: Arc<DirCache>,
     root: PathBuf,
+    cache: Arc<BlockCache>,
 ) -> Result<(), Box<dyn std::error::Error>> {
-    let stream = Stream::new(stream, server_keypair, tx, root).await?;
-    stream.handle().await
+    let addr = stream.peer_addr()?;
+    let metrics = Arc::new(Metrics::default());
+    let stream =
+        Stream::new(stream, server_keypair, ids, dir_cache, root, cache.clone(), metrics.clone())
+            .await?;
+    let result = stream.handle().await;
+    println!(
+        "{}: {} requests, {} reads ({} bytes), {} block hits, {} block misses, {} bytes cached",
+        addr,
+        metrics.requests.load(Ordering::Relaxed),
+        metrics.reads.load(Ordering::Relaxed),
+        metrics.read_bytes.load(Ordering::Relaxed),
+        metrics.block_hits.load(Ordering::Relaxed),
+        metrics.block_misses.load(Ordering::Relaxed),
+        cache.size(),
+    );
+    result
+}
+
+#[derive(Default)]
+struct Metrics {
+    requests: AtomicU64,
+    reads: AtomicU64,
+    read_bytes: AtomicU64,
+    block_hits: AtomicU64,
+    block_misses: AtomicU64,
+}
+
+/// Clients which send request ids can have requests and responses in flight at the same time, so
+/// once their first request is sent the messages of each direction are numbered separately: the
+/// requests from 0 and the responses from 1. Older clients wait for each response, and number all
+/// messages in a single sequence.
+#[derive(Default)]
+struct MessageIds {
+    separate: AtomicBool,
+    read_count: AtomicU64,
+    write_count: AtomicU64,
+}
+
+impl MessageIds {
+    fn next_read(&self) -> u64 {
+        let read_count = self.read_count.fetch_add(1, Ordering::SeqCst);
+        if self.separate.load(Ordering::SeqCst) {
+            read_count
+        } else {
+            read_count + self.write_count.load(Ordering::SeqCst)
+        }
+    }
+
+    fn next_write(&self) -> u64 {
+        let write_count = self.write_count.fetch_add(1, Ordering::SeqCst);
+        if self.separate.load(Ordering::SeqCst) {
+            write_count + 1
+        } else {
+            write_count + self.read_count.load(Ordering::SeqCst)
+        }
+    }
 }
 
 struct Stream {
-    stream: TcpStream,
-    message_id: u64,
+    stream: OwnedReadHalf,
+    message_ids: Arc<MessageIds>,
     context: secretbox::Context,
-    tx_key: secretbox::Key,
     rx_key: secretbox::Key,
-    tx: mpsc::Sender<ConversionRequest>,
+    // Responses are sent by a separate task, so that reads can complete out of order. Each reply
+    // is written contiguously: a response followed by its data chunks, if any.
+    writer: mpsc::Sender<Reply>,
+    request_id: Option<u32>,
+    cache: Arc<BlockCache>,
+    metrics: Arc<Metrics>,
+    ids: Arc<PathIds>,
+    dir_cache: Arc<DirCache>,
     root: PathBuf,
     files: [Option<File>; 32],
     dirs: [Option<Dir>; 32],
@@ -124,8 +173,11 @@ impl Stream {
     async fn new(
         mut stream: TcpStream,
         server_keypair: kx::KeyPair,
-        tx: mpsc::Sender<ConversionRequest>,
+        ids: Arc<PathIds>,
+        dir_cache: Arc<DirCache>,
         root: PathBuf,
+        cache: Arc<BlockCache>,
+        metrics: Arc<Metrics>,
     ) -> Result<Stream, Box<dyn std::error::Error>> {
         stream.set_nodelay(true)?;
 
@@ -138,13 +190,26 @@ impl Stream {
         let tx_key: Zeroizing<[u8; 32]> = Zeroizing::new(keypair.tx.clone().into());
         let tx_key = (*tx_key).into();
 
+        let (stream, write_stream) = stream.into_split();
+        let message_ids = Arc::new(MessageIds::default());
+        let (writer, rx) = mpsc::channel(32);
+        let writer_message_ids = message_ids.clone();
+        tokio::spawn(async move {
+            let context = (*b"storage ").into();
+            let _ = write_responses(write_stream, context, tx_key, writer_message_ids, rx).await;
+        });
+
         Ok(Stream {
             stream,
-            message_id: 0,
+            message_ids,
             context: (*b"storage ").into(),
             rx_key,
-            tx_key,
-            tx,
+            writer,
+            request_id: None,
+            cache,
+            metrics,
+            ids,
+            dir_cache,
             root,
             files: Default::default(),
             dirs: Default::default(),
@@ -154,11 +219,13 @@ impl Stream {
     async fn handle(mut self) -> Result<(), Box<dyn std::error::Error>> {
         use net_storage_request::Request::*;
 
+        let mut request: NetStorageRequest = self.read_message().await?;
+        self.message_ids.separate.store(request.id.is_some(), Ordering::SeqCst);
         loop {
-            let request: NetStorageRequest = self.read_message().await?;
-            let request = request.request.ok_or(anyhow!("Failed to get request type!"))?;
-            match request {
-                FastOpen(fast_open) => match self.id_to_path(fast_open.id).await {
+            self.request_id = request.id;
+            self.metrics.requests.fetch_add(1, Ordering::Relaxed);
+            match request.request.ok_or(anyhow!("Failed to get request type!"))? {
+                FastOpen(fast_open) => match self.ids.id_to_path(fast_open.id) {
                     Some(path) => self.open_file(path, "r").await?,
                     None => self.error().await?,
                 },
@@ -176,7 +243,7 @@ impl Stream {
                 Close(close) => self.close_file(close.handle).await?,
                 Read(read) => self.read_file(read.handle, read.size, read.offset).await?,
                 Write(write) => self.write_file(write.handle, write.size, write.offset).await?,
-                FastOpenDir(fast_open_dir) => match self.id_to_path(fast_open_dir.id).await {
+                FastOpenDir(fast_open_dir) => match self.ids.id_to_path(fast_open_dir.id) {
                     Some(path) => self.open_dir(path).await?,
                     None => self.error().await?,
                 },
@@ -199,6 +266,7 @@ impl Stream {
                 },
                 StartBenchmark(_) => self.start_benchmark().await?,
             }
+            request = self.read_message().await?;
         }
     }
 
@@ -218,22 +286,26 @@ impl Stream {
             Ok(file) => file,
             Err(_) => return self.error().await,
         };
-        let size = match file.metadata().await {
-            Ok(metadata) => metadata.len(),
+        let (size, modified) = match file.metadata().await {
+            Ok(metadata) => (metadata.len(), metadata.modified().ok()),
             Err(_) => return self.error().await,
         };
+        let key = FileKey {
+            path: path.clone(),
+            size,
+            modified,
+        };
         let _ = self.files[handle].insert(File {
-            file,
+            file: Arc::new(file.into_std().await),
             path: Some(path),
+            key: Some(Arc::new(key)),
         });
         let handle = handle as u32;
-        let response = NetStorageResponse {
-            response: Some(Response::Open(net_storage_response::Open {
-                handle,
-                size,
-            })),
-        };
-        self.write_message(response).await
+        self.respond(Response::Open(net_storage_response::Open {
+            handle,
+            size,
+        }))
+        .await
     }
 
     async fn close_file(&mut self, handle: u32) -> Result<(), Box<dyn std::error::Error>> {
@@ -253,21 +325,38 @@ impl Stream {
         size: u32,
         offset: u64,
     ) -> Result<(), Box<dyn std::error::Error>> {
-        let file = match self.file_mut(handle) {
-            Some(file) => file,
+        let (file, key) = match self.file(handle) {
+            Some(file) => (file.file.clone(), file.key.clone()),
             None => return self.error().await,
         };
-        if file.file.seek(SeekFrom::Start(offset)).await.is_err() {
-            return self.error().await;
-        }
-        let mut data = vec![0u8; size as usize];
-        match file.file.read_exact(&mut data).await {
-            Ok(_) => self.ok().await?,
-            Err(_) => return self.error().await,
-        }
-        for chunk in data.chunks(0x1000) {
-            self.write(chunk).await?;
-        }
+        let id = self.request_id;
+        let writer = self.writer.clone();
+        let cache = self.cache.clone();
+        let metrics = self.metrics.clone();
+        metrics.reads.fetch_add(1, Ordering::Relaxed);
+        metrics.read_bytes.fetch_add(size as u64, Ordering::Relaxed);
+        tokio::spawn(async move {
+            let data = tokio::task::spawn_blocking(move || match key {
+                Some(key) => read_blocks(&cache, &metrics, &file, key, size, offset),
+                None => {
+                    let mut data = vec![0u8; size as usize];
+                    read_exact_at(&file, &mut data, offset)?;
+                    Ok(vec![(Arc::new(data), 0..size as usize)])
+                }
+            })
+            .await;
+            let reply = match data {
+                Ok(Ok(data)) => Reply {
+                    response: encode_response(id, Response::Ok(net_storage_response::Ok {})),
+                    data,
+                },
+                _ => Reply {
+                    response: encode_response(id, Response::Error(net_storage_response::Error {})),
+                    data: vec![],
+                },
+            };
+            let _ = writer.send(reply).await;
+        });
         Ok(())
     }
 
@@ -286,16 +375,14 @@ impl Stream {
             size -= chunk.len() as u32;
             data.extend(chunk);
         }
-        let file = match self.file_mut(handle) {
-            Some(file) => file,
+        let file = match self.file(handle) {
+            Some(file) => file.file.clone(),
             None => return self.error().await,
         };
-        if file.file.seek(SeekFrom::Start(offset)).await.is_err() {
-            return self.error().await;
+        match tokio::task::spawn_blocking(move || write_all_at(&file, &data, offset)).await {
+            Ok(Ok(())) => self.ok().await,
+            _ => self.error().await,
         }
-        file.file.write_all(&data).await?;
-        self.ok().await?;
-        Ok(())
     }
 
     async fn open_dir(&mut self, path: PathBuf) -> Result<(), Box<dyn std::error::Error>> {
@@ -303,21 +390,24 @@ impl Stream {
             Some(handle) => handle,
             None => return self.error().await,
         };
-        let dir = match tokio::fs::read_dir(&path).await {
-            Ok(dir) => dir,
-            Err(_) => return self.error().await,
-        };
+        let ids = self.ids.clone();
+        let dir_cache = self.dir_cache.clone();
+        let listing_path = path.clone();
+        let listing =
+            match tokio::task::spawn_blocking(move || dir_cache.get(&listing_path, &ids)).await {
+                Ok(Ok(listing)) => listing,
+                _ => return self.error().await,
+            };
         let _ = self.dirs[handle].insert(Dir {
-            dir,
+            listing,
+            position: 0,
             path,
         });
         let handle = handle as u32;
-        let response = NetStorageResponse {
-            response: Some(Response::OpenDir(net_storage_response::OpenDir {
-                handle,
-            })),
-        };
-        self.write_message(response).await
+        self.respond(Response::OpenDir(net_storage_response::OpenDir {
+            handle,
+        }))
+        .await
     }
 
     async fn close_dir(&mut self, handle: u32) -> Result<(), Box<dyn std::error::Error>> {
@@ -336,43 +426,21 @@ impl Stream {
             Some(dir) => dir,
             None => return self.error().await,
         };
-        let entry = match dir.dir.next_entry().await {
-            Ok(Some(entry)) => entry,
-            _ => return self.error().await,
-        };
-        let id = self.path_to_id(entry.path()).await;
-        let metadata = entry.metadata().await;
-        let name = entry.file_name().into_string();
-        let (id, metadata, name) = match (id, metadata, name) {
-            (Some(id), Ok(metadata), Ok(name)) => (id, metadata, name),
+        let node_info = match dir.listing.get(dir.position) {
+            Some(Some(node_info)) => node_info.clone(),
             _ => return self.error().await,
         };
-        let r#type = if metadata.file_type().is_file() {
-            net_storage_response::node_info::Type::File
-        } else if metadata.file_type().is_dir() {
-            net_storage_response::node_info::Type::Dir
-        } else {
-            return self.error().await;
-        } as i32;
-        let node_info = net_storage_response::NodeInfo {
-            id,
-            r#type,
-            size: metadata.len(),
-            name: name,
-        };
-        let response = NetStorageResponse {
-            response: Some(Response::NodeInfo(node_info)),
-        };
-        self.write_message(response).await
+        dir.position += 1;
+        self.respond(Response::NodeInfo(node_info)).await
     }
 
     async fn stat(&mut self, path: PathBuf) -> Result<(), Box<dyn std::error::Error>> {
-        let id = self.path_to_id(path.clone()).await;
+        let id = self.ids.path_to_id(&path);
         let path = Path::new(&path);
         let metadata = tokio::fs::metadata(path).await;
         let name = path.file_name().and_then(|name| name.to_os_string().into_string().ok());
-        let (id, metadata, name) = match (id, metadata, name) {
-            (Some(id), Ok(metadata), Some(name)) => (id, metadata, name),
+        let (metadata, name) = match (metadata, name) {
+            (Ok(metadata), Some(name)) => (metadata, name),
             _ => return self.error().await,
         };
         let r#type = if metadata.file_type().is_file() {
@@ -388,10 +456,7 @@ impl Stream {
             size: metadata.len(),
             name: name,
         };
-        let response = NetStorageResponse {
-            response: Some(Response::NodeInfo(node_info)),
-        };
-        self.write_message(response).await
+        self.respond(Response::NodeInfo(node_info)).await
     }
 
     async fn start_benchmark(&mut self) -> Result<(), Box<dyn std::error::Error>> {
@@ -403,37 +468,38 @@ impl Stream {
             Ok(file) => file,
             Err(_) => return self.error().await,
         };
-        let file = tokio::fs::File::from_std(file);
-        let size = match file.metadata().await {
+        let size = match file.metadata() {
             Ok(metadata) => metadata.len(),
             Err(_) => return self.error().await,
         };
         let _ = self.files[handle].insert(File {
-            file,
+            file: Arc::new(file),
             path: None,
+            key: None,
         });
         let handle = handle as u32;
-        let response = NetStorageResponse {
-            response: Some(Response::Open(net_storage_response::Open {
-                handle,
-                size,
-            })),
-        };
-        self.write_message(response).await
+        self.respond(Response::Open(net_storage_response::Open {
+            handle,
+            size,
+        }))
+        .await
     }
 
     async fn ok(&mut self) -> Result<(), Box<dyn std::error::Error>> {
-        let response = NetStorageResponse {
-            response: Some(Response::Ok(net_storage_response::Ok {})),
-        };
-        self.write_message(response).await
+        self.respond(Response::Ok(net_storage_response::Ok {})).await
     }
 
     async fn error(&mut self) -> Result<(), Box<dyn std::error::Error>> {
-        let response = NetStorageResponse {
-            response: Some(Response::Error(net_storage_response::Error {})),
+        self.respond(Response::Error(net_storage_response::Error {})).await
+    }
+
+    async fn respond(&mut self, response: Response) -> Result<(), Box<dyn std::error::Error>> {
+        let reply = Reply {
+            response: encode_response(self.request_id, response),
+            data: vec![],
         };
-        self.write_message(response).await
+        self.writer.send(reply).await?;
+        Ok(())
     }
 
     async fn read(&mut self) -> Result<Vec<u8>, Box<dyn std::error::Error>> {
@@ -442,8 +508,8 @@ impl Stream {
         let size = u16::from_be_bytes(size);
         let mut tmp = vec![0; size as usize];
         self.stream.read_exact(&mut tmp).await?;
-        let tmp = secretbox::decrypt(&tmp, self.message_id, &self.context, &self.rx_key)?;
-        self.message_id += 1;
+        let message_id = self.message_ids.next_read();
+        let tmp = secretbox::decrypt(&tmp, message_id, &self.context, &self.rx_key)?;
         Ok(tmp)
     }
 
@@ -454,59 +520,6 @@ impl Stream {
         self.read().await.and_then(|tmp| Ok(M::decode(&*tmp)?))
     }
 
-    async fn write(&mut self, tmp: &[u8]) -> Result<(), Box<dyn std::error::Error>> {
-        let tmp = secretbox::encrypt(&tmp, self.message_id, &self.context, &self.tx_key);
-        self.message_id += 1;
-        let size = tmp.len();
-        assert!(size <= u16::MAX as usize);
-        let size = (size as u16).to_be_bytes();
-        self.stream.write_all(&size).await?;
-        self.stream.write_all(&tmp).await?;
-        Ok(())
-    }
-
-    async fn write_message<M: Message>(
-        &mut self,
-        message: M,
-    ) -> Result<(), Box<dyn std::error::Error>>
-    where
-        M: Message,
-    {
-        self.write(&message.encode_to_vec()).await
-    }
-
-    async fn path_to_id(&self, path: PathBuf) -> Option<u32> {
-        let (tx, rx) = oneshot::channel();
-        if self
-            .tx
-            .send(ConversionRequest::PathToId {
-                path,
-                tx,
-            })
-            .await
-            .is_err()
-        {
-            return None;
-        }
-        rx.await.ok()
-    }
-
-    async fn id_to_path(&self, id: u32) -> Option<PathBuf> {
-        let (tx, rx) = oneshot::channel();
-        if self
-            .tx
-            .send(ConversionRequest::IdToPath {
-                id,
-                tx,
-            })
-            .await
-            .is_err()
-        {
-            return None;
-        }
-        rx.await.ok().flatten()
-    }
-
     fn convert_path(&self, path: &str) -> Option<PathBuf> {
         let path = path.strip_prefix("ro:/")?;
         let path = Path::new(&self.root).join(path).canonicalize().ok()?;
@@ -521,10 +534,6 @@ impl Stream {
         self.files.get(handle as usize).map(|file| file.as_ref()).flatten()
     }
 
-    fn file_mut(&mut self, handle: u32) -> Option<&mut File> {
-        self.files.get_mut(handle as usize).map(|file| file.as_mut()).flatten()
-    }
-
     fn dir(&self, handle: u32) -> Option<&Dir> {
         self.dirs.get(handle as usize).map(|dir| dir.as_ref()).flatten()
     }
@@ -534,23 +543,280 @@ impl Stream {
     }
 }
 
-enum ConversionRequest {
-    PathToId {
-        path: PathBuf,
-        tx: oneshot::Sender<u32>,
-    },
-    IdToPath {
-        id: u32,
-        tx: oneshot::Sender<Option<PathBuf>>,
-    },
+/// The data of a read, as ranges of blocks that may be shared with the cache.
+type Segments = Vec<(Arc<Vec<u8>>, Range<usize>)>;
+
+struct Reply {
+    response: Vec<u8>,
+    data: Segments,
+}
+
+async fn write_responses(
+    mut stream: OwnedWriteHalf,
+    context: secretbox::Context,
+    key: secretbox::Key,
+    message_ids: Arc<MessageIds>,
+    mut rx: mpsc::Receiver<Reply>,
+) -> std::io::Result<()> {
+    // Both buffers are reused across replies. Replies that are already queued are coalesced into
+    // a single write.
+    let mut buffer = vec![];
+    let mut chunk = Vec::with_capacity(0x1000);
+    while let Some(mut reply) = rx.recv().await {
+        loop {
+            push_frame(&mut buffer, &reply.response, &message_ids, &context, &key);
+            let mut segments = reply.data.iter().map(|(data, range)| &data[range.clone()]);
+            let mut segment: &[u8] = &[];
+            loop {
+                if segment.is_empty() {
+                    segment = match segments.next() {
+                        Some(segment) => segment,
+                        None => break,
+                    };
+                    continue;
+                }
+                if chunk.is_empty() && segment.len() >= 0x1000 {
+                    // Fast path: the chunk lies within a single block
+                    push_frame(&mut buffer, &segment[..0x1000], &message_ids, &context, &key);
+                    segment = &segment[0x1000..];
+                    continue;
+                }
+                let size = segment.len().min(0x1000 - chunk.len());
+                chunk.extend_from_slice(&segment[..size]);
+                segment = &segment[size..];
+                if chunk.len() == 0x1000 {
+                    push_frame(&mut buffer, &chunk, &message_ids, &context, &key);
+                    chunk.clear();
+                }
+            }
+            if !chunk.is_empty() {
+                push_frame(&mut buffer, &chunk, &message_ids, &context, &key);
+                chunk.clear();
+            }
+            if buffer.len() >= 0x40000 {
+                break;
+            }
+            reply = match rx.try_recv() {
+                Ok(reply) => reply,
+                Err(_) => break,
+            };
+        }
+        stream.write_all(&buffer).await?;
+        buffer.clear();
+    }
+    Ok(())
+}
+
+fn push_frame(
+    buffer: &mut Vec<u8>,
+    message: &[u8],
+    message_ids: &MessageIds,
+    context: &secretbox::Context,
+    key: &secretbox::Key,
+) {
+    let message = secretbox::encrypt(message, message_ids.next_write(), context, key);
+    let size = message.len();
+    assert!(size <= u16::MAX as usize);
+    buffer.extend_from_slice(&(size as u16).to_be_bytes());
+    buffer.extend_from_slice(&message);
+}
+
+fn read_blocks(
+    cache: &BlockCache,
+    metrics: &Metrics,
+    file: &std::fs::File,
+    key: Arc<FileKey>,
+    size: u32,
+    offset: u64,
+) -> std::io::Result<Segments> {
+    let end = offset + size as u64;
+    if end > key.size {
+        return Err(ErrorKind::UnexpectedEof.into());
+    }
+    let mut segments = vec![];
+    let mut position = offset;
+    while position < end {
+        let index = position / BLOCK_SIZE;
+        let block = match cache.get(&key, index) {
+            Some(block) => {
+                metrics.block_hits.fetch_add(1, Ordering::Relaxed);
+                block
+            }
+            None => {
+                metrics.block_misses.fetch_add(1, Ordering::Relaxed);
+                let block_offset = index * BLOCK_SIZE;
+                let mut block = vec![0u8; (key.size - block_offset).min(BLOCK_SIZE) as usize];
+                read_exact_at(file, &mut block, block_offset)?;
+                let block = Arc::new(block);
+                cache.insert(key.clone(), index, block.clone());
+                block
+            }
+        };
+        let start = (position - index * BLOCK_SIZE) as usize;
+        let block_end = ((end - index * BLOCK_SIZE) as usize).min(block.len());
+        position += (block_end - start) as u64;
+        segments.push((block, start..block_end));
+    }
+    Ok(segments)
+}
+
+fn encode_response(id: Option<u32>, response: Response) -> Vec<u8> {
+    NetStorageResponse {
+        id,
+        response: Some(response),
+    }
+    .encode_to_vec()
+}
+
+#[cfg(unix)]
+fn read_exact_at(file: &std::fs::File, buf: &mut [u8], offset: u64) -> std::io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.read_exact_at(buf, offset)
+}
+
+#[cfg(windows)]
+fn read_exact_at(file: &std::fs::File, mut buf: &mut [u8], mut offset: u64) -> std::io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    while !buf.is_empty() {
+        match file.seek_read(buf, offset)? {
+            0 => return Err(ErrorKind::UnexpectedEof.into()),
+            size => {
+                buf = &mut buf[size..];
+                offset += size as u64;
+            }
+        }
+    }
+    Ok(())
+}
+
+#[cfg(unix)]
+fn write_all_at(file: &std::fs::File, buf: &[u8], offset: u64) -> std::io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.write_all_at(buf, offset)
+}
+
+#[cfg(windows)]
+fn write_all_at(file: &std::fs::File, mut buf: &[u8], mut offset: u64) -> std::io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    while !buf.is_empty() {
+        let size = file.seek_write(buf, offset)?;
+        buf = &buf[size..];
+        offset += size as u64;
+    }
+    Ok(())
 }
 
 struct File {
-    file: tokio::fs::File,
+    file: Arc<std::fs::File>,
     path: Option<PathBuf>,
+    key: Option<Arc<FileKey>>,
 }
 
 struct Dir {
-    dir: tokio::fs::ReadDir,
+    listing: Listing,
+    position: usize,
     path: PathBuf,
 }
+
+#[cfg(test)]
+mod tests {
+    use std::time::Instant;
+
+    use super::*;
+
+    const FILE_COUNT: u64 = 32;
+    const FILE_SIZE: u64 = 4 * 1024 * 1024;
+    const READ_SIZE: u32 = 0x4000;
+    const READS_PER_CLIENT: u64 = 4096;
+
+    fn byte(file_index: u64, offset: u64) -> u8 {
+        (file_index * 31 + offset / 0x100) as u8
+    }
+
+    /// A xorshift generator, so that each client picks its own sequence of files.
+    struct Random(u64);
+
+    impl Random {
+        fn next(&mut self) -> u64 {
+            self.0 ^= self.0 << 13;
+            self.0 ^= self.0 >> 7;
+            self.0 ^= self.0 << 17;
+            self.0
+        }
+    }
+
+    /// Loads whole files the way the payload loads courses, the first files more often than the
+    /// last ones, and checks that each read returns the data of its own file and offset.
+    fn run_client(
+        seed: u64,
+        cache: &BlockCache,
+        metrics: &Metrics,
+        files: &[(std::fs::File, Arc<FileKey>)],
+    ) {
+        let mut random = Random(seed);
+        let mut read_count = 0;
+        while read_count < READS_PER_CLIENT {
+            let file_index = random.next() % (1 + random.next() % FILE_COUNT);
+            let (file, key) = &files[file_index as usize];
+            for offset in (0..FILE_SIZE).step_by(READ_SIZE as usize) {
+                let segments = read_blocks(cache, metrics, file, key.clone(), READ_SIZE, offset);
+                let segments = segments.unwrap();
+                let (block, range) = &segments[0];
+                assert_eq!(block[range.start], byte(file_index, offset));
+                let size: usize = segments.iter().map(|(_, range)| range.len()).sum();
+                assert_eq!(size, READ_SIZE as usize);
+                read_count += 1;
+            }
+        }
+    }
+
+    /// Runs clients in parallel against a shared block cache, with a capacity above and below the
+    /// size of the files they read, and prints the throughput and the hit rate. Run it with
+    /// `cargo test --release block_cache_load -- --ignored --nocapture`.
+    #[test]
+    #[ignore]
+    fn block_cache_load() {
+        let dir = tempfile::tempdir().unwrap();
+        let files: Vec<_> = (0..FILE_COUNT)
+            .map(|file_index| {
+                let path = dir.path().join(format!("{file_index}.szs"));
+                let data: Vec<_> = (0..FILE_SIZE).map(|offset| byte(file_index, offset)).collect();
+                std::fs::write(&path, data).unwrap();
+                let file = std::fs::File::open(&path).unwrap();
+                let metadata = file.metadata().unwrap();
+                let key = FileKey {
+                    path,
+                    size: metadata.len(),
+                    modified: metadata.modified().ok(),
+                };
+                (file, Arc::new(key))
+            })
+            .collect();
+
+        for capacity in [CACHE_CAPACITY, (FILE_COUNT * FILE_SIZE / 4) as usize] {
+            for client_count in [1, 4, 12, 32] {
+                let cache = BlockCache::new(capacity);
+                let metrics = Metrics::default();
+                let start = Instant::now();
+                std::thread::scope(|scope| {
+                    for seed in 1..=client_count {
+                        let (cache, metrics, files) = (&cache, &metrics, &files);
+                        scope.spawn(move || run_client(seed, cache, metrics, files));
+                    }
+                });
+                let duration = start.elapsed().as_secs_f64();
+                let read_count = READS_PER_CLIENT * client_count;
+                let hits = metrics.block_hits.load(Ordering::Relaxed);
+                let misses = metrics.block_misses.load(Ordering::Relaxed);
+                println!(
+                    "{} MiB cache, {client_count:2} clients: {:8.0} reads/s, {:6.0} MiB/s, \
+                     {:5.1}% block hits",
+                    capacity / (1024 * 1024),
+                    read_count as f64 / duration,
+                    (read_count * READ_SIZE as u64) as f64 / duration / (1024.0 * 1024.0),
+                    hits as f64 * 100.0 / (hits + misses) as f64,
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+use std::collections::hash_map::{DefaultHasher, Entry};
+use std::collections::HashMap;
+use std::hash::{Hash, Hasher};
+use std::path::{Path, PathBuf};
+use std::sync::RwLock;
+
+const SHARD_COUNT: usize = 16;
+
+/// Stable ids for the paths handed out to clients, shared by all connections. Paths are spread
+/// over shards by hash and the shard is encoded in the low bits of the id, so that conversions in
+/// either direction only ever lock one shard.
+pub struct PathIds {
+    shards: [RwLock<Shard>; SHARD_COUNT],
+}
+
+#[derive(Default)]
+struct Shard {
+    ids: HashMap<PathBuf, u32>,
+    paths: Vec<PathBuf>,
+}
+
+impl PathIds {
+    pub fn new() -> PathIds {
+        PathIds {
+            shards: Default::default(),
+        }
+    }
+
+    pub fn path_to_id(&self, path: &Path) -> u32 {
+        let mut hasher = DefaultHasher::new();
+        path.hash(&mut hasher);
+        let shard_index = hasher.finish() as usize % SHARD_COUNT;
+        let shard = &self.shards[shard_index];
+        if let Some(id) = shard.read().unwrap().ids.get(path) {
+            return *id;
+        }
+
+        let mut shard = shard.write().unwrap();
+        let shard = &mut *shard;
+        match shard.ids.entry(path.to_path_buf()) {
+            Entry::Occupied(occupied) => *occupied.get(),
+            Entry::Vacant(vacant) => {
+                let id = (shard.paths.len() * SHARD_COUNT + shard_index) as u32;
+                shard.paths.push(path.to_path_buf());
+                *vacant.insert(id)
+            }
+        }
+    }
+
+    pub fn id_to_path(&self, id: u32) -> Option<PathBuf> {
+        let shard = &self.shards[id as usize % SHARD_COUNT];
+        shard.read().unwrap().paths.get(id as usize / SHARD_COUNT).cloned()
+    }
+}
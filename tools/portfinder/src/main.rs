@@ -1,9 +1,12 @@
+use std::collections::{BTreeMap, HashMap};
 use std::env;
+use std::fmt::Write;
 use std::fs;
 use std::io;
 use std::mem;
 use std::num::ParseIntError;
 use std::path::Path;
+use std::thread;
 
 fn main() -> Result<(), Error> {
     let args: Vec<String> = env::args().collect();
@@ -47,12 +50,26 @@ fn main() -> Result<(), Error> {
         }
     }
 
-    for (source_section, target_section) in source_sections.iter().zip(target_sections.iter()) {
-        if source_section.kind != SectionKind::Text {
-            continue;
-        }
+    // Sections are independent, so they are matched in parallel and printed in order.
+    let text_sections: Vec<_> = source_sections
+        .iter()
+        .zip(target_sections.iter())
+        .filter(|(source_section, _)| source_section.kind == SectionKind::Text)
+        .collect();
+    let results: Vec<_> = thread::scope(|scope| {
+        let handles: Vec<_> = text_sections
+            .iter()
+            .map(|(source_section, target_section)| {
+                scope.spawn(|| process(source_section, target_section))
+            })
+            .collect();
+        handles.into_iter().map(|handle| handle.join().unwrap()).collect()
+    });
 
-        let mut matches = process(source_section, target_section);
+    for ((source_section, target_section), (mut matches, log)) in
+        text_sections.into_iter().zip(results)
+    {
+        eprint!("{}", log);
         postprocess(source_section, &mut matches);
         matches.iter_mut().for_each(|m| mem::swap(&mut m.source_start, &mut m.target_start));
         postprocess(target_section, &mut matches);
@@ -200,11 +217,17 @@ fn parse_rel(rel: Vec<u8>, base: usize) -> Result<Vec<Section>, Error> {
     return Ok(sections);
 }
 
-fn process(source: &Section, target: &Section) -> Vec<Match> {
+/// Returns the matches and the coverage log, which is printed once the section is done.
+fn process(source: &Section, target: &Section) -> (Vec<Match>, String) {
     let mut min_size = 0x10000.min(source.vals.len()).min(target.vals.len());
     let mut matches = vec![];
+    let mut coverage = Coverage::new(source.vals.len(), target.vals.len());
+    let mut log = String::new();
     while min_size >= 0x100.min(source.vals.len()).min(target.vals.len()) {
-        while let Some(best_match) = find_best_match(min_size, &source, &target, &matches) {
+        let anchors = Anchors::new(source, target, (min_size / 2).max(1));
+        while let Some(best_match) = find_best_match(min_size, source, target, &anchors, &coverage)
+        {
+            coverage.insert(&best_match);
             matches.push(best_match);
 
             let sum: usize = matches.iter().map(|m| m.size).sum();
@@ -212,12 +235,12 @@ fn process(source: &Section, target: &Section) -> Vec<Match> {
             let target_coverage = sum as f32 / target.vals.len() as f32;
             let coverage = source_coverage.max(target_coverage);
 
-            eprintln!("{:?}", coverage);
+            writeln!(log, "{:?}", coverage).unwrap();
         }
         min_size /= 2;
     }
-    eprintln!();
-    return matches;
+    writeln!(log).unwrap();
+    return (matches, log);
 }
 
 fn postprocess(source: &Section, matches: &mut Vec<Match>) {
@@ -265,52 +288,179 @@ impl Match {
     fn source_end(&self) -> usize {
         self.source_start + self.size
     }
+}
+
+/// The parts of the sections already covered by matches. As in the original linear scans, a
+/// target offset inside matches is skipped by the size of the first of them, which is recorded
+/// when the offset gets covered.
+struct Coverage {
+    source: Vec<bool>,
+    target_skips: Vec<usize>,
+    /// Disjoint covered runs of the target, by start
+    target_runs: BTreeMap<usize, usize>,
+}
+
+impl Coverage {
+    fn new(source_len: usize, target_len: usize) -> Coverage {
+        Coverage {
+            source: vec![false; source_len],
+            target_skips: vec![0; target_len],
+            target_runs: BTreeMap::new(),
+        }
+    }
 
-    fn contains_source(&self, source_offset: usize) -> bool {
-        self.source_start <= source_offset && self.source_start + self.size > source_offset
+    fn insert(&mut self, m: &Match) {
+        self.source[m.source_start..m.source_end()].fill(true);
+        let target_end = m.target_start + m.size;
+        for skip in &mut self.target_skips[m.target_start..target_end] {
+            if *skip == 0 {
+                *skip = m.size;
+            }
+        }
+
+        let mut start = m.target_start;
+        let mut end = target_end;
+        let overlapping: Vec<_> = self
+            .target_runs
+            .range(..=end)
+            .rev()
+            .take_while(|(_, e)| **e >= start)
+            .map(|(s, e)| (*s, *e))
+            .collect();
+        for (run_start, run_end) in overlapping {
+            self.target_runs.remove(&run_start);
+            start = start.min(run_start);
+            end = end.max(run_end);
+        }
+        self.target_runs.insert(start, end);
     }
 
-    fn contains_target(&self, target_offset: usize) -> bool {
-        self.target_start <= target_offset && self.target_start + self.size > target_offset
+    /// Returns the target offsets skipped when scanning from the start, as sorted disjoint
+    /// ranges, and whether the scan lands on the end of the section after a skip.
+    fn target_gaps(&self) -> (Vec<(usize, usize)>, bool) {
+        let len = self.target_skips.len();
+        let mut gaps = vec![];
+        let mut offset = 0;
+        while offset < len {
+            let covered = match self.target_runs.range(..=offset).next_back() {
+                Some((_, end)) if *end > offset => Some(offset),
+                _ => self.target_runs.range(offset..).next().map(|(start, _)| *start),
+            };
+            let Some(covered) = covered else {
+                break;
+            };
+            let evaluated = covered + self.target_skips[covered];
+            gaps.push((covered, evaluated));
+            if evaluated == len {
+                return (gaps, true);
+            }
+            offset = evaluated + 1;
+        }
+        (gaps, false)
     }
 }
 
+/// Target offsets by the hash of the k values starting there, with k at most half the minimum
+/// match size. Any long enough match around a source offset then either starts with the k values
+/// at that offset or ends with the k values before it, so only those anchors need to be looked at.
+struct Anchors {
+    k: usize,
+    source_hashes: Vec<u64>,
+    target_offsets: HashMap<u64, Vec<usize>>,
+}
+
+impl Anchors {
+    fn new(source: &Section, target: &Section, k: usize) -> Anchors {
+        let source_hashes = Self::hashes(&source.vals, k);
+        let mut target_offsets: HashMap<u64, Vec<usize>> = HashMap::new();
+        for (offset, hash) in Self::hashes(&target.vals, k).into_iter().enumerate() {
+            target_offsets.entry(hash).or_default().push(offset);
+        }
+        Anchors {
+            k,
+            source_hashes,
+            target_offsets,
+        }
+    }
+
+    fn hashes(vals: &[u32], k: usize) -> Vec<u64> {
+        const BASE: u64 = 0x100000001b3;
+        if vals.len() < k {
+            return vec![];
+        }
+        let high_power = (1..k).fold(1u64, |power, _| power.wrapping_mul(BASE));
+        let mut hash = vals[..k]
+            .iter()
+            .fold(0u64, |hash, val| hash.wrapping_mul(BASE).wrapping_add(*val as u64));
+        let mut hashes = Vec::with_capacity(vals.len() - k + 1);
+        hashes.push(hash);
+        for i in k..vals.len() {
+            hash = hash.wrapping_sub((vals[i - k] as u64).wrapping_mul(high_power));
+            hash = hash.wrapping_mul(BASE).wrapping_add(vals[i] as u64);
+            hashes.push(hash);
+        }
+        hashes
+    }
+
+    /// Returns the sorted target offsets which may match around the source offset.
+    fn candidates(&self, source_offset: usize) -> Vec<usize> {
+        let mut candidates = vec![];
+        if let Some(hash) = self.source_hashes.get(source_offset) {
+            if let Some(offsets) = self.target_offsets.get(hash) {
+                candidates.extend_from_slice(offsets);
+            }
+        }
+        if source_offset >= self.k {
+            if let Some(offsets) =
+                self.target_offsets.get(&self.source_hashes[source_offset - self.k])
+            {
+                candidates.extend(offsets.iter().map(|offset| offset + self.k));
+            }
+        }
+        candidates.sort_unstable();
+        candidates.dedup();
+        candidates
+    }
+}
+
+/// Finds the longest match of at least min_size values through one of the sampled source
+/// offsets, the last one found winning ties, as if every target offset was scanned.
 fn find_best_match(
     min_size: usize,
     source: &Section,
     target: &Section,
-    matches: &[Match],
+    anchors: &Anchors,
+    coverage: &Coverage,
 ) -> Option<Match> {
+    let (gaps, lands_on_end) = coverage.target_gaps();
+    let is_scanned = |target_offset: usize| {
+        if target_offset == target.vals.len() {
+            return lands_on_end;
+        }
+        let gap = gaps.partition_point(|(start, _)| *start <= target_offset);
+        gap == 0 || gaps[gap - 1].1 <= target_offset
+    };
+
     let mut best_match = None;
     for source_offset in (min_size / 2..source.vals.len()).step_by(min_size) {
-        if matches.iter().any(|m| m.contains_source(source_offset)) {
+        if coverage.source[source_offset] {
             continue;
         }
-        let mut target_offset = 0x0;
-        while target_offset < target.vals.len() {
-            if let Some(m) = matches.iter().find(|m| m.contains_target(target_offset)) {
-                target_offset += m.size;
-            }
-            let mut left_size = 0x0;
-            loop {
-                let source_val = source.vals.get(source_offset - 0x1 - left_size);
-                let target_val = target.vals.get(target_offset - 0x1 - left_size);
-                match (source_val, target_val) {
-                    (Some(source_val), Some(target_val)) if source_val == target_val => (),
-                    _ => break,
-                }
-                left_size += 0x1;
-            }
-            let mut right_size = 0x0;
-            loop {
-                let source_val = source.vals.get(source_offset + right_size);
-                let target_val = target.vals.get(target_offset + right_size);
-                match (source_val, target_val) {
-                    (Some(source_val), Some(target_val)) if source_val == target_val => (),
-                    _ => break,
-                }
-                right_size += 0x1;
+        for target_offset in anchors.candidates(source_offset) {
+            if !is_scanned(target_offset) {
+                continue;
             }
+            let left_size = source.vals[..source_offset]
+                .iter()
+                .rev()
+                .zip(target.vals[..target_offset].iter().rev())
+                .take_while(|(source_val, target_val)| source_val == target_val)
+                .count();
+            let right_size = source.vals[source_offset..]
+                .iter()
+                .zip(target.vals[target_offset..].iter())
+                .take_while(|(source_val, target_val)| source_val == target_val)
+                .count();
             let size = left_size + right_size;
             if size >= min_size {
                 match best_match {
@@ -329,7 +479,6 @@ fn find_best_match(
                     }
                 }
             }
-            target_offset += 0x1;
         }
     }
     return best_match;
@@ -0,0 +1,82 @@
+//! Binary deltas between two versions of contents.arc, applied by SP::Update while downloading.
+//!
+//! A delta is a sequence of operations, each starting with a 9-byte big-endian header:
+//!
+//! 0x0 kind (0 to copy from the previous version, 1 to add the bytes which follow)
+//! 0x1 size
+//! 0x5 offset in the previous version (copies only, 0 otherwise)
+
+use std::collections::HashMap;
+
+const COPY: u8 = 0;
+const ADD: u8 = 1;
+/// Matches shorter than this are sent as literals.
+const BLOCK_SIZE: usize = 64;
+const PRIME: u32 = 0x01000193;
+
+pub fn diff(base: &[u8], target: &[u8]) -> Vec<u8> {
+    // Only aligned blocks of the previous version are indexed, matches are then extended in both
+    // directions byte by byte.
+    let mut blocks = HashMap::new();
+    for offset in (0..base.len() / BLOCK_SIZE).map(|i| i * BLOCK_SIZE) {
+        blocks.entry(hash(&base[offset..offset + BLOCK_SIZE])).or_insert(offset);
+    }
+    let high_power = (1..BLOCK_SIZE).fold(1u32, |power, _| power.wrapping_mul(PRIME));
+
+    let mut delta = Vec::new();
+    let mut literal_start = 0;
+    let mut position = 0;
+    let mut rolling = None;
+    while position + BLOCK_SIZE <= target.len() {
+        let value = *rolling.get_or_insert_with(|| hash(&target[position..position + BLOCK_SIZE]));
+        let found = blocks.get(&value).copied().filter(|&offset| {
+            base[offset..offset + BLOCK_SIZE] == target[position..position + BLOCK_SIZE]
+        });
+        let Some(offset) = found else {
+            if position + BLOCK_SIZE < target.len() {
+                let removed = (target[position] as u32).wrapping_mul(high_power);
+                let value = value.wrapping_sub(removed).wrapping_mul(PRIME);
+                rolling = Some(value.wrapping_add(target[position + BLOCK_SIZE] as u32));
+            }
+            position += 1;
+            continue;
+        };
+
+        let mut start = position;
+        let mut base_start = offset;
+        while start > literal_start && base_start > 0 && target[start - 1] == base[base_start - 1] {
+            start -= 1;
+            base_start -= 1;
+        }
+        let mut end = position + BLOCK_SIZE;
+        let mut base_end = offset + BLOCK_SIZE;
+        while end < target.len() && base_end < base.len() && target[end] == base[base_end] {
+            end += 1;
+            base_end += 1;
+        }
+        push_add(&mut delta, &target[literal_start..start]);
+        push_op(&mut delta, COPY, end - start, base_start);
+        literal_start = end;
+        position = end;
+        rolling = None;
+    }
+    push_add(&mut delta, &target[literal_start..]);
+    delta
+}
+
+fn hash(block: &[u8]) -> u32 {
+    block.iter().fold(0u32, |value, byte| value.wrapping_mul(PRIME).wrapping_add(*byte as u32))
+}
+
+fn push_add(delta: &mut Vec<u8>, literal: &[u8]) {
+    if !literal.is_empty() {
+        push_op(delta, ADD, literal.len(), 0);
+        delta.extend_from_slice(literal);
+    }
+}
+
+fn push_op(delta: &mut Vec<u8>, kind: u8, size: usize, offset: usize) {
+    delta.push(kind);
+    delta.extend_from_slice(&(size as u32).to_be_bytes());
+    delta.extend_from_slice(&(offset as u32).to_be_bytes());
+}
@@ -1,3 +1,6 @@
+mod delta;
+mod resume;
+
 use std::collections::VecDeque;
 use std::fmt;
 use std::fs::{self, File};
@@ -150,13 +153,15 @@ impl Stream {
     async fn handle(mut self) -> Result<(), Box<dyn std::error::Error>> {
         let request: UpdateRequest = self.read_message().await?;
         let wants_update = request.wants_update;
+        let wants_delta = request.wants_delta == Some(true);
+        let request_offset = request.offset;
         let source = Version::parse(&request)?;
         let target = source.find_target();
         if !wants_update && target.is_some() {
             self.tx.send((self.address, request)).await?;
         }
         let mut target = target.unwrap_or(source);
-        let contents = format!("updates/{}/contents.arc", target);
+        let contents = Self::contents_path(target);
         let signature = contents.clone() + ".sig";
         let contents = fs::read(contents).ok();
         let mut size = contents.as_ref().and_then(|contents| contents.len().try_into().ok());
@@ -168,26 +173,62 @@ impl Stream {
             size = None;
             signature = None;
         }
+        let contents = contents.filter(|_| wants_update && target != source);
+        let mut delta = None;
+        if contents.is_some() && wants_delta {
+            delta = tokio::task::spawn_blocking(move || Self::find_delta(source, target)).await?;
+            delta = delta.filter(|delta| delta.len() < size.unwrap_or(0) as usize);
+        }
+        let offset = match (&contents, &delta) {
+            (Some(contents), None) => resume::offset(contents, request_offset),
+            _ => None,
+        };
         let response = UpdateResponse {
             version_major: target.major as u32,
             version_minor: target.minor as u32,
             version_patch: target.patch as u32,
             size: size.unwrap_or(0),
             signature: signature.unwrap_or(vec![]),
+            offset,
+            delta_size: delta.as_ref().map(|delta| delta.len() as u32),
         };
         self.write_message(response).await?;
 
-        let contents = match contents {
-            Some(contents) if wants_update && target != source => contents,
-            _ => return Ok(()),
+        let contents = match (delta, contents) {
+            (Some(delta), _) => delta,
+            (None, Some(contents)) => contents,
+            (None, None) => return Ok(()),
         };
-        for chunk in contents.chunks(0x1000) {
+        for chunk in resume::remaining(&contents, offset).chunks(0x1000) {
             self.write(chunk).await?;
         }
 
         Ok(())
     }
 
+    fn contents_path(version: Version) -> String {
+        format!("updates/{}/contents.arc", version)
+    }
+
+    /// Returns the delta between two versions, generating it the first time it is requested. The
+    /// signature of the target contents covers the patched file, so deltas do not need their own.
+    fn find_delta(source: Version, target: Version) -> Option<Vec<u8>> {
+        let path = format!("updates/{}/{}.delta", target, source);
+        if let Ok(delta) = fs::read(&path) {
+            return Some(delta);
+        }
+
+        let base = fs::read(Self::contents_path(source)).ok()?;
+        let contents = fs::read(Self::contents_path(target)).ok()?;
+        let delta = delta::diff(&base, &contents);
+        // Concurrent requests may generate the same delta, but only complete files are renamed.
+        let tmp_path = format!("{}.{}", path, random::u32());
+        if fs::write(&tmp_path, &delta).and_then(|_| fs::rename(&tmp_path, &path)).is_err() {
+            let _ = fs::remove_file(&tmp_path);
+        }
+        Some(delta)
+    }
+
     async fn read(&mut self) -> Result<Vec<u8>, Box<dyn std::error::Error>> {
         let mut size = [0u8; 2];
         self.stream.read_exact(&mut size).await?;
@@ -0,0 +1,46 @@
+//! Resumption of full downloads of contents.arc, which SP::Update asks for with the size it has
+//! already written when the same update is offered again.
+
+/// The offset to send the contents from, echoed to the client. Offsets which aren't within the
+/// contents are refused, in which case the client starts over.
+pub fn offset(contents: &[u8], requested: Option<u32>) -> Option<u32> {
+    requested.filter(|offset| (*offset as usize) < contents.len())
+}
+
+/// The part of the contents which is left to send.
+pub fn remaining(contents: &[u8], offset: Option<u32>) -> &[u8] {
+    &contents[offset.unwrap_or(0) as usize..]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn contents() -> Vec<u8> {
+        (0..0x2800u32).map(|i| (i * 7 + i / 0x100) as u8).collect()
+    }
+
+    #[test]
+    fn interrupted_download_resumes() {
+        let contents = contents();
+        // The connection drops in the middle of the third chunk.
+        let received: Vec<u8> =
+            remaining(&contents, None).chunks(0x1000).flatten().take(0x2345).copied().collect();
+
+        let offset = offset(&contents, Some(received.len() as u32));
+        assert_eq!(offset, Some(0x2345));
+        let mut resumed = received;
+        for chunk in remaining(&contents, offset).chunks(0x1000) {
+            resumed.extend_from_slice(chunk);
+        }
+        assert_eq!(resumed, contents);
+    }
+
+    #[test]
+    fn invalid_offset_restarts() {
+        let contents = contents();
+        assert_eq!(offset(&contents, Some(contents.len() as u32)), None);
+        assert_eq!(offset(&contents, None), None);
+        assert_eq!(remaining(&contents, None), &contents[..]);
+    }
+}
@@ -0,0 +1,9 @@
+// What the game provides to the YAZ decoder.
+
+#include <egg/core/eggHeap.hh>
+
+#include <cstdlib>
+
+void *operator new[](size_t size, EGG::Heap * /* heap */, int align) {
+    return std::aligned_alloc(align, AlignUp(size, align));
+}
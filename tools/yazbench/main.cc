@@ -0,0 +1,335 @@
+// Checks the two engines of the YAZ decoder of the payload against each other and against a
+// reference decoder, and measures them on a PC. See README.md.
+
+#include <sp/YAZDecoder.hh>
+
+#include <common/Bytes.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Groups are only decoded in one go when the largest group is buffered (25 bytes), so smaller
+// chunks keep the decoder on the resumable state machine.
+const size_t STATE_MACHINE_CHUNK_SIZE = 24;
+
+using Buffer = std::vector<u8>;
+
+// Feeds the payload decoder with chunks of the sizes returned by nextChunkSize, as DecompLoader
+// does with the reads of the storage.
+std::optional<Buffer> Decode(const Buffer &src, const std::function<size_t()> &nextChunkSize) {
+    EGG::Heap heap;
+    SP::YAZDecoder decoder(src.data(), src.size(), &heap);
+    size_t offset = SP::YAZDecoder::HEADER_SIZE;
+    while (decoder.ok() && !decoder.done() && offset < src.size()) {
+        size_t size = std::min(nextChunkSize(), src.size() - offset);
+        if (!decoder.decode(src.data() + offset, size)) {
+            return {};
+        }
+        offset += size;
+    }
+    if (!decoder.ok() || !decoder.done()) {
+        return {};
+    }
+
+    u8 *dst;
+    size_t dstSize;
+    decoder.release(&dst, &dstSize);
+    Buffer result(dst, dst + dstSize);
+    delete[] dst;
+    return result;
+}
+
+std::optional<Buffer> DecodeAtOnce(const Buffer &src) {
+    return Decode(src, [] { return SIZE_MAX; });
+}
+
+std::optional<Buffer> DecodeWithStateMachine(const Buffer &src) {
+    return Decode(src, [] { return STATE_MACHINE_CHUNK_SIZE; });
+}
+
+// The format as written down, one token at a time.
+std::optional<Buffer> DecodeReference(const Buffer &src) {
+    if (src.size() < SP::YAZDecoder::HEADER_SIZE ||
+            !SP::YAZDecoder::CheckMagic(Bytes::Read<u32>(src.data(), 0x0))) {
+        return {};
+    }
+    u32 dstSize = Bytes::Read<u32>(src.data(), 0x4);
+    Buffer dst;
+    dst.reserve(dstSize);
+    size_t offset = SP::YAZDecoder::HEADER_SIZE;
+    u8 groupHeader = 0;
+    u32 groupIndex = 8;
+    while (dst.size() < dstSize) {
+        if (groupIndex == 8) {
+            if (offset >= src.size()) {
+                return {};
+            }
+            groupHeader = src[offset++];
+            groupIndex = 0;
+        }
+        bool isCopy = groupHeader >> (7 - groupIndex++) & 1;
+        if (isCopy) {
+            if (offset >= src.size()) {
+                return {};
+            }
+            dst.push_back(src[offset++]);
+            continue;
+        }
+
+        if (offset + 2 > src.size()) {
+            return {};
+        }
+        u8 val0 = src[offset++], val1 = src[offset++];
+        size_t refOffset = ((val0 & 0xf) << 8 | val1) + 1;
+        if (refOffset > dst.size()) {
+            return {};
+        }
+        size_t refSize = (val0 >> 4) + 0x2;
+        if (refSize == 0x2) {
+            if (offset >= src.size()) {
+                return {};
+            }
+            refSize = src[offset++] + 0x12;
+        }
+        if (dst.size() + refSize > dstSize) {
+            return {};
+        }
+        for (size_t i = 0; i < refSize; i++) {
+            dst.push_back(dst[dst.size() - refOffset]);
+        }
+    }
+    return dst;
+}
+
+// Greedy, with a single candidate per 3-byte hash. Overlapping refs are emitted for runs.
+Buffer Encode(const Buffer &src) {
+    Buffer dst(SP::YAZDecoder::HEADER_SIZE);
+    memcpy(dst.data(), "Yaz0", 4);
+    Bytes::Write<u32>(dst.data(), 0x4, src.size());
+    std::vector<s64> lastPositions(1 << 16, -1);
+    size_t groupHeaderOffset = 0;
+    u32 groupIndex = 8;
+    for (size_t i = 0; i < src.size();) {
+        if (groupIndex == 8) {
+            groupHeaderOffset = dst.size();
+            dst.push_back(0);
+            groupIndex = 0;
+        }
+
+        size_t refOffset = 0, refSize = 0;
+        if (i + 3 <= src.size()) {
+            u32 hash = (src[i] << 8 ^ src[i + 1] << 4 ^ src[i + 2]) & 0xffff;
+            s64 candidate = lastPositions[hash];
+            lastPositions[hash] = i;
+            if (candidate >= 0 && i - candidate <= 0x1000) {
+                size_t maxSize = std::min<size_t>(0x111, src.size() - i);
+                size_t size = 0;
+                while (size < maxSize && src[candidate + size] == src[i + size]) {
+                    size++;
+                }
+                if (size >= 3) {
+                    refOffset = i - candidate;
+                    refSize = size;
+                }
+            }
+        }
+
+        if (refSize == 0) {
+            dst[groupHeaderOffset] |= 0x80 >> groupIndex;
+            dst.push_back(src[i++]);
+        } else if (refSize < 0x12) {
+            dst.push_back((refSize - 0x2) << 4 | (refOffset - 1) >> 8);
+            dst.push_back(refOffset - 1);
+            i += refSize;
+        } else {
+            dst.push_back((refOffset - 1) >> 8);
+            dst.push_back(refOffset - 1);
+            dst.push_back(refSize - 0x12);
+            i += refSize;
+        }
+        groupIndex++;
+    }
+    return dst;
+}
+
+// A mix of what archives hold: incompressible spans, runs, short periods and repeated blocks.
+Buffer Synthesize(std::mt19937 &random, size_t size) {
+    std::uniform_int_distribution<u32> dist(0, UINT32_MAX);
+    Buffer data;
+    data.reserve(size);
+    while (data.size() < size) {
+        size_t spanSize = std::min<size_t>(1 + dist(random) % 0x200, size - data.size());
+        switch (dist(random) % 4) {
+        case 0:
+            for (size_t i = 0; i < spanSize; i++) {
+                data.push_back(dist(random));
+            }
+            break;
+        case 1:
+            data.insert(data.end(), spanSize, dist(random));
+            break;
+        case 2: {
+            size_t period = 2 + dist(random) % 7;
+            size_t start = data.size();
+            for (size_t i = 0; i < spanSize; i++) {
+                data.push_back(i < period ? dist(random) : data[start + i - period]);
+            }
+            break;
+        }
+        default:
+            if (data.empty()) {
+                break;
+            }
+            size_t offset = 1 + dist(random) % std::min<size_t>(data.size(), 0x1000);
+            for (size_t i = 0; i < spanSize; i++) {
+                data.push_back(data[data.size() - offset]);
+            }
+            break;
+        }
+    }
+    return data;
+}
+
+// All the ways of decoding src must agree, on the output or on the failure.
+bool Check(const char *name, const Buffer &src, std::mt19937 &random) {
+    auto reference = DecodeReference(src);
+    auto atOnce = DecodeAtOnce(src);
+    auto stateMachine = DecodeWithStateMachine(src);
+    std::uniform_int_distribution<size_t> chunkSize(1, 64);
+    auto randomChunks = Decode(src, [&] { return chunkSize(random); });
+    if (atOnce == reference && stateMachine == reference && randomChunks == reference) {
+        return true;
+    }
+
+    auto status = [&](const std::optional<Buffer> &result) {
+        return !result ? "failed" : result == reference ? "ok" : "different output";
+    };
+    fprintf(stderr, "%s: mismatch (reference %s, at once %s, state machine %s, random chunks %s)\n",
+            name, reference ? "ok" : "failed", status(atOnce), status(stateMachine),
+            status(randomChunks));
+    return false;
+}
+
+bool Fuzz(u32 iterations, u32 seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<u32> dist(0, UINT32_MAX);
+    u32 validCount = 0;
+    for (u32 i = 0; i < iterations; i++) {
+        Buffer src;
+        switch (i % 3) {
+        case 0:
+            // Valid streams
+            src = Encode(Synthesize(random, dist(random) % 0x4000));
+            break;
+        case 1:
+            // Corrupted streams
+            src = Encode(Synthesize(random, dist(random) % 0x4000));
+            for (u32 j = 0; j < 1 + dist(random) % 4 && src.size() > SP::YAZDecoder::HEADER_SIZE;
+                    j++) {
+                size_t offset = SP::YAZDecoder::HEADER_SIZE +
+                        dist(random) % (src.size() - SP::YAZDecoder::HEADER_SIZE);
+                src[offset] ^= 1 << dist(random) % 8;
+            }
+            if (dist(random) % 4 == 0) {
+                src.resize(SP::YAZDecoder::HEADER_SIZE +
+                        dist(random) % (src.size() - SP::YAZDecoder::HEADER_SIZE + 1));
+            }
+            break;
+        default:
+            // Noise behind a valid header
+            src.resize(SP::YAZDecoder::HEADER_SIZE + dist(random) % 0x2000);
+            memcpy(src.data(), "Yaz0", 4);
+            Bytes::Write<u32>(src.data(), 0x4, dist(random) % 0x4000);
+            for (size_t j = SP::YAZDecoder::HEADER_SIZE; j < src.size(); j++) {
+                src[j] = dist(random);
+            }
+            break;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "Iteration %u", i);
+        if (!Check(name, src, random)) {
+            return false;
+        }
+        validCount += DecodeReference(src).has_value();
+    }
+    printf("Fuzzing: %u inputs (%u valid), no mismatch\n", iterations, validCount);
+    return true;
+}
+
+void Measure(const char *name, const Buffer &src, std::optional<Buffer> (*decode)(const Buffer &)) {
+    u32 count = 0;
+    size_t dstSize = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    do {
+        auto dst = decode(src);
+        dstSize = dst ? dst->size() : 0;
+        count++;
+        end = std::chrono::steady_clock::now();
+    } while (end - start < std::chrono::milliseconds(200));
+    f64 s = std::chrono::duration<f64>(end - start).count() / count;
+    printf("  %-13s %8.2f ms, %7.1f MiB/s\n", name, s * 1000.0, dstSize / s / (1024.0 * 1024.0));
+}
+
+bool Bench(const char *name, const Buffer &src, std::mt19937 &random) {
+    auto dst = DecodeReference(src);
+    if (!dst) {
+        fprintf(stderr, "%s: not a valid YAZ file\n", name);
+        return false;
+    }
+    printf("%s: %zu bytes, %zu decoded\n", name, src.size(), dst->size());
+    Measure("group", src, DecodeAtOnce);
+    Measure("state machine", src, DecodeWithStateMachine);
+    return Check(name, src, random);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    u32 iterations = 30000;
+    u32 seed = 0;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (!strcmp(argv[i], "-f")) {
+            iterations = strtoul(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "-s")) {
+            seed = strtoul(argv[i + 1], nullptr, 0);
+        } else {
+            break;
+        }
+    }
+    if (i < argc && argv[i][0] == '-') {
+        fprintf(stderr, "Usage: %s [-f iterations] [-s seed] file.szs...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = Fuzz(iterations, seed);
+    std::mt19937 random(seed);
+    if (i == argc) {
+        Buffer src = Encode(Synthesize(random, 4 * 1024 * 1024));
+        ok &= Bench("Synthetic", src, random);
+    }
+    for (; i < argc; i++) {
+        std::ifstream stream(argv[i], std::ios::binary);
+        if (!stream) {
+            fprintf(stderr, "%s: cannot be opened\n", argv[i]);
+            ok = false;
+            continue;
+        }
+        Buffer src(std::istreambuf_iterator<char>(stream), {});
+        ok &= Bench(argv[i], src, random);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}